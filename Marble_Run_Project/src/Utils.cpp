@@ -7,6 +7,12 @@ using namespace std;
 Utils::Utils() {}
 
 string Utils::readShaderFile(const char *filePath) 
+{
+	set<string> including;
+	return readShaderFile(filePath, including);
+}
+
+string Utils::readShaderFile(const char *filePath, set<string>& including)
 {
 	string content;
 
@@ -15,13 +21,35 @@ string Utils::readShaderFile(const char *filePath)
 	{
 		throw "Unable to open file.";
 	}
+	including.insert(filePath);
 	string line = "";
 	while (!fileStream.eof()) 
 	{
 		getline(fileStream, line);
+		// #include "file" pastes in a file from the same directory
+		if (line.compare(0, 9, "#include ") == 0)
+		{
+			size_t open = line.find('"');
+			size_t close = open == string::npos ? string::npos : line.find('"', open + 1);
+			if (close == string::npos)
+			{
+				cout << filePath << ": skipping include without a quoted file name: " << line << endl;
+				continue;
+			}
+			string path = filePath;
+			path = path.substr(0, path.find_last_of("/\\") + 1) + line.substr(open + 1, close - open - 1);
+			if (including.count(path))
+			{
+				cout << filePath << ": skipping include of " << path << ", it is already being included" << endl;
+				continue;
+			}
+			content.append(readShaderFile(path.c_str(), including));
+			continue;
+		}
 		content.append(line + "\n");
 	}
 	fileStream.close();
+	including.erase(filePath);
 	return content;
 }
 
@@ -158,7 +186,7 @@ GLuint Utils::loadTexture(const char *texImagePath)
 	return textureRef;
 }
 
-std::vector<std::vector<float>> Utils::loadHeightMap(const char* texImagePath)
+std::shared_ptr<Heightfield> Utils::loadHeightMap(const char* texImagePath)
 {
 	int width, height, channels;
 
@@ -167,25 +195,29 @@ std::vector<std::vector<float>> Utils::loadHeightMap(const char* texImagePath)
 
 	if (!data) {
 		std::cerr << "Failed to load heightmap: " << texImagePath << std::endl;
-		return {};
+		return nullptr;
 	}
 
-	std::vector<std::vector<float>> heightmap(width, std::vector<float>(height));
+	// Heights from 0 to 1
+	std::shared_ptr<Heightfield> heightfield = std::make_shared<Heightfield>(width, height, 1.0f / 255.0f);
+	short* samples = heightfield->writableSamples();
 
-	// SOIL2 loads from top-left corner, row-major order
-	for (int y = 0; y < height; ++y) {
-		for (int x = 0; x < width; ++x) {
-			int index = y * width + x;
-			float value = static_cast<float>(data[index]) / 255.0f;
-			// Some trickery to orient correctly
-			heightmap[width-1-x][height-1-y] = value;
-		}
+	// SOIL2 loads from top-left corner, row-major order. Flipped on both axes to orient
+	// correctly, which is the whole image reversed.
+	size_t count = size_t(width) * height;
+	for (size_t i = 0; i < count; ++i) {
+		samples[count - 1 - i] = data[i];
 	}
 	// Free the image data from memory
 	SOIL_free_image_data(data);
 
-	return heightmap;
+	return heightfield;
+}
+
 
+void shaderSetVec2(GLuint shaderProgram, const char* name, glm::vec2& value)
+{
+	glUniform2fv(glGetUniformLocation(shaderProgram, name), 1, &value[0]);
 }
 
 
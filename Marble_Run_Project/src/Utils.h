@@ -7,6 +7,8 @@
 #include <iostream>
 #include <fstream>
 #include <cmath>
+#include <memory>
+#include <set>
 #include <vector>
 
 #include <glm/glm.hpp>
@@ -14,11 +16,15 @@
 #include <glm/gtc/matrix_transform.hpp> // glm::translate, glm::rotate, glm::scale, glm::perspective
 //#include <glm/gtx/euler_angles.hpp>
 
+#include "heightfield.h"
+
 
 class Utils
 {
 private:
 	static std::string readShaderFile(const char *filePath);
+	// including holds the files whose #includes are being read, to stop include cycles
+	static std::string readShaderFile(const char *filePath, std::set<std::string>& including);
 	static void printShaderLog(GLuint shader);
 	static void printProgramLog(int prog);
 	static GLuint prepareShader(int shaderTYPE, const char *shaderPath);
@@ -30,9 +36,10 @@ public:
 	static GLuint createShaderProgram(const char *vp, const char *fp);
 	static GLuint loadTexture(const char *texImagePath);
 	static GLuint loadCubeMap(const char *mapDir);
-	static std::vector<std::vector<float>> loadHeightMap(const char* texImagePath);
+	static std::shared_ptr<Heightfield> loadHeightMap(const char* texImagePath);
 };
 
+void shaderSetVec2(GLuint shaderProgram, const char* name, glm::vec2& value);
 void shaderSetVec3(GLuint shaderProgram, const char* name, glm::vec3& value);
 void shaderSetVec4(GLuint shaderProgram, const char* name, glm::vec4& value);
 void shaderSetMat4(GLuint shaderProgram, const char* name, glm::mat4& value);
@@ -0,0 +1,900 @@
+// Standalone timings for the CPU side hot paths. No window or GL context needed.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "course.h"
+#include "fixed_timestep.h"
+#include "heightfield.h"
+#include "mesh_builder.h"
+#include "mesh_optimizer.h"
+#include "particle_sort.h"
+#include "rng.h"
+#include "settings.h"
+#include "terrain_builder.h"
+#include "thread_pool.h"
+#include "track_path.h"
+#include "triple_buffer.h"
+
+using Clock = std::chrono::high_resolution_clock;
+
+static double elapsedMs(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Radix sort against std::sort. Returns the number of sizes sorted out of order.
+static int benchParticleSort()
+{
+    std::printf("Particle depth sort (back to front)\n");
+    std::printf("%10s %12s %12s %8s\n", "particles", "radix ms", "std ms", "speedup");
+
+    int failures = 0;
+    Rng rng;
+    ParticleSorter sorter;
+
+    for (int count : { 10000, 100000, 1000000 }) {
+        std::vector<float> depths(count);
+        for (float& d : depths) d = rng.uniform(-5.0f, 200.0f);
+
+        int runs = std::max(5, 2000000 / count);
+        double radixMs = 0.0;
+        double stdMs = 0.0;
+
+        sorter.reserve(count);
+        for (int run = 0; run <= runs; run++) {
+            // Run 0 warms up the scratch buffers and is not counted
+            Clock::time_point start = Clock::now();
+            sorter.clear();
+            for (int i = 0; i < count; i++) sorter.add(depths[i], i);
+            sorter.sort();
+            if (run > 0) radixMs += elapsedMs(start);
+
+            std::vector<std::pair<float, int>> items(count);
+            for (int i = 0; i < count; i++) items[i] = { depths[i], i };
+            start = Clock::now();
+            std::sort(items.begin(), items.end(),
+                [](const std::pair<float, int>& a, const std::pair<float, int>& b) { return a.first > b.first; });
+            if (run > 0) stdMs += elapsedMs(start);
+        }
+
+        // Sanity check the order
+        const std::vector<uint32_t>& order = sorter.values();
+        for (int i = 1; i < count; i++) {
+            if (depths[order[i - 1]] < depths[order[i]]) {
+                std::printf("Sort order wrong at %d\n", i);
+                failures++;
+                break;
+            }
+        }
+
+        radixMs /= runs;
+        stdMs /= runs;
+        std::printf("%10d %12.3f %12.3f %7.1fx\n", count, radixMs, stdMs, stdMs / radixMs);
+    }
+    std::printf("\n");
+    return failures;
+}
+
+static void benchRandom()
+{
+    const int count = 10000000;
+    std::vector<float> values(count);
+    double sum = 0.0;
+
+    std::printf("Random floats (%d)\n", count);
+
+    // Roughly what glm::linearRand costs: std::rand behind a shared state
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < count; i++) values[i] = std::rand() / (RAND_MAX + 1.0f);
+    std::printf("%-12s %8.2f ms\n", "std::rand", elapsedMs(start));
+    sum += values[count - 1];
+
+    Rng rng;
+    start = Clock::now();
+    for (int i = 0; i < count; i++) values[i] = rng.uniform();
+    std::printf("%-12s %8.2f ms\n", "Rng scalar", elapsedMs(start));
+    sum += values[count - 1];
+
+    start = Clock::now();
+    rng.uniformBatch(values.data(), count);
+    std::printf("%-12s %8.2f ms\n", "Rng batch", elapsedMs(start));
+    sum += values[count - 1];
+
+    std::printf("(checksum %f)\n\n", sum);
+}
+
+// Runs build() until at least minMs has passed and returns the average time per call
+template <typename Build>
+static double timeBuild(Build build, MeshData& mesh, double minMs = 50.0)
+{
+    int runs = 0;
+    Clock::time_point start = Clock::now();
+    do {
+        mesh = build();
+        runs++;
+    } while (elapsedMs(start) < minMs);
+    return elapsedMs(start) / runs;
+}
+
+static void printMesh(const char* name, int tessellation, double ms, const MeshData& mesh)
+{
+    // Size of the interleaved upload with 2_10_10_10 normals
+    VertexLayout layout = chooseVertexLayout(mesh, false, 2.0f);
+    size_t packed = layout.stride() * mesh.vertexCount() + mesh.indices.size() * sizeof(unsigned int);
+    std::printf("%-14s %8d %10.1f %10zu %10zu %10.1f %10.1f\n", name, tessellation, ms * 1000.0,
+        mesh.vertexCount(), mesh.triangleCount(), mesh.byteSize() / 1024.0, packed / 1024.0);
+}
+
+static std::vector<TrackSupport> spiralSupports(int count)
+{
+    // A descending spiral, roughly the shape of the generated tracks
+    std::vector<TrackSupport> supports;
+    for (int i = 0; i < count; i++) {
+        float a = i * 0.1f;
+        supports.push_back({ 10.0f * std::cos(a), 40.0f - i * 0.2f, 10.0f * std::sin(a),
+            glm::degrees(a), 0.4f, 0.45f });
+    }
+    return supports;
+}
+
+// Straight runs split into many supports, with a slight kink in the slope halfway
+static std::vector<TrackSupport> straightSupports(int count)
+{
+    std::vector<TrackSupport> supports;
+    for (int i = 0; i < count; i++) {
+        float y = i < count / 2 ? -0.2f * i : -0.2f * (count / 2) - 0.25f * (i - count / 2);
+        supports.push_back({ 0.0f, y, 0.5f * i, 0.0f, 0.9f, 1.0f });
+    }
+    return supports;
+}
+
+static void benchGeometry()
+{
+    std::printf("Mesh generation\n");
+    std::printf("%-14s %8s %10s %10s %10s %10s %10s\n", "shape", "tess", "us", "vertices", "triangles", "KiB", "packed KiB");
+
+    MeshData mesh;
+    double ms = timeBuild([] { return buildBox(1.0f, 1.0f, 1.0f); }, mesh);
+    printMesh("Box", 1, ms, mesh);
+    ms = timeBuild([] { return buildPyramid(1.0f, 1.0f, 1.0f); }, mesh);
+    printMesh("Pyramid", 1, ms, mesh);
+    ms = timeBuild([] { return buildPlane(1.0f, 1.0f); }, mesh);
+    printMesh("Plane", 1, ms, mesh);
+
+    for (int size : { 64, 256, 1024 }) {
+        Heightfield heightfield(size, size, 1.0f / 255.0f);
+        Rng rng;
+        short* samples = heightfield.writableSamples();
+        for (size_t i = 0; i < size_t(size) * size; i++) samples[i] = static_cast<short>(rng.next() & 0xFF);
+        ms = timeBuild([&] { return buildCompositePlane(size, size, &heightfield); }, mesh);
+        printMesh("CompositePlane", size, ms, mesh);
+    }
+
+    for (int tess : { 10, 20, 50, 100 }) {
+        ms = timeBuild([=] { return buildSphere(1.0f, tess, tess); }, mesh);
+        printMesh("Sphere", tess, ms, mesh);
+    }
+    for (int tess : { 10, 20, 50, 100 }) {
+        ms = timeBuild([=] { return buildCylinder(0.5f, 1.0f, tess); }, mesh);
+        printMesh("Cylinder", tess, ms, mesh);
+    }
+    for (int tess : { 10, 20, 50, 100 }) {
+        ms = timeBuild([=] { return buildHalfPipe(0.9f, 1.0f, 1.0f, tess); }, mesh);
+        printMesh("HalfPipe", tess, ms, mesh);
+    }
+
+    std::vector<TrackSupport> supports = spiralSupports(200);
+    for (int tess : { 10, 20, 50, 100 }) {
+        ms = timeBuild([&] { return buildHalfPipeTrack(supports, tess); }, mesh);
+        printMesh("HalfPipeTrack", tess, ms, mesh);
+    }
+    std::printf("\n");
+}
+
+// Builds each track serially and on the pool. Returns the number of pool builds that differ.
+static int benchTrackThreads()
+{
+    std::printf("HalfPipeTrack segments, serial vs thread pool (%d workers + caller)\n", threadPool().workerCount());
+    std::printf("%10s %8s %12s %12s %8s %10s\n", "supports", "tess", "serial ms", "pool ms", "speedup", "identical");
+
+    int failures = 0;
+    ThreadPool serial(0);
+    for (int count : { 100, 1000, 10000 }) {
+        std::vector<TrackSupport> supports = spiralSupports(count);
+        for (int tess : { 10, 30 }) {
+            MeshData a;
+            MeshData b;
+            double serialMs = timeBuild([&] { return buildHalfPipeTrack(supports, tess, serial); }, a, 200.0);
+            double poolMs = timeBuild([&] { return buildHalfPipeTrack(supports, tess); }, b, 200.0);
+            bool identical = a.positions == b.positions && a.uvs == b.uvs
+                && a.normals == b.normals && a.indices == b.indices;
+            if (!identical) failures++;
+            std::printf("%10d %8d %12.3f %12.3f %7.1fx %10s\n", count, tess, serialMs, poolMs,
+                serialMs / poolMs, identical ? "yes" : "NO");
+        }
+    }
+    std::printf("\n");
+    return failures;
+}
+
+// Moving one support, rebuilding the whole track against rewriting and repacking its segments.
+// Returns the number of edited meshes that differ from a full rebuild.
+static int benchTrackEdit()
+{
+    std::printf("Track edit, one support moved (full rebuild vs segments next to it)\n");
+    std::printf("%10s %8s %12s %12s %10s %10s\n", "supports", "tess", "rebuild ms", "edit ms", "vertices", "identical");
+
+    int failures = 0;
+    const int sectors = 20;
+    VertexLayout layout;
+    for (int count : { 100, 1000, 10000 }) {
+        std::vector<TrackSupport> supports = spiralSupports(count);
+        MeshData edited = buildHalfPipeTrack(supports, sectors);
+
+        size_t index = supports.size() / 2;
+        MeshData rebuilt;
+        double rebuildMs = timeBuild([&] {
+            supports[index].y += 0.001f;
+            return buildHalfPipeTrack(supports, sectors);
+        }, rebuilt);
+
+        size_t vertices = 0;
+        int edits = 0;
+        Clock::time_point start = Clock::now();
+        do {
+            for (const MeshRange& range : updateHalfPipeTrack(edited, supports, sectors, index)) {
+                vertices = range.vertexCount;
+                packVertices(edited, layout, range.firstVertex, range.vertexCount);
+            }
+            edits++;
+        } while (elapsedMs(start) < 50.0);
+        double editMs = elapsedMs(start) / edits;
+
+        // End supports also rewrite an end face
+        for (size_t end : { size_t(0), supports.size() - 1 }) {
+            supports[end].x += 0.01f;
+            supports[end].angle += 1.0f;
+            updateHalfPipeTrack(edited, supports, sectors, end);
+        }
+
+        // Both built from the final supports, so they should match exactly
+        rebuilt = buildHalfPipeTrack(supports, sectors);
+        bool identical = edited.positions == rebuilt.positions && edited.uvs == rebuilt.uvs
+            && edited.normals == rebuilt.normals && edited.indices == rebuilt.indices;
+        if (!identical) failures++;
+        std::printf("%10d %8d %12.3f %12.4f %10zu %10s\n", count, sectors, rebuildMs, editMs, vertices,
+            identical ? "yes" : "NO");
+    }
+    std::printf("\n");
+    return failures;
+}
+
+// C++ copy of trackVertex in shader/trackVertex.glsl, to check it against the CPU mesh
+struct PulledVertex {
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec2 texCoord;
+};
+
+static PulledVertex pullTrackVertex(const std::vector<float>& texels, int sectors, int supportCount, int id)
+{
+    static const int QUAD_A[6][2] = { { 0, 0 }, { 0, 1 }, { 1, 0 }, { 1, 0 }, { 0, 1 }, { 1, 1 } };
+    static const int QUAD_B[6][2] = { { 0, 0 }, { 1, 0 }, { 0, 1 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+    static const int SQUARE[12] = { 0, 3, 2, 0, 2, 1, 4, 7, 6, 4, 6, 5 };
+    auto texel = [&](int i) { return glm::vec4(texels[i * 4], texels[i * 4 + 1], texels[i * 4 + 2], texels[i * 4 + 3]); };
+    auto ring = [&](int i) { return glm::vec2(texels[i * 4], texels[i * 4 + 1]); };
+    auto point = [&](int s) { return texel(sectors + 1 + 2 * s); };
+    auto frame = [&](int s) { return texel(sectors + 2 + 2 * s); };
+    auto ringPosition = [](glm::vec4 p, glm::vec4 f, glm::vec2 a, float r) {
+        return glm::vec3(p.x + r * a.x * f.x, p.y + r * a.y, p.z + r * a.x * f.y);
+    };
+
+    int segmentVertices = 12 * sectors + 12;
+    int segments = supportCount - 1;
+    PulledVertex v;
+
+    if (id < segments * segmentVertices) {
+        int segment = id / segmentVertices;
+        int local = id - segment * segmentVertices;
+        glm::vec4 p1 = point(segment);
+        glm::vec4 f1 = frame(segment);
+        glm::vec4 p2 = point(segment + 1);
+        glm::vec4 f2 = frame(segment + 1);
+        float uvRepeat = p1.w;
+        float uvInner1 = f1.z / f1.w;
+        float uvInner2 = f2.z / f2.w;
+
+        if (local < 12 * sectors) {
+            bool outer = local >= 6 * sectors;
+            int q = outer ? local - 6 * sectors : local;
+            const int* c = outer ? QUAD_B[q % 6] : QUAD_A[q % 6];
+            glm::vec2 a = ring(q / 6 + c[0]);
+            glm::vec4 p = c[1] == 0 ? p1 : p2;
+            glm::vec4 f = c[1] == 0 ? f1 : f2;
+
+            v.position = ringPosition(p, f, a, outer ? f.w : f.z);
+            v.normal = outer ? glm::vec3(a.x * f1.x, a.y, a.x * f1.y) : glm::vec3(-a.x * f1.x, -a.y, -a.x * f1.y);
+            if (outer) {
+                v.texCoord = c[1] == 0 ? glm::vec2((a.x + 1.0f) * 0.5f, 0.0f) : glm::vec2((a.y + 1.0f) * 0.5f, uvRepeat);
+            }
+            else {
+                v.texCoord = c[1] == 0 ? glm::vec2((a.x * uvInner1 + 1.0f) * 0.5f, 0.0f) : glm::vec2((a.y * uvInner2 + 1.0f) * 0.5f, uvRepeat);
+            }
+        }
+        else {
+            int q = SQUARE[local - 12 * sectors];
+            bool second = q == 2 || q == 3 || q == 6 || q == 7;
+            bool outer = q == 0 || q == 3 || q == 5 || q == 6;
+            glm::vec4 p = second ? p2 : p1;
+            glm::vec4 f = second ? f2 : f1;
+            float r = (q < 4 ? -1.0f : 1.0f) * (outer ? f.w : f.z);
+            float uvInner = second ? uvInner2 : uvInner1;
+
+            v.position = glm::vec3(p.x + r * f.x, p.y, p.z + r * f.y);
+            v.normal = glm::vec3(0.0f, 1.0f, 0.0f);
+            v.texCoord.x = outer ? (q < 4 ? 1.0f : 0.0f) : (q < 4 ? uvInner : 1.0f - uvInner);
+            v.texCoord.y = second ? uvRepeat : 0.0f;
+        }
+    }
+    else {
+        int local = id - segments * segmentVertices;
+        bool back = local >= 6 * sectors;
+        int q = back ? local - 6 * sectors : local;
+        const int* c = back ? QUAD_A[q % 6] : QUAD_B[q % 6];
+        glm::vec2 a = ring(q / 6 + c[0]);
+        glm::vec4 p = point(back ? segments : 0);
+        glm::vec4 f = frame(back ? segments : 0);
+        float uvInner = f.z / f.w;
+
+        v.position = ringPosition(p, f, a, c[1] == 0 ? f.z : f.w);
+        v.normal = back ? glm::vec3(f.y, 0.0f, f.x) : glm::vec3(-f.y, 0.0f, -f.x);
+        v.texCoord = c[1] == 0 ? (a * uvInner + 1.0f) * 0.5f : (a + 1.0f) * 0.5f;
+    }
+    return v;
+}
+
+// GPU memory of the procedural track against the indexed mesh, and a check that every pulled
+// vertex matches the mesh. Returns the number of tracks that differ.
+static int benchProceduralTrack()
+{
+    std::printf("Procedural track (supports as a buffer texture, vertices pulled by id)\n");
+    std::printf("%10s %8s %12s %12s %12s %12s\n", "supports", "tess", "mesh KiB", "packed KiB", "texels KiB", "max error");
+
+    int failures = 0;
+    for (int count : { 2, 100, 1000 }) {
+        for (int tess : { 3, 10, 20 }) {
+            std::vector<TrackSupport> supports = spiralSupports(count);
+            for (size_t i = 0; i < supports.size(); i++) {
+                supports[i].outerRadius += 0.1f * (i % 3);
+            }
+            MeshData mesh = buildHalfPipeTrack(supports, tess);
+            std::vector<float> texels = buildTrackSupportTexels(supports, tess);
+
+            float maxError = 0.0f;
+            for (size_t i = 0; i < mesh.indices.size(); i++) {
+                PulledVertex v = pullTrackVertex(texels, tess, count, static_cast<int>(i));
+                unsigned int k = mesh.indices[i];
+                glm::vec3 position(mesh.positions[k * 3], mesh.positions[k * 3 + 1], mesh.positions[k * 3 + 2]);
+                glm::vec3 normal(mesh.normals[k * 3], mesh.normals[k * 3 + 1], mesh.normals[k * 3 + 2]);
+                glm::vec2 uv(mesh.uvs[k * 2], mesh.uvs[k * 2 + 1]);
+                maxError = std::max(maxError, glm::length(v.position - position));
+                maxError = std::max(maxError, glm::length(v.normal - normal));
+                maxError = std::max(maxError, glm::length(v.texCoord - uv));
+            }
+            if (maxError > 1e-5f) failures++;
+
+            size_t meshBytes = mesh.byteSize();
+            size_t packedBytes = mesh.vertexCount() * chooseVertexLayout(mesh, false, 2.0f).stride()
+                + mesh.indices.size() * (fitsShortIndices(mesh) ? 2 : 4);
+            std::printf("%10d %8d %12.1f %12.1f %12.2f %12.2g\n", count, tess, meshBytes / 1024.0,
+                packedBytes / 1024.0, texels.size() * sizeof(float) / 1024.0, maxError);
+        }
+    }
+    std::printf("Procedural track: %s\n\n", failures == 0 ? "ok" : "FAILED");
+    return failures;
+}
+
+static void benchMeshOptimizer()
+{
+    std::printf("Mesh optimization (ACMR: vertex cache misses per triangle, cache of %d)\n", VERTEX_CACHE_SIZE);
+    std::printf("%-14s %8s %10s %10s %10s %10s %10s\n", "shape", "tess", "ms", "removed", "ACMR", "optimized", "16-bit");
+
+    auto report = [](const char* name, int tessellation, MeshData mesh) {
+        Clock::time_point start = Clock::now();
+        MeshOptimizeStats stats = optimizeMesh(mesh);
+        double ms = elapsedMs(start);
+        std::printf("%-14s %8d %10.2f %10zu %10.3f %10.3f %10s\n", name, tessellation, ms,
+            stats.degenerate + stats.duplicate, stats.acmrBefore, stats.acmrAfter,
+            fitsShortIndices(mesh) ? "yes" : "no");
+    };
+
+    std::vector<TrackSupport> supports = spiralSupports(200);
+    for (int tess : { 20, 50 }) {
+        report("Sphere", tess, buildSphere(1.0f, tess, tess));
+        report("Cylinder", tess, buildCylinder(0.5f, 1.0f, tess));
+        report("HalfPipe", tess, buildHalfPipe(0.9f, 1.0f, 1.0f, tess));
+        report("HalfPipeTrack", tess, buildHalfPipeTrack(supports, tess));
+    }
+    report("CompositePlane", 256, buildCompositePlane(256, 256, nullptr));
+    std::printf("\n");
+}
+
+// Resampling is there to save triangles. Returns the number of tracks it made bigger.
+static int benchTrackResample()
+{
+    std::printf("Adaptive track supports (deviation: furthest original support from the resampled centre line)\n");
+    std::printf("%-10s %10s %10s %10s %10s %12s %12s %10s\n", "track", "tolerance", "ms", "supports", "resampled",
+        "triangles", "resampled", "deviation");
+
+    int failures = 0;
+    auto report = [&failures](const char* name, const std::vector<TrackSupport>& supports, float tolerance) {
+        Clock::time_point start = Clock::now();
+        std::vector<TrackSupport> resampled = resampleTrack(supports, tolerance);
+        double ms = elapsedMs(start);
+
+        float deviation = 0.0f;
+        for (const TrackSupport& s : supports) {
+            glm::vec3 p(s.x, s.y, s.z);
+            float nearest = 1e30f;
+            for (size_t i = 0; i + 1 < resampled.size(); i++) {
+                glm::vec3 a(resampled[i].x, resampled[i].y, resampled[i].z);
+                glm::vec3 b(resampled[i + 1].x, resampled[i + 1].y, resampled[i + 1].z);
+                float length2 = glm::dot(b - a, b - a);
+                float t = length2 > 0.0f ? glm::clamp(glm::dot(p - a, b - a) / length2, 0.0f, 1.0f) : 0.0f;
+                nearest = std::min(nearest, glm::length(p - (a + (b - a) * t)));
+            }
+            deviation = std::max(deviation, nearest);
+        }
+
+        const int sectors = 20;
+        size_t triangles = buildHalfPipeTrack(supports, sectors).triangleCount();
+        size_t resampledTriangles = buildHalfPipeTrack(resampled, sectors).triangleCount();
+        if (resampledTriangles > triangles) failures++;
+        std::printf("%-10s %10.3f %10.3f %10zu %10zu %12zu %12zu %10.4f%s\n", name, tolerance, ms,
+            supports.size(), resampled.size(), triangles, resampledTriangles, deviation,
+            resampledTriangles > triangles ? "  MORE" : "");
+    };
+
+    for (float tolerance : { 0.002f, 0.01f, TRACK_TOLERANCE }) {
+        report("spiral", spiralSupports(200), tolerance);
+        report("straight", straightSupports(100), tolerance);
+    }
+
+    // The course's own tracks as placed, at the tolerance the app uses
+    CourseLayout placed = buildCourseLayout(COURSE_START, 0.0f);
+    for (size_t i = 0; i < placed.tracks.size(); i++) {
+        std::string name = "course " + std::to_string(i + 1);
+        report(name.c_str(), placed.tracks[i], TRACK_TOLERANCE);
+    }
+    std::printf("Track resample: %s\n\n", failures == 0 ? "ok" : "FAILED");
+    return failures;
+}
+
+// Heightmap loading, the old column vectors against the flat heightfield and a mapped
+// raw file. Returns the number of failed checks.
+static int benchHeightfield()
+{
+    std::printf("Heightfield loading (8-bit image decoded, or raw 16-bit file mapped)\n");
+    std::printf("%6s %14s %14s %12s %12s %10s %10s %10s\n", "size", "columns ms", "flat ms", "map ms",
+        "touch ms", "cols MiB", "flat MiB", "identical");
+
+    int failures = 0;
+    const char* path = "benchmark_heightfield.raw";
+    for (int size : { 1024, 4096 }) {
+        // Stand-in for the decoded image, row-major from the top-left corner
+        size_t count = size_t(size) * size;
+        std::vector<unsigned char> image(count);
+        Rng rng;
+        for (unsigned char& p : image) p = static_cast<unsigned char>(rng.next() & 0xFF);
+
+        // What loadHeightMap used to build, one allocation per column
+        Clock::time_point start = Clock::now();
+        std::vector<std::vector<float>> columns(size, std::vector<float>(size));
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                columns[size - 1 - x][size - 1 - y] = image[size_t(y) * size + x] / 255.0f;
+            }
+        }
+        double columnsMs = elapsedMs(start);
+
+        start = Clock::now();
+        Heightfield flat(size, size, 1.0f / 255.0f);
+        short* samples = flat.writableSamples();
+        for (size_t i = 0; i < count; ++i) samples[count - 1 - i] = image[i];
+        double flatMs = elapsedMs(start);
+
+        FILE* file = std::fopen(path, "wb");
+        bool written = file && std::fwrite(flat.samples(), sizeof(short), count, file) == count;
+        if (file) std::fclose(file);
+
+        start = Clock::now();
+        std::shared_ptr<Heightfield> mapped = written ? Heightfield::mapRaw16(path, size, size, 1.0f / 255.0f) : nullptr;
+        double mapMs = elapsedMs(start);
+        start = Clock::now();
+        short minSample = 0, maxSample = 0;
+        if (mapped) mapped->sampleRange(minSample, maxSample);
+        double touchMs = elapsedMs(start);
+
+        bool identical = mapped != nullptr && std::equal(flat.samples(), flat.samples() + count, mapped->samples());
+        for (int x = 0; identical && x < size; x++) {
+            for (int z = 0; z < size; z++) {
+                // v / 255 against v * (1 / 255), equal to rounding
+                if (std::abs(columns[x][z] - flat.height(x, z)) > 1e-6f) {
+                    identical = false;
+                    break;
+                }
+            }
+        }
+        failures += identical ? 0 : 1;
+
+        double columnsMiB = (count * sizeof(float) + size * sizeof(std::vector<float>)) / (1024.0 * 1024.0);
+        std::printf("%6d %14.2f %14.2f %12.3f %12.2f %10.1f %10.1f %10s\n", size, columnsMs, flatMs, mapMs,
+            touchMs, columnsMiB, flat.byteSize() / (1024.0 * 1024.0), identical ? "yes" : "NO");
+        mapped.reset();
+        std::remove(path);
+    }
+    std::printf("\n");
+    return failures;
+}
+
+// Rolling hills with some noise, in the signed 16-bit range
+static void fillHills(Heightfield& field)
+{
+    Rng rng;
+    short* samples = field.writableSamples();
+    for (int z = 0; z < field.depth(); z++) {
+        for (int x = 0; x < field.width(); x++) {
+            float h = 8000.0f * std::sin(x * 0.01f) * std::cos(z * 0.013f) + rng.uniform(-300.0f, 300.0f);
+            samples[size_t(z) * field.width() + x] = static_cast<short>(h);
+        }
+    }
+}
+
+// Sobel normals, stitched LOD index buffers and LOD selection for growing terrains.
+// Returns the number of failed checks.
+static int benchTerrain()
+{
+    int failures = 0;
+    std::printf("Terrain normals, Sobel (scalar serial, SSE2 serial, SSE2 on the pool)\n");
+    std::printf("%6s %12s %12s %12s %10s\n", "size", "scalar ms", "simd ms", "pool ms", "identical");
+    ThreadPool serial(0);
+    for (int size : { 1024, 2048 }) {
+        Heightfield field(size, size, 1.0f / 32767.0f);
+        fillHills(field);
+        glm::vec3 spacing = terrainSampleSpacing(field, glm::vec3(100.0f, 30.0f, 100.0f));
+        std::vector<uint32_t> scalar(size_t(size) * size), simd(scalar.size()), pooled(scalar.size());
+
+        Clock::time_point start = Clock::now();
+        computeTerrainNormals(field, spacing, scalar.data(), serial, false);
+        double scalarMs = elapsedMs(start);
+        start = Clock::now();
+        computeTerrainNormals(field, spacing, simd.data(), serial, true);
+        double simdMs = elapsedMs(start);
+        start = Clock::now();
+        computeTerrainNormals(field, spacing, pooled.data());
+        double poolMs = elapsedMs(start);
+
+        bool identical = scalar == simd && scalar == pooled;
+        failures += identical ? 0 : 1;
+        std::printf("%6d %12.2f %12.2f %12.2f %10s\n", size, scalarMs, simdMs, poolMs, identical ? "yes" : "NO");
+    }
+
+    // Flat ground points straight up
+    Heightfield flat(16, 16, 1.0f);
+    std::vector<uint32_t> up(16 * 16);
+    computeTerrainNormals(flat, glm::vec3(1.0f), up.data());
+    for (uint32_t n : up) {
+        if (n != (511u << 10)) {
+            std::printf("Flat terrain normal is not up: %08x\n", n);
+            failures++;
+            break;
+        }
+    }
+
+    // Every level and stitch mask keeps the winding, covers the chunk exactly, and uses
+    // only the vertices a coarser neighbour has on stitched edges
+    const int chunkSize = 64;
+    TerrainGrid grid = makeTerrainGrid(chunkSize + 1, chunkSize + 1, chunkSize);
+    int checked = 0;
+    for (int level = 0; level < grid.levels; level++) {
+        int step = 1 << level;
+        for (int mask = 0; mask < TERRAIN_EDGE_MASKS; mask++) {
+            std::vector<uint16_t> indices = buildTerrainIndices(chunkSize, level, mask);
+            long long area = 0;
+            bool ok = true;
+            for (size_t t = 0; t < indices.size(); t += 3) {
+                int x[3], z[3];
+                for (int k = 0; k < 3; k++) {
+                    x[k] = indices[t + k] % (chunkSize + 1);
+                    z[k] = indices[t + k] / (chunkSize + 1);
+                    bool odd = false;
+                    if ((x[k] == 0 && (mask & TERRAIN_EDGE_WEST)) || (x[k] == chunkSize && (mask & TERRAIN_EDGE_EAST))) odd |= z[k] % (2 * step) != 0;
+                    if ((z[k] == 0 && (mask & TERRAIN_EDGE_NORTH)) || (z[k] == chunkSize && (mask & TERRAIN_EDGE_SOUTH))) odd |= x[k] % (2 * step) != 0;
+                    ok &= !odd && x[k] % step == 0 && z[k] % step == 0;
+                }
+                int twice = (x[1] - x[0]) * (z[2] - z[0]) - (x[2] - x[0]) * (z[1] - z[0]);
+                ok &= twice < 0;
+                area += twice;
+            }
+            ok &= area == -2LL * chunkSize * chunkSize;
+            if (!ok) {
+                std::printf("Terrain indices broken at level %d, stitch mask %d\n", level, mask);
+                failures++;
+            }
+            checked++;
+        }
+    }
+    std::printf("Terrain index buffers: %d checked, %d levels of %d quads\n\n", checked, grid.levels, chunkSize);
+
+    // Same sample spacing on bigger maps, camera in the middle. Triangles grow with the
+    // number of far chunks at the coarsest level, not with the samples.
+    std::printf("Terrain LOD, 0.05 between samples, camera 2 above the centre\n");
+    std::printf("%6s %8s %12s %14s %14s %10s\n", "size", "chunks", "select ms", "full tris", "lod tris", "max step");
+    for (int size : { 1025, 2049, 4097, 8193 }) {
+        TerrainGrid terrain = makeTerrainGrid(size, size, chunkSize);
+        float chunkWorld = chunkSize * 0.05f;
+        float half = 0.5f * (size - 1) * 0.05f;
+        glm::vec3 camera(0.0f, 2.0f, 0.0f);
+        std::vector<float> distances(terrain.chunkCount());
+        std::vector<int> levels;
+        std::vector<std::vector<size_t>> counts(terrain.levels, std::vector<size_t>(TERRAIN_EDGE_MASKS));
+        for (int level = 0; level < terrain.levels; level++) {
+            for (int mask = 0; mask < TERRAIN_EDGE_MASKS; mask++) {
+                counts[level][mask] = buildTerrainIndices(chunkSize, level, mask).size() / 3;
+            }
+        }
+
+        int runs = 0;
+        size_t lodTriangles = 0;
+        int maxStep = 0;
+        Clock::time_point start = Clock::now();
+        do {
+            for (int c = 0; c < terrain.chunkCount(); c++) {
+                glm::vec3 lo(-half + (c % terrain.chunksX) * chunkWorld, -1.0f, -half + (c / terrain.chunksX) * chunkWorld);
+                glm::vec3 hi = lo + glm::vec3(chunkWorld, 2.0f, chunkWorld);
+                distances[c] = glm::distance(camera, glm::clamp(camera, lo, hi));
+            }
+            selectTerrainLevels(terrain, distances, TERRAIN_LOD_DISTANCE, levels);
+            lodTriangles = 0;
+            for (int c = 0; c < terrain.chunkCount(); c++) {
+                int x = c % terrain.chunksX;
+                int z = c / terrain.chunksX;
+                lodTriangles += counts[levels[c]][terrainStitchMask(terrain, levels, x, z)];
+                if (x + 1 < terrain.chunksX) maxStep = std::max(maxStep, std::abs(levels[c] - levels[c + 1]));
+                if (z + 1 < terrain.chunksZ) maxStep = std::max(maxStep, std::abs(levels[c] - levels[c + terrain.chunksX]));
+            }
+            runs++;
+        } while (elapsedMs(start) < 50.0);
+        double selectMs = elapsedMs(start) / runs;
+
+        failures += maxStep <= 1 ? 0 : 1;
+        size_t fullTriangles = size_t(size - 1) * (size - 1) * 2;
+        std::printf("%6d %8d %12.3f %14zu %14zu %10d\n", size, terrain.chunkCount(), selectMs, fullTriangles,
+            lodTriangles, maxStep);
+    }
+    std::printf("\n");
+    return failures;
+}
+
+// Ten simulated seconds at several display rates, with jittered frame times. Every rate has
+// to take the same number of physics steps unless the substep cap drops time.
+static int checkFixedTimestep()
+{
+    int failures = 0;
+    std::printf("Fixed timestep, %.0f Hz, %d substeps max\n", PHYSICS_RATE, PHYSICS_MAX_SUBSTEPS);
+    std::printf("%8s %10s %12s %12s\n", "fps", "steps", "steps/frame", "dropped s");
+
+    Rng rng;
+    for (double fps : { 5.0, 24.0, 30.0, 60.0, 144.0, 240.0 }) {
+        FixedTimestep timestep(PHYSICS_RATE, PHYSICS_MAX_SUBSTEPS);
+        int frames = static_cast<int>(10.0 * fps);
+        int maxPerFrame = 0;
+        double total = 0.0;
+        for (int i = 0; i < frames; i++) {
+            double dt = 1.0 / fps * rng.uniform(0.8f, 1.2f);
+            total += dt;
+            maxPerFrame = std::max(maxPerFrame, timestep.advance(dt));
+            if (timestep.alpha() < 0.0f || timestep.alpha() >= 1.0f) failures++;
+        }
+
+        double expected = (total - timestep.mDroppedTime) * PHYSICS_RATE;
+        if (std::abs(timestep.mSteps - expected) > 1.0 || maxPerFrame > PHYSICS_MAX_SUBSTEPS) failures++;
+        std::printf("%8.0f %10lld %12d %12.2f\n", fps, timestep.mSteps, maxPerFrame, timestep.mDroppedTime);
+    }
+
+    std::printf("Fixed timestep: %s\n\n", failures == 0 ? "ok" : "FAILED");
+    return failures;
+}
+
+// A writer thread publishes numbered payloads as fast as it can while this thread reads.
+// Every read has to be one whole payload, never older than the one before.
+static int checkTripleBuffer()
+{
+    struct Payload {
+        long long sequence = -1;
+        std::vector<long long> values;
+    };
+    const long long PUBLISHES = 200000;
+    const int VALUES = 64;
+
+    TripleBuffer<Payload> buffer;
+    auto start = Clock::now();
+    std::thread writer([&buffer, PUBLISHES, VALUES]() {
+        for (long long n = 0; n < PUBLISHES; n++) {
+            Payload& payload = buffer.back();
+            payload.sequence = n;
+            payload.values.resize(VALUES);
+            for (int i = 0; i < VALUES; i++) payload.values[i] = n * VALUES + i;
+            buffer.publish();
+        }
+    });
+
+    int failures = 0;
+    long long reads = 0;
+    long long seen = 0;
+    long long last = -1;
+    while (last < PUBLISHES - 1) {
+        const Payload& payload = buffer.read();
+        reads++;
+        if (payload.sequence < last) failures++;
+        if (payload.sequence > last) seen++;
+        if (payload.sequence >= 0) {
+            for (int i = 0; i < VALUES; i++) {
+                if (payload.values[i] != payload.sequence * VALUES + i) {
+                    failures++;
+                    break;
+                }
+            }
+        }
+        last = payload.sequence;
+    }
+    writer.join();
+    double ms = elapsedMs(start);
+
+    std::printf("Triple buffer: %lld publishes, %lld reads saw %lld of them in %.1f ms: %s\n\n",
+        PUBLISHES, reads, seen, ms, failures == 0 ? "ok" : "FAILED");
+    return failures;
+}
+
+// Regression check of the triangle count of every primitive, before and after optimizing.
+// Returns the number of mismatches.
+static int checkTriangleCounts()
+{
+    int failures = 0;
+    auto check = [&failures](const char* name, int tessellation, const MeshData& mesh, size_t expected) {
+        MeshData optimized = mesh;
+        optimizeMesh(optimized);
+        if (mesh.triangleCount() != expected || optimized.triangleCount() != expected) {
+            std::printf("%-14s %4d: %zu triangles, %zu optimized, expected %zu\n", name, tessellation,
+                mesh.triangleCount(), optimized.triangleCount(), expected);
+            failures++;
+        }
+    };
+
+    check("Box", 1, buildBox(1.0f, 1.0f, 1.0f), 12);
+    check("Pyramid", 1, buildPyramid(1.0f, 1.0f, 1.0f), 6);
+    check("Plane", 1, buildPlane(1.0f, 1.0f), 2);
+    for (int n : { 2, 3, 10, 64 }) {
+        std::vector<TrackSupport> supports = spiralSupports(n);
+        check("CompositePlane", n, buildCompositePlane(n, n + 1, nullptr), 2 * (n - 1) * n);
+        check("Sphere", n + 2, buildSphere(1.0f, n + 2, n + 2), 2 * (n + 2) * (n + 1));
+        check("Cylinder", n + 2, buildCylinder(0.5f, 1.0f, n + 2), 4 * (n + 2));
+        check("HalfPipe", n, buildHalfPipe(0.9f, 1.0f, 1.0f, n), 8 * n + 4);
+        // Inner and outer curve plus two squares per segment, and the two end faces
+        check("HalfPipeTrack", n, buildHalfPipeTrack(supports, n), (n - 1) * (4 * n + 4) + 4 * n);
+    }
+
+    std::printf("Triangle counts: %s\n\n", failures == 0 ? "ok" : "FAILED");
+    return failures;
+}
+
+// Tasks a hundred times longer at the start of the range, like races that take long to settle.
+// Every index has to run exactly once, and thread 0 shouldn't be left with its share alone.
+static int checkWorkStealing()
+{
+    const size_t TASKS = 4000;
+    int threads = std::max(4, static_cast<int>(std::thread::hardware_concurrency()));
+    std::printf("Work stealing, %zu uneven tasks on %d threads\n", TASKS, threads);
+    std::printf("%8s %10s %10s %10s\n", "threads", "ms", "steals", "once");
+
+    int failures = 0;
+    for (int count = 1; count <= threads; count *= 2) {
+        std::vector<std::atomic<int>> runs(TASKS);
+        for (std::atomic<int>& r : runs) r = 0;
+
+        auto start = Clock::now();
+        size_t steals = workStealingFor(count, TASKS, [&](int, size_t index) {
+            int spins = index < TASKS / 4 ? 20000 : 200;
+            volatile float sink = 0.0f;
+            for (int i = 0; i < spins; i++) sink = sink + std::sqrt(static_cast<float>(i));
+            runs[index]++;
+        });
+        double ms = elapsedMs(start);
+
+        bool once = std::all_of(runs.begin(), runs.end(), [](const std::atomic<int>& r) { return r == 1; });
+        if (!once) failures++;
+        if (count > 1 && steals == 0) failures++;
+        std::printf("%8d %10.2f %10zu %10s\n", count, ms, steals, once ? "yes" : "NO");
+    }
+
+    std::printf("Work stealing: %s\n\n", failures == 0 ? "ok" : "FAILED");
+    return failures;
+}
+
+// The course both the app and the headless simulator race on
+static int checkCourseLayout()
+{
+    int failures = 0;
+    auto start = Clock::now();
+    CourseLayout course = buildCourseLayout(COURSE_START);
+    double ms = elapsedMs(start);
+
+    // Same supports every time, or two runs with one seed race on different tracks
+    CourseLayout again = buildCourseLayout(COURSE_START);
+    size_t supports = 0;
+    for (size_t i = 0; i < course.tracks.size(); i++) {
+        supports += course.tracks[i].size();
+        if (again.tracks[i].size() != course.tracks[i].size()) {
+            failures++;
+            continue;
+        }
+        for (size_t j = 0; j < course.tracks[i].size(); j++) {
+            const TrackSupport& a = course.tracks[i][j];
+            const TrackSupport& b = again.tracks[i][j];
+            if (a.x != b.x || a.y != b.y || a.z != b.z || a.angle != b.angle) failures++;
+        }
+    }
+    if (course.tracks.size() != 5 || course.plinkos.size() != 1) failures++;
+
+    // 10 rows of 7 and 6 pegs between two walls on a board
+    const PlinkoParts& plinko = plinkoParts();
+    if (plinko.boxes.size() != 3 || plinko.pegs.size() != 65) failures++;
+
+    // 3 x 3 a layer, 0.5 apart, centered over start
+    std::vector<glm::vec3> positions = marbleStartPositions(COURSE_START, 36);
+    for (int i = 0; i < 36; i++) {
+        glm::vec3 expected = COURSE_START + glm::vec3((i % 3 - 1) * 0.5f, (i / 9) * 0.5f, ((i / 3) % 3 - 1) * 0.5f);
+        if (glm::length(positions[i] - expected) > 1e-5f) failures++;
+    }
+
+    std::printf("Course: %zu tracks with %zu supports, %zu plinko pegs, built in %.2f ms: %s\n\n",
+        course.tracks.size(), supports, plinko.pegs.size(), ms, failures == 0 ? "ok" : "FAILED");
+    return failures;
+}
+
+int main(int argc, char** argv)
+{
+    uint64_t seed = 1234;
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--seed" && i + 1 < argc) {
+            seed = std::stoull(argv[++i]);
+        }
+    }
+    setGlobalSeed(seed);
+    std::printf("Seed: %llu\n\n", static_cast<unsigned long long>(seed));
+
+    int failures = benchParticleSort();
+    benchRandom();
+    failures += checkTriangleCounts();
+    benchGeometry();
+    failures += benchTrackThreads();
+    failures += benchTrackEdit();
+    failures += benchProceduralTrack();
+    benchMeshOptimizer();
+    failures += benchTrackResample();
+    failures += benchHeightfield();
+    failures += benchTerrain();
+    failures += checkFixedTimestep();
+    failures += checkTripleBuffer();
+    failures += checkCourseLayout();
+    failures += checkWorkStealing();
+    return failures == 0 ? 0 : 1;
+}
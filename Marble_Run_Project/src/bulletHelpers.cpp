@@ -1,5 +1,123 @@
 #include "bulletHelpers.h"
 
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <BulletCollision/CollisionDispatch/btCollisionDispatcherMt.h>
+#include <BulletCollision/CollisionDispatch/btGhostObject.h>
+#include <BulletDynamics/Dynamics/btDiscreteDynamicsWorldMt.h>
+#include <LinearMath/btAabbUtil2.h>
+#include <LinearMath/btThreads.h>
+#include <glm/glm.hpp>
+
+btITaskScheduler* findTaskScheduler(const std::string& name)
+{
+    static std::map<std::string, btITaskScheduler*> schedulers;
+    auto it = schedulers.find(name);
+    if (it != schedulers.end()) {
+        return it->second;
+    }
+
+    btITaskScheduler* scheduler = nullptr;
+    if (name == "sequential") scheduler = btGetSequentialTaskScheduler();
+    else if (name == "default") scheduler = btCreateDefaultTaskScheduler();
+    else if (name == "openmp") scheduler = btGetOpenMPTaskScheduler();
+    else if (name == "tbb") scheduler = btGetTBBTaskScheduler();
+    else if (name == "ppl") scheduler = btGetPPLTaskScheduler();
+    else std::cout << "Unknown task scheduler " << name << std::endl;
+
+    schedulers[name] = scheduler;
+    return scheduler;
+}
+
+void createBulletWorld(Bullet& bullet, const PhysicsWorldOptions& options)
+{
+    // Room for thousands of marbles touching without the pools falling back to the heap
+    btDefaultCollisionConstructionInfo constructionInfo;
+    constructionInfo.m_defaultMaxPersistentManifoldPoolSize = 80000;
+    constructionInfo.m_defaultMaxCollisionAlgorithmPoolSize = 80000;
+    bullet.pCollisionConfiguration = new btDefaultCollisionConfiguration(constructionInfo);
+    bullet.pBroadphase = new btDbvtBroadphase();
+    bullet.pTaskScheduler = nullptr;
+
+    btITaskScheduler* scheduler = options.multithreaded ? findTaskScheduler(options.scheduler) : nullptr;
+    if (options.multithreaded && !scheduler) {
+        std::cout << "Task scheduler " << options.scheduler << " isn't available, using the single threaded world" << std::endl;
+    }
+
+    if (scheduler) {
+        int threads = scheduler->getMaxNumThreads();
+        if (options.threads > 0) {
+            threads = std::min(options.threads, threads);
+        }
+        scheduler->setNumThreads(threads);
+        btSetTaskScheduler(scheduler);
+
+        bullet.pDispatcher = new btCollisionDispatcherMt(bullet.pCollisionConfiguration, 40);
+        bullet.pSolver = new btConstraintSolverPoolMt(threads);
+        bullet.pWorld = new btDiscreteDynamicsWorldMt(bullet.pDispatcher, bullet.pBroadphase,
+            static_cast<btConstraintSolverPoolMt*>(bullet.pSolver), nullptr, bullet.pCollisionConfiguration);
+        bullet.pTaskScheduler = scheduler;
+    }
+    else {
+        bullet.pDispatcher = new btCollisionDispatcher(bullet.pCollisionConfiguration);
+        bullet.pSolver = new btSequentialImpulseConstraintSolver();
+        bullet.pWorld = new btDiscreteDynamicsWorld(
+            bullet.pDispatcher, bullet.pBroadphase, bullet.pSolver, bullet.pCollisionConfiguration);
+    }
+    bullet.pWorld->setGravity(btVector3(0, -9.81f, 0));
+
+    bullet.pGhostPairCallback = new btGhostPairCallback();
+    bullet.pBroadphase->getOverlappingPairCache()->setInternalGhostPairCallback(bullet.pGhostPairCallback);
+}
+
+void destroyBulletWorld(Bullet& bullet)
+{
+    delete bullet.pWorld;
+    delete bullet.pSolver;
+    delete bullet.pBroadphase;
+    delete bullet.pGhostPairCallback;
+    delete bullet.pDispatcher;
+    delete bullet.pCollisionConfiguration;
+    bullet.pWorld = nullptr;
+    bullet.pSolver = nullptr;
+    bullet.pBroadphase = nullptr;
+    bullet.pGhostPairCallback = nullptr;
+    bullet.pDispatcher = nullptr;
+    bullet.pCollisionConfiguration = nullptr;
+    bullet.pTaskScheduler = nullptr;
+}
+
+static void deleteCollisionShape(btCollisionShape* shape)
+{
+    btCompoundShape* compound = dynamic_cast<btCompoundShape*>(shape);
+    if (compound) {
+        for (int i = 0; i < compound->getNumChildShapes(); i++) {
+            deleteCollisionShape(compound->getChildShape(i));
+        }
+    }
+    btBvhTriangleMeshShape* mesh = dynamic_cast<btBvhTriangleMeshShape*>(shape);
+    if (mesh) {
+        delete mesh->getMeshInterface();
+    }
+    delete shape;
+}
+
+void deleteCollisionObjects(btCollisionWorld* world)
+{
+    btCollisionObjectArray& objects = world->getCollisionObjectArray();
+    for (int i = objects.size() - 1; i >= 0; i--) {
+        btCollisionObject* object = objects[i];
+        btRigidBody* body = btRigidBody::upcast(object);
+        if (body) {
+            delete body->getMotionState();
+        }
+        world->removeCollisionObject(object);
+        deleteCollisionShape(object->getCollisionShape());
+        delete object;
+    }
+}
+
 btQuaternion quatFromYawPitchRoll(btScalar yaw, btScalar pitch, btScalar roll)
 {
     // Input in degrees
@@ -11,29 +129,159 @@ btQuaternion quatFromYawPitchRoll(btScalar yaw, btScalar pitch, btScalar roll)
     return q;
 }
 
-btTriangleMesh* createBtTriangleMesh(Shape* shape)
+SharedMeshInterface::SharedMeshInterface(std::shared_ptr<MeshData> mesh) :
+    mMesh(std::move(mesh))
 {
-    std::vector<float> vertices = shape->mVertices;
-    std::vector<unsigned int> indices = shape->mIndices;
+    // Points straight at the shape's positions and indices, nothing is copied
+    btIndexedMesh part;
+    part.m_numTriangles = static_cast<int>(mMesh->triangleCount());
+    part.m_triangleIndexBase = reinterpret_cast<const unsigned char*>(mMesh->indices.data());
+    part.m_triangleIndexStride = 3 * sizeof(unsigned int);
+    part.m_numVertices = static_cast<int>(mMesh->vertexCount());
+    part.m_vertexBase = reinterpret_cast<const unsigned char*>(mMesh->positions.data());
+    part.m_vertexStride = 3 * sizeof(float);
+    part.m_indexType = PHY_INTEGER;
+    part.m_vertexType = PHY_FLOAT;
+    addIndexedMesh(part, PHY_INTEGER);
+}
+
+HeightfieldShape::HeightfieldShape(std::shared_ptr<Heightfield> heightfield, btScalar heightScale, short minSample, short maxSample) :
+    btHeightfieldTerrainShape(heightfield->width(), heightfield->depth(), heightfield->samples(),
+        heightScale, minSample * heightScale, maxSample * heightScale, 1, false),
+    mHeightfield(heightfield)
+{ }
 
-    if (vertices.size() == 0) std::cout << "Shape has 0 vertices saved!" << std::endl;
+btRigidBody* createTerrainRigidBody(std::shared_ptr<Heightfield> heightfield, btVector3 scale, btVector3 origin, btScalar rest, btScalar fric)
+{
+    if (!heightfield || heightfield->width() < 2 || heightfield->depth() < 2) {
+        std::cout << "Terrain needs a heightfield of at least 2x2 samples!" << std::endl;
+        return nullptr;
+    }
 
-    btTriangleMesh* mesh = new btTriangleMesh();
+    short minSample, maxSample;
+    heightfield->sampleRange(minSample, maxSample);
+    btScalar heightScale = heightfield->heightScale() * COMPOSITE_PLANE_HEIGHT;
+    HeightfieldShape* shape = new HeightfieldShape(heightfield, heightScale, minSample, maxSample);
+
+    // CompositePlane spans one unit along x and depth / width along z. The triangle
+    // diagonals already match, running from (x, z + 1) to (x + 1, z).
+    float width = static_cast<float>(heightfield->width());
+    float depth = static_cast<float>(heightfield->depth());
+    shape->setLocalScaling(btVector3(scale.x() / (width - 1), scale.y(), scale.z() * (depth / width) / (depth - 1)));
+
+    // Bullet centres the terrain on its height range
+    btScalar center = 0.5f * (minSample + maxSample) * heightScale * scale.y();
+    return createStaticRigidBody(static_cast<btCollisionShape*>(shape), origin + btVector3(0, center, 0),
+        btQuaternion(0, 0, 0, 1), rest, fric);
+}
 
-    for (int i = 0; i < indices.size(); i += 3)
-    {
-        int i0 = indices[i];
-        int i1 = indices[i + 1];
-        int i2 = indices[i + 2];
+static btVector3 paddedMeshBound(btStridingMeshInterface* mesh, btScalar margin, bool max)
+{
+    btVector3 aabbMin, aabbMax;
+    mesh->calculateAabbBruteForce(aabbMin, aabbMax);
+    btVector3 pad(margin, margin, margin);
+    return max ? aabbMax + pad : aabbMin - pad;
+}
 
-        btVector3 v0(vertices[3 * i0], vertices[3 * i0 + 1], vertices[3 * i0 + 2]);
-        btVector3 v1(vertices[3 * i1], vertices[3 * i1 + 1], vertices[3 * i1 + 2]);
-        btVector3 v2(vertices[3 * i2], vertices[3 * i2 + 1], vertices[3 * i2 + 2]);
+EditableMeshShape::EditableMeshShape(btStridingMeshInterface* mesh, btScalar editMargin) :
+    btBvhTriangleMeshShape(mesh, true, paddedMeshBound(mesh, editMargin, false), paddedMeshBound(mesh, editMargin, true)),
+    mEditMargin(editMargin),
+    mBoundsMin(paddedMeshBound(mesh, editMargin, false)),
+    mBoundsMax(paddedMeshBound(mesh, editMargin, true))
+{ }
 
-        mesh->addTriangle(v0, v1, v2);
+void EditableMeshShape::refit(const btVector3& aabbMin, const btVector3& aabbMax)
+{
+    bool inside = aabbMin.x() > mBoundsMin.x() && aabbMin.y() > mBoundsMin.y() && aabbMin.z() > mBoundsMin.z()
+        && aabbMax.x() < mBoundsMax.x() && aabbMax.y() < mBoundsMax.y() && aabbMax.z() < mBoundsMax.z();
+    if (inside) {
+        partialRefitTree(aabbMin, aabbMax);
+        return;
     }
 
-    return mesh;
+    // Quantized nodes can't describe points outside the bounds, requantize every node
+    std::cout << "Track edit outside the collision bounds, refitting the whole tree" << std::endl;
+    mBoundsMin = paddedMeshBound(m_meshInterface, mEditMargin, false);
+    mBoundsMax = paddedMeshBound(m_meshInterface, mEditMargin, true);
+    refitTree(mBoundsMin, mBoundsMax);
+}
+
+void refitCollisionMesh(btRigidBody* body, const btVector3& aabbMin, const btVector3& aabbMax, btCollisionWorld* world)
+{
+    EditableMeshShape* shape = dynamic_cast<EditableMeshShape*>(body->getCollisionShape());
+    if (!shape) {
+        std::cout << "Body has no editable triangle mesh!" << std::endl;
+        return;
+    }
+    if (aabbMin.x() > aabbMax.x()) {
+        return;
+    }
+
+    shape->refit(aabbMin, aabbMax);
+
+    if (world) {
+        world->updateSingleAabb(body);
+
+        // Bodies resting on the old surface would otherwise sleep through the change
+        btVector3 margin(0.5f, 0.5f, 0.5f);
+        btCollisionObjectArray& objects = world->getCollisionObjectArray();
+        for (int i = 0; i < objects.size(); i++) {
+            btVector3 objectMin, objectMax;
+            objects[i]->getCollisionShape()->getAabb(objects[i]->getWorldTransform(), objectMin, objectMax);
+            if (objects[i] != body && TestAabbAgainstAabb2(objectMin, objectMax, aabbMin - margin, aabbMax + margin)) {
+                objects[i]->activate(true);
+            }
+        }
+    }
+}
+
+InterpolatedMotionState::InterpolatedMotionState(const btTransform& transform) :
+    mPrevious(transform), mCurrent(transform), mBlended(transform)
+{
+}
+
+void InterpolatedMotionState::getWorldTransform(btTransform& worldTrans) const
+{
+    worldTrans = mBlended;
+}
+
+void InterpolatedMotionState::setWorldTransform(const btTransform& worldTrans)
+{
+    mCurrent = worldTrans;
+}
+
+void InterpolatedMotionState::reset(const btTransform& transform)
+{
+    mPrevious = transform;
+    mCurrent = transform;
+}
+
+void InterpolatedMotionState::blend(const btTransform& from, const btTransform& to, btScalar alpha)
+{
+    mBlended.setOrigin(from.getOrigin().lerp(to.getOrigin(), alpha));
+    mBlended.setRotation(from.getRotation().slerp(to.getRotation(), alpha));
+}
+
+InterpolatedMotionState* interpolatedMotionState(btCollisionObject* object)
+{
+    btRigidBody* body = btRigidBody::upcast(object);
+    if (!body || body->isStaticOrKinematicObject()) return nullptr;
+
+    return dynamic_cast<InterpolatedMotionState*>(body->getMotionState());
+}
+
+void teleportRigidBody(btRigidBody* body, const btTransform& transform)
+{
+    body->setWorldTransform(transform);
+    body->setInterpolationWorldTransform(transform);
+
+    InterpolatedMotionState* state = dynamic_cast<InterpolatedMotionState*>(body->getMotionState());
+    if (state) {
+        state->reset(transform);
+    }
+    else if (body->getMotionState()) {
+        body->getMotionState()->setWorldTransform(transform);
+    }
 }
 
 btRigidBody* createMarbleRigidBody(btScalar mass, btScalar radius, btVector3 origin, btScalar rest, btScalar fric)
@@ -46,8 +294,8 @@ btRigidBody* createMarbleRigidBody(btScalar mass, btScalar radius, btVector3 ori
 
     btQuaternion q = btQuaternion(0, 0, 0, 1);
 
-    btDefaultMotionState* motionState =
-        new btDefaultMotionState(btTransform(q, origin));
+    InterpolatedMotionState* motionState =
+        new InterpolatedMotionState(btTransform(q, origin));
 
     btRigidBody::btRigidBodyConstructionInfo rigidBodyCI(
         mass,
@@ -70,7 +318,7 @@ btRigidBody* createMarbleRigidBody(btScalar mass, btScalar radius, btVector3 ori
     return rigidBody;
 }
 
-btRigidBody* createStaticRigidBody(btTriangleMesh* mesh, btVector3 origin, btQuaternion rotation, btScalar rest, btScalar fric)
+btRigidBody* createStaticRigidBody(btStridingMeshInterface* mesh, btVector3 origin, btQuaternion rotation, btScalar rest, btScalar fric)
 {
     bool useQuantizedAabbCompression = true; // usually true for performance
     btBvhTriangleMeshShape* shape = new btBvhTriangleMeshShape(mesh, useQuantizedAabbCompression);
@@ -1,20 +1,135 @@
 #pragma once
 
+#include <memory>
+#include <string>
 #include <vector>
 #include <BulletDynamics/Dynamics/btDynamicsWorld.h>
 #include <btBulletDynamicsCommon.h>
-#include "shape.h"
+#include <BulletCollision/CollisionShapes/btHeightfieldTerrainShape.h>
+#include "heightfield.h"
+#include "mesh_builder.h"
+#include "settings.h"
+
+class PhysicsThread;
+class btITaskScheduler;
+class btGhostPairCallback;
+
+struct Bullet {
+	btCollisionConfiguration* pCollisionConfiguration;
+	btCollisionDispatcher* pDispatcher;
+	btBroadphaseInterface* pBroadphase;
+	btConstraintSolver* pSolver;
+	btDynamicsWorld* pWorld;
+	// Lets ghost objects, like the finish line, track what overlaps them
+	btGhostPairCallback* pGhostPairCallback = nullptr;
+	// Set when pWorld is the multithreaded world, not owned
+	btITaskScheduler* pTaskScheduler = nullptr;
+	PhysicsThread* pPhysics = nullptr;
+};
+
+// Which dynamics world createBulletWorld builds
+struct PhysicsWorldOptions {
+	bool multithreaded = PHYSICS_MULTITHREADED;
+	std::string scheduler = PHYSICS_TASK_SCHEDULER;
+	int threads = PHYSICS_WORKER_THREADS;
+};
+
+// Bullet's task scheduler by name, see PHYSICS_TASK_SCHEDULER. Schedulers own their worker
+// threads, so each is made once and kept for the whole run. nullptr when Bullet was built without it.
+btITaskScheduler* findTaskScheduler(const std::string& name);
+
+// Fills bullet with a world and everything it steps with. The multithreaded world solves
+// islands with a btConstraintSolverPoolMt on the named task scheduler. When that scheduler
+// isn't available the single threaded world is built instead. The multithreaded world must
+// be stepped on the thread that called this.
+void createBulletWorld(Bullet& bullet, const PhysicsWorldOptions& options = PhysicsWorldOptions());
+// Deletes what createBulletWorld made. Bodies still in the world aren't deleted.
+void destroyBulletWorld(Bullet& bullet);
+// Removes every object from the world and deletes it with its motion state and shape,
+// for worlds whose shapes aren't shared with anything else
+void deleteCollisionObjects(btCollisionWorld* world);
 
 btQuaternion quatFromYawPitchRoll(btScalar yaw = 0.0f, btScalar pitch = 0.0f, btScalar roll = 0.0f);
 
-btTriangleMesh* createBtTriangleMesh(Shape* shape);
+// Collision mesh over a shape's MeshData. Holds a reference to the mesh, so render and
+// physics share one copy of the positions and indices.
+class SharedMeshInterface : public btTriangleIndexVertexArray {
+public:
+	SharedMeshInterface(std::shared_ptr<MeshData> mesh);
+
+	std::shared_ptr<MeshData> mMesh;
+};
+
+// Terrain reading a heightfield's samples in place. Holds a reference, so the samples
+// outlive the shape.
+class HeightfieldShape : public btHeightfieldTerrainShape {
+public:
+	HeightfieldShape(std::shared_ptr<Heightfield> heightfield, btScalar heightScale, short minSample, short maxSample);
+
+	std::shared_ptr<Heightfield> mHeightfield;
+};
+
+// Static terrain matching a CompositePlane drawn from the same heightfield, scaled by
+// scale and placed at origin
+btRigidBody* createTerrainRigidBody(
+	std::shared_ptr<Heightfield> heightfield, btVector3 scale, btVector3 origin = btVector3(0.0, 0.0, 0.0),
+	btScalar rest = 0.5f, btScalar fric = 0.8f);
+
+// Triangle mesh BVH whose quantization bounds are padded by editMargin, so triangles can
+// move that far and be refit in place with partialRefitTree instead of rebuilding the tree
+class EditableMeshShape : public btBvhTriangleMeshShape {
+public:
+	EditableMeshShape(btStridingMeshInterface* mesh, btScalar editMargin);
+	// Refits the part of the tree between aabbMin and aabbMax, or the whole tree with
+	// new bounds when the change reaches outside the current ones
+	void refit(const btVector3& aabbMin, const btVector3& aabbMax);
+
+	btScalar mEditMargin;
+	btVector3 mBoundsMin;
+	btVector3 mBoundsMax;
+};
+
+// Refits the body's EditableMeshShape after its shared mesh changed between aabbMin and aabbMax,
+// which should cover the triangles both before and after the change. With a world, the body's
+// broadphase AABB is updated and sleeping bodies near the change are woken.
+void refitCollisionMesh(btRigidBody* body, const btVector3& aabbMin, const btVector3& aabbMax,
+	btCollisionWorld* world = nullptr);
+
+// Motion state of a dynamic body keeping its transforms after the last two physics steps,
+// which the physics side publishes. getWorldTransform returns the blend of them the render
+// side last made, so drawing reads positions between steps. Not for kinematic bodies,
+// Bullet would read the blend back.
+class InterpolatedMotionState : public btMotionState {
+public:
+	InterpolatedMotionState(const btTransform& transform);
+
+	void getWorldTransform(btTransform& worldTrans) const override;
+	void setWorldTransform(const btTransform& worldTrans) override;
+
+	// Physics side. Called before each step, so bodies that don't move keep a still blend.
+	void beginStep() { mPrevious = mCurrent; }
+	// Physics side. Jump to transform without blending from the old one.
+	void reset(const btTransform& transform);
+	// Render side
+	void blend(const btTransform& from, const btTransform& to, btScalar alpha);
+
+	btTransform mPrevious;
+	btTransform mCurrent;
+	btTransform mBlended;
+};
+
+// The body's InterpolatedMotionState, or nullptr for static bodies and other motion states
+InterpolatedMotionState* interpolatedMotionState(btCollisionObject* object);
+
+// Moves a body without the move being drawn as motion
+void teleportRigidBody(btRigidBody* body, const btTransform& transform);
 
 btRigidBody* createMarbleRigidBody(
 	btScalar mass = 1.0f, btScalar radius = 0.1f, btVector3 origin = btVector3(0.0, 0.0, 0.0), 
 	btScalar rest = 0.5f, btScalar fric = 0.8f);
 
 btRigidBody* createStaticRigidBody(
-	btTriangleMesh* mesh, btVector3 origin = btVector3(0.0, 0.0, 0.0), 
+	btStridingMeshInterface* mesh, btVector3 origin = btVector3(0.0, 0.0, 0.0), 
 	btQuaternion rotation = btQuaternion(0, 0, 0, 1), btScalar rest = 0.5f, btScalar fric = 0.8f);
 
 btRigidBody* createStaticRigidBody(
@@ -0,0 +1,271 @@
+#define _USE_MATH_DEFINES
+
+#include "course.h"
+
+#include <cmath>
+
+#include "trackSupportGenerator.h"
+
+CourseLayout buildCourseLayout(glm::vec3 start, float tolerance)
+{
+    // Track turn: 90 deg -> 10 segments
+    CourseLayout course;
+    course.start = start;
+
+    glm::vec3 pillarPos;
+    float nextAngle = 0.0f;
+    glm::vec3 nextPos = {
+        start.x,
+        start.y,
+        start.z - 2.0f,
+    };
+
+    std::vector<TrackSupport> supports;
+    TrackSupportGenerator trackGenerator = TrackSupportGenerator();
+
+    // Track 1
+    course.torches.push_back({
+        nextPos.x + 1.95f,
+        nextPos.y - 0.05f,
+        nextPos.z + 0.05f
+        });
+    course.torches.push_back({
+        nextPos.x - 1.95f,
+        nextPos.y - 0.05f,
+        nextPos.z + 0.05f
+        });
+
+    trackGenerator.newTrack(
+        nextPos.x, nextPos.y, nextPos.z,
+        nextAngle, 1.9f, 2.0f);
+    trackGenerator.forward(4.0f, -2.0f, 1.9f, 2.0f);
+    pillarPos = trackGenerator.getLastPos();
+    pillarPos.y -= 1.95f;
+    course.pillars.push_back({ pillarPos, 0.2f });
+    trackGenerator.forward(4.0f, -1.8f, 0.9f, 1.0f);
+
+    trackGenerator.turn(-180.0f, 4.0f, -1.2f, 20);
+
+    supports = trackGenerator.getAdaptiveSupports(tolerance);
+    course.tracks.push_back(supports);
+
+    pillarPos = trackGenerator.getLastPos();
+    pillarPos.y -= 0.95f;
+    pillarPos.z += 0.2f;
+    course.pillars.push_back({ pillarPos, 0.2f });
+
+    // Plinko 1
+    nextPos = trackGenerator.nextModuleCenter(8.0f, plinkoParts().tilt);
+    nextAngle = supports.back().angle;
+    course.plinkos.push_back({ nextPos, nextAngle });
+
+    // Track 2a & 2b
+    nextPos = trackGenerator.nextModuleCenter(16.0f, plinkoParts().tilt); // After plinko
+
+    trackGenerator.newTrack(
+        nextPos.x, nextPos.y, nextPos.z, nextAngle);
+    trackGenerator.forward(0.9f);
+
+    nextPos = trackGenerator.getLastPos(); // + offset
+    pillarPos = nextPos;
+    pillarPos.y -= 0.95f;
+    course.pillars.push_back({ pillarPos, 0.2f });
+
+    // Track 2a
+    trackGenerator.newTrack(
+        nextPos.x, nextPos.y, nextPos.z,
+        nextAngle + 90.0f,
+        0.9f, 1.0f);
+    trackGenerator.forward(2.0f, -0.1f, 0.9f, 1.0f);
+    trackGenerator.turn(-135.0f, 3.0f, -1.0f, 13);
+
+    pillarPos = trackGenerator.getLastPos();
+    pillarPos.y -= 0.95f;
+    course.pillars.push_back({ pillarPos, 0.2f });
+
+    trackGenerator.forward(3.0f, -1.0f, 0.4f, 0.5f);
+    trackGenerator.turn(720.0f, 3.0f, -4.0f, 80, 0.4f, 0.5f);
+
+    pillarPos = trackGenerator.getLastPos();
+    pillarPos.y -= 0.45f;
+    course.pillars.push_back({ pillarPos, 0.2f });
+
+    trackGenerator.forward(1.0f, -0.2f, 0.3f, 0.4f);
+
+    supports = trackGenerator.getAdaptiveSupports(tolerance);
+    course.tracks.push_back(supports);
+
+    glm::vec3 pos2a = trackGenerator.getLastPos();
+
+    // Track 2b
+    trackGenerator.newTrack(
+        nextPos.x, nextPos.y, nextPos.z,
+        nextAngle - 90.0f,
+        0.9f, 1.0f);
+    trackGenerator.forward(2.0f, -0.1f, 0.9f, 1.0f);
+    trackGenerator.turn(135.0f, 3.0f, -1.0f, 13);
+
+    pillarPos = trackGenerator.getLastPos();
+    pillarPos.y -= 0.95f;
+    course.pillars.push_back({ pillarPos, 0.2f });
+
+    trackGenerator.forward(3.0f, -1.0f, 0.4f, 0.5f);
+    trackGenerator.turn(-720.0f, 3.0f, -4.0f, 80, 0.4f, 0.5f);
+
+    pillarPos = trackGenerator.getLastPos();
+    pillarPos.y -= 0.45f;
+    course.pillars.push_back({ pillarPos, 0.2f });
+
+    trackGenerator.forward(1.0f, -0.2f, 0.3f, 0.4f);
+
+    supports = trackGenerator.getAdaptiveSupports(tolerance);
+    course.tracks.push_back(supports);
+
+    glm::vec3 pos2b = trackGenerator.getLastPos();
+
+    // Track 3
+    nextPos = (pos2a + pos2b) * 0.5f;
+    nextPos.y -= 0.5f;
+
+    trackGenerator.newTrack(
+        nextPos.x, nextPos.y, nextPos.z,
+        nextAngle,
+        0.9f, 1.0f);
+    trackGenerator.forward(6.0f, -1.0f, 0.9f, 1.0f);
+
+    pillarPos = trackGenerator.getLastPos();
+    pillarPos.y -= 0.95f;
+    course.pillars.push_back({ pillarPos, 0.2f });
+
+    trackGenerator.turn(-180.0f, 8, -2.0f, 20, 0.9f, 1.0f);
+
+    pillarPos = trackGenerator.getLastPos();
+    pillarPos.y -= 0.95f;
+    course.pillars.push_back({ pillarPos, 0.2f });
+
+    trackGenerator.forward(8.0f, -0.5f, 0.4f, 0.5f);
+    trackGenerator.forward(0.5f, 0.1f, 0.4f, 0.5f);
+    trackGenerator.forward(0.5f, 0.2f, 0.4f, 0.5f);
+
+    supports = trackGenerator.getAdaptiveSupports(tolerance);
+    course.tracks.push_back(supports);
+
+    pillarPos = trackGenerator.getLastPos();
+
+    // Finish line
+    float lastRadius = 0.5f;
+    float finishAngle = supports.back().angle;
+
+    trackGenerator.forward(lastRadius + 0.1f);
+    course.finishLine = { trackGenerator.getLastPos(), finishAngle, lastRadius };
+
+    pillarPos.x += 1.1f;
+    course.torches.push_back(pillarPos);
+    course.pillars.push_back({ pillarPos, 0.1f });
+
+    pillarPos.x -= 2.2f;
+    course.torches.push_back(pillarPos);
+    course.pillars.push_back({ pillarPos, 0.1f });
+
+    // Landing area after race
+    trackGenerator.forward(0.0f, -0.5f);
+    nextPos = trackGenerator.getLastPos();
+    nextAngle = finishAngle;
+
+    trackGenerator.newTrack(
+        nextPos.x, nextPos.y, nextPos.z,
+        nextAngle, 0.9f, 1.0f);
+    trackGenerator.forward(10.0f, -1.0f, 0.2f, 0.3f);
+
+    pillarPos = trackGenerator.getLastPos();
+    pillarPos.y -= 0.25f;
+    course.pillars.push_back({ pillarPos, 0.2f });
+
+    trackGenerator.forward(20.0f, 0.0f, 0.2f, 0.3f);
+
+    pillarPos = trackGenerator.getLastPos();
+    pillarPos.y -= 0.25f;
+    course.pillars.push_back({ pillarPos, 0.2f });
+
+    trackGenerator.forward(4.0f, 1.2f, 0.2f, 0.3f);
+
+    supports = trackGenerator.getAdaptiveSupports(tolerance);
+    course.tracks.push_back(supports);
+
+    return course;
+}
+
+static PlinkoParts makePlinkoParts()
+{
+    float length = 8.0f;
+    float width = 4.0f;
+    float height = 0.5f;
+    float thicknes = 0.1f;
+    float radius = 0.05f;
+
+    PlinkoParts parts;
+    parts.tilt = 10.0f;
+
+    // base board
+    parts.boxes.push_back({ { 0.0f, 0.0f, 0.0f }, { width, thicknes, length } });
+    // right wall
+    parts.boxes.push_back({
+        { (width / 2.0f - thicknes / 2.0f), (height / 2.0f + thicknes / 2.0f), 0.0f },
+        { thicknes, height, length } });
+    // left wall
+    parts.boxes.push_back({
+        { -(width / 2.0f - thicknes / 2.0f), (height / 2.0f + thicknes / 2.0f), 0.0f },
+        { thicknes, height, length } });
+
+    // pillar obstacles
+    int numRows = 10;
+    int pillarsPerRow = 7;
+    float pillarDist = 0.625;
+    float xOffsetEven = -(pillarDist * (pillarsPerRow - 1)) / 2.0;
+    float xOffsetOdd = -(pillarDist * (pillarsPerRow - 2)) / 2.0;
+    float zOffset = -(pillarDist * (numRows - 1)) / 2.0;
+    float yPos = (height / 2.0f + thicknes / 2.01f);
+
+    for (int i = 0; i < numRows; i++) {
+        float xOffset = (i % 2 == 0) ? xOffsetEven : xOffsetOdd;
+        for (int j = 0; j < pillarsPerRow - (i % 2); j++) {
+            float xPos = xOffset + (j * pillarDist);
+            float zPos = zOffset + (i * pillarDist);
+            parts.pegs.push_back({ { xPos, yPos, zPos }, radius, height });
+        }
+    }
+    return parts;
+}
+
+const PlinkoParts& plinkoParts()
+{
+    static const PlinkoParts parts = makePlinkoParts();
+    return parts;
+}
+
+float marbleMass(float radius, float density)
+{
+    return density * (4.0 / 3.0) * M_PI * std::pow(radius, 3.0);
+}
+
+std::vector<glm::vec3> marbleStartPositions(glm::vec3 start, int count)
+{
+    int numX = 3;
+    int numZ = 3;
+    float sphereDist = 0.5;
+    float xOffset = -(sphereDist * (numX - 1)) / 2.0f;
+    float zOffset = -(sphereDist * (numZ - 1)) / 2.0f;
+
+    std::vector<glm::vec3> positions;
+    for (int sId = 0; sId < count; sId++) {
+        int i = sId / (numX * numZ);
+        int j = (sId / numZ) % numZ;
+        int k = sId % numX;
+        positions.push_back({
+            start.x + xOffset + (k * sphereDist),
+            start.y + (i * sphereDist),
+            start.z + zOffset + (j * sphereDist)
+            });
+    }
+    return positions;
+}
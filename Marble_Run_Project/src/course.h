@@ -0,0 +1,78 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "mesh_builder.h"
+#include "settings.h"
+
+// The race course as plain data. createWorld draws it and adds its bodies, the headless
+// simulator only adds the bodies, so both race on the same course.
+
+struct PlinkoLayout {
+	glm::vec3 pos;
+	float angle;
+};
+
+struct PillarLayout {
+	glm::vec3 top;
+	float radius;
+};
+
+struct FinishLineLayout {
+	glm::vec3 pos;
+	float angle;
+	float halfSize;
+};
+
+struct CourseLayout {
+	glm::vec3 start;
+	// Supports of each half pipe track, in the order they are built
+	std::vector<std::vector<TrackSupport>> tracks;
+	std::vector<PlinkoLayout> plinkos;
+	FinishLineLayout finishLine;
+	// Decoration only, no bodies
+	std::vector<PillarLayout> pillars;
+	std::vector<glm::vec3> torches;
+};
+
+// Where the marbles drop and fallen ones go back to
+const glm::vec3 COURSE_START = { 0.0f, 20.0f, 0.0f };
+
+// The course starting at start, its tracks resampled to tolerance
+CourseLayout buildCourseLayout(glm::vec3 start, float tolerance = TRACK_TOLERANCE);
+
+// Parts of a plinko board around its center, before it is tilted and turned
+struct PlinkoBox {
+	glm::vec3 center;
+	glm::vec3 size;
+};
+
+struct PlinkoPeg {
+	glm::vec3 center;
+	float radius;
+	float height;
+};
+
+struct PlinkoParts {
+	float tilt;
+	std::vector<PlinkoBox> boxes;		// base board, right wall, left wall
+	std::vector<PlinkoPeg> pegs;
+};
+
+const PlinkoParts& plinkoParts();
+
+// What racing needs of a marble, SphereInfo without the looks
+struct MarbleSpec {
+	std::string name;
+	float radius = 0.1f;
+	float density = 1.0f;
+	float restitution = MARBLE_RESTITUTION;
+	float friction = MARBLE_FRICTION;
+};
+
+float marbleMass(float radius, float density);
+
+// Where count marbles drop, in layers of 3 x 3 above start
+std::vector<glm::vec3> marbleStartPositions(glm::vec3 start, int count);
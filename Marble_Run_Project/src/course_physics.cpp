@@ -0,0 +1,116 @@
+#include "course_physics.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "bulletHelpers.h"
+#include "settings.h"
+
+btRigidBody* createGroundRigidBody()
+{
+    btQuaternion q = quatFromYawPitchRoll(0.0f, 0.0f, 0.0f);
+    btCollisionShape* groundShape = new btStaticPlaneShape(btVector3(0, 1, 0), 0);
+    return createStaticRigidBody(groundShape, { 0, 0, 0 }, q, 0.6f, 0.5f);
+}
+
+btRigidBody* createTrackRigidBody(std::shared_ptr<MeshData> mesh)
+{
+    if (!mesh || mesh->positions.empty()) {
+        std::cout << "Track keeps no CPU mesh, construct it as a physics source!" << std::endl;
+        return nullptr;
+    }
+
+    btQuaternion q = quatFromYawPitchRoll(0.0f, 0.0f, 0.0f);
+    SharedMeshInterface* trackMesh = new SharedMeshInterface(mesh);
+    return createStaticRigidBody(
+        new EditableMeshShape(trackMesh, TRACK_EDIT_MARGIN),
+        { 0, 0, 0 }, q,
+        TRACK_RESTITUTION, TRACK_FRICTION);
+}
+
+std::shared_ptr<MeshData> buildTrackCollisionMesh(const std::vector<TrackSupport>& supports)
+{
+    return std::make_shared<MeshData>(buildHalfPipeTrack(supports, TRACK_SECTORS));
+}
+
+btRigidBody* createPlinkoRigidBody(const PlinkoLayout& plinko)
+{
+    const PlinkoParts& parts = plinkoParts();
+    btCompoundShape* compound = new btCompoundShape();
+    btTransform tLocal;
+
+    for (const PlinkoBox& box : parts.boxes) {
+        btCollisionShape* btBox = new btBoxShape(btVector3(box.size.x / 2.0f, box.size.y / 2.0f, box.size.z / 2.0f));
+        tLocal.setIdentity();
+        tLocal.setOrigin(btVector3(box.center.x, box.center.y, box.center.z));
+        compound->addChildShape(tLocal, btBox);
+    }
+    for (const PlinkoPeg& peg : parts.pegs) {
+        btCollisionShape* btPillar = new btCylinderShape({ peg.radius, peg.height / 2.0f, peg.radius });
+        tLocal.setIdentity();
+        tLocal.setOrigin(btVector3(peg.center.x, peg.center.y, peg.center.z));
+        compound->addChildShape(tLocal, btPillar);
+    }
+
+    btQuaternion q = quatFromYawPitchRoll(0.0f, -plinko.angle, parts.tilt);
+    return createStaticRigidBody(compound, { plinko.pos.x, plinko.pos.y, plinko.pos.z }, q,
+        PLINKO_RESTITUTION, PLINKO_FRICTION);
+}
+
+btGhostObject* createFinishLine(btDynamicsWorld* world, const FinishLineLayout& finishLine)
+{
+    btQuaternion q = quatFromYawPitchRoll(0.0f, -finishLine.angle, 0.0f);
+    btVector3 finishLinePos = btVector3(finishLine.pos.x, finishLine.pos.y, finishLine.pos.z);
+    btScalar halfSize = finishLine.halfSize;
+
+    btGhostObject* ghostObject = new btGhostObject();
+
+    ghostObject->setCollisionShape(new btBoxShape(btVector3(halfSize, halfSize, halfSize)));
+    ghostObject->setWorldTransform(btTransform(q, finishLinePos));
+    ghostObject->setCollisionFlags(ghostObject->getCollisionFlags() | btCollisionObject::CF_NO_CONTACT_RESPONSE);
+
+    world->addCollisionObject(ghostObject, btBroadphaseProxy::SensorTrigger, btBroadphaseProxy::DefaultFilter);
+    return ghostObject;
+}
+
+btRigidBody* createMarbleRigidBody(const MarbleSpec& marble, glm::vec3 pos)
+{
+    return createMarbleRigidBody(marbleMass(marble.radius, marble.density), marble.radius,
+        { pos.x, pos.y, pos.z }, marble.restitution, marble.friction);
+}
+
+void RaceRules::setRespawn(btScalar minY, const btVector3& start)
+{
+    mRespawn = true;
+    mRespawnY = minY;
+    mRespawnStart = start;
+}
+
+int RaceRules::apply(const std::vector<btRigidBody*>& bodies)
+{
+    // Sphere fell off, teleport back to start
+    if (mRespawn) {
+        for (btRigidBody* body : bodies) {
+            btTransform trans = body->getWorldTransform();
+            if (trans.getOrigin().getY() < mRespawnY) {
+                trans.setOrigin(mRespawnStart);
+                teleportRigidBody(body, trans);
+                body->setLinearVelocity({ 0.0, 1.0, 0.0 });
+            }
+        }
+    }
+
+    // Placement
+    int finished = 0;
+    if (mFinishLine) {
+        for (int i = 0; i < mFinishLine->getNumOverlappingObjects(); i++) {
+            const btCollisionObject* object = mFinishLine->getOverlappingObject(i);
+            if (object->isStaticOrKinematicObject()) continue;
+            if (std::find(mFinishOrder.begin(), mFinishOrder.end(), object) == mFinishOrder.end()) {
+                mFinishOrder.push_back(object);
+                finished++;
+            }
+        }
+    }
+    return finished;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <BulletDynamics/Dynamics/btDynamicsWorld.h>
+#include <btBulletDynamicsCommon.h>
+#include <BulletCollision/CollisionDispatch/btGhostObject.h>
+
+#include "course.h"
+#include "mesh_builder.h"
+
+// Bodies of the course, made the same way for the app and the headless simulator. The
+// app adds them ground first, then the marbles, the tracks, the plinkos and the finish
+// line, and so must anything that wants to race like it.
+
+// Flat ground at y = 0
+btRigidBody* createGroundRigidBody();
+
+// Static half pipe over mesh. Shares the mesh, so edits to it can be refit in place.
+btRigidBody* createTrackRigidBody(std::shared_ptr<MeshData> mesh);
+
+// Collision mesh of a track as HalfPipeTrack builds it
+std::shared_ptr<MeshData> buildTrackCollisionMesh(const std::vector<TrackSupport>& supports);
+
+// Board, walls and pegs of plinkoParts() in one compound
+btRigidBody* createPlinkoRigidBody(const PlinkoLayout& plinko);
+
+// Sensor box marbles pass through. Added to world, which must track ghost pairs.
+btGhostObject* createFinishLine(btDynamicsWorld* world, const FinishLineLayout& finishLine);
+
+btRigidBody* createMarbleRigidBody(const MarbleSpec& marble, glm::vec3 pos);
+
+// What happens to marbles after each step: those that fell below the respawn height go back
+// to start, and those reaching the finish line are placed in the order they got there
+class RaceRules {
+public:
+	void setFinishLine(btGhostObject* finishLine) { mFinishLine = finishLine; }
+	void setRespawn(btScalar minY, const btVector3& start);
+
+	// After each step, with the dynamic bodies of the world. Returns the number of marbles
+	// that finished in this step.
+	int apply(const std::vector<btRigidBody*>& bodies);
+	const std::vector<const btCollisionObject*>& finishOrder() const { return mFinishOrder; }
+
+private:
+	btGhostObject* mFinishLine = nullptr;
+	bool mRespawn = false;
+	btScalar mRespawnY = 0.0f;
+	btVector3 mRespawnStart;
+	std::vector<const btCollisionObject*> mFinishOrder;
+};
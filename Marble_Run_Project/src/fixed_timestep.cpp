@@ -0,0 +1,31 @@
+#include "fixed_timestep.h"
+
+#include <algorithm>
+#include <cmath>
+
+FixedTimestep::FixedTimestep(double rate, int maxSubSteps)
+    : mStep(1.0 / rate), mMaxSubSteps(std::max(maxSubSteps, 1))
+{
+}
+
+int FixedTimestep::advance(double dt)
+{
+    mAccumulator += std::max(dt, 0.0);
+
+    int steps = static_cast<int>(std::floor(mAccumulator / mStep));
+    if (steps > mMaxSubSteps) {
+        // Keep the phase of the leftover time, drop the rest
+        double kept = std::fmod(mAccumulator, mStep);
+        mDroppedTime += mAccumulator - kept - mMaxSubSteps * mStep;
+        mAccumulator = kept;
+        steps = mMaxSubSteps;
+    }
+    else {
+        mAccumulator -= steps * mStep;
+    }
+    // Rounding can leave the remainder a hair below zero or at a full step
+    mAccumulator = std::min(std::max(mAccumulator, 0.0), std::nextafter(mStep, 0.0));
+
+    mSteps += steps;
+    return steps;
+}
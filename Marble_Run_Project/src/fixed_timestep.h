@@ -0,0 +1,26 @@
+#pragma once
+
+// Accumulator that turns variable frame times into a whole number of fixed physics steps.
+// The time left over is kept for the next frame, and alpha() is how far the frame lies
+// between the last two steps, for drawing interpolated states.
+class FixedTimestep {
+public:
+	FixedTimestep(double rate, int maxSubSteps);
+
+	// Adds a frame of dt seconds and returns the steps to take, at most maxSubSteps.
+	// Time beyond that is dropped, so a slow frame can't snowball into slower ones.
+	int advance(double dt);
+
+	double step() const { return mStep; }
+	int maxSubSteps() const { return mMaxSubSteps; }
+	// [0, 1) from the last step to the next
+	float alpha() const { return static_cast<float>(mAccumulator / mStep); }
+
+	long long mSteps = 0;			// taken since creation
+	double mDroppedTime = 0.0;		// seconds skipped by the substep cap
+
+private:
+	double mStep;
+	int mMaxSubSteps;
+	double mAccumulator = 0.0;
+};
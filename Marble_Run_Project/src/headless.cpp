@@ -0,0 +1,236 @@
+// Headless race simulator. Builds the course without a window or GL context, runs one race
+// as fast as the machine allows and prints the result as JSON. With --races, runs a race farm
+// instead and prints each marble's win probability and placements.
+//
+//   Marble_Run_Headless [--seed N] [--marbles N | --marble-set FILE] [--rate HZ]
+//                       [--max-time SECONDS] [--physics-world st|mt]
+//                       [--physics-scheduler NAME] [--physics-threads N]
+//                       [--races N [--threads N] [--jitter DISTANCE]]
+//
+// A marble set has one marble a line: name,radius,density[,restitution,friction].
+// Empty lines and lines starting with # are skipped.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "course.h"
+#include "race.h"
+#include "race_farm.h"
+#include "rng.h"
+#include "settings.h"
+
+using Clock = std::chrono::high_resolution_clock;
+
+static bool loadMarbleSet(const std::string& path, std::vector<MarbleSpec>& marbles)
+{
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Can't open marble set " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        if (line.empty() || line[0] == '#') continue;
+
+        std::vector<std::string> fields;
+        std::stringstream stream(line);
+        std::string field;
+        while (std::getline(stream, field, ',')) {
+            fields.push_back(field);
+        }
+        if (fields.size() != 3 && fields.size() != 5) {
+            std::cerr << path << ":" << lineNumber << ": expected name,radius,density[,restitution,friction]" << std::endl;
+            return false;
+        }
+
+        MarbleSpec marble;
+        marble.name = fields[0];
+        marble.radius = std::stof(fields[1]);
+        marble.density = std::stof(fields[2]);
+        if (fields.size() == 5) {
+            marble.restitution = std::stof(fields[3]);
+            marble.friction = std::stof(fields[4]);
+        }
+        marbles.push_back(marble);
+    }
+    return true;
+}
+
+static std::string jsonString(const std::string& text)
+{
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        }
+        else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+static void printFarm(uint64_t seed, const RaceFarmResult& result, const std::vector<MarbleSpec>& marbles, double rate)
+{
+    std::printf("{\n");
+    std::printf("  \"seed\": %llu,\n", static_cast<unsigned long long>(seed));
+    std::printf("  \"rate\": %g,\n", rate);
+    std::printf("  \"races\": %d,\n", result.races);
+    std::printf("  \"threads\": %d,\n", result.threads);
+    std::printf("  \"seconds\": %.3f,\n", result.seconds);
+    std::printf("  \"races_per_second\": %.3f,\n", result.racesPerSecond());
+    std::printf("  \"steals\": %zu,\n", result.steals);
+    std::printf("  \"steps\": %lld,\n", result.steps);
+    std::printf("  \"marbles\": [");
+    for (size_t i = 0; i < marbles.size(); i++) {
+        const MarbleRaceStats& stats = result.marbles[i];
+        std::printf("%s\n    { \"name\": %s, \"radius\": %g, \"density\": %g, ", i == 0 ? "" : ",",
+            jsonString(marbles[i].name).c_str(), marbles[i].radius, marbles[i].density);
+        std::printf("\"win_probability\": %.4f, \"mean_place\": %.3f, \"mean_time\": %.3f, \"unfinished\": %d, \"places\": [",
+            stats.winProbability(result.races), stats.meanPlace(), stats.meanTime(), stats.unfinished);
+        for (size_t p = 0; p < stats.places.size(); p++) {
+            std::printf("%s%d", p == 0 ? "" : ", ", stats.places[p]);
+        }
+        std::printf("] }");
+    }
+    std::printf("\n  ]\n}\n");
+}
+
+int main(int argc, char** argv)
+{
+    uint64_t seed = std::random_device{}();
+    int marbleCount = 36;
+    std::string marbleSet;
+    RaceSettings settings;
+    RaceFarmSettings farm;
+    farm.races = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--seed" && i + 1 < argc) {
+            seed = std::stoull(argv[++i]);
+        }
+        else if (arg == "--marbles" && i + 1 < argc) {
+            marbleCount = std::stoi(argv[++i]);
+        }
+        else if (arg == "--marble-set" && i + 1 < argc) {
+            marbleSet = argv[++i];
+        }
+        else if (arg == "--rate" && i + 1 < argc) {
+            settings.rate = std::stod(argv[++i]);
+        }
+        else if (arg == "--max-time" && i + 1 < argc) {
+            settings.maxTime = std::stod(argv[++i]);
+        }
+        else if (arg == "--physics-world" && i + 1 < argc) {
+            settings.world.multithreaded = std::string(argv[++i]) == "mt";
+        }
+        else if (arg == "--physics-scheduler" && i + 1 < argc) {
+            settings.world.scheduler = argv[++i];
+        }
+        else if (arg == "--physics-threads" && i + 1 < argc) {
+            settings.world.threads = std::stoi(argv[++i]);
+        }
+        else if (arg == "--races" && i + 1 < argc) {
+            farm.races = std::stoi(argv[++i]);
+        }
+        else if (arg == "--threads" && i + 1 < argc) {
+            farm.threads = std::stoi(argv[++i]);
+        }
+        else if (arg == "--jitter" && i + 1 < argc) {
+            farm.startJitter = std::stof(argv[++i]);
+        }
+        else {
+            std::cerr << "Unknown argument " << arg << std::endl;
+            return 1;
+        }
+    }
+    if (settings.rate <= 0.0) {
+        std::cerr << "Step rate must be above 0" << std::endl;
+        return 1;
+    }
+    if (TERRAIN_GROUND) {
+        std::cerr << "Terrain ground needs the heightmap textures, racing on flat ground" << std::endl;
+    }
+
+    std::vector<MarbleSpec> marbles;
+    if (!marbleSet.empty()) {
+        if (!loadMarbleSet(marbleSet, marbles)) return 1;
+    }
+    else {
+        for (int i = 0; i < marbleCount; i++) {
+            MarbleSpec marble;
+            marble.name = "Marble " + std::to_string(i + 1);
+            marbles.push_back(marble);
+        }
+    }
+
+    setGlobalSeed(seed);
+
+    auto begin = Clock::now();
+    RaceCourse course = buildRaceCourse(COURSE_START);
+    double buildMs = std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+
+    if (farm.races > 0) {
+        farm.race = settings;
+        printFarm(seed, runRaceFarm(course, marbles, farm), marbles, settings.rate);
+        return 0;
+    }
+
+    // Drop order from the seed, shuffled like createSpheres does
+    Rng rng(RNG_STREAM_MARBLE_ORDER);
+    std::shuffle(marbles.begin(), marbles.end(), rng);
+
+    std::vector<RaceEntry> entries = raceEntries(course, marbles);
+    begin = Clock::now();
+    RaceResult result = runRace(course, entries, settings);
+    double raceMs = std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+    double raceTime = result.steps / settings.rate;
+
+    std::printf("{\n");
+    std::printf("  \"seed\": %llu,\n", static_cast<unsigned long long>(seed));
+    std::printf("  \"rate\": %g,\n", settings.rate);
+    std::printf("  \"world\": \"%s\",\n", settings.world.multithreaded ? "mt" : "st");
+    std::printf("  \"marbles\": %d,\n", static_cast<int>(entries.size()));
+    std::printf("  \"complete\": %s,\n", result.complete ? "true" : "false");
+    std::printf("  \"steps\": %lld,\n", result.steps);
+    std::printf("  \"race_time\": %.4f,\n", raceTime);
+    std::printf("  \"ms_per_step\": %.4f,\n", result.stepMs);
+    std::printf("  \"build_ms\": %.2f,\n", buildMs);
+    std::printf("  \"race_ms\": %.2f,\n", raceMs);
+    std::printf("  \"realtime_factor\": %.2f,\n", raceMs > 0.0 ? raceTime * 1000.0 / raceMs : 0.0);
+    std::printf("  \"placements\": [");
+
+    // Finishers first, then those still out in drop order
+    std::vector<int> order = result.placements;
+    for (int i = 0; i < static_cast<int>(entries.size()); i++) {
+        if (result.finishTimes[i] < 0.0) order.push_back(i);
+    }
+    for (size_t i = 0; i < order.size(); i++) {
+        int entry = order[i];
+        std::printf("%s\n    { \"name\": %s, ", i == 0 ? "" : ",", jsonString(entries[entry].marble.name).c_str());
+        if (result.finishTimes[entry] >= 0.0) {
+            std::printf("\"place\": %d, \"time\": %.4f }", static_cast<int>(i) + 1, result.finishTimes[entry]);
+        }
+        else {
+            std::printf("\"place\": null, \"time\": null }");
+        }
+    }
+    std::printf("\n  ]\n}\n");
+    return 0;
+}
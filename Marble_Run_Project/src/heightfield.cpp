@@ -0,0 +1,135 @@
+#include "heightfield.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+Heightfield::Heightfield(int width, int depth, float heightScale) :
+    mWidth(width), mDepth(depth), mHeightScale(heightScale)
+{
+    // Aligned for cache lines, and so rows can be read with SIMD loads
+    size_t bytes = std::max(byteSize(), size_t(64));
+#ifdef _WIN32
+    mSamples = static_cast<short*>(_aligned_malloc(bytes, 64));
+#else
+    void* block = nullptr;
+    mSamples = posix_memalign(&block, 64, bytes) == 0 ? static_cast<short*>(block) : nullptr;
+#endif
+    if (!mSamples) {
+        std::cout << "Failed to allocate a " << width << "x" << depth << " heightfield" << std::endl;
+        mWidth = 0;
+        mDepth = 0;
+        return;
+    }
+    std::memset(mSamples, 0, bytes);
+}
+
+Heightfield::~Heightfield()
+{
+#ifdef _WIN32
+    if (mMapped) {
+        UnmapViewOfFile(mSamples);
+        CloseHandle(mMapping);
+        CloseHandle(mFile);
+    }
+    else {
+        _aligned_free(mSamples);
+    }
+#else
+    if (mMapped) {
+        munmap(mSamples, byteSize());
+    }
+    else {
+        free(mSamples);
+    }
+#endif
+}
+
+std::shared_ptr<Heightfield> Heightfield::mapRaw16(const char* path, int width, int depth, float heightScale)
+{
+    size_t expected = size_t(width) * depth * sizeof(short);
+    std::shared_ptr<Heightfield> field(new Heightfield());
+    field->mWidth = width;
+    field->mDepth = depth;
+    field->mHeightScale = heightScale;
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        std::cout << "Failed to open heightfield: " << path << std::endl;
+        return nullptr;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size_t(size.QuadPart) != expected) {
+        std::cout << "Heightfield " << path << " is not " << width << "x" << depth << " 16-bit samples" << std::endl;
+        CloseHandle(file);
+        return nullptr;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view) {
+        std::cout << "Failed to map heightfield: " << path << std::endl;
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        return nullptr;
+    }
+    field->mFile = file;
+    field->mMapping = mapping;
+#else
+    int file = open(path, O_RDONLY);
+    if (file < 0) {
+        std::cout << "Failed to open heightfield: " << path << std::endl;
+        return nullptr;
+    }
+    struct stat info;
+    if (fstat(file, &info) != 0 || size_t(info.st_size) != expected) {
+        std::cout << "Heightfield " << path << " is not " << width << "x" << depth << " 16-bit samples" << std::endl;
+        close(file);
+        return nullptr;
+    }
+    void* view = mmap(nullptr, expected, PROT_READ, MAP_PRIVATE, file, 0);
+    // The mapping keeps the file referenced
+    close(file);
+    if (view == MAP_FAILED) {
+        std::cout << "Failed to map heightfield: " << path << std::endl;
+        return nullptr;
+    }
+#endif
+
+    // Mapped views are page aligned
+    field->mSamples = static_cast<short*>(view);
+    field->mMapped = true;
+    return field;
+}
+
+void Heightfield::sampleRange(short& minSample, short& maxSample) const
+{
+    size_t count = size_t(mWidth) * mDepth;
+    if (count == 0) {
+        minSample = 0;
+        maxSample = 0;
+        return;
+    }
+    short lo = mSamples[0];
+    short hi = mSamples[0];
+    for (size_t i = 1; i < count; i++) {
+        lo = std::min(lo, mSamples[i]);
+        hi = std::max(hi, mSamples[i]);
+    }
+    minSample = lo;
+    maxSample = hi;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+// Grid of 16-bit height samples in one contiguous block, x fastest. The same samples
+// are read by CompositePlane and, through btHeightfieldTerrainShape, by Bullet.
+// Heights are sample * heightScale.
+class Heightfield {
+public:
+	// Zeroed samples in a 64-byte aligned block owned by the heightfield
+	Heightfield(int width, int depth, float heightScale);
+	~Heightfield();
+	Heightfield(const Heightfield&) = delete;
+	Heightfield& operator=(const Heightfield&) = delete;
+
+	// Maps a headerless file of width * depth little-endian signed 16-bit samples, rows
+	// along z. Nothing is read until a sample is touched. Returns nullptr when the file
+	// can't be opened or its size doesn't match.
+	static std::shared_ptr<Heightfield> mapRaw16(const char* path, int width, int depth, float heightScale);
+
+	int width() const { return mWidth; }
+	int depth() const { return mDepth; }
+	float heightScale() const { return mHeightScale; }
+	bool isMapped() const { return mMapped; }
+	size_t byteSize() const { return size_t(mWidth) * mDepth * sizeof(short); }
+
+	const short* samples() const { return mSamples; }
+	// Null for a mapped file, which is read only
+	short* writableSamples() { return mMapped ? nullptr : mSamples; }
+
+	short sample(int x, int z) const { return mSamples[size_t(z) * mWidth + x]; }
+	float height(int x, int z) const { return sample(x, z) * mHeightScale; }
+	// Lowest and highest sample, scanning the whole grid
+	void sampleRange(short& minSample, short& maxSample) const;
+
+private:
+	Heightfield() = default;
+
+	short* mSamples = nullptr;
+	int mWidth = 0;
+	int mDepth = 0;
+	float mHeightScale = 1.0f;
+	bool mMapped = false;
+	// Platform handles of a mapped file
+	void* mFile = nullptr;
+	void* mMapping = nullptr;
+};
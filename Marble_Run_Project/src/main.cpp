@@ -5,6 +5,7 @@
 #include <iostream>
 #include <map>
 #include <algorithm>
+#include <atomic>
 #include <random>
 #include <cmath>
 #include <string>
@@ -16,6 +17,7 @@
 #include <BulletDynamics/Dynamics/btDynamicsWorld.h>
 #include <btBulletDynamicsCommon.h>
 #include <BulletCollision/CollisionDispatch/btGhostObject.h>
+#include <LinearMath/btThreads.h>
 
 #include "settings.h"
 #include "Utils.h"
@@ -25,7 +27,13 @@
 #include "camera.h"
 #include "scene.h"
 #include "bulletHelpers.h"
-#include "trackSupportGenerator.h"
+#include "course.h"
+#include "course_physics.h"
+#include "physics_bench.h"
+#include "physics_thread.h"
+#include "race_farm.h"
+#include "rng.h"
+#include "memory_stats.h"
 
 #include "imgui.h"
 #include "backends/imgui_impl_glfw.h"
@@ -37,6 +45,7 @@ void processInput(GLFWwindow* window, RenderInfo& ri);
 void initRenderInfo(RenderInfo& ri);
 void loadTextures(RenderInfo& ri);
 void loadSkyboxTextures(RenderInfo& ri);
+void loadParticleAtlas(RenderInfo& ri);
 void createLights(Scene& scene);
 glm::mat4 menuSphereModelMatrix(float angle, float radius, glm::vec3 start_pos);
 void ImGuiHelpMarker(const char* desc);
@@ -49,9 +58,9 @@ void createSupportPillar(RenderInfo& ri, Scene& scene, glm::vec3 topPos, float r
 void createGround(RenderInfo& ri, Scene& scene);
 void createSphereInfo(RenderInfo& ri, Scene& scene);
 void createSpheres(RenderInfo& ri, Scene& scene, glm::vec3 pos);
-void createHalfPipeTrack(RenderInfo& ri, Scene& scene, std::vector<TrackSupport>& supports);
-void createPlinko(RenderInfo& ri, Scene& scene, glm::vec3 pos, float angle);
-void createFinishLine(RenderInfo& ri, Scene& scene, glm::vec3 pos, float angle, float halfSize, bool visualize);
+void createHalfPipeTrack(RenderInfo& ri, Scene& scene, const std::vector<TrackSupport>& supports);
+void createPlinko(RenderInfo& ri, Scene& scene, const PlinkoLayout& plinko);
+void createFinishLine(RenderInfo& ri, Scene& scene, const FinishLineLayout& finishLine, bool visualize);
 
 void createMenuWorld(RenderInfo& ri, Scene& scene);
 void createWorld(RenderInfo& ri, Scene& scene);
@@ -67,7 +76,7 @@ void drawScene(Scene& scene, Camera& camera, double dt);
 unsigned int SCR_WIDTH = SCREEN_WIDTH;
 unsigned int SCR_HEIGHT = SCREEN_HEIGHT;
 float FONT_SIZE = GUI_FONT_SIZE;
-glm::vec3 START_POS = { 0.0f, 20.0f, 0.0f };
+glm::vec3 START_POS = COURSE_START;
 
 bool PAUSED = false;
 bool P_PRESSED_LAST_FRAME = false;
@@ -79,13 +88,46 @@ Utils util = Utils();
 Material material{};
 
 
-int main()
+int main(int argc, char** argv)
 {
+    // Random seed, fixed with --seed N for reproducible runs
+    uint64_t seed = std::random_device{}();
+    PhysicsWorldOptions physicsOptions;
+    bool benchmarkPhysics = false;
+    int raceFarmRaces = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--seed" && i + 1 < argc) {
+            seed = std::stoull(argv[++i]);
+        }
+        else if (arg == "--physics-world" && i + 1 < argc) {
+            physicsOptions.multithreaded = std::string(argv[++i]) == "mt";
+        }
+        else if (arg == "--physics-scheduler" && i + 1 < argc) {
+            physicsOptions.scheduler = argv[++i];
+        }
+        else if (arg == "--physics-threads" && i + 1 < argc) {
+            physicsOptions.threads = std::stoi(argv[++i]);
+        }
+        else if (arg == "--bench-physics") {
+            benchmarkPhysics = true;
+        }
+        else if (arg == "--race-farm" && i + 1 < argc) {
+            raceFarmRaces = std::stoi(argv[++i]);
+        }
+    }
+    setGlobalSeed(seed);
+    std::cout << "Seed: " << seed << std::endl;
+
     if (!glfwInit()) {
         std::cerr << "Error initializing GLFW" << std::endl;
         return -1;
     }
 
+    // Depth format must match the particle target depth for blitting
+    glfwWindowHint(GLFW_DEPTH_BITS, 24);
+    glfwWindowHint(GLFW_STENCIL_BITS, 8);
+
     GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Marble run", NULL, NULL);
     if (!window)
     {
@@ -111,8 +153,8 @@ int main()
     resetCamera(camera, START_POS);
     ri.camera = &camera;
 
-    Scene menuScene = Scene(window);
-    Scene scene = Scene(window);
+    Scene menuScene(window);
+    Scene scene(window);
     
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
@@ -123,10 +165,17 @@ int main()
     GLuint shaderProgramSkybox = Utils::createShaderProgram("src/shader/vertexShaderSkybox.glsl", "src/shader/fragmentShaderSkybox.glsl");
     GLuint shaderProgramShadowMap = Utils::createShaderProgram("src/shader/vertexShaderShadow.glsl", "src/shader/fragmentShaderShadow.glsl");
     GLuint shaderProgramParticle = Utils::createShaderProgram("src/shader/vertexShaderParticle.glsl", "src/shader/fragmentShaderParticle.glsl");
+    GLuint shaderProgramParticleBatch = Utils::createShaderProgram("src/shader/vertexShaderParticleBatch.glsl", "src/shader/fragmentShaderParticleBatch.glsl");
+    GLuint shaderProgramParticleComposite = Utils::createShaderProgram("src/shader/vertexShaderFullscreen.glsl", "src/shader/fragmentShaderParticleComposite.glsl");
+    GLuint shaderProgramTrail = Utils::createShaderProgram("src/shader/vertexShaderTrail.glsl", "src/shader/fragmentShaderTrail.glsl");
     
     menuScene.setShaders(shaderProgramBase, shaderProgramPhong, shaderProgramSkybox, shaderProgramShadowMap);
     scene.setShaders(shaderProgramBase, shaderProgramPhong, shaderProgramSkybox, shaderProgramShadowMap);
     scene.setParticleShader(shaderProgramParticle);
+    scene.setParticleBatchShader(shaderProgramParticleBatch);
+    scene.setParticleAtlas(ri.particleAtlas);
+    scene.setParticleCompositeShader(shaderProgramParticleComposite);
+    scene.setTrailShader(shaderProgramTrail);
 
     // Skybox
     Skybox* skybox = new Skybox(ri.skyboxTexture["sky_42"]);
@@ -135,16 +184,36 @@ int main()
     scene.updateLightSpaceMatrix();
 
     // Init bullet
-    ri.bullet.pCollisionConfiguration = new btDefaultCollisionConfiguration();
-    ri.bullet.pDispatcher = new btCollisionDispatcher(ri.bullet.pCollisionConfiguration);
-    ri.bullet.pBroadphase = new btDbvtBroadphase();
-    ri.bullet.pSolver = new btSequentialImpulseConstraintSolver();
-    ri.bullet.pWorld = new btDiscreteDynamicsWorld(
-        ri.bullet.pDispatcher, ri.bullet.pBroadphase, ri.bullet.pSolver, ri.bullet.pCollisionConfiguration);
-    ri.bullet.pWorld->setGravity(btVector3(0, -9.81f, 0));
+    createBulletWorld(ri.bullet, physicsOptions);
+    // The multithreaded world steps on this thread, see PHYSICS_THREAD
+    ri.bullet.pPhysics = new PhysicsThread(ri.bullet.pWorld, PHYSICS_THREAD && !ri.bullet.pTaskScheduler);
 
     // Create shapes
     createSphereInfo(ri, scene);
+
+    // Win probabilities of the marbles, from races on the course without drawing them
+    if (raceFarmRaces > 0) {
+        std::vector<MarbleSpec> marbles;
+        for (const SphereInfo& s : ri.sphereinfo) {
+            marbles.push_back({ s.description, s.radius, s.density, s.restitution, s.friction });
+        }
+        RaceFarmSettings farm;
+        farm.races = raceFarmRaces;
+        farm.race.world = physicsOptions;
+        printRaceFarm(runRaceFarm(buildRaceCourse(START_POS), marbles, farm), marbles);
+        scene.mTrails.release();
+        menuScene.mTrails.release();
+        glfwTerminate();
+        return 0;
+    }
+    if (benchmarkPhysics) {
+        createWorld(ri, scene);
+        benchPhysics(ri.bullet.pWorld, physicsOptions, { START_POS.x, START_POS.y, START_POS.z });
+        scene.mTrails.release();
+        menuScene.mTrails.release();
+        glfwTerminate();
+        return 0;
+    }
     createMenuWorld(ri, menuScene);
     // createShapes(ri, scene);
 
@@ -169,13 +238,17 @@ int main()
     glDeleteProgram(shaderProgramSkybox);
     glDeleteProgram(shaderProgramShadowMap);
     glDeleteProgram(shaderProgramParticle);
+    glDeleteProgram(shaderProgramParticleBatch);
+    glDeleteProgram(shaderProgramParticleComposite);
+    glDeleteProgram(shaderProgramTrail);
+    delete ri.particleAtlas;
+    meshCache().clear();
+    scene.mTrails.release();
+    menuScene.mTrails.release();
 
     // Shutdown bullet
-    delete ri.bullet.pWorld;
-    delete ri.bullet.pSolver;
-    delete ri.bullet.pBroadphase;
-    delete ri.bullet.pDispatcher;
-    delete ri.bullet.pCollisionConfiguration;
+    delete ri.bullet.pPhysics;
+    destroyBulletWorld(ri.bullet);
 
     // Cleanup
     ImGui_ImplOpenGL3_Shutdown();
@@ -215,12 +288,26 @@ void initRenderInfo(RenderInfo& ri)
 
     loadTextures(ri);
     loadSkyboxTextures(ri);
+    loadParticleAtlas(ri);
+}
+
+void loadParticleAtlas(RenderInfo& ri)
+{
+    // Same images as the particle textures, so emitters keep using ri.texture
+    ri.particleAtlas = new ParticleAtlas();
+    for (const char* name : { "particle", "particle_star1", "particle_star2", "particle_star3" }) {
+        std::string path = std::string("src/textures/") + name + ".png";
+        ri.particleAtlas->addImage(ri.texture[name], path.c_str());
+    }
 }
 
 void loadTextures(RenderInfo& ri)
 {
     //ri.texture["heightmap_1"] = Utils::loadTexture("src/textures/heightmaps/heightmap_1.png");
     //ri.texture["heightmap_2"] = Utils::loadTexture("src/textures/heightmaps/heightmap_2.png");
+    if (TERRAIN_GROUND) {
+        ri.heightMap["heightmap_1"] = Utils::loadHeightMap("src/Textures/Heightmaps/heightmap_1.png");
+    }
 
     ri.texture["particle"] = Utils::loadTexture("src/textures/particle.png");
     ri.texture["particle_star1"] = Utils::loadTexture("src/textures/particle_star1.png");
@@ -368,22 +455,19 @@ void gameLogic(RenderInfo& ri, Scene& scene, Scene& menuScene)
     else {
         ri.camera->mAcceptInput = true;
         drawScene(scene, *ri.camera, ri.time.dt);
-        ri.bullet.pWorld->stepSimulation(float(ri.time.dt));
+        ri.bullet.pPhysics->setRunning(!PAUSED);
+        const PhysicsSnapshot& snapshot = ri.bullet.pPhysics->update(ri.time.dt);
         static int placement = 1;
 
-        // Placement
-        int numOverlapping = ri.finishLine->getNumOverlappingObjects();
-        for (int i = 0; i < numOverlapping; i++) {
-            btCollisionObject* otherObject = ri.finishLine->getOverlappingObject(i);
-            btRigidBody* otherBody = btRigidBody::upcast(otherObject);
-            if (!otherBody) continue;
-
+        // Placement, in the order the physics side saw marbles reach the finish line.
+        // Falling off is handled there too, see setRespawn.
+        for (const btCollisionObject* otherObject : snapshot.finishOrder) {
             // Find iterator to current sphere
             auto it = std::find_if(
                 ri.sphereinfo.begin(),
                 ri.sphereinfo.end(),
-                [otherBody](const SphereInfo& info) {
-                    return info.pBody == otherBody;
+                [otherObject](const SphereInfo& info) {
+                    return info.pBody == otherObject;
                 }
             );
             if (it == ri.sphereinfo.end()) continue;
@@ -395,26 +479,6 @@ void gameLogic(RenderInfo& ri, Scene& scene, Scene& menuScene)
                 leaderboard.push_back(sphere.player ? "**Player**" : sphere.description);
             }
         }
-
-        // Sphere fell off
-        for (SphereInfo& sphere : ri.sphereinfo) {
-            btRigidBody* pBody = sphere.pBody;
-            if (pBody == nullptr) continue;
-
-            btTransform trans;
-            pBody->getMotionState()->getWorldTransform(trans);
-
-            btVector3 pos = trans.getOrigin();
-            btScalar y_pos = pos.getY();
-            
-            if (y_pos < 0.2f) {
-                // Teleport back to start
-                glm::vec3 pos = START_POS;
-                trans.setOrigin({pos.x, pos.y, pos.z});
-                pBody->setWorldTransform(trans);
-                pBody->setLinearVelocity({0.0, 1.0 ,0.0});
-            }
-        }
     }
 }
 
@@ -460,12 +524,63 @@ void createTorch(RenderInfo& ri, Scene& scene, glm::vec3 pos)
 
     scene.addPointLight(torchLight, false);
 
-    Emitter* flameEmitter = new FlameEmitter(400, 0.7f, radius * 1.2, radius * 0.4f, ri.texture["particle"]);
-    flameEmitter->setPosition({ pos.x, pos.y + height, pos.z });
-    scene.addEmitter(flameEmitter);
+    glm::vec3 emitterPos = { pos.x, pos.y + height, pos.z };
+
+    auto createFlame = [&]() {
+        return new FlameEmitter(400, 0.7f, radius * 1.2, radius * 0.4f, ri.texture["particle"]);
+    };
+    auto createSmoke = [&]() {
+        return new SmokeEmitter(100, 2.0f, radius * 1.2, radius * 0.3f, ri.texture["particle"]);
+    };
+
+    // Far away torches are drawn from a flipbook, baked once per emitter type
+    if (!ri.flipbook.count("torch_flame")) {
+        Emitter* bakeFlame = createFlame();
+        ri.flipbook["torch_flame"] = scene.bakeFlipbook(bakeFlame);
+        delete bakeFlame;
+
+        Emitter* bakeSmoke = createSmoke();
+        ri.flipbook["torch_smoke"] = scene.bakeFlipbook(bakeSmoke);
+        delete bakeSmoke;
+    }
+
+    Emitter* flameEmitter = createFlame();
+    flameEmitter->setPosition(emitterPos);
+    flameEmitter->setLod(true, ri.flipbook["torch_flame"]);
+
+    Emitter* smokeEmitter = createSmoke();
+    smokeEmitter->setPosition(emitterPos);
+    smokeEmitter->setLod(true, ri.flipbook["torch_smoke"]);
+
+    if (EMITTER_TEMPLATES) {
+        // A few phase shifted sources shared by all torches, each torch picks one and a rotation
+        if (!ri.emitterTemplates.count("torch_flame")) {
+            for (int i = 0; i < EMITTER_TEMPLATE_VARIANTS; i++) {
+                float phase = float(i) / EMITTER_TEMPLATE_VARIANTS;
+
+                Emitter* flame = createFlame();
+                flame->simulate((1.0f + phase) * flame->mParticleLifetime);
+                scene.addEmitterTemplate(flame);
+                ri.emitterTemplates["torch_flame"].push_back(flame);
+
+                Emitter* smoke = createSmoke();
+                smoke->simulate((1.0f + phase) * smoke->mParticleLifetime);
+                scene.addEmitterTemplate(smoke);
+                ri.emitterTemplates["torch_smoke"].push_back(smoke);
+            }
+        }
 
-    Emitter* smokeEmitter = new SmokeEmitter(100, 2.0f, radius * 1.2, radius * 0.3f, ri.texture["particle"]);
-    smokeEmitter->setPosition({ pos.x, pos.y + height, pos.z });
+        int variant = static_cast<int>(flameEmitter->random(0.0f, float(EMITTER_TEMPLATE_VARIANTS))) % EMITTER_TEMPLATE_VARIANTS;
+        float rotation = flameEmitter->random(0.0f, 2.0f * glm::pi<float>());
+        flameEmitter->setTemplate(ri.emitterTemplates["torch_flame"][variant], rotation);
+        smokeEmitter->setTemplate(ri.emitterTemplates["torch_smoke"][variant], rotation);
+    }
+    else {
+        flameEmitter->setAnalytic(ANALYTIC_PARTICLES);
+        smokeEmitter->setAnalytic(ANALYTIC_PARTICLES);
+    }
+
+    scene.addEmitter(flameEmitter);
     scene.addEmitter(smokeEmitter);
 }
 
@@ -484,10 +599,20 @@ void createSupportPillar(RenderInfo& ri, Scene& scene, glm::vec3 topPos, float r
 
 void createGround(RenderInfo& ri, Scene& scene)
 {
-    btQuaternion q = quatFromYawPitchRoll(0.0f, 0.0f, 0.0f);
-    btCollisionShape* groundShape = new btStaticPlaneShape(btVector3(0, 1, 0), 0);
-    btRigidBody* planeRigidBody = createStaticRigidBody(
-        groundShape, { 0, 0, 0 }, q, 0.6f, 0.5f);
+    std::shared_ptr<Heightfield> heightfield = TERRAIN_GROUND ? ri.heightMap["heightmap_1"] : nullptr;
+    btRigidBody* terrainRigidBody = heightfield ? createTerrainRigidBody(
+        heightfield, { 100, TERRAIN_GROUND_HEIGHT / COMPOSITE_PLANE_HEIGHT, 100 }, { 0, 0, 0 }, 0.6f, 0.5f) : nullptr;
+    if (terrainRigidBody) {
+        ri.bullet.pWorld->addRigidBody(terrainRigidBody);
+
+        // Not given the body, Bullet moves its origin to the middle of the height range
+        Terrain* terrain = new Terrain(heightfield, { 100, TERRAIN_GROUND_HEIGHT / COMPOSITE_PLANE_HEIGHT, 100 }, ri.texture["grass"]);
+        terrain->castShadow(false);
+        scene.addTerrain(terrain);
+        return;
+    }
+
+    btRigidBody* planeRigidBody = createGroundRigidBody();
 
     ri.bullet.pWorld->addRigidBody(planeRigidBody);
 
@@ -564,194 +689,93 @@ void createSpheres(RenderInfo& ri, Scene& scene, glm::vec3 pos)
     std::vector<SphereInfo>& sphereinfo = ri.sphereinfo;
 
     // Shuffle spheres
-    std::random_device rd;
-    std::mt19937 g(rd());
-    std::shuffle(std::begin(sphereinfo), std::end(sphereinfo), g);
+    static Rng rng(RNG_STREAM_MARBLE_ORDER);
+    std::shuffle(std::begin(sphereinfo), std::end(sphereinfo), rng);
 
     // Place spheres in world
-    int numSpheres = sphereinfo.size();
-    int numX = 3;
-    int numY = 5;
-    int numZ = 3;
-    float sphereDist = 0.5;
-    float xOffset = -(sphereDist * (numX - 1)) / 2.0f;
-    float zOffset = -(sphereDist * (numZ - 1)) / 2.0f;
-    float xPos, yPos, zPos;
-
-    for (int i = 0; i < numY; i++) {
-        for (int j = 0; j < numZ; j++) {
-            for (int k = 0; k < numX; k++)
-            {
-                int sId = (i * numX * numZ) + (j * numZ) + k;
-
-                if (sId >= numSpheres) return;
-                SphereInfo& s = sphereinfo[sId];
-
-                xPos = pos.x + xOffset + (k * sphereDist);
-                yPos = pos.y + (i * sphereDist);
-                zPos = pos.z + zOffset + (j * sphereDist);
-
-                float mass = s.density * (4.0 / 3.0) * M_PI * std::pow(s.radius, 3.0);
-
-                btRigidBody* sphereRigidBody = createMarbleRigidBody(
-                    mass, s.radius, { xPos, yPos, zPos }, s.restitution, s.friction);
-
-                ri.bullet.pWorld->addRigidBody(sphereRigidBody);
-                s.pBody = sphereRigidBody;
-
-                Shape* sphere = new Sphere(s.radius, 40, 40);
-                sphere->setMaterial(s.material);
-                if (s.texture) {
-                    sphere->useTexture(s.texture);
-                }
-                if (s.player) {
-                    ri.camera->setPBody(sphereRigidBody);
+    std::vector<glm::vec3> positions = marbleStartPositions(pos, static_cast<int>(sphereinfo.size()));
+    for (size_t i = 0; i < sphereinfo.size(); i++) {
+        SphereInfo& s = sphereinfo[i];
 
-                    Emitter* trailEmitter = new TrailEmitter(0.1f, 10.0f, s.radius * 0.5f, ri.texture["particle_star1"]);
-                    trailEmitter->setPBody(sphereRigidBody);
-                    scene.addEmitter(trailEmitter);
-                }
-                sphere->setPBody(sphereRigidBody);
-                scene.addPhongShape(sphere);
-            }
+        btRigidBody* sphereRigidBody = createMarbleRigidBody(
+            { s.description, s.radius, s.density, s.restitution, s.friction }, positions[i]);
+
+        ri.bullet.pWorld->addRigidBody(sphereRigidBody);
+        s.pBody = sphereRigidBody;
+
+        Shape* sphere = new Sphere(s.radius, 40, 40);
+        sphere->setMaterial(s.material);
+        if (s.texture) {
+            sphere->useTexture(s.texture);
         }
+        // Every marble leaves a trail in its own color, the player's stands out
+        if (s.player) {
+            ri.camera->setPBody(sphereRigidBody);
+            scene.mTrails.addTrail(sphereRigidBody, s.radius, { 1.0f, 0.0f, 0.0f, 0.7f });
+        }
+        else {
+            glm::vec4 trailColor = s.material.diffuse;
+            trailColor.a = 0.3f;
+            scene.mTrails.addTrail(sphereRigidBody, s.radius * 0.6f, trailColor);
+        }
+        sphere->setPBody(sphereRigidBody);
+        scene.addPhongShape(sphere);
     }
 }
 
-void createHalfPipeTrack(RenderInfo& ri, Scene& scene, std::vector<TrackSupport>& supports)
+void createHalfPipeTrack(RenderInfo& ri, Scene& scene, const std::vector<TrackSupport>& supports)
 {
-    Shape* track = new HalfPipeTrack(supports);
+    HalfPipeTrack* track = new HalfPipeTrack(supports);
 
-    btQuaternion q = quatFromYawPitchRoll(0.0f, 0.0f, 0.0f);
-    btTriangleMesh* trackMesh = createBtTriangleMesh(track);
-    btRigidBody* trackRigidBody = createStaticRigidBody(
-        trackMesh,
-        { 0, 0, 0 }, q, 
-        TRACK_RESTITUTION, TRACK_FRICTION);
+    btRigidBody* trackRigidBody = createTrackRigidBody(track->mMesh);
 
     ri.bullet.pWorld->addRigidBody(trackRigidBody);
 
     track->useTexture(ri.texture["wood"]);
     track->setPBody(trackRigidBody);
     scene.addPhongShape(track);
+    ri.tracks.push_back(track);
 }
 
-void createPlinko(RenderInfo& ri, Scene& scene, glm::vec3 pos, float angle)
+void createPlinko(RenderInfo& ri, Scene& scene, const PlinkoLayout& plinko)
 {
-    float length = 8.0f;
-    float width = 4.0f;
-    float height = 0.5f;
-    float thicknes = 0.1f;
-    float radius = 0.05f;
-    float tilt = 10.0f;
-
-    glm::mat4 modelMatrix = glm::mat4(1.0f);
-    glm::mat4 modelMatrixLocal = glm::mat4(1.0f);   // local offset
-    btTransform tLocal;                             // local offset bt
-    btCompoundShape* compound = new btCompoundShape();
+    const PlinkoParts& parts = plinkoParts();
 
     // Global offset
-    modelMatrix = glm::translate(modelMatrix, pos);
-    modelMatrix = glm::rotate(modelMatrix, glm::radians(-angle), { 0.0f, 1.0f, 0.0f });
-    modelMatrix = glm::rotate(modelMatrix, glm::radians(tilt), { 1.0f, 0.0f, 0.0f });
-
-    // base board
-    Shape* box1 = new Box(width, thicknes, length);
-    modelMatrixLocal = glm::mat4(1.0f);
-    box1->setModelMatrix(modelMatrix * modelMatrixLocal);
-    box1->useTexture(ri.texture["wood"]);
-    scene.addPhongShape(box1);
-
-    btCollisionShape* btBox1 = new btBoxShape(btVector3(width / 2.0f, thicknes / 2.0f, length / 2.0f));
-    tLocal.setIdentity();
-    tLocal.setOrigin(btVector3(0, 0, 0));
-    compound->addChildShape(tLocal, btBox1);
-
-
-    // right wall
-    Shape* box2 = new Box(thicknes, height, length);
-    modelMatrixLocal = glm::mat4(1.0f);
-    modelMatrixLocal = glm::translate(modelMatrixLocal, { 
-        (width/2.0f - thicknes/2.0f), (height/2.0f + thicknes / 2.0f), 0.0f
-        });
-
-    box2->setModelMatrix(modelMatrix * modelMatrixLocal);
-    box2->useTexture(ri.texture["wood"]);
-    scene.addPhongShape(box2);
-
-    btCollisionShape* btBox2 = new btBoxShape(btVector3(thicknes / 2.0f, height / 2.0f, length / 2.0f));
-    tLocal.setIdentity();
-    tLocal.setOrigin(btVector3((width / 2.0f - thicknes / 2.0f), (height / 2.0f + thicknes / 2.0f), 0.0f));
-    compound->addChildShape(tLocal, btBox2);
-
-
-    // left wall
-    Shape* box3 = new Box(thicknes, height, length);
-    modelMatrixLocal = glm::mat4(1.0f);
-    modelMatrixLocal = glm::translate(modelMatrixLocal, {
-        -(width / 2.0f - thicknes / 2.0f), (height / 2.0f + thicknes / 2.0f), 0.0f
-        });
-
-    box3->setModelMatrix(modelMatrix * modelMatrixLocal);
-    box3->useTexture(ri.texture["wood"]);
-    scene.addPhongShape(box3);
-
-    btCollisionShape* btBox3 = new btBoxShape(btVector3(thicknes / 2.0f, height / 2.0f, length / 2.0f));
-    tLocal.setIdentity();
-    tLocal.setOrigin(btVector3(-(width / 2.0f - thicknes / 2.0f), (height / 2.0f + thicknes / 2.0f), 0.0f));
-    compound->addChildShape(tLocal, btBox3);
+    glm::mat4 modelMatrix = glm::mat4(1.0f);
+    modelMatrix = glm::translate(modelMatrix, plinko.pos);
+    modelMatrix = glm::rotate(modelMatrix, glm::radians(-plinko.angle), { 0.0f, 1.0f, 0.0f });
+    modelMatrix = glm::rotate(modelMatrix, glm::radians(parts.tilt), { 1.0f, 0.0f, 0.0f });
+
+    // base board and walls
+    for (const PlinkoBox& part : parts.boxes) {
+        Shape* box = new Box(part.size.x, part.size.y, part.size.z);
+        box->setModelMatrix(glm::translate(modelMatrix, part.center));
+        box->useTexture(ri.texture["wood"]);
+        scene.addPhongShape(box);
+    }
 
     // pillar obstacles
-    int numRows = 10;
-    int pillarsPerRow = 7;
-    float pillarDist = 0.625;
-    float xOffsetEven = -(pillarDist * (pillarsPerRow - 1)) / 2.0;
-    float xOffsetOdd = -(pillarDist * (pillarsPerRow - 2)) / 2.0;
-    float xOffset;
-    float zOffset = -(pillarDist * (numRows - 1)) / 2.0;
-    float xPos, zPos;
-    float yPos = (height / 2.0f + thicknes / 2.01f);
-
-    for (int i = 0; i < numRows; i++) {
-        if (i % 2 == 0) {
-            xOffset = xOffsetEven;
-        }
-        else {
-            xOffset = xOffsetOdd;
-        }
-        for (int j = 0; j < pillarsPerRow-(i % 2); j++) {
-            Shape* pillar = new Cylinder(radius, height, 20);
-            xPos = xOffset + (j * pillarDist);
-            zPos = zOffset + (i * pillarDist);
-
-            modelMatrixLocal = glm::mat4(1.0f);
-            modelMatrixLocal = glm::translate(modelMatrixLocal, { xPos, yPos, zPos });
-
-            pillar->setModelMatrix(modelMatrix * modelMatrixLocal);
-            pillar->setMaterial(material.silver);
-            scene.addPhongShape(pillar);
-
-            btCollisionShape* btPillar = new btCylinderShape({ radius, height / 2.0f , radius });
-            tLocal.setIdentity();
-            tLocal.setOrigin(btVector3(xPos, yPos, zPos));
-            compound->addChildShape(tLocal, btPillar);
-        }
+    for (const PlinkoPeg& peg : parts.pegs) {
+        Shape* pillar = new Cylinder(peg.radius, peg.height, 20);
+        pillar->setModelMatrix(glm::translate(modelMatrix, peg.center));
+        pillar->setMaterial(material.silver);
+        scene.addPhongShape(pillar);
     }
 
     // Add to bullet world
-    btQuaternion q = quatFromYawPitchRoll(0.0f, -angle, tilt);
-    btRigidBody* body = createStaticRigidBody(compound, { pos.x, pos.y, pos.z }, q, PLINKO_RESTITUTION, PLINKO_FRICTION);
-    ri.bullet.pWorld->addRigidBody(body);
+    ri.bullet.pWorld->addRigidBody(createPlinkoRigidBody(plinko));
 }
 
-void createFinishLine(RenderInfo& ri, Scene& scene, glm::vec3 pos, float angle, float halfSize, bool visualize)
+void createFinishLine(RenderInfo& ri, Scene& scene, const FinishLineLayout& finishLine, bool visualize)
 {
     // test box
     if (visualize) {
-        Shape* testBox = new Box(halfSize * 2, halfSize * 2, halfSize * 2);
+        float size = finishLine.halfSize * 2;
+        Shape* testBox = new Box(size, size, size);
         glm::mat4 modelMatrix = glm::mat4(1.0f);
-        modelMatrix = glm::translate(modelMatrix, pos);
-        modelMatrix = glm::rotate(modelMatrix, glm::radians(-angle), { 0.0f, 1.0f, 0.0f });
+        modelMatrix = glm::translate(modelMatrix, finishLine.pos);
+        modelMatrix = glm::rotate(modelMatrix, glm::radians(-finishLine.angle), { 0.0f, 1.0f, 0.0f });
 
         testBox->setModelMatrix(modelMatrix);
         //testBox->useTexture(ri.texture["rock"]);
@@ -759,20 +783,7 @@ void createFinishLine(RenderInfo& ri, Scene& scene, glm::vec3 pos, float angle,
         scene.addPhongShape(testBox);
     }
 
-    btQuaternion q = quatFromYawPitchRoll(0.0f, -angle, 0.0f);
-    btVector3 finishLinePos = btVector3(pos.x, pos.y, pos.z);
-
-    btGhostObject* ghostObject = new btGhostObject();
-
-    ghostObject->setCollisionShape(new btBoxShape(btVector3(halfSize, halfSize, halfSize)));
-    ghostObject->setWorldTransform(btTransform(q, finishLinePos));
-    ghostObject->setCollisionFlags(ghostObject->getCollisionFlags() | btCollisionObject::CF_NO_CONTACT_RESPONSE);
-
-    ri.bullet.pWorld->addCollisionObject(ghostObject, btBroadphaseProxy::SensorTrigger, btBroadphaseProxy::DefaultFilter);
-
-    ri.bullet.pWorld->getBroadphase()->getOverlappingPairCache()->setInternalGhostPairCallback(new btGhostPairCallback());
-
-    ri.finishLine = ghostObject;
+    ri.finishLine = createFinishLine(ri.bullet.pWorld, finishLine);
 }
 
 void createMenuWorld(RenderInfo& ri, Scene& scene)
@@ -798,193 +809,25 @@ void createMenuWorld(RenderInfo& ri, Scene& scene)
 
 void createWorld(RenderInfo& ri, Scene& scene)
 {
-    // Track turn: 90 deg -> 10 segments
-
-    glm::vec3 sphereStartPos = START_POS;
-    glm::vec3 pillarPos;
-    float nextAngle = 0.0f;
-    glm::vec3 nextPos = {
-        sphereStartPos.x,
-        sphereStartPos.y,
-        sphereStartPos.z - 2.0f,
-    };
-
-    std::vector<TrackSupport> supports;
-    TrackSupportGenerator trackGenerator = TrackSupportGenerator();
+    CourseLayout course = buildCourseLayout(START_POS);
 
+    // Bodies in the order the headless simulator adds them, so both step the same world
     createGround(ri, scene);
-    createSpheres(ri, scene, sphereStartPos);
-    
-    // Track 1
-    createTorch(ri, scene, { 
-        nextPos.x + 1.95f, 
-        nextPos.y - 0.05f, 
-        nextPos.z + 0.05f
-        });
-    createTorch(ri, scene, {
-        nextPos.x - 1.95f,
-        nextPos.y - 0.05f,
-        nextPos.z + 0.05f
-        });
-
-    trackGenerator.newTrack(
-        nextPos.x, nextPos.y, nextPos.z,
-        nextAngle, 1.9f, 2.0f);
-    trackGenerator.forward(4.0f, -2.0f, 1.9f, 2.0f);
-    pillarPos = trackGenerator.getLastPos();
-    pillarPos.y -= 1.95f;
-    createSupportPillar(ri, scene, pillarPos, 0.2f);
-    trackGenerator.forward(4.0f, -1.8f, 0.9f, 1.0f);
-
-    trackGenerator.turn(-180.0f, 4.0f, -1.2f, 20);
-
-    supports = trackGenerator.getSupports();
-    createHalfPipeTrack(ri, scene, supports);
-
-    pillarPos = trackGenerator.getLastPos();
-    pillarPos.y -= 0.95f;
-    pillarPos.z += 0.2f;
-    createSupportPillar(ri, scene, pillarPos, 0.2f);
-
-    // Plinko 1
-    nextPos = trackGenerator.nextModuleCenter(8.0f, 10.0f);
-    nextAngle = supports.back().angle;
-    createPlinko(ri, scene, { nextPos.x, nextPos.y, nextPos.z }, nextAngle);
-
-    // Track 2a & 2b
-    nextPos = trackGenerator.nextModuleCenter(16.0f, 10.0f); // After plinko
-    
-    trackGenerator.newTrack(
-        nextPos.x, nextPos.y, nextPos.z, nextAngle);
-    trackGenerator.forward(0.9f);
-
-    nextPos = trackGenerator.getLastPos(); // + offset
-    pillarPos = nextPos;
-    pillarPos.y -= 0.95f;
-    createSupportPillar(ri, scene, pillarPos, 0.2f);
-
-    // Track 2a
-    trackGenerator.newTrack(
-        nextPos.x, nextPos.y, nextPos.z,
-        nextAngle + 90.0f,
-        0.9f, 1.0f);
-    trackGenerator.forward(2.0f, -0.1f, 0.9f, 1.0f);
-    trackGenerator.turn(-135.0f, 3.0f, -1.0f, 13);
-
-    pillarPos = trackGenerator.getLastPos();
-    pillarPos.y -= 0.95f;
-    createSupportPillar(ri, scene, pillarPos, 0.2f);
-    
-    trackGenerator.forward(3.0f, -1.0f, 0.4f, 0.5f);
-    trackGenerator.turn(720.0f, 3.0f, -4.0f, 80, 0.4f, 0.5f);
-
-    pillarPos = trackGenerator.getLastPos();
-    pillarPos.y -= 0.45f;
-    createSupportPillar(ri, scene, pillarPos, 0.2f);
-    
-    trackGenerator.forward(1.0f, -0.2f, 0.3f, 0.4f);
-
-    supports = trackGenerator.getSupports();
-    createHalfPipeTrack(ri, scene, supports);
-
-    glm::vec3 pos2a = trackGenerator.getLastPos();
-
-    // Track 2b
-    trackGenerator.newTrack(
-        nextPos.x, nextPos.y, nextPos.z,
-        nextAngle - 90.0f,
-        0.9f, 1.0f);
-    trackGenerator.forward(2.0f, -0.1f, 0.9f, 1.0f);
-    trackGenerator.turn(135.0f, 3.0f, -1.0f, 13);
-
-    pillarPos = trackGenerator.getLastPos();
-    pillarPos.y -= 0.95f;
-    createSupportPillar(ri, scene, pillarPos, 0.2f);
-
-    trackGenerator.forward(3.0f, -1.0f, 0.4f, 0.5f);
-    trackGenerator.turn(-720.0f, 3.0f, -4.0f, 80, 0.4f, 0.5f);
-
-    pillarPos = trackGenerator.getLastPos();
-    pillarPos.y -= 0.45f;
-    createSupportPillar(ri, scene, pillarPos, 0.2f);
-
-    trackGenerator.forward(1.0f, -0.2f, 0.3f, 0.4f);
-
-    supports = trackGenerator.getSupports();
-    createHalfPipeTrack(ri, scene, supports);
-
-    glm::vec3 pos2b = trackGenerator.getLastPos();
-
-    // Track 3
-    nextPos = (pos2a + pos2b) * 0.5f;
-    nextPos.y -= 0.5f;
-
-    trackGenerator.newTrack(
-        nextPos.x, nextPos.y, nextPos.z,
-        nextAngle,
-        0.9f, 1.0f);
-    trackGenerator.forward(6.0f, -1.0f, 0.9f, 1.0f);
-
-    pillarPos = trackGenerator.getLastPos();
-    pillarPos.y -= 0.95f;
-    createSupportPillar(ri, scene, pillarPos, 0.2f);
-
-    trackGenerator.turn(-180.0f, 8, -2.0f, 20, 0.9f, 1.0f);
-
-    pillarPos = trackGenerator.getLastPos();
-    pillarPos.y -= 0.95f;
-    createSupportPillar(ri, scene, pillarPos, 0.2f);
-
-    trackGenerator.forward(8.0f, -0.5f, 0.4f, 0.5f);
-    trackGenerator.forward(0.5f, 0.1f, 0.4f, 0.5f);
-    trackGenerator.forward(0.5f, 0.2f, 0.4f, 0.5f);
-
-    supports = trackGenerator.getSupports();
-    createHalfPipeTrack(ri, scene, supports);
-
-    pillarPos = trackGenerator.getLastPos();
-
-    // Finish line
-    float lastRadius = 0.5f;
-    float finishAngle = supports.back().angle;
-
-    trackGenerator.forward(lastRadius + 0.1f);
-    glm::vec3 finishPos = trackGenerator.getLastPos();
-
-    createFinishLine(ri, scene, finishPos, finishAngle, lastRadius, false);
-
-    pillarPos.x += 1.1f;
-    createTorch(ri, scene, pillarPos);
-    createSupportPillar(ri, scene, pillarPos, 0.1f);
-
-    pillarPos.x -= 2.2f;
-    createTorch(ri, scene, pillarPos);
-    createSupportPillar(ri, scene, pillarPos, 0.1f);
-
-    // Landing area after race
-    trackGenerator.forward(0.0f, -0.5f);
-    nextPos = trackGenerator.getLastPos();
-    nextAngle = finishAngle;
-
-    trackGenerator.newTrack(
-        nextPos.x, nextPos.y, nextPos.z,
-        nextAngle, 0.9f, 1.0f);
-    trackGenerator.forward(10.0f, -1.0f, 0.2f, 0.3f);
-
-    pillarPos = trackGenerator.getLastPos();
-    pillarPos.y -= 0.25f;
-    createSupportPillar(ri, scene, pillarPos, 0.2f);
-
-    trackGenerator.forward(20.0f, 0.0f, 0.2f, 0.3f);
-
-    pillarPos = trackGenerator.getLastPos();
-    pillarPos.y -= 0.25f;
-    createSupportPillar(ri, scene, pillarPos, 0.2f);
-
-    trackGenerator.forward(4.0f, 1.2f, 0.2f, 0.3f);
+    createSpheres(ri, scene, course.start);
+    for (const std::vector<TrackSupport>& supports : course.tracks) {
+        createHalfPipeTrack(ri, scene, supports);
+    }
+    for (const PlinkoLayout& plinko : course.plinkos) {
+        createPlinko(ri, scene, plinko);
+    }
+    createFinishLine(ri, scene, course.finishLine, false);
 
-    supports = trackGenerator.getSupports();
-    createHalfPipeTrack(ri, scene, supports);
+    for (const PillarLayout& pillar : course.pillars) {
+        createSupportPillar(ri, scene, pillar.top, pillar.radius);
+    }
+    for (const glm::vec3& torch : course.torches) {
+        createTorch(ri, scene, torch);
+    }
 }
 
 void createShapes(RenderInfo& ri, Scene& scene)
@@ -1152,6 +995,91 @@ void animate(GLFWwindow* window, RenderInfo& ri, Scene& scene, Scene& menuScene)
                 ImGui::SliderFloat("Shadow area", &scene.mShadowAreaSize, 10.0f, 100.0f);
             }
 
+            ImGui::Spacing();
+            ImGui::Spacing();
+            if (ImGui::CollapsingHeader("Particles", ImGuiTreeNodeFlags_DefaultOpen)) {
+                ImGui::Checkbox("Depth sort", &scene.mSortParticles);
+                ImGui::Combo("Resolution", &scene.mParticleResolution, "Full\0Half\0Quarter\0");
+                ImGui::Text("Batched particles: %d", static_cast<int>(scene.mParticleBatch.size()));
+                ImGui::Text("Emitter LOD near/mid/far/hidden: %d/%d/%d/%d",
+                    scene.mLodCounts[0], scene.mLodCounts[1], scene.mLodCounts[2], scene.mLodCounts[3]);
+            }
+
+            ImGui::Spacing();
+            ImGui::Spacing();
+            if (ImGui::CollapsingHeader("Physics")) {
+                const PhysicsThread& physics = *ri.bullet.pPhysics;
+                const PhysicsSnapshot& snapshot = physics.snapshot();
+                ImGui::Text("Fixed step: %.1f Hz, up to %d a frame", 1.0 / physics.step(), physics.maxSubSteps());
+                ImGui::Text("Stepping on: %s", physics.isThreaded() ? "physics thread" : "render thread");
+                if (ri.bullet.pTaskScheduler) {
+                    ImGui::Text("World: multithreaded, %s on %d threads", ri.bullet.pTaskScheduler->getName(),
+                        ri.bullet.pTaskScheduler->getNumThreads());
+                }
+                else {
+                    ImGui::Text("World: single threaded");
+                }
+                ImGui::Text("Steps: %lld", snapshot.steps);
+                ImGui::Text("Last step: %.3f ms", snapshot.stepMs);
+                ImGui::Text("Dropped time: %.2f s", snapshot.droppedTime);
+            }
+
+            if (!scene.mTerrains.empty()) {
+                ImGui::Spacing();
+                ImGui::Spacing();
+                if (ImGui::CollapsingHeader("Terrain")) {
+                    Terrain* terrain = scene.mTerrains.front();
+                    ImGui::SliderFloat("LOD distance", &terrain->mLodDistance, 1.0f, 100.0f);
+                    ImGui::Text("Chunks drawn: %d of %d", terrain->mDrawnChunks, terrain->chunkCount());
+                    ImGui::Text("Triangles: %d", static_cast<int>(terrain->mDrawnTriangles));
+                }
+            }
+
+            ImGui::Spacing();
+            ImGui::Spacing();
+            if (ImGui::CollapsingHeader("Track editor") && !ri.tracks.empty()) {
+                static int trackIdx = 0;
+                static int supportIdx = 0;
+                static std::atomic<double> editMs{ 0.0 };
+                // Last edit the physics side hasn't applied yet
+                static uint64_t pendingEdit = 0;
+                static HalfPipeTrack* pendingTrack = nullptr;
+                static int pendingSupport = 0;
+
+                ImGui::SliderInt("Track", &trackIdx, 0, static_cast<int>(ri.tracks.size()) - 1);
+                HalfPipeTrack* track = ri.tracks[trackIdx];
+                int lastSupport = static_cast<int>(track->getSupports().size()) - 1;
+                supportIdx = std::min(supportIdx, lastSupport);
+                ImGui::SliderInt("Support", &supportIdx, 0, lastSupport);
+
+                TrackSupport support = track->getSupports()[supportIdx];
+                bool changed = ImGui::DragFloat3("Position", &support.x, 0.01f);
+                changed |= ImGui::DragFloat("Angle", &support.angle, 0.5f);
+                changed |= ImGui::DragFloat("Width", &support.outerRadius, 0.01f, 0.2f, 3.0f);
+                ImGui::SameLine(); ImGuiHelpMarker("Outer radius, the wall keeps its thickness");
+
+                // A non-procedural track uploads the rewritten mesh once the physics side is done
+                // with it, and takes no new edit until then
+                if (pendingEdit != 0 && ri.bullet.pPhysics->snapshot().commandsApplied >= pendingEdit) {
+                    pendingTrack->uploadSupport(pendingSupport);
+                    pendingEdit = 0;
+                }
+                if (changed && (track->isProcedural() || pendingEdit == 0)) {
+                    TrackSupport old = track->getSupports()[supportIdx];
+                    support.innerRadius = support.outerRadius - (old.outerRadius - old.innerRadius);
+
+                    std::function<void(btCollisionWorld*)> edit = track->moveSupport(supportIdx, support);
+                    pendingEdit = ri.bullet.pPhysics->submit([edit](btDynamicsWorld* world) {
+                        double editStart = glfwGetTime();
+                        edit(world);
+                        editMs = (glfwGetTime() - editStart) * 1000.0;
+                    });
+                    pendingTrack = track;
+                    pendingSupport = supportIdx;
+                }
+                ImGui::Text("Last edit: %.3f ms", editMs.load());
+            }
+
             ImGui::Spacing();
             ImGui::Spacing();
             if (ImGui::CollapsingHeader("Controls", ImGuiTreeNodeFlags_DefaultOpen)) {
@@ -1239,7 +1167,19 @@ void animate(GLFWwindow* window, RenderInfo& ri, Scene& scene, Scene& menuScene)
                         ri.sphereinfo[selectedSphereIdx].density = sphereDensity;
                         ri.camera->captureMouse();
 
+                        size_t memoryBefore = currentMemoryBytes();
+                        double buildStart = glfwGetTime();
                         createWorld(ri, scene);
+                        std::cout << "World built in " << (glfwGetTime() - buildStart) * 1000.0 << " ms" << std::endl;
+                        meshCache().printStats();
+                        scene.printVertexStats();
+                        scene.printCollisionStats();
+                        std::cout << "World added " << (static_cast<long long>(currentMemoryBytes()) - static_cast<long long>(memoryBefore)) / 1024 << " KiB" << std::endl;
+
+                        // The world is built, physics can take over
+                        ri.bullet.pPhysics->setFinishLine(ri.finishLine);
+                        ri.bullet.pPhysics->setRespawn(MARBLE_RESPAWN_HEIGHT, { START_POS.x, START_POS.y, START_POS.z });
+                        ri.bullet.pPhysics->start();
 
                         // Set camera
                         //moveCamera(*ri.camera,
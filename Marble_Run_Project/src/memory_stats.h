@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstddef>
+
+// Process memory in bytes, 0 where the platform doesn't report it.
+// Current is the working set / resident size, peak its high-water mark.
+size_t currentMemoryBytes();
+size_t peakMemoryBytes();
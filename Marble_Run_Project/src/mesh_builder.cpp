@@ -0,0 +1,1242 @@
+#include "mesh_builder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <glm/gtc/packing.hpp>
+
+static const float PI = acos(-1.0f);
+
+size_t MeshData::byteSize() const
+{
+    return (positions.size() + uvs.size() + normals.size()) * sizeof(float)
+        + indices.size() * sizeof(unsigned int);
+}
+
+VertexLayout chooseVertexLayout(const MeshData& mesh, bool octahedralNormals, float halfRange)
+{
+    VertexLayout layout;
+    layout.octahedralNormals = octahedralNormals;
+    layout.halfPositions = std::all_of(mesh.positions.begin(), mesh.positions.end(),
+        [halfRange](float p) { return std::abs(p) <= halfRange; });
+    return layout;
+}
+
+glm::vec2 encodeOctahedral(glm::vec3 n)
+{
+    // Project onto the octahedron |x| + |y| + |z| = 1 and fold the lower half over the upper
+    n /= std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    glm::vec2 e(n.x, n.y);
+    if (n.z < 0.0f) {
+        e.x = (1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+        e.y = (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return e;
+}
+
+std::vector<unsigned char> packVertices(const MeshData& mesh, const VertexLayout& layout)
+{
+    return packVertices(mesh, layout, 0, mesh.vertexCount());
+}
+
+std::vector<unsigned char> packVertices(const MeshData& mesh, const VertexLayout& layout, size_t first, size_t count)
+{
+    const int stride = layout.stride();
+    std::vector<unsigned char> data(count * stride);
+
+    for (size_t i = first; i < first + count; i++) {
+        unsigned char* v = &data[(i - first) * stride];
+        glm::vec3 p(mesh.positions[i * 3], mesh.positions[i * 3 + 1], mesh.positions[i * 3 + 2]);
+        glm::vec3 n(mesh.normals[i * 3], mesh.normals[i * 3 + 1], mesh.normals[i * 3 + 2]);
+        glm::vec2 uv(mesh.uvs[i * 2], mesh.uvs[i * 2 + 1]);
+
+        if (layout.halfPositions) {
+            uint32_t xy = glm::packHalf2x16(glm::vec2(p.x, p.y));
+            uint32_t zw = glm::packHalf2x16(glm::vec2(p.z, 1.0f));
+            std::memcpy(v, &xy, 4);
+            std::memcpy(v + 4, &zw, 4);
+        }
+        else {
+            std::memcpy(v, &p[0], 12);
+        }
+
+        uint32_t normal = layout.octahedralNormals
+            ? glm::packSnorm2x16(encodeOctahedral(n))
+            : glm::packSnorm3x10_1x2(glm::vec4(n, 0.0f));
+        std::memcpy(v + layout.normalOffset(), &normal, 4);
+
+        uint32_t texCoord = glm::packHalf2x16(uv);
+        std::memcpy(v + layout.uvOffset(), &texCoord, 4);
+    }
+    return data;
+}
+
+MeshData buildBox(float sizeX, float sizeY, float sizeZ)
+{
+    const float x = sizeX / 2.0f;
+    const float y = sizeY / 2.0f;
+    const float z = sizeZ / 2.0f;
+
+    std::vector<float> vertices = {
+        // Front face
+        -x, -y,  z,   
+        -x, -y, -z,   
+        -x,  y, -z,   
+        -x,  y,  z,   
+
+        // Back face
+         x, -y, -z,   
+         x, -y,  z,   
+         x,  y,  z,   
+         x,  y, -z,   
+
+        // Right face
+         x, -y,  z,   
+        -x, -y,  z,   
+        -x,  y,  z,   
+         x,  y,  z,   
+
+        // Left face
+        -x, -y, -z,  
+         x, -y, -z,  
+         x,  y, -z,  
+        -x,  y, -z,  
+
+        // Top face
+        -x,  y,  z,  
+        -x,  y, -z,  
+         x,  y, -z,  
+         x,  y,  z,  
+
+        // Bottom face
+         x, -y, -z,  
+         x, -y,  z,  
+        -x, -y,  z,  
+        -x, -y, -z,  
+    };
+
+    std::vector<float> textureUVs{
+        1.0, 0.0, 0.0, 0.0, 0.0, 1.0, 1.0, 1.0,
+        1.0, 0.0, 0.0, 0.0, 0.0, 1.0, 1.0, 1.0,
+        1.0, 0.0, 0.0, 0.0, 0.0, 1.0, 1.0, 1.0,
+        1.0, 0.0, 0.0, 0.0, 0.0, 1.0, 1.0, 1.0,
+        1.0, 0.0, 0.0, 0.0, 0.0, 1.0, 1.0, 1.0,
+        1.0, 0.0, 0.0, 0.0, 0.0, 1.0, 1.0, 1.0,
+
+    };
+
+    std::vector<float> normals = {
+        // Front face
+        -1.0f, 0.0f, 0.0f, 
+        -1.0f, 0.0f, 0.0f,
+        -1.0f, 0.0f, 0.0f, 
+        -1.0f, 0.0f, 0.0f,
+        // Back face
+        1.0f, 0.0f, 0.0f,
+        1.0f, 0.0f, 0.0f,
+        1.0f, 0.0f, 0.0f,
+        1.0f, 0.0f, 0.0f,
+        // Right face
+        0.0f, 0.0f, 1.0f,
+        0.0f, 0.0f, 1.0f,
+        0.0f, 0.0f, 1.0f,
+        0.0f, 0.0f, 1.0f,
+        // Left face
+        0.0f, 0.0f, -1.0f,
+        0.0f, 0.0f, -1.0f,
+        0.0f, 0.0f, -1.0f,
+        0.0f, 0.0f, -1.0f,
+        // Top face
+        0.0f, 1.0f, 0.0f,
+        0.0f, 1.0f, 0.0f,
+        0.0f, 1.0f, 0.0f,
+        0.0f, 1.0f, 0.0f,
+        // Bottom face
+        0.0f, -1.0f, 0.0f,
+        0.0f, -1.0f, 0.0f,
+        0.0f, -1.0f, 0.0f,
+        0.0f, -1.0f, 0.0f,
+    };
+
+    std::vector<unsigned int> indices = {
+        // Front face
+        0, 2, 1,
+        2, 0, 3,
+        // Back face
+        4, 6, 5,
+        6, 4, 7,
+        // Right face
+        8, 10, 9,
+        10, 8, 11,
+        // Left face
+        12, 14, 13,
+        14, 12, 15,
+        // Top face
+        16, 18, 17,
+        18, 16, 19,
+        // Bottom face
+        20, 21, 22,
+        22, 23, 20,
+    };
+
+    return { std::move(vertices), std::move(textureUVs), std::move(normals), std::move(indices) };
+}
+
+
+
+MeshData buildPyramid(float sizeX, float height, float sizeZ)
+{
+    const float x = sizeX / 2.0f;
+    const float h = height / 2.0f;
+    const float z = sizeZ / 2.0f;
+
+    std::vector<float> vertices = {
+        // Side 1
+        -x, -h, -z,
+         x, -h, -z,
+         0,  h,  0,
+
+        // Side 2
+         x, -h, -z,
+         x, -h,  z,
+         0,  h,  0,
+
+        // Side 3
+         x, -h, z, 
+        -x, -h, z, 
+         0,  h, 0, 
+
+        // Side 4 
+        -x, -h,  z,
+        -x, -h, -z,
+         0,  h,  0,
+
+        // Bottom    
+         x, -h, -z,
+         x, -h,  z,
+        -x, -h,  z,
+        -x, -h, -z,
+    };
+
+    std::vector<float> textureUVs = {
+        1.0, 0.0,
+        0.0, 0.0,
+        0.5, 1.0,
+
+        1.0, 0.0,
+        0.0, 0.0,
+        0.5, 1.0,
+
+        1.0, 0.0,
+        0.0, 0.0,
+        0.5, 1.0,
+
+        1.0, 0.0,
+        0.0, 0.0,
+        0.5, 1.0,
+
+        0.0, 0.0,
+        0.0, 1.0,
+        1.0, 1.0,
+        1.0, 0.0,
+    };
+
+    glm::vec3 n1 = glm::normalize(glm::cross(glm::vec3(0, height, z), glm::vec3(1, 0, 0) ));
+    glm::vec3 n2 = glm::normalize(glm::cross(glm::vec3(-x, height, 0), glm::vec3(0, 0, 1) ));
+    glm::vec3 n3 = glm::normalize(glm::cross(glm::vec3(0, height, -z), glm::vec3(-1, 0, 0) ));
+    glm::vec3 n4 = glm::normalize(glm::cross(glm::vec3(x, height, 0), glm::vec3(0, 0, -1) ));
+ 
+    std::vector<float> normals = {
+        n1.x, n1.y, n1.z,
+        n1.x, n1.y, n1.z,
+        n1.x, n1.y, n1.z,
+
+        n2.x, n2.y, n2.z,
+        n2.x, n2.y, n2.z,
+        n2.x, n2.y, n2.z,
+
+        n3.x, n3.y, n3.z,
+        n3.x, n3.y, n3.z,
+        n3.x, n3.y, n3.z,
+
+        n4.x, n4.y, n4.z,
+        n4.x, n4.y, n4.z,
+        n4.x, n4.y, n4.z,
+
+        0.0, -1.0, 0.0,
+        0.0, -1.0, 0.0,
+        0.0, -1.0, 0.0,
+        0.0, -1.0, 0.0,
+    };
+
+    std::vector<unsigned int> indices = {
+        // Sides
+        0, 2, 1,
+        3, 5, 4,
+        6, 8, 7,
+        9, 11, 10,
+        // Bottom
+        12, 13, 14,
+        14, 15, 12,
+    };
+
+    return { std::move(vertices), std::move(textureUVs), std::move(normals), std::move(indices) };
+}
+
+
+
+MeshData buildPlane(float sizeX, float sizeZ)
+{
+    const float x = sizeX / 2.0f;
+    const float z = sizeZ / 2.0f;
+
+    std::vector<float> vertices = {  
+             x, 0.0f, -z,
+             x, 0.0f,  z,
+            -x, 0.0f,  z,
+            -x, 0.0f, -z,
+    };
+
+    std::vector<float> textureUVs = {
+        0.0, 0.0,
+        0.0, 1.0,
+        1.0, 1.0,
+        1.0, 0.0,
+    };
+
+    std::vector<float> normals = {
+        0.0, 1.0, 0.0,
+        0.0, 1.0, 0.0,
+        0.0, 1.0, 0.0,
+        0.0, 1.0, 0.0,
+    };
+
+    std::vector<unsigned int> indices = {
+        0, 2, 1,
+        2, 0, 3,
+    };
+
+    return { std::move(vertices), std::move(textureUVs), std::move(normals), std::move(indices) };
+}
+
+
+
+MeshData buildCompositePlane(int width, int depth, const Heightfield* heightfield)
+{
+    std::vector<float> vertices;
+    std::vector<float> textureUVs;
+    std::vector<float> normals;
+    std::vector<unsigned int> indices;
+
+    const float x_to_z_ratio = static_cast<float>(depth) / width;
+    const float scale = COMPOSITE_PLANE_HEIGHT;
+    const bool useHeights = heightfield && heightfield->width() == width && heightfield->depth() == depth;
+    if (width < 2 || depth < 2) {
+        return {};
+    }
+
+    vertices.reserve(size_t(width) * depth * 3);
+    textureUVs.reserve(size_t(width) * depth * 2);
+    normals.reserve(size_t(width) * depth * 3);
+    indices.reserve(size_t(width - 1) * (depth - 1) * 6);
+
+    // Rows along z, so the heightfield is read in memory order
+    for (int z = 0; z < depth; z++) {
+        for (int x = 0; x < width; x++) {
+
+            float u = (x / float(width - 1));
+            float v = (z / float(depth - 1));
+
+            float height = useHeights ? heightfield->height(x, z) * scale : 0.0f;
+
+            vertices.push_back(u - 0.5f);
+            vertices.push_back(height);
+            vertices.push_back((v - 0.5f) * x_to_z_ratio);
+
+            // UV
+            textureUVs.push_back(1-u); // Mirror texture the correct way
+            textureUVs.push_back(v);
+
+            normals.push_back(0.0f);
+            normals.push_back(1.0f);
+            normals.push_back(0.0f);
+        }
+    }
+
+    for (int z = 0; z < depth - 1; z++) {
+        for (int x = 0; x < width - 1; x++) {
+
+            int start = z * width + x;
+
+            indices.push_back(start);
+            indices.push_back(start + width);
+            indices.push_back(start + 1);
+
+            indices.push_back(start + width);
+            indices.push_back(start + width + 1);
+            indices.push_back(start + 1);
+        }
+    }
+
+    return { std::move(vertices), std::move(textureUVs), std::move(normals), std::move(indices) };
+}
+
+
+
+MeshData buildSphere(float radius, int sectors, int stacks)
+{
+    std::vector<float> vertices;
+    std::vector<float> textureUVs;
+    std::vector<float> normals;
+    std::vector<unsigned int> indices;
+
+    float x, y, z, xy;                              // vertex position
+    float nx, ny, nz;                               // normal
+    float lengthInv = 1.0f / radius;
+    float u, v;
+
+    const float sectorStep = 2 * PI / sectors;
+    const float stackStep = PI / stacks;
+    float sectorAngle, stackAngle;
+
+    for (int i = 0; i <= stacks; ++i) {
+        stackAngle = PI / 2 - i * stackStep;        // starting from pi/2 to -pi/2
+        xy = radius * cosf(stackAngle);             // r * cos(u)
+        z = radius * sinf(stackAngle);              // r * sin(u)
+
+        // add (sectorCount+1) vertices per stack
+        // the first and last vertices have same position and normal, but different tex coords
+        for (int j = 0; j <= sectors; ++j) {
+            sectorAngle = j * sectorStep;           // starting from 0 to 2pi
+
+            // vertex position
+            x = xy * cosf(sectorAngle);             // r * cos(u) * cos(v)
+            y = xy * sinf(sectorAngle);             // r * cos(u) * sin(v)
+
+            vertices.push_back(x);
+            vertices.push_back(y);
+            vertices.push_back(z);
+
+            // normalized vertex normal
+            nx = x * lengthInv;
+            ny = y * lengthInv;
+            nz = z * lengthInv;
+
+            normals.push_back(nx);
+            normals.push_back(ny);
+            normals.push_back(nz);
+
+            // vertex tex coord between [0, 1]
+            u = (float)j / sectors;
+            v = (float)i / stacks;
+
+            textureUVs.push_back(1-u);
+            textureUVs.push_back(v);
+        }
+    }
+
+    // indices
+    //  k1--k1+1
+    //  |  / |
+    //  | /  |
+    //  k2--k2+1
+    unsigned int k1, k2;
+    for (int i = 0; i < stacks; ++i) {
+        k1 = i * (sectors + 1);     // beginning of current stack
+        k2 = k1 + sectors + 1;      // beginning of next stack
+
+        for (int j = 0; j < sectors; ++j, ++k1, ++k2) {
+            if (i != 0) {
+                indices.push_back(k1);
+                indices.push_back(k2);
+                indices.push_back(k1 + 1);
+            }
+            if (i != (stacks - 1)) {
+                indices.push_back(k1 + 1);
+                indices.push_back(k2);
+                indices.push_back(k2 + 1);
+            }
+        }
+    }
+
+    return { std::move(vertices), std::move(textureUVs), std::move(normals), std::move(indices) };
+}
+
+
+
+MeshData buildCylinder(float radius, float height, int sectors, int uvRepeat)
+{
+    std::vector<float> vertices;
+    std::vector<float> textureUVs;
+    std::vector<float> normals;
+    std::vector<unsigned int> indices;
+
+    if (uvRepeat <= 0) {
+        uvRepeat = std::max(int(height / (2 * radius)), 1);
+    }
+
+    const float h = height / 2;
+
+    float x, z;                                     // vertex position
+    float nx, ny, nz;                               // normal
+    float u, v;                                     // texCoord
+
+    const float sectorStep = 2 * PI / sectors;
+    float sectorAngle;
+
+    // Outer shell:
+    for (int i = 0; i <= sectors; ++i) {
+        float sectorAngle = i * sectorStep;
+
+        float cosA = cosf(sectorAngle);
+        float sinA = sinf(sectorAngle);
+        x = radius * cosA;
+        z = radius * sinA;
+        nx = cosA;
+        ny = 0.0f;
+        nz = sinA;
+
+        // Top - bottom
+        vertices.insert(vertices.end(), {
+            x, h, z,
+            x, -h, z
+            });
+
+        normals.insert(normals.end(), { nx, ny, nz, nx, ny, nz });
+
+        u = (float)i / sectors;
+        textureUVs.insert(textureUVs.end(), { u, 1.0f * uvRepeat, u, 0.0f });
+
+    }
+
+    for (int i = 0; i < sectors; ++i) {
+        int k1 = i * 2;
+        int k2 = k1 + 2;
+
+        indices.push_back(k1);
+        indices.push_back(k2);
+        indices.push_back(k1 + 1);
+
+        indices.push_back(k2);
+        indices.push_back(k2 + 1);
+        indices.push_back(k1 + 1);
+    }
+
+    // Top circle:
+    int topCenterIndex = vertices.size() / 3;
+    vertices.push_back(0.0f); 
+    vertices.push_back(h); 
+    vertices.push_back(0.0f);
+
+    normals.push_back(0.0f); 
+    normals.push_back(1.0f); 
+    normals.push_back(0.0f);
+
+    textureUVs.push_back(0.5f); 
+    textureUVs.push_back(0.5f);
+
+    for (int i = 0; i <= sectors; ++i) {
+        float sectorAngle = i * sectorStep;
+        float cosA = cosf(sectorAngle);
+        float sinA = sinf(sectorAngle);
+        x = radius * cosA;
+        z = radius * sinA;
+
+        vertices.push_back(x);
+        vertices.push_back(h);
+        vertices.push_back(z);
+
+        normals.push_back(0.0f);
+        normals.push_back(1.0f);
+        normals.push_back(0.0f);
+
+        textureUVs.push_back((cosA + 1.0f) * 0.5f);
+        textureUVs.push_back((sinA + 1.0f) * 0.5f);
+    }
+
+    for (int i = 0; i < sectors; ++i) {
+        indices.push_back(topCenterIndex);
+        indices.push_back(topCenterIndex + i + 2);
+        indices.push_back(topCenterIndex + i + 1);
+    }
+
+    // Bottom circle:
+    int bottomCenterIndex = vertices.size() / 3;
+
+    vertices.push_back(0.0f); 
+    vertices.push_back(-h); 
+    vertices.push_back(0.0f);
+
+    normals.push_back(0.0f); 
+    normals.push_back(-1.0f); 
+    normals.push_back(0.0f);
+
+    textureUVs.push_back(0.5f); 
+    textureUVs.push_back(0.5f);
+
+    for (int i = 0; i <= sectors; ++i) {
+        float sectorAngle = i * sectorStep;
+        float cosA = cos(sectorAngle);
+        float sinA = sin(sectorAngle);
+        x = radius * cosA;
+        z = radius * sinA;
+
+        vertices.push_back(x);
+        vertices.push_back(-h);
+        vertices.push_back(z);
+
+        normals.push_back(0.0f);
+        normals.push_back(-1.0f);
+        normals.push_back(0.0f);
+
+        textureUVs.push_back((cosA + 1.0f) * 0.5f);
+        textureUVs.push_back((sinA + 1.0f) * 0.5f);
+    }
+
+    for (int i = 0; i < sectors; ++i) {
+        indices.push_back(bottomCenterIndex);
+        indices.push_back(bottomCenterIndex + i + 1);
+        indices.push_back(bottomCenterIndex + i + 2);
+    }
+
+    return { std::move(vertices), std::move(textureUVs), std::move(normals), std::move(indices) };
+}
+
+
+
+MeshData buildHalfPipe(float innerRadius, float outerRadius, float length, int sectors)
+{
+    std::vector<float> vertices;
+    std::vector<float> textureUVs;
+    std::vector<float> normals;
+    std::vector<unsigned int> indices;
+
+    int uvRepeat = std::max(int(length / (2*outerRadius)), 1);
+
+    const float rInner = innerRadius;
+    const float rOuter = outerRadius;
+    const float halfLength = length / 2.0f;
+
+    float xIn, xOut, yIn, yOut;                     // vertex position
+    float nx, ny, nz;                               // normal
+    const float uvInner = rInner / rOuter;          // uv distance for inner curve [0 to 1]
+
+    const float sectorStep = PI / sectors;
+    unsigned int startIndex;
+
+    // Inner curve
+    startIndex = vertices.size() / 3;
+    nz = 0.0f;
+    for (int i = 0; i <= sectors; ++i) {
+        float sectorAngle = PI + i * sectorStep;    // starting from pi to 2*pi
+
+        float cosA = cosf(sectorAngle);
+        float sinA = sinf(sectorAngle);
+        xIn = rInner * cosA;
+        yIn = rInner * sinA;
+        nx = -cosA;
+        ny = -sinA;
+
+        // front - back
+        vertices.push_back(xIn);
+        vertices.push_back(yIn);
+        vertices.push_back(-halfLength);
+
+        vertices.push_back(xIn);
+        vertices.push_back(yIn);
+        vertices.push_back(halfLength);
+
+        normals.insert(normals.end(), { nx, ny, nz, nx, ny, nz });
+
+        textureUVs.insert(textureUVs.end(), {
+        (cosA * uvInner + 1.0f) * 0.5f, 0.0f,
+        (sinA * uvInner + 1.0f) * 0.5f, 1.0f * uvRepeat,
+            });
+    }
+    for (int i = 0; i < sectors; ++i) {
+        int k1 = i * 2 + startIndex;
+        int k2 = k1 + 2;
+
+        indices.push_back(k1);
+        indices.push_back(k1 + 1);
+        indices.push_back(k2);
+
+        indices.push_back(k2);
+        indices.push_back(k1 + 1);
+        indices.push_back(k2 + 1);
+    }
+
+
+    // Outer curve
+    startIndex = vertices.size() / 3;
+    for (int i = 0; i <= sectors; ++i) {
+        float sectorAngle = PI + i * sectorStep;
+    
+        float cosA = cosf(sectorAngle);
+        float sinA = sinf(sectorAngle);
+        xOut = rOuter * cosA;
+        yOut = rOuter * sinA;
+        nx = cosA;
+        ny = sinA;
+
+        // front - back
+        vertices.push_back(xOut);
+        vertices.push_back(yOut);
+        vertices.push_back(-halfLength);
+
+        vertices.push_back(xOut);
+        vertices.push_back(yOut);
+        vertices.push_back(halfLength);
+
+        normals.insert(normals.end(), { nx, ny, nz, nx, ny, nz });
+
+        textureUVs.insert(textureUVs.end(), {
+        (cosA + 1.0f) * 0.5f, 0.0f,
+        (sinA + 1.0f) * 0.5f, 1.0f * uvRepeat,
+            });
+    }
+    for (int i = 0; i < sectors; ++i) {
+        int k1 = i * 2 + startIndex;
+        int k2 = k1 + 2;
+
+        indices.push_back(k1);
+        indices.push_back(k2);
+        indices.push_back(k1 + 1);
+
+        indices.push_back(k2);
+        indices.push_back(k2 + 1);
+        indices.push_back(k1 + 1);
+    }
+
+    // Front face
+    startIndex = vertices.size() / 3;
+    nx = 0;
+    ny = 0;
+    nz = -1.0f;
+    for (int i = 0; i <= sectors; ++i) {
+        float sectorAngle = PI + i * sectorStep;
+
+        float cosA = cosf(sectorAngle);
+        float sinA = sinf(sectorAngle);
+        xIn = rInner * cosA;
+        yIn = rInner * sinA;
+        xOut = rOuter * cosA;
+        yOut = rOuter * sinA;
+
+        // inner - outer
+        vertices.push_back(xIn);
+        vertices.push_back(yIn);
+        vertices.push_back(-halfLength);
+
+        vertices.push_back(xOut);
+        vertices.push_back(yOut);
+        vertices.push_back(-halfLength);
+
+        normals.insert(normals.end(), { nx, ny, nz, nx, ny, nz });
+
+        textureUVs.push_back((cosA * uvInner + 1.0f) * 0.5f);
+        textureUVs.push_back((sinA * uvInner + 1.0f) * 0.5f);
+        textureUVs.push_back((cosA + 1.0f) * 0.5f);
+        textureUVs.push_back((sinA + 1.0f) * 0.5f);
+    }
+    for (int i = 0; i < sectors; ++i) {
+        int k1 = i * 2 + startIndex;
+        int k2 = k1 + 2;
+
+        indices.push_back(k1);
+        indices.push_back(k2);
+        indices.push_back(k1 + 1);
+
+        indices.push_back(k2);
+        indices.push_back(k2 + 1);
+        indices.push_back(k1 + 1);
+    }
+
+    // Back face
+    startIndex = vertices.size() / 3;
+    nx = 0;
+    ny = 0;
+    nz = 1.0f;
+    for (int i = 0; i <= sectors; ++i) {
+        float sectorAngle = PI + i * sectorStep;
+
+        float cosA = cosf(sectorAngle);
+        float sinA = sinf(sectorAngle);
+        xIn = rInner * cosA;
+        yIn = rInner * sinA;
+        xOut = rOuter * cosA;
+        yOut = rOuter * sinA;
+
+        // inner - outer
+        vertices.push_back(xIn);
+        vertices.push_back(yIn);
+        vertices.push_back(halfLength);
+
+        vertices.push_back(xOut);
+        vertices.push_back(yOut);
+        vertices.push_back(halfLength);
+
+        normals.insert(normals.end(), { nx, ny, nz, nx, ny, nz });
+
+        textureUVs.push_back((cosA * uvInner + 1.0f) * 0.5f);
+        textureUVs.push_back((sinA * uvInner + 1.0f) * 0.5f);
+        textureUVs.push_back((cosA + 1.0f) * 0.5f);
+        textureUVs.push_back((sinA + 1.0f) * 0.5f);
+    }
+    for (int i = 0; i < sectors; ++i) {
+        int k1 = i * 2 + startIndex;
+        int k2 = k1 + 2;
+
+        indices.push_back(k1);
+        indices.push_back(k1 + 1);
+        indices.push_back(k2);
+
+        indices.push_back(k2);
+        indices.push_back(k1 + 1);
+        indices.push_back(k2 + 1);
+    }
+
+    // Squares
+    startIndex = vertices.size() / 3;
+    nx = 0;
+    ny = 1.0f;
+    nz = 0;
+
+    vertices.insert(vertices.end(), { 
+        -rOuter, 0.0f, -halfLength,
+        -rInner, 0.0f, -halfLength,
+        -rInner, 0.0f, halfLength,
+        -rOuter, 0.0f, halfLength,
+
+        rInner, 0.0f, -halfLength,
+        rOuter, 0.0f, -halfLength,
+        rOuter, 0.0f, halfLength,
+        rInner, 0.0f, halfLength,
+        });
+
+    normals.insert(normals.end(), { 
+        nx, ny, nz,
+        nx, ny, nz,
+        nx, ny, nz,
+        nx, ny, nz,
+
+        nx, ny, nz,
+        nx, ny, nz,
+        nx, ny, nz,
+        nx, ny, nz,
+        });
+
+    textureUVs.insert(textureUVs.end(), {
+        1.0f, 0.0f,
+        uvInner, 0.0f,
+        uvInner, 1.0f * uvRepeat,
+        1.0f, 1.0f * uvRepeat,
+
+        1.0f - uvInner, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 1.0f * uvRepeat,
+        1.0f - uvInner, 1.0f * uvRepeat,
+        });
+
+    indices.insert(indices.end(), {
+        startIndex, startIndex + 3, startIndex + 2,
+        startIndex, startIndex + 2, startIndex + 1,
+
+        startIndex+4, startIndex + 7, startIndex + 6,
+        startIndex+4, startIndex + 6, startIndex + 5,
+        });
+
+    return { std::move(vertices), std::move(textureUVs), std::move(normals), std::move(indices) };
+}
+
+
+
+// Every segment has the same layout: inner curve, outer curve, then the two rim squares
+size_t trackSegmentVertexCount(int sectors) { return 4 * (sectors + 1) + 8; }
+size_t trackSegmentIndexCount(int sectors) { return 12 * sectors + 12; }
+size_t trackFaceVertexCount(int sectors) { return 2 * (sectors + 1); }
+size_t trackFaceIndexCount(int sectors) { return 6 * sectors; }
+
+// Whole texture repeats along a segment, about one per track width
+static int trackSegmentUvRepeat(const TrackSupport& s1, const TrackSupport& s2)
+{
+    float length = std::sqrt(std::pow(s2.x - s1.x, 2) + std::pow(s2.y - s1.y, 2) + std::pow(s2.z - s1.z, 2));
+    return std::max(int(length / (s1.outerRadius + s2.outerRadius)), 1);
+}
+
+template <typename T>
+static void put(T*& out, std::initializer_list<T> values)
+{
+    out = std::copy(values.begin(), values.end(), out);
+}
+
+// Writes one segment between two supports to preallocated arrays, numbering vertices from baseVertex
+static void fillTrackSegment(const TrackSupport& s1, const TrackSupport& s2, int sectors, unsigned int baseVertex,
+    float* vertices, float* textureUVs, float* normals, unsigned int* indices)
+{
+    float xIn1, xOut1, yIn1, yOut1, zIn1, zOut1;        // vertex position for s1
+    float xIn2, xOut2, yIn2, yOut2, zIn2, zOut2;        // vertex position for s2
+    float nx, ny, nz;                                   // normal
+
+    const float sectorStep = PI / sectors;
+    unsigned int startIndex;
+
+    float cosR1 = cosf(glm::radians(s1.angle));
+    float cosR2 = cosf(glm::radians(s2.angle));
+    float sinR1 = sinf(glm::radians(s1.angle));
+    float sinR2 = sinf(glm::radians(s2.angle));
+
+    float rInner1 = s1.innerRadius;
+    float rInner2 = s2.innerRadius;
+    float rOuter1 = s1.outerRadius;
+    float rOuter2 = s2.outerRadius;
+
+    float uvInner1 = rInner1 / rOuter1;                 // uv distance for inner curve [0 to 1]
+    float uvInner2 = rInner2 / rOuter2;
+
+    int uvRepeat = trackSegmentUvRepeat(s1, s2);
+
+    // Inner curve
+    startIndex = baseVertex;
+    for (int i = 0; i <= sectors; ++i) {
+        float sectorAngle = PI + i * sectorStep;    // starting from pi to 2*pi
+
+        float cosA = cosf(sectorAngle);
+        float sinA = sinf(sectorAngle);
+
+        xIn1 = s1.x + (rInner1 * cosA * cosR1);
+        yIn1 = s1.y + (rInner1 * sinA);
+        zIn1 = s1.z + (rInner1 * cosA * sinR1);
+
+        xIn2 = s2.x + (rInner2 * cosA * cosR2);
+        yIn2 = s2.y + (rInner2 * sinA);
+        zIn2 = s2.z + (rInner2 * cosA * sinR2);
+
+        nx = -cosA * cosR1;
+        ny = -sinA;
+        nz = -cosA * sinR1;
+
+        put(vertices, {
+            xIn1, yIn1, zIn1,
+            xIn2, yIn2, zIn2,
+        });
+
+        put(normals, { nx, ny, nz, nx, ny, nz });
+
+        put(textureUVs, {
+            (cosA * uvInner1 + 1.0f) * 0.5f, 0.0f,
+            (sinA * uvInner2 + 1.0f) * 0.5f, 1.0f * uvRepeat,
+        });
+    }
+    for (int i = 0; i < sectors; ++i) {
+        unsigned int k1 = i * 2 + startIndex;
+        unsigned int k2 = k1 + 2;
+
+        put(indices, {
+            k1, k1 + 1, k2,
+            k2, k1 + 1, k2 + 1,
+        });
+    }
+
+    // Outer curve
+    startIndex = baseVertex + 2 * (sectors + 1);
+    for (int i = 0; i <= sectors; ++i) {
+        float sectorAngle = PI + i * sectorStep;    // starting from pi to 2*pi
+
+        float cosA = cosf(sectorAngle);
+        float sinA = sinf(sectorAngle);
+
+        xOut1 = s1.x + (rOuter1 * cosA * cosR1);
+        yOut1 = s1.y + (rOuter1 * sinA);
+        zOut1 = s1.z + (rOuter1 * cosA * sinR1);
+
+        xOut2 = s2.x + (rOuter2 * cosA * cosR2);
+        yOut2 = s2.y + (rOuter2 * sinA);
+        zOut2 = s2.z + (rOuter2 * cosA * sinR2);
+
+        nx = cosA * cosR1;
+        ny = sinA;
+        nz = cosA * sinR1;
+
+        put(vertices, {
+            xOut1, yOut1, zOut1,
+            xOut2, yOut2, zOut2,
+        });
+
+        put(normals, { nx, ny, nz, nx, ny, nz });
+
+        put(textureUVs, {
+            (cosA + 1.0f) * 0.5f, 0.0f,
+            (sinA + 1.0f) * 0.5f, 1.0f * uvRepeat,
+        });
+    }
+    for (int i = 0; i < sectors; ++i) {
+        unsigned int k1 = i * 2 + startIndex;
+        unsigned int k2 = k1 + 2;
+
+        put(indices, {
+            k1, k2, k1 + 1,
+            k2, k2 + 1, k1 + 1,
+        });
+    }
+
+    // Squares
+    startIndex = baseVertex + 4 * (sectors + 1);
+    nx = 0;
+    ny = 1.0f;
+    nz = 0;
+
+    put(vertices, {
+        s1.x + (-rOuter1 * cosR1),
+        s1.y, 
+        s1.z + (-rOuter1 * sinR1),
+        s1.x + (-rInner1 * cosR1),
+        s1.y,
+        s1.z + (-rInner1 * sinR1),
+        s2.x + (-rInner2 * cosR2),
+        s2.y,
+        s2.z + (-rInner2 * sinR2),
+        s2.x + (-rOuter2 * cosR2),
+        s2.y,
+        s2.z + (-rOuter2 * sinR2),
+
+        s1.x + (rInner1 * cosR1), 
+        s1.y, 
+        s1.z + (rInner1 * sinR1),
+        s1.x + (rOuter1 * cosR1), 
+        s1.y,
+        s1.z + (rOuter1 * sinR1),
+        s2.x + (rOuter2 * cosR2), 
+        s2.y, 
+        s2.z + (rOuter2 * sinR2),
+        s2.x + (rInner2 * cosR2), 
+        s2.y, 
+        s2.z + (rInner2 * sinR2),
+    });
+
+    put(normals, {
+       nx, ny, nz,
+       nx, ny, nz,
+       nx, ny, nz,
+       nx, ny, nz,
+
+       nx, ny, nz,
+       nx, ny, nz,
+       nx, ny, nz,
+       nx, ny, nz,
+    });
+
+    put(textureUVs, {
+        1.0f, 0.0f,
+        uvInner1, 0.0f,
+        uvInner2, 1.0f * uvRepeat,
+        1.0f, 1.0f * uvRepeat,
+
+        1.0f - uvInner1, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 1.0f * uvRepeat,
+        1.0f - uvInner2, 1.0f * uvRepeat,
+    });
+
+    put(indices, {
+        startIndex, startIndex + 3, startIndex + 2,
+        startIndex, startIndex + 2, startIndex + 1,
+
+        startIndex + 4, startIndex + 7, startIndex + 6,
+        startIndex + 4, startIndex + 6, startIndex + 5,
+    });
+}
+
+// Closes the track at a support. The front face looks back along the track, the back face forward.
+static void fillTrackFace(const TrackSupport& s, int sectors, bool back, unsigned int baseVertex,
+    float* vertices, float* textureUVs, float* normals, unsigned int* indices)
+{
+    const float sectorStep = PI / sectors;
+
+    float cosR = cosf(glm::radians(s.angle));
+    float sinR = sinf(glm::radians(s.angle));
+
+    float rInner = s.innerRadius;
+    float rOuter = s.outerRadius;
+
+    float nx = back ? sinR : -sinR;
+    float ny = 0;
+    float nz = back ? cosR : -cosR;
+
+    float uvInner = rInner / rOuter;
+
+    for (int i = 0; i <= sectors; ++i) {
+        float sectorAngle = PI + i * sectorStep;
+
+        float cosA = cosf(sectorAngle);
+        float sinA = sinf(sectorAngle);
+
+        put(vertices, {
+            s.x + (rInner * cosA * cosR), s.y + (rInner * sinA), s.z + (rInner * cosA * sinR),
+            s.x + (rOuter * cosA * cosR), s.y + (rOuter * sinA), s.z + (rOuter * cosA * sinR),
+        });
+
+        put(normals, { nx, ny, nz, nx, ny, nz });
+
+        put(textureUVs, {
+            (cosA * uvInner + 1.0f) * 0.5f,
+            (sinA * uvInner + 1.0f) * 0.5f,
+            (cosA + 1.0f) * 0.5f,
+            (sinA + 1.0f) * 0.5f,
+        });
+    }
+    for (int i = 0; i < sectors; ++i) {
+        unsigned int k1 = i * 2 + baseVertex;
+        unsigned int k2 = k1 + 2;
+
+        if (back) {
+            put(indices, { k1, k1 + 1, k2, k2, k1 + 1, k2 + 1 });
+        }
+        else {
+            put(indices, { k1, k2, k1 + 1, k2, k2 + 1, k1 + 1 });
+        }
+    }
+}
+
+MeshData buildHalfPipeTrack(const std::vector<TrackSupport>& supports, int sectors, ThreadPool& pool)
+{
+    if (supports.size() < 2) {
+        return {};
+    }
+
+    // Every part has a fixed size, so the offset of each segment is known up front
+    // and segments can be written in parallel without reallocating
+    const size_t segments = supports.size() - 1;
+    const size_t segmentVertices = trackSegmentVertexCount(sectors);
+    const size_t segmentIndices = trackSegmentIndexCount(sectors);
+    const size_t faceVertices = trackFaceVertexCount(sectors);
+    const size_t faceIndices = trackFaceIndexCount(sectors);
+
+    const size_t vertexCount = segments * segmentVertices + 2 * faceVertices;
+    const size_t indexCount = segments * segmentIndices + 2 * faceIndices;
+
+    MeshData mesh;
+    mesh.positions.resize(vertexCount * 3);
+    mesh.uvs.resize(vertexCount * 2);
+    mesh.normals.resize(vertexCount * 3);
+    mesh.indices.resize(indexCount);
+
+    // Segments
+    pool.parallelFor(segments, 16, [&](size_t begin, size_t end) {
+        for (size_t s = begin; s < end; s++) {
+            size_t v = s * segmentVertices;
+            size_t i = s * segmentIndices;
+            fillTrackSegment(supports[s], supports[s + 1], sectors, static_cast<unsigned int>(v),
+                &mesh.positions[v * 3], &mesh.uvs[v * 2], &mesh.normals[v * 3], &mesh.indices[i]);
+        }
+    });
+
+    // Front face
+    size_t v = segments * segmentVertices;
+    size_t i = segments * segmentIndices;
+    fillTrackFace(supports.front(), sectors, false, static_cast<unsigned int>(v),
+        &mesh.positions[v * 3], &mesh.uvs[v * 2], &mesh.normals[v * 3], &mesh.indices[i]);
+
+    // Back face
+    v += faceVertices;
+    i += faceIndices;
+    fillTrackFace(supports.back(), sectors, true, static_cast<unsigned int>(v),
+        &mesh.positions[v * 3], &mesh.uvs[v * 2], &mesh.normals[v * 3], &mesh.indices[i]);
+
+    return mesh;
+}
+
+std::vector<MeshRange> halfPipeTrackRanges(size_t supportCount, int sectors, size_t support)
+{
+    std::vector<MeshRange> ranges;
+    if (supportCount < 2 || support >= supportCount) {
+        return ranges;
+    }
+
+    const size_t segments = supportCount - 1;
+    const size_t segmentVertices = trackSegmentVertexCount(sectors);
+    const size_t segmentIndices = trackSegmentIndexCount(sectors);
+    const size_t faceVertices = trackFaceVertexCount(sectors);
+    const size_t faceIndices = trackFaceIndexCount(sectors);
+
+    // The segment ending at the support and the one starting at it
+    size_t first = support > 0 ? support - 1 : 0;
+    size_t last = std::min(support, segments - 1);
+    ranges.push_back({ first * segmentVertices, (last - first + 1) * segmentVertices,
+        first * segmentIndices, (last - first + 1) * segmentIndices });
+
+    size_t v = segments * segmentVertices;
+    size_t i = segments * segmentIndices;
+    if (support == 0) {
+        ranges.push_back({ v, faceVertices, i, faceIndices });
+    }
+    if (support == segments) {
+        ranges.push_back({ v + faceVertices, faceVertices, i + faceIndices, faceIndices });
+    }
+    return ranges;
+}
+
+std::vector<MeshRange> updateHalfPipeTrack(MeshData& mesh, const std::vector<TrackSupport>& supports, int sectors, size_t support)
+{
+    std::vector<MeshRange> ranges = halfPipeTrackRanges(supports.size(), sectors, support);
+    if (ranges.empty()) {
+        return ranges;
+    }
+
+    const size_t segments = supports.size() - 1;
+    const size_t segmentVertices = trackSegmentVertexCount(sectors);
+    const size_t segmentIndices = trackSegmentIndexCount(sectors);
+    const size_t faceVertices = trackFaceVertexCount(sectors);
+
+    size_t first = support > 0 ? support - 1 : 0;
+    size_t last = std::min(support, segments - 1);
+    for (size_t s = first; s <= last; s++) {
+        size_t v = s * segmentVertices;
+        size_t i = s * segmentIndices;
+        fillTrackSegment(supports[s], supports[s + 1], sectors, static_cast<unsigned int>(v),
+            &mesh.positions[v * 3], &mesh.uvs[v * 2], &mesh.normals[v * 3], &mesh.indices[i]);
+    }
+
+    // End faces come after the segments, front then back
+    for (size_t r = 1; r < ranges.size(); r++) {
+        const MeshRange& face = ranges[r];
+        bool back = face.firstVertex >= segments * segmentVertices + faceVertices;
+        fillTrackFace(back ? supports.back() : supports.front(), sectors, back, static_cast<unsigned int>(face.firstVertex),
+            &mesh.positions[face.firstVertex * 3], &mesh.uvs[face.firstVertex * 2],
+            &mesh.normals[face.firstVertex * 3], &mesh.indices[face.firstIndex]);
+    }
+    return ranges;
+}
+
+size_t trackSupportTexel(int sectors, size_t support)
+{
+    return sectors + 1 + 2 * support;
+}
+
+void fillTrackSupportTexels(const std::vector<TrackSupport>& supports, size_t support, float* texels)
+{
+    const TrackSupport& s = supports[support];
+    float uvRepeat = support + 1 < supports.size() ? float(trackSegmentUvRepeat(s, supports[support + 1])) : 0.0f;
+    put(texels, {
+        s.x, s.y, s.z, uvRepeat,
+        cosf(glm::radians(s.angle)), sinf(glm::radians(s.angle)), s.innerRadius, s.outerRadius,
+    });
+}
+
+std::vector<float> buildTrackSupportTexels(const std::vector<TrackSupport>& supports, int sectors)
+{
+    std::vector<float> texels(trackSupportTexel(sectors, supports.size()) * 4, 0.0f);
+
+    // Ring directions, the same values the CPU mesh uses
+    const float sectorStep = PI / sectors;
+    for (int i = 0; i <= sectors; ++i) {
+        float sectorAngle = PI + i * sectorStep;
+        texels[i * 4] = cosf(sectorAngle);
+        texels[i * 4 + 1] = sinf(sectorAngle);
+    }
+
+    for (size_t s = 0; s < supports.size(); s++) {
+        fillTrackSupportTexels(supports, s, &texels[trackSupportTexel(sectors, s) * 4]);
+    }
+    return texels;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "heightfield.h"
+#include "thread_pool.h"
+
+struct TrackSupport {
+	float x, y, z;
+	float angle;		// Degrees of rotation clockwise around y-axis. 0.0 along z-axis
+	float innerRadius;
+	float outerRadius;
+};
+
+// CPU side geometry for the Shape classes. Building makes no GL calls, so it can
+// run on any thread or without a context. Shape::uploadMesh sends it to the GPU.
+struct MeshData {
+	std::vector<float> positions;		// xyz
+	std::vector<float> uvs;				// uv
+	std::vector<float> normals;			// xyz
+	std::vector<unsigned int> indices;
+
+	size_t vertexCount() const { return positions.size() / 3; }
+	size_t triangleCount() const { return indices.size() / 3; }
+	size_t byteSize() const;
+};
+
+// One interleaved vertex: position (float or half), packed normal, half float UV.
+// UVs stay half floats since the track and pillar textures repeat past 1.0.
+struct VertexLayout {
+	bool halfPositions = false;
+	bool octahedralNormals = false;		// else GL_INT_2_10_10_10_REV
+
+	int positionBytes() const { return halfPositions ? 8 : 12; }
+	int normalOffset() const { return positionBytes(); }
+	int uvOffset() const { return positionBytes() + 4; }
+	int stride() const { return positionBytes() + 8; }
+};
+
+// Half positions only when every coordinate is within halfRange, like the cached unit meshes
+VertexLayout chooseVertexLayout(const MeshData& mesh, bool octahedralNormals, float halfRange);
+std::vector<unsigned char> packVertices(const MeshData& mesh, const VertexLayout& layout);
+// Only vertices [first, first + count), for updating part of a buffer
+std::vector<unsigned char> packVertices(const MeshData& mesh, const VertexLayout& layout, size_t first, size_t count);
+glm::vec2 encodeOctahedral(glm::vec3 n);
+
+MeshData buildBox(float sizeX, float sizeY, float sizeZ);
+MeshData buildPyramid(float sizeX, float height, float sizeZ);
+MeshData buildPlane(float sizeX, float sizeZ);
+// Height of a unit CompositePlane where the heightfield is at height 1
+const float COMPOSITE_PLANE_HEIGHT = 0.1f;
+// heightfield may be nullptr for a flat grid
+MeshData buildCompositePlane(int width, int depth, const Heightfield* heightfield);
+MeshData buildSphere(float radius, int sectors, int stacks);
+// uvRepeat 0 picks the texture repeat along the height from the proportions
+MeshData buildCylinder(float radius, float height, int sectors, int uvRepeat = 0);
+MeshData buildHalfPipe(float innerRadius, float outerRadius, float length, int sectors);
+// Segments are generated in parallel on the pool
+MeshData buildHalfPipeTrack(const std::vector<TrackSupport>& supports, int sectors, ThreadPool& pool = threadPool());
+
+// A HalfPipeTrack mesh is one fixed size block per segment, in support order, followed
+// by the front and back end faces. Part sizes for a given tessellation:
+size_t trackSegmentVertexCount(int sectors);
+size_t trackSegmentIndexCount(int sectors);
+size_t trackFaceVertexCount(int sectors);
+size_t trackFaceIndexCount(int sectors);
+
+// Contiguous vertices and indices of a mesh
+struct MeshRange {
+	size_t firstVertex;
+	size_t vertexCount;
+	size_t firstIndex;
+	size_t indexCount;
+};
+
+// Parts of a buildHalfPipeTrack mesh that use the given support: the segments on either
+// side, and the end face when it is the first or last
+std::vector<MeshRange> halfPipeTrackRanges(size_t supportCount, int sectors, size_t support);
+// Rewrites halfPipeTrackRanges of the support. Supports and sectors must have the same
+// count as the build. Returns the rewritten ranges.
+std::vector<MeshRange> updateHalfPipeTrack(MeshData& mesh, const std::vector<TrackSupport>& supports, int sectors, size_t support);
+
+// RGBA float texels for generating a track on the GPU, see shader/trackVertex.glsl. The
+// cos and sin of each of the sectors + 1 rings come first, then two texels per support:
+// (x, y, z, texture repeats to the next support) and (cos angle, sin angle, innerRadius, outerRadius)
+std::vector<float> buildTrackSupportTexels(const std::vector<TrackSupport>& supports, int sectors);
+size_t trackSupportTexel(int sectors, size_t support);
+// Writes the two texels of one support
+void fillTrackSupportTexels(const std::vector<TrackSupport>& supports, size_t support, float* texels);
@@ -0,0 +1,51 @@
+#include "mesh_cache.h"
+
+#include <iostream>
+#include <tuple>
+
+bool MeshKey::operator<(const MeshKey& other) const
+{
+    return std::tie(type, a, b) < std::tie(other.type, other.a, other.b);
+}
+
+const CachedMesh* MeshCache::find(const MeshKey& key)
+{
+    auto it = mMeshes.find(key);
+    if (it == mMeshes.end()) {
+        return nullptr;
+    }
+    mUsers++;
+    return &it->second;
+}
+
+const CachedMesh& MeshCache::add(const MeshKey& key, const CachedMesh& mesh)
+{
+    mUsers++;
+    return mMeshes[key] = mesh;
+}
+
+void MeshCache::clear()
+{
+    for (auto& entry : mMeshes) {
+        CachedMesh& mesh = entry.second;
+        glDeleteVertexArrays(1, &mesh.VAO);
+        glDeleteBuffers(4, mesh.VBO);
+        glDeleteBuffers(1, &mesh.EBO);
+    }
+    mMeshes.clear();
+    mUsers = 0;
+}
+
+void MeshCache::printStats() const
+{
+    // Without the cache every user would own a VAO, 4 VBOs and an EBO
+    int saved = mUsers - meshCount();
+    std::cout << "Mesh cache: " << meshCount() << " meshes shared by " << mUsers << " shapes, "
+        << saved << " VAOs and " << saved * 5 << " buffers saved" << std::endl;
+}
+
+MeshCache& meshCache()
+{
+    static MeshCache cache;
+    return cache;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <map>
+
+enum MeshPrimitive {
+	MESH_BOX,
+	MESH_PLANE,
+	MESH_SPHERE,
+	MESH_CYLINDER,
+};
+
+// Primitive type and tessellation. Size is not part of the key, cached meshes
+// are unit sized and scaled by the shape's model matrix.
+struct MeshKey {
+	MeshPrimitive type;
+	int a = 0;
+	int b = 0;
+
+	bool operator<(const MeshKey& other) const;
+};
+
+// GL buffers of one unit mesh, shared by every shape with the same key
+struct CachedMesh {
+	GLuint VAO = 0;
+	GLuint VBO[4] = {};
+	GLuint EBO = 0;
+	GLsizei indexCount = 0;
+	GLenum indexType = GL_UNSIGNED_INT;
+	bool octahedralNormals = false;
+};
+
+class MeshCache {
+public:
+	const CachedMesh* find(const MeshKey& key);
+	const CachedMesh& add(const MeshKey& key, const CachedMesh& mesh);
+	// Deletes the GL buffers, call while the context is still current
+	void clear();
+
+	int meshCount() const { return static_cast<int>(mMeshes.size()); }
+	int userCount() const { return mUsers; }
+	void printStats() const;
+
+private:
+	std::map<MeshKey, CachedMesh> mMeshes;
+	int mUsers = 0;
+};
+
+MeshCache& meshCache();
@@ -0,0 +1,313 @@
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <set>
+
+static glm::vec3 vertexPosition(const std::vector<float>& positions, unsigned int index)
+{
+    return glm::vec3(positions[index * 3], positions[index * 3 + 1], positions[index * 3 + 2]);
+}
+
+void removeBadTriangles(MeshData& mesh, size_t& degenerate, size_t& duplicate)
+{
+    degenerate = 0;
+    duplicate = 0;
+
+    std::set<std::array<unsigned int, 3>> seen;
+    std::vector<unsigned int> kept;
+    kept.reserve(mesh.indices.size());
+
+    for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3) {
+        unsigned int a = mesh.indices[t];
+        unsigned int b = mesh.indices[t + 1];
+        unsigned int c = mesh.indices[t + 2];
+
+        glm::vec3 pa = vertexPosition(mesh.positions, a);
+        glm::vec3 pb = vertexPosition(mesh.positions, b);
+        glm::vec3 pc = vertexPosition(mesh.positions, c);
+        glm::vec3 cross = glm::cross(pb - pa, pc - pa);
+        if (a == b || b == c || c == a || glm::dot(cross, cross) < 1e-14f) {
+            degenerate++;
+            continue;
+        }
+
+        // Rotate the smallest index first, so the same triangle with the same winding gives the same key
+        std::array<unsigned int, 3> key = { a, b, c };
+        std::rotate(key.begin(), std::min_element(key.begin(), key.end()), key.end());
+        if (!seen.insert(key).second) {
+            duplicate++;
+            continue;
+        }
+
+        kept.insert(kept.end(), { a, b, c });
+    }
+    mesh.indices.swap(kept);
+}
+
+// Forsyth scoring constants
+static const float CACHE_DECAY_POWER = 1.5f;
+static const float LAST_TRI_SCORE = 0.75f;
+static const float VALENCE_BOOST_SCALE = 2.0f;
+static const float VALENCE_BOOST_POWER = 0.5f;
+
+static float vertexScore(int cachePosition, int remainingTriangles)
+{
+    if (remainingTriangles == 0) {
+        return -1.0f;
+    }
+
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        if (cachePosition < 3) {
+            // The last triangle's vertices, deliberately below the next ones so strips are not favoured
+            score = LAST_TRI_SCORE;
+        }
+        else {
+            float scaler = 1.0f / (VERTEX_CACHE_SIZE - 3);
+            score = std::pow(1.0f - (cachePosition - 3) * scaler, CACHE_DECAY_POWER);
+        }
+    }
+    // Favour vertices with few triangles left, to finish them off
+    score += VALENCE_BOOST_SCALE * std::pow(float(remainingTriangles), -VALENCE_BOOST_POWER);
+    return score;
+}
+
+void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount)
+{
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+        return;
+    }
+
+    // Triangles of each vertex, as one flat list
+    std::vector<unsigned int> offsets(vertexCount + 1, 0);
+    for (unsigned int v : indices) offsets[v + 1]++;
+    for (size_t v = 0; v < vertexCount; v++) offsets[v + 1] += offsets[v];
+
+    std::vector<unsigned int> vertexTriangles(indices.size());
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++) {
+        vertexTriangles[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+    }
+
+    std::vector<int> remaining(vertexCount);
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> score(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+        remaining[v] = offsets[v + 1] - offsets[v];
+        score[v] = vertexScore(-1, remaining[v]);
+    }
+
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for (size_t t = 0; t < triangleCount; t++) {
+        triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+    }
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    // Room for a full cache plus the three vertices being pushed in
+    std::vector<unsigned int> cache;
+    cache.reserve(VERTEX_CACHE_SIZE + 3);
+    std::vector<unsigned int> nextCache;
+    nextCache.reserve(VERTEX_CACHE_SIZE + 3);
+
+    size_t cursor = 0;
+    long best = 0;
+    for (size_t t = 1; t < triangleCount; t++) {
+        if (triangleScore[t] > triangleScore[best]) best = static_cast<long>(t);
+    }
+
+    while (result.size() < indices.size()) {
+        if (best < 0) {
+            // Nothing in the cache has triangles left, start over at the next triangle in input order
+            while (emitted[cursor]) cursor++;
+            best = static_cast<long>(cursor);
+        }
+
+        emitted[best] = true;
+        const unsigned int* tri = &indices[best * 3];
+        result.insert(result.end(), { tri[0], tri[1], tri[2] });
+
+        // New vertices at the front of the LRU cache, the rest keep their order
+        nextCache.assign(tri, tri + 3);
+        for (unsigned int v : cache) {
+            if (v != tri[0] && v != tri[1] && v != tri[2]) nextCache.push_back(v);
+        }
+        cache.swap(nextCache);
+
+        for (int k = 0; k < 3; k++) {
+            unsigned int v = tri[k];
+            if ((k > 0 && v == tri[0]) || (k == 2 && v == tri[1])) continue;
+            unsigned int* begin = &vertexTriangles[offsets[v]];
+            unsigned int* end = begin + remaining[v];
+            *std::find(begin, end, static_cast<unsigned int>(best)) = *(end - 1);
+            remaining[v]--;
+        }
+
+        // Evicted vertices lose their cache score
+        for (size_t i = VERTEX_CACHE_SIZE; i < cache.size(); i++) {
+            cachePosition[cache[i]] = -1;
+            score[cache[i]] = vertexScore(-1, remaining[cache[i]]);
+        }
+        if (cache.size() > VERTEX_CACHE_SIZE) {
+            cache.resize(VERTEX_CACHE_SIZE);
+        }
+
+        for (size_t i = 0; i < cache.size(); i++) {
+            cachePosition[cache[i]] = static_cast<int>(i);
+            score[cache[i]] = vertexScore(static_cast<int>(i), remaining[cache[i]]);
+        }
+
+        // Only triangles touching the cache changed score
+        best = -1;
+        float bestScore = -1.0f;
+        for (unsigned int v : cache) {
+            for (int i = 0; i < remaining[v]; i++) {
+                unsigned int t = vertexTriangles[offsets[v] + i];
+                float s = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+                triangleScore[t] = s;
+                if (s > bestScore) {
+                    bestScore = s;
+                    best = t;
+                }
+            }
+        }
+    }
+    indices.swap(result);
+}
+
+void optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<float>& positions)
+{
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+        return;
+    }
+
+    // Split where all three vertices of a triangle miss the cache. The order within a
+    // cluster is kept, so moving clusters around costs almost no cache efficiency.
+    std::vector<size_t> clusterStart;
+    std::vector<unsigned int> fifo(VERTEX_CACHE_SIZE, ~0u);
+    size_t fifoHead = 0;
+    for (size_t t = 0; t < triangleCount; t++) {
+        int misses = 0;
+        for (int k = 0; k < 3; k++) {
+            unsigned int v = indices[t * 3 + k];
+            if (std::find(fifo.begin(), fifo.end(), v) == fifo.end()) {
+                fifo[fifoHead] = v;
+                fifoHead = (fifoHead + 1) % fifo.size();
+                misses++;
+            }
+        }
+        if (misses == 3 || t == 0) {
+            clusterStart.push_back(t);
+        }
+    }
+    clusterStart.push_back(triangleCount);
+
+    glm::vec3 meshCenter(0.0f);
+    size_t vertexCount = positions.size() / 3;
+    for (size_t v = 0; v < vertexCount; v++) meshCenter += vertexPosition(positions, static_cast<unsigned int>(v));
+    meshCenter /= float(std::max<size_t>(vertexCount, 1));
+
+    // Clusters facing away from the mesh center are likely to occlude the rest
+    struct Cluster {
+        size_t begin, end;
+        float sortKey;
+    };
+    std::vector<Cluster> clusters;
+    for (size_t c = 0; c + 1 < clusterStart.size(); c++) {
+        glm::vec3 center(0.0f);
+        glm::vec3 normal(0.0f);
+        float area = 0.0f;
+        for (size_t t = clusterStart[c]; t < clusterStart[c + 1]; t++) {
+            glm::vec3 a = vertexPosition(positions, indices[t * 3]);
+            glm::vec3 b = vertexPosition(positions, indices[t * 3 + 1]);
+            glm::vec3 p = vertexPosition(positions, indices[t * 3 + 2]);
+            glm::vec3 n = glm::cross(b - a, p - a);
+            float triangleArea = glm::length(n);
+            center += (a + b + p) * (triangleArea / 3.0f);
+            normal += n;
+            area += triangleArea;
+        }
+        center = area > 0.0f ? center / area : center;
+        float normalLength = glm::length(normal);
+        float key = normalLength > 0.0f ? glm::dot(center - meshCenter, normal / normalLength) : 0.0f;
+        clusters.push_back({ clusterStart[c], clusterStart[c + 1], key });
+    }
+
+    std::stable_sort(clusters.begin(), clusters.end(),
+        [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (const Cluster& cluster : clusters) {
+        result.insert(result.end(), indices.begin() + cluster.begin * 3, indices.begin() + cluster.end * 3);
+    }
+    indices.swap(result);
+}
+
+void optimizeVertexFetch(MeshData& mesh)
+{
+    const unsigned int unused = ~0u;
+    std::vector<unsigned int> remap(mesh.vertexCount(), unused);
+    unsigned int next = 0;
+    for (unsigned int& index : mesh.indices) {
+        if (remap[index] == unused) remap[index] = next++;
+        index = remap[index];
+    }
+
+    MeshData ordered;
+    ordered.positions.resize(next * 3);
+    ordered.uvs.resize(next * 2);
+    ordered.normals.resize(next * 3);
+    for (size_t v = 0; v < remap.size(); v++) {
+        unsigned int r = remap[v];
+        if (r == unused) continue;
+        std::copy_n(&mesh.positions[v * 3], 3, &ordered.positions[r * 3]);
+        std::copy_n(&mesh.uvs[v * 2], 2, &ordered.uvs[r * 2]);
+        std::copy_n(&mesh.normals[v * 3], 3, &ordered.normals[r * 3]);
+    }
+    mesh.positions.swap(ordered.positions);
+    mesh.uvs.swap(ordered.uvs);
+    mesh.normals.swap(ordered.normals);
+}
+
+float averageCacheMissRatio(const std::vector<unsigned int>& indices, size_t vertexCount, int cacheSize)
+{
+    if (indices.empty()) {
+        return 0.0f;
+    }
+
+    // FIFO cache, as most hardware implements it. Stamps avoid searching the cache.
+    std::vector<size_t> insertedAt(vertexCount, 0);
+    size_t misses = 0;
+    for (unsigned int v : indices) {
+        if (insertedAt[v] == 0 || misses - insertedAt[v] + 1 > size_t(cacheSize)) {
+            misses++;
+            insertedAt[v] = misses;
+        }
+    }
+    return float(misses) / (indices.size() / 3);
+}
+
+MeshOptimizeStats optimizeMesh(MeshData& mesh)
+{
+    MeshOptimizeStats stats;
+    stats.acmrBefore = averageCacheMissRatio(mesh.indices, mesh.vertexCount());
+
+    removeBadTriangles(mesh, stats.degenerate, stats.duplicate);
+    optimizeVertexCache(mesh.indices, mesh.vertexCount());
+    optimizeOverdraw(mesh.indices, mesh.positions);
+    optimizeVertexFetch(mesh);
+
+    stats.acmrAfter = averageCacheMissRatio(mesh.indices, mesh.vertexCount());
+    return stats;
+}
+
+bool fitsShortIndices(const MeshData& mesh)
+{
+    return mesh.vertexCount() <= 65536;
+}
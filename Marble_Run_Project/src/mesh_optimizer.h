@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+
+#include "mesh_builder.h"
+
+struct MeshOptimizeStats {
+	size_t degenerate = 0;			// triangles removed
+	size_t duplicate = 0;			// triangles removed
+	float acmrBefore = 0.0f;		// average cache misses per triangle
+	float acmrAfter = 0.0f;
+};
+
+// Post-transform cache used for the reordering and for measuring it
+const int VERTEX_CACHE_SIZE = 32;
+
+// Removes triangles with repeated or collapsed vertices and triangles already in
+// the list with the same winding. Returns the number removed of each.
+void removeBadTriangles(MeshData& mesh, size_t& degenerate, size_t& duplicate);
+// Tom Forsyth's linear speed vertex cache optimisation
+void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount);
+// Keeps the cache friendly order within clusters, then draws outward facing clusters first
+void optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<float>& positions);
+// Renumbers vertices in order of first use and drops unused ones
+void optimizeVertexFetch(MeshData& mesh);
+float averageCacheMissRatio(const std::vector<unsigned int>& indices, size_t vertexCount, int cacheSize = VERTEX_CACHE_SIZE);
+
+// All of the above, in order
+MeshOptimizeStats optimizeMesh(MeshData& mesh);
+
+// True when the indices fit GL_UNSIGNED_SHORT
+bool fitsShortIndices(const MeshData& mesh);
@@ -0,0 +1,111 @@
+#include "particle_atlas.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include <SOIL2/soil2.h>
+
+ParticleAtlas::ParticleAtlas(int size) : mSize(size)
+{
+    glGenTextures(1, &mTexture);
+    glBindTexture(GL_TEXTURE_2D, mTexture);
+
+    // Start fully transparent
+    std::vector<unsigned char> clear(size * size * 4, 0);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, clear.data());
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+ParticleAtlas::~ParticleAtlas()
+{
+    if (mTexture) glDeleteTextures(1, &mTexture);
+}
+
+bool ParticleAtlas::addImage(GLuint sourceTexture, const char* path)
+{
+    int width, height, channels;
+    unsigned char* data = SOIL_load_image(path, &width, &height, &channels, SOIL_LOAD_RGBA);
+    if (!data) {
+        std::cout << "Failed to load particle texture " << path << std::endl;
+        return false;
+    }
+
+    glm::ivec4 region;
+    if (!allocate(width, height, region)) {
+        std::cout << "Particle atlas full, " << path << " is drawn on its own" << std::endl;
+        SOIL_free_image_data(data);
+        return false;
+    }
+
+    // Flip rows to match textures loaded with SOIL_FLAG_INVERT_Y
+    std::vector<unsigned char> flipped(width * height * 4);
+    for (int y = 0; y < height; y++) {
+        std::copy(data + (height - 1 - y) * width * 4, data + (height - y) * width * 4, flipped.begin() + y * width * 4);
+    }
+    SOIL_free_image_data(data);
+
+    glBindTexture(GL_TEXTURE_2D, mTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, region.x, region.y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, flipped.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    mRects[sourceTexture] = uvRect(region);
+    return true;
+}
+
+bool ParticleAtlas::allocate(int width, int height, glm::ivec4& pixelRect)
+{
+    const int padding = PARTICLE_ATLAS_PADDING;
+
+    // Start a new shelf when the current one is full
+    if (mShelfX + width + padding > mSize) {
+        mShelfX = 0;
+        mShelfY += mShelfHeight;
+        mShelfHeight = 0;
+    }
+    if (width + padding > mSize || mShelfY + height + padding > mSize) {
+        return false;
+    }
+
+    pixelRect = { mShelfX + padding, mShelfY + padding, width, height };
+    mShelfX += width + padding;
+    mShelfHeight = std::max(mShelfHeight, height + padding);
+    return true;
+}
+
+glm::vec4 ParticleAtlas::uvRect(glm::ivec4 pixelRect) const
+{
+    // Half a texel in from the edges, so bilinear filtering stays inside the region
+    float texel = 1.0f / mSize;
+    return {
+        (pixelRect.x + 0.5f) * texel,
+        (pixelRect.y + 0.5f) * texel,
+        (pixelRect.z - 1.0f) * texel,
+        (pixelRect.w - 1.0f) * texel
+    };
+}
+
+void ParticleAtlas::generateMipmaps()
+{
+    glBindTexture(GL_TEXTURE_2D, mTexture);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+bool ParticleAtlas::contains(GLuint sourceTexture) const
+{
+    return mRects.count(sourceTexture) > 0;
+}
+
+glm::vec4 ParticleAtlas::rectFor(GLuint sourceTexture) const
+{
+    auto it = mRects.find(sourceTexture);
+    return (it != mRects.end()) ? it->second : glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <map>
+
+#include "settings.h"
+
+// All particle textures in one texture, so particles of every emitter can be
+// drawn in a single batch. Regions are packed on shelves with padding against
+// mipmap bleeding. Flipbooks are baked into free regions of the same atlas.
+class ParticleAtlas {
+public:
+	ParticleAtlas(int size = PARTICLE_ATLAS_SIZE);
+	~ParticleAtlas();
+
+	bool addImage(GLuint sourceTexture, const char* path);
+	bool allocate(int width, int height, glm::ivec4& pixelRect);
+	glm::vec4 uvRect(glm::ivec4 pixelRect) const;
+	void generateMipmaps();
+
+	bool contains(GLuint sourceTexture) const;
+	glm::vec4 rectFor(GLuint sourceTexture) const;
+
+	GLuint mTexture = 0;
+	int mSize;
+
+private:
+	std::map<GLuint, glm::vec4> mRects;
+	int mShelfX = 0;
+	int mShelfY = 0;
+	int mShelfHeight = 0;
+};
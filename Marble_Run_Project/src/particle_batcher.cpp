@@ -0,0 +1,129 @@
+#include "particle_batcher.h"
+
+#include <cstddef>
+
+ParticleBatcher::ParticleBatcher()
+{
+    // Same quad as Emitter::fillBuffers, so flipbooks bake and display the same way around
+    float vertices[] = {
+         -1.0f, -1.0f, 0.0f,
+          1.0f, -1.0f, 0.0f,
+          1.0f,  1.0f, 0.0f,
+         -1.0f,  1.0f, 0.0f,
+    };
+
+    float textureUVs[] = {
+        1.0f, 0.0f,
+        0.0f, 0.0f,
+        0.0f, 1.0f,
+        1.0f, 1.0f,
+    };
+
+    unsigned int indices[] = {
+        0, 2, 1,
+        2, 0, 3,
+    };
+
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(2, VBO);
+    glGenBuffers(1, &EBO);
+    glGenBuffers(1, &mInstanceVBO);
+
+    glBindVertexArray(VAO);
+
+    // position attribute
+    glBindBuffer(GL_ARRAY_BUFFER, VBO[0]);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+
+    // texture UV attribute
+    glBindBuffer(GL_ARRAY_BUFFER, VBO[1]);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(textureUVs), textureUVs, GL_STATIC_DRAW);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(1);
+
+    // Per instance attributes
+    glBindBuffer(GL_ARRAY_BUFFER, mInstanceVBO);
+
+    // position + size
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(ParticleInstance), (void*)offsetof(ParticleInstance, position));
+    glEnableVertexAttribArray(2);
+    glVertexAttribDivisor(2, 1);
+
+    // color
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(ParticleInstance), (void*)offsetof(ParticleInstance, color));
+    glEnableVertexAttribArray(3);
+    glVertexAttribDivisor(3, 1);
+
+    // atlas region
+    glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(ParticleInstance), (void*)offsetof(ParticleInstance, uvRect));
+    glEnableVertexAttribArray(4);
+    glVertexAttribDivisor(4, 1);
+
+    // premultiplied flag
+    glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, sizeof(ParticleInstance), (void*)offsetof(ParticleInstance, premultiplied));
+    glEnableVertexAttribArray(5);
+    glVertexAttribDivisor(5, 1);
+
+    // Indices
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+    glBindVertexArray(0);
+}
+
+ParticleBatcher::~ParticleBatcher()
+{
+    if (VAO) glDeleteVertexArrays(1, &VAO);
+    if (VBO[0]) glDeleteBuffers(2, VBO);
+    if (EBO) glDeleteBuffers(1, &EBO);
+    if (mInstanceVBO) glDeleteBuffers(1, &mInstanceVBO);
+}
+
+void ParticleBatcher::clear()
+{
+    mInstances.clear();
+}
+
+void ParticleBatcher::add(const ParticleInstance& instance)
+{
+    mInstances.push_back(instance);
+}
+
+size_t ParticleBatcher::size() const
+{
+    return mInstances.size();
+}
+
+void ParticleBatcher::draw(GLuint shaderProgram, GLuint atlasTexture)
+{
+    if (mInstances.empty()) return;
+
+    // Grow the instance buffer when needed, otherwise orphan and refill it
+    size_t bytes = mInstances.size() * sizeof(ParticleInstance);
+    if (bytes > mInstanceCapacity) {
+        mInstanceCapacity = bytes * 2;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, mInstanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, mInstanceCapacity, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, mInstances.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, atlasTexture);
+    glBindVertexArray(VAO);
+
+    // Everything leaves the fragment shader premultiplied
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    glDepthMask(GL_FALSE);
+
+    glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0, static_cast<GLsizei>(mInstances.size()));
+
+    glBindVertexArray(0);
+
+    glDepthMask(GL_TRUE);
+    glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    glDisable(GL_BLEND);
+}
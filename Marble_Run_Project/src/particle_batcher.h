@@ -0,0 +1,39 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "Utils.h"
+
+// Per particle data of the batched draw, must match vertexShaderParticleBatch.glsl
+struct ParticleInstance {
+	glm::vec3 position;
+	float size;
+	glm::vec4 color;
+	glm::vec4 uvRect;
+	float premultiplied;	// 1 for flipbook frames, which are baked with premultiplied alpha
+};
+
+// Draws any number of particles from the particle atlas with one instanced call.
+// Instances are drawn in the order they were added.
+class ParticleBatcher {
+public:
+	ParticleBatcher();
+	~ParticleBatcher();
+
+	void clear();
+	void add(const ParticleInstance& instance);
+	size_t size() const;
+	void draw(GLuint shaderProgram, GLuint atlasTexture);
+
+private:
+	GLuint VAO;
+	GLuint VBO[2];
+	// 0 - position
+	// 1 - UV
+	GLuint EBO;
+	GLuint mInstanceVBO;
+	size_t mInstanceCapacity = 0;
+
+	std::vector<ParticleInstance> mInstances;
+};
@@ -13,6 +13,7 @@ Emitter::~Emitter()
     if (VAO) glDeleteVertexArrays(1, &VAO);
     if (VBO) glDeleteBuffers(2, VBO);
     if (EBO) glDeleteBuffers(1, &EBO);
+    if (mSpawnVBO) glDeleteBuffers(1, &mSpawnVBO);
 }
 
 void Emitter::initializeParticles()
@@ -116,7 +117,113 @@ void Emitter::setPBody(btRigidBody* pBody)
     mPosition = glm::vec3(pos.getX(), pos.getY(), pos.getZ());
 }
 
-void Emitter::renderParticles(GLuint shaderProgram)
+float Emitter::random(float min, float max)
+{
+    if (mRandomIndex >= mRandomPool.size()) {
+        mRandomPool.resize(RANDOM_POOL_SIZE);
+        mRng.uniformBatch(mRandomPool.data(), RANDOM_POOL_SIZE);
+        mRandomIndex = 0;
+    }
+    return min + (max - min) * mRandomPool[mRandomIndex++];
+}
+
+void Emitter::setAnalytic(bool analytic)
+{
+    if (!analytic || mAnalytic) return;
+
+    if (analyticBehaviour() == NONE) {
+        std::cout << "Emitter has no analytic behaviour, keeping simulated particles.\n";
+        return;
+    }
+
+    mAnalytic = true;
+    initSpawnBuffer();
+
+    // Particles live on the GPU from now on
+    mParticlesContainer.clear();
+    mParticlesContainer.shrink_to_fit();
+}
+
+void Emitter::initSpawnBuffer()
+{
+    // Same capacity as the simulated container. Dead records have a spawn time far in the past
+    mSpawnCapacity = static_cast<int>(mParticlesContainer.size());
+    mSpawnHead = 0;
+    mPendingSpawns.reserve(mSpawnCapacity);
+
+    std::vector<ParticleSpawn> records(mSpawnCapacity, { glm::vec3(0.0f), -1.0e6f, glm::vec3(0.0f), 0.0f });
+
+    glBindVertexArray(VAO);
+    glGenBuffers(1, &mSpawnVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, mSpawnVBO);
+    glBufferData(GL_ARRAY_BUFFER, records.size() * sizeof(ParticleSpawn), records.data(), GL_DYNAMIC_DRAW);
+
+    // origin + spawn time
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(ParticleSpawn), (void*)0);
+    glEnableVertexAttribArray(2);
+    glVertexAttribDivisor(2, 1);
+
+    // velocity + seed
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(ParticleSpawn), (void*)(4 * sizeof(float)));
+    glEnableVertexAttribArray(3);
+    glVertexAttribDivisor(3, 1);
+
+    glBindVertexArray(0);
+}
+
+void Emitter::updateAnalytic(float dt)
+{
+    mTime += dt;
+    mTimeSinceLast += dt;
+
+    while (mTimeSinceLast > mTimeBetweenParticles) {
+        mTimeSinceLast -= mTimeBetweenParticles;
+
+        Particle p;
+        spawnParticle(p);
+
+        // Spread spawns over the frame instead of stacking them on the same timestamp
+        float spawnTime = static_cast<float>(mTime - mTimeSinceLast);
+        mPendingSpawns.push_back({ p.position, spawnTime, p.velocity, random(0.0f, 1.0f) });
+    }
+}
+
+void Emitter::uploadSpawns()
+{
+    if (mPendingSpawns.empty()) return;
+
+    // Only the newest records fit if a long frame spawned more than the ring holds
+    int count = static_cast<int>(mPendingSpawns.size());
+    int first = std::max(0, count - mSpawnCapacity);
+    count -= first;
+
+    glBindBuffer(GL_ARRAY_BUFFER, mSpawnVBO);
+
+    // At most two writes: up to the end of the ring, then the wrapped remainder
+    int tail = std::min(count, mSpawnCapacity - mSpawnHead);
+    glBufferSubData(GL_ARRAY_BUFFER, mSpawnHead * sizeof(ParticleSpawn), 
+        tail * sizeof(ParticleSpawn), &mPendingSpawns[first]);
+    if (count > tail) {
+        glBufferSubData(GL_ARRAY_BUFFER, 0, 
+            (count - tail) * sizeof(ParticleSpawn), &mPendingSpawns[first + tail]);
+    }
+    mSpawnHead = (mSpawnHead + count) % mSpawnCapacity;
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    mPendingSpawns.clear();
+}
+
+Emitter::AnalyticBehaviour Emitter::analyticBehaviour() const
+{
+    return NONE;
+}
+
+void Emitter::spawnParticle(Particle& p)
+{
+    p.position = mPosition;
+}
+
+void Emitter::followBody()
 {
     if (m_pBody) {
         btTransform trans;
@@ -125,7 +232,10 @@ void Emitter::renderParticles(GLuint shaderProgram)
         btVector3 pos = trans.getOrigin();
         mPosition = glm::vec3(pos.getX(), pos.getY(), pos.getZ());
     }
+}
 
+void Emitter::bindForRender()
+{
     // Activate texture
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, mTexture);
@@ -139,21 +249,217 @@ void Emitter::renderParticles(GLuint shaderProgram)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
     glBindVertexArray(VAO);
+}
+
+void Emitter::drawParticle(GLuint shaderProgram, Particle& p)
+{
+    shaderSetVec4(shaderProgram, "inColor", p.color);
+    shaderSetVec3(shaderProgram, "inPosition", p.position);
+    shaderSetFloat(shaderProgram, "inSize", p.size);
+
+    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+}
+
+void Emitter::drawAnalytic(GLuint shaderProgram)
+{
+    uploadSpawns();
+
+    shaderSetInt(shaderProgram, "uAnalytic", analyticBehaviour());
+    shaderSetFloat(shaderProgram, "uTime", static_cast<float>(mTime));
+    shaderSetFloat(shaderProgram, "uLifetime", mParticleLifetime);
+    shaderSetFloat(shaderProgram, "uBaseSize", mSize);
+
+    glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0, mSpawnCapacity);
+
+    shaderSetInt(shaderProgram, "uAnalytic", NONE);
+}
+
+void Emitter::drawFlipbook(GLuint shaderProgram)
+{
+    glm::vec4 uvRect = flipbookFrameRect();
+    glm::vec4 fullRect = { 0.0f, 0.0f, 1.0f, 1.0f };
+    Particle billboard = flipbookBillboard();
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, mFlipbook.texture);
+    glBindVertexArray(VAO);
+
+    // Frames are baked with premultiplied alpha
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    shaderSetVec4(shaderProgram, "uUVRect", uvRect);
+    drawParticle(shaderProgram, billboard);
+    shaderSetVec4(shaderProgram, "uUVRect", fullRect);
+    glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+glm::vec4 Emitter::flipbookFrameRect() const
+{
+    int frames = mFlipbook.columns * mFlipbook.rows;
+    int frame = static_cast<int>(mFlipbookTime / mFlipbook.duration * frames) % frames;
+    float du = mFlipbook.rect.z / mFlipbook.columns;
+    float dv = mFlipbook.rect.w / mFlipbook.rows;
+
+    return {
+        mFlipbook.rect.x + (frame % mFlipbook.columns) * du,
+        mFlipbook.rect.y + (frame / mFlipbook.columns) * dv,
+        du,
+        dv
+    };
+}
+
+Particle Emitter::flipbookBillboard() const
+{
+    Particle billboard;
+    billboard.position = mPosition + glm::vec3(0.0f, mFlipbook.centerHeight, 0.0f);
+    billboard.size = mFlipbook.halfSize;
+    return billboard;
+}
+
+void Emitter::setLod(bool enabled, Flipbook flipbook)
+{
+    mUseLod = enabled;
+    mFlipbook = flipbook;
+    mBaseSize = mSize;
+}
+
+void Emitter::setLodTier(LodTier tier)
+{
+    if (!mUseLod || tier == mLodTier) return;
+    mLodTier = tier;
+
+    // A shared source keeps its full rate
+    if (mSource) return;
+
+    float rate = (tier == LOD_MID) ? EMITTER_LOD_MID_RATE : 1.0f;
+    float size = (tier == LOD_MID) ? EMITTER_LOD_MID_SIZE : 1.0f;
+    mTimeBetweenParticles = 1.0f / (mParticlesPerSecond * rate);
+    mSize = mBaseSize * size;
+}
+
+int Emitter::expectedParticles(LodTier tier) const
+{
+    if (mSource) return 0;
+
+    switch (tier) {
+    case LOD_NEAR:
+        return static_cast<int>(mParticlesPerSecond * mParticleLifetime);
+    case LOD_MID:
+        return static_cast<int>(mParticlesPerSecond * EMITTER_LOD_MID_RATE * mParticleLifetime);
+    default:
+        return 0;
+    }
+}
+
+float Emitter::boundingRadius() const
+{
+    if (mFlipbook.texture) {
+        return mFlipbook.centerHeight + mFlipbook.halfSize;
+    }
+    return mRadius + mParticleLifetime;
+}
+
+void Emitter::update(float dt)
+{
+    if (mSource) {
+        // Simulated once for all users by the scene
+        mFlipbookTime += dt;
+        return;
+    }
+
+    if (!mUseLod) {
+        updateParticles(dt);
+        return;
+    }
+
+    if (mLodTier == LOD_FAR || mLodTier == LOD_HIDDEN) {
+        mSuspendedTime += dt;
+        mFlipbookTime += dt;
+        return;
+    }
+
+    // Back in view, simulate the time we missed. Older particles would have died anyway
+    if (mSuspendedTime > 0.0f) {
+        simulate(std::min(mSuspendedTime, mParticleLifetime));
+        mSuspendedTime = 0.0f;
+    }
+
+    updateParticles(dt);
+}
+
+void Emitter::simulate(float time)
+{
+    const float step = 1.0f / 30.0f;
+    while (time > 0.0f) {
+        float stepDt = std::min(step, time);
+        updateParticles(stepDt);
+        time -= stepDt;
+    }
+}
+
+void Emitter::setTemplate(Emitter* source, float rotation)
+{
+    mSource = source;
+    mRotation = { cos(rotation), sin(rotation) };
+
+    // The source owns the particles
+    mParticlesContainer.clear();
+    mParticlesContainer.shrink_to_fit();
+}
+
+const std::vector<Particle>& Emitter::particles() const
+{
+    return mSource ? mSource->mParticlesContainer : mParticlesContainer;
+}
+
+Particle Emitter::worldParticle(int i) const
+{
+    if (!mSource) return mParticlesContainer[i];
+
+    // Source particles are simulated around the origin
+    Particle p = mSource->mParticlesContainer[i];
+    p.position = mPosition + glm::vec3(
+        mRotation.x * p.position.x + mRotation.y * p.position.z,
+        p.position.y,
+        -mRotation.y * p.position.x + mRotation.x * p.position.z
+    );
+    return p;
+}
+
+void Emitter::renderParticles(GLuint shaderProgram)
+{
+    followBody();
+    if (mUseLod && mLodTier == LOD_HIDDEN) return;
+
+    if (mUseLod && mLodTier == LOD_FAR) {
+        if (mFlipbook.texture) {
+            glEnable(GL_BLEND);
+            glDepthMask(GL_FALSE);
+            drawFlipbook(shaderProgram);
+            glBindVertexArray(0);
+            glDepthMask(GL_TRUE);
+            glDisable(GL_BLEND);
+        }
+        return;
+    }
+
+    bindForRender();
 
     glEnable(GL_BLEND);
     //glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
     glDepthMask(GL_FALSE);
 
-    int active_p = 0;
-    for (Particle& p : mParticlesContainer) {
+    if (mAnalytic) {
+        drawAnalytic(shaderProgram);
+    }
 
-        if (p.life > 0.0) {
-            shaderSetVec4(shaderProgram, "inColor", p.color);
-            shaderSetVec3(shaderProgram, "inPosition", p.position);
-            shaderSetFloat(shaderProgram, "inSize", p.size);
+    int active_p = 0;
+    const std::vector<Particle>& container = particles();
+    for (int i = 0; i < container.size(); i++) {
 
-            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+        if (container[i].life > 0.0) {
+            Particle p = worldParticle(i);
+            drawParticle(shaderProgram, p);
 
             active_p++;
         }
@@ -171,6 +477,11 @@ void Emitter::renderParticles(GLuint shaderProgram)
 
 void FlameEmitter::updateParticles(float dt)
 {
+    if (mAnalytic) {
+        updateAnalytic(dt);
+        return;
+    }
+
     mTimeSinceLast += dt;
 
     for (Particle& p : mParticlesContainer) {
@@ -193,39 +504,52 @@ void FlameEmitter::updateParticles(float dt)
         mTimeSinceLast -= mTimeBetweenParticles;
 
         int p_idx = findUnusedParticle();
-        Particle& p = mParticlesContainer[p_idx];
+        spawnParticle(mParticlesContainer[p_idx]);
+    }
+}
 
-        float angle = glm::linearRand(0.0f, 2.0f * glm::pi<float>());
-        float distance = glm::linearRand(0.0f, mRadius);
+void FlameEmitter::spawnParticle(Particle& p)
+{
+    float angle = random(0.0f, 2.0f * glm::pi<float>());
+    float distance = random(0.0f, mRadius);
 
-        p.position = {
-            cos(angle) * distance,
-            0.0f,
-            sin(angle) * distance
-        };
+    p.position = {
+        cos(angle) * distance,
+        0.0f,
+        sin(angle) * distance
+    };
 
-        p.velocity = {
-            glm::linearRand(-0.2f, 0.2f), // x
-            glm::linearRand(0.2f, 1.0f),  // y
-            glm::linearRand(-0.2f, 0.2f)  // z
-        };
+    p.velocity = {
+        random(-0.2f, 0.2f), // x
+        random(0.2f, 1.0f),  // y
+        random(-0.2f, 0.2f)  // z
+    };
 
-        p.color = {
-            glm::linearRand(0.7f, 1.0f),
-            glm::linearRand(0.1f, 0.7f),
-            0.0f,
-            0.4f
-        };
+    p.color = {
+        random(0.7f, 1.0f),
+        random(0.1f, 0.7f),
+        0.0f,
+        0.4f
+    };
 
-        p.life = mParticleLifetime;
-        p.position += mPosition;
-    }
+    p.life = mParticleLifetime;
+    p.position += mPosition;
+}
+
+Emitter::AnalyticBehaviour FlameEmitter::analyticBehaviour() const
+{
+    return FLAME;
 }
 
 
 
 void SmokeEmitter::updateParticles(float dt)
 {
+    if (mAnalytic) {
+        updateAnalytic(dt);
+        return;
+    }
+
     mTimeSinceLast += dt;
 
     for (Particle& p : mParticlesContainer) {
@@ -255,35 +579,43 @@ void SmokeEmitter::updateParticles(float dt)
         mTimeSinceLast -= mTimeBetweenParticles;
 
         int p_idx = findUnusedParticle();
-        Particle& p = mParticlesContainer[p_idx];
+        spawnParticle(mParticlesContainer[p_idx]);
+    }
 
-        float angle = glm::linearRand(0.0f, 2.0f * glm::pi<float>());
-        float distance = glm::linearRand(0.0f, mRadius);
-        float color = glm::linearRand(0.2f, 0.5f);
+}
 
-        p.position = {
-            cos(angle) * distance,
-            0.0f,
-            sin(angle) * distance
-        };
+void SmokeEmitter::spawnParticle(Particle& p)
+{
+    float angle = random(0.0f, 2.0f * glm::pi<float>());
+    float distance = random(0.0f, mRadius);
+    float color = random(0.2f, 0.5f);
+
+    p.position = {
+        cos(angle) * distance,
+        0.0f,
+        sin(angle) * distance
+    };
 
-        p.velocity = {
-            glm::linearRand(-0.1f, 0.1f), // x
-            glm::linearRand(1.0f, 0.8f),  // y
-            glm::linearRand(-0.1f, 0.1f)  // z
-        };
+    p.velocity = {
+        random(-0.1f, 0.1f), // x
+        random(1.0f, 0.8f),  // y
+        random(-0.1f, 0.1f)  // z
+    };
 
-        p.color = {
-            color,
-            color,
-            color,
-            0.4f
-        };
+    p.color = {
+        color,
+        color,
+        color,
+        0.4f
+    };
 
-        p.life = mParticleLifetime;
-        p.position += mPosition;
-    }
+    p.life = mParticleLifetime;
+    p.position += mPosition;
+}
 
+Emitter::AnalyticBehaviour SmokeEmitter::analyticBehaviour() const
+{
+    return SMOKE;
 }
 
 
@@ -2,14 +2,16 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
-#include <glm/gtc/random.hpp>
+#include <glm/gtc/constants.hpp>
 #include <iostream>
 #include <vector>
 #include <algorithm>
 #include <BulletDynamics/Dynamics/btDynamicsWorld.h>
 #include <btBulletDynamicsCommon.h>
 
+#include "settings.h"
 #include "Utils.h"
+#include "rng.h"
 
 
 struct Particle {
@@ -23,11 +25,45 @@ struct Particle {
 		position(0.0f), velocity(0.0f), color(1.0f), life(0), size(1.0f) { }
 };
 
+// Spawn record for analytic emitters. Everything else about the particle
+// is a closed-form function of its age, evaluated in vertexShaderParticle.glsl
+struct ParticleSpawn {
+	glm::vec3 origin;
+	float spawnTime;
+	glm::vec3 velocity;
+	float seed;
+};
+
+// Pre-rendered animation of an emitter, drawn as a single billboard far away
+struct Flipbook {
+	GLuint texture = 0;
+	int columns = 0;
+	int rows = 0;
+	float duration = 0.0f;		// seconds for all frames
+	float centerHeight = 0.0f;	// billboard center above the emitter
+	float halfSize = 0.0f;
+	glm::vec4 rect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);	// texture region of all frames
+};
+
 
 class Emitter {
 public:
+	// Must match the uAnalytic values in vertexShaderParticle.glsl
+	enum AnalyticBehaviour {
+		NONE = 0,
+		FLAME = 1,
+		SMOKE = 2
+	};
+
+	enum LodTier {
+		LOD_NEAR,	// full simulation
+		LOD_MID,	// reduced spawn rate, larger particles
+		LOD_FAR,	// flipbook billboard, simulation suspended
+		LOD_HIDDEN	// off screen or over budget, simulation suspended
+	};
+
 	Emitter(int particlesPerSecond=0, float particleLifetime=0, float radius=0, float particleSize=0.1, GLuint texture=0);
-	~Emitter();
+	virtual ~Emitter();
 
 	virtual void initializeParticles();
 	void fillBuffers();
@@ -35,10 +71,41 @@ public:
 	void resetParticle(Particle& p);
 	int findUnusedParticle();
 	void setPBody(btRigidBody* pBody);
+	float random(float min, float max);
+
+	// Analytic mode
+	void setAnalytic(bool analytic);
+	void initSpawnBuffer();
+	void updateAnalytic(float dt);
+	void uploadSpawns();
+	virtual AnalyticBehaviour analyticBehaviour() const;
+	virtual void spawnParticle(Particle& p);
+
+	// Level of detail
+	void setLod(bool enabled, Flipbook flipbook = Flipbook());
+	void setLodTier(LodTier tier);
+	int expectedParticles(LodTier tier) const;
+	float boundingRadius() const;
+	void update(float dt);
+	void simulate(float time);
+
+	// Template mode, draws the particles of a shared source emitter at this position
+	void setTemplate(Emitter* source, float rotation);
+	const std::vector<Particle>& particles() const;
+	Particle worldParticle(int i) const;
 
 	virtual void updateParticles(float dt) = 0;
 	void renderParticles(GLuint shaderProgram);
 
+	// Building blocks for drawing particles of several emitters in depth order
+	void followBody();
+	void bindForRender();
+	void drawParticle(GLuint shaderProgram, Particle& p);
+	void drawAnalytic(GLuint shaderProgram);
+	void drawFlipbook(GLuint shaderProgram);
+	glm::vec4 flipbookFrameRect() const;
+	Particle flipbookBillboard() const;
+
 	/// Variables
 	GLuint VAO;
 	GLuint VBO[2];
@@ -59,18 +126,47 @@ public:
 	GLuint mTexture;
 	glm::vec3 mPosition = glm::vec3(0.0f);
 	btRigidBody* m_pBody = nullptr;
+
+	// Own random stream, refilled in SIMD batches
+	Rng mRng;
+	std::vector<float> mRandomPool;
+	int mRandomIndex = 0;
+
+	// Analytic mode
+	bool mAnalytic = false;
+	double mTime = 0.0;
+	GLuint mSpawnVBO = 0;
+	int mSpawnCapacity = 0;
+	int mSpawnHead = 0;
+	std::vector<ParticleSpawn> mPendingSpawns;
+
+	// Level of detail
+	bool mUseLod = false;
+	LodTier mLodTier = LOD_NEAR;
+	float mBaseSize = 0.0f;
+	float mSuspendedTime = 0.0f;
+	float mFlipbookTime = 0.0f;
+	Flipbook mFlipbook;
+
+	// Template mode
+	Emitter* mSource = nullptr;
+	glm::vec2 mRotation = glm::vec2(1.0f, 0.0f);	// cos, sin around the y axis
 };
 
 class FlameEmitter : public Emitter {
 public:
 	using Emitter::Emitter;
 	void updateParticles(float dt) override;
+	void spawnParticle(Particle& p) override;
+	AnalyticBehaviour analyticBehaviour() const override;
 };
 
 class SmokeEmitter : public Emitter {
 public:
 	using Emitter::Emitter;
 	void updateParticles(float dt) override;
+	void spawnParticle(Particle& p) override;
+	AnalyticBehaviour analyticBehaviour() const override;
 };
 
 class TrailEmitter : public Emitter {	
@@ -0,0 +1,101 @@
+#include "particle_sort.h"
+
+#include <cstring>
+#include <utility>
+
+void ParticleSorter::clear()
+{
+    mKeys.clear();
+    mValues.clear();
+}
+
+void ParticleSorter::reserve(size_t count)
+{
+    mKeys.reserve(count);
+    mValues.reserve(count);
+    mKeysScratch.reserve(count);
+    mValuesScratch.reserve(count);
+}
+
+void ParticleSorter::add(float depth, uint32_t value)
+{
+    mKeys.push_back(depthKey(depth));
+    mValues.push_back(value);
+}
+
+uint32_t ParticleSorter::depthKey(float depth)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &depth, sizeof(bits));
+
+    // Map float ordering onto unsigned ordering: flip all bits of negatives, only the sign of positives
+    uint32_t mask = (bits & 0x80000000u) ? 0xFFFFFFFFu : 0x80000000u;
+
+    // Invert so that ascending keys means descending depth (back to front)
+    return ~(bits ^ mask);
+}
+
+void ParticleSorter::sort()
+{
+    size_t count = mKeys.size();
+    if (count < 2) return;
+
+    mKeysScratch.resize(count);
+    mValuesScratch.resize(count);
+
+    // All histograms in one pass over the keys
+    std::memset(mHistogram, 0, sizeof(mHistogram));
+    for (size_t i = 0; i < count; i++) {
+        uint32_t key = mKeys[i];
+        for (int pass = 0; pass < NUM_PASSES; pass++) {
+            mHistogram[pass][(key >> (pass * RADIX_BITS)) & (RADIX_SIZE - 1)]++;
+        }
+    }
+
+    uint32_t* keysIn = mKeys.data();
+    uint32_t* valuesIn = mValues.data();
+    uint32_t* keysOut = mKeysScratch.data();
+    uint32_t* valuesOut = mValuesScratch.data();
+
+    for (int pass = 0; pass < NUM_PASSES; pass++) {
+        uint32_t* histogram = mHistogram[pass];
+        int shift = pass * RADIX_BITS;
+
+        // Skip passes where every key has the same digit, common for clustered depths
+        if (histogram[(keysIn[0] >> shift) & (RADIX_SIZE - 1)] == count) continue;
+
+        // Exclusive prefix sum gives the output offset of each bucket
+        uint32_t sum = 0;
+        for (int i = 0; i < RADIX_SIZE; i++) {
+            uint32_t c = histogram[i];
+            histogram[i] = sum;
+            sum += c;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            uint32_t key = keysIn[i];
+            uint32_t dst = histogram[(key >> shift) & (RADIX_SIZE - 1)]++;
+            keysOut[dst] = key;
+            valuesOut[dst] = valuesIn[i];
+        }
+
+        std::swap(keysIn, keysOut);
+        std::swap(valuesIn, valuesOut);
+    }
+
+    // Result ended up in the scratch buffers after an odd number of passes
+    if (keysIn != mKeys.data()) {
+        mKeys.swap(mKeysScratch);
+        mValues.swap(mValuesScratch);
+    }
+}
+
+size_t ParticleSorter::size() const
+{
+    return mKeys.size();
+}
+
+const std::vector<uint32_t>& ParticleSorter::values() const
+{
+    return mValues;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// LSD radix sort of particles on view depth, back to front.
+// Keys are 32-bit float bits sorted in three 11-bit passes. All buffers are
+// kept between frames, so steady-state sorting does not allocate.
+class ParticleSorter {
+public:
+	void clear();
+	void reserve(size_t count);
+	void add(float depth, uint32_t value);
+	void sort();
+
+	size_t size() const;
+	const std::vector<uint32_t>& values() const;
+
+private:
+	static uint32_t depthKey(float depth);
+
+	static const int RADIX_BITS = 11;
+	static const int RADIX_SIZE = 1 << RADIX_BITS;
+	static const int NUM_PASSES = 3;
+
+	std::vector<uint32_t> mKeys;
+	std::vector<uint32_t> mValues;
+	std::vector<uint32_t> mKeysScratch;
+	std::vector<uint32_t> mValuesScratch;
+	uint32_t mHistogram[NUM_PASSES][RADIX_SIZE];
+};
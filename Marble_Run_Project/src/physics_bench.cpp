@@ -0,0 +1,140 @@
+#include "physics_bench.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include <LinearMath/btThreads.h>
+
+#include "settings.h"
+
+using Clock = std::chrono::high_resolution_clock;
+
+static const int WARMUP_STEPS = 60;
+static const int TIMED_STEPS = 240;
+
+// Marbles in layers of 6 x 6 above start, like createSpheres but taller
+static std::vector<btRigidBody*> addMarbles(btDynamicsWorld* world, int count, const btVector3& start)
+{
+    const int side = 6;
+    const float spacing = 0.25f;
+    const float radius = 0.1f;
+    const float mass = (4.0f / 3.0f) * SIMD_PI * radius * radius * radius;
+    const float offset = -(spacing * (side - 1)) / 2.0f;
+
+    std::vector<btRigidBody*> marbles;
+    for (int i = 0; i < count; i++) {
+        int x = i % side;
+        int z = (i / side) % side;
+        int y = i / (side * side);
+        btVector3 pos = start + btVector3(offset + x * spacing, y * spacing, offset + z * spacing);
+
+        btRigidBody* marble = createMarbleRigidBody(mass, radius, pos, MARBLE_RESTITUTION, MARBLE_FRICTION);
+        world->addRigidBody(marble);
+        marbles.push_back(marble);
+    }
+    return marbles;
+}
+
+static void removeMarbles(btDynamicsWorld* world, std::vector<btRigidBody*>& marbles)
+{
+    for (btRigidBody* marble : marbles) {
+        world->removeRigidBody(marble);
+        delete marble->getMotionState();
+        delete marble->getCollisionShape();
+        delete marble;
+    }
+    marbles.clear();
+}
+
+// Average ms of a step once the marbles have settled in a little
+static double timeSteps(const PhysicsWorldOptions& options, const std::vector<btRigidBody*>& statics,
+    int marbleCount, const btVector3& start, int& threads)
+{
+    Bullet bullet;
+    createBulletWorld(bullet, options);
+    threads = bullet.pTaskScheduler ? bullet.pTaskScheduler->getNumThreads() : 1;
+
+    for (btRigidBody* body : statics) {
+        bullet.pWorld->addRigidBody(body);
+    }
+    std::vector<btRigidBody*> marbles = addMarbles(bullet.pWorld, marbleCount, start);
+
+    btScalar step = btScalar(1.0 / PHYSICS_RATE);
+    for (int i = 0; i < WARMUP_STEPS; i++) {
+        bullet.pWorld->stepSimulation(step, 0);
+    }
+    auto begin = Clock::now();
+    for (int i = 0; i < TIMED_STEPS; i++) {
+        bullet.pWorld->stepSimulation(step, 0);
+    }
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - begin).count() / TIMED_STEPS;
+
+    removeMarbles(bullet.pWorld, marbles);
+    for (btRigidBody* body : statics) {
+        bullet.pWorld->removeRigidBody(body);
+    }
+    destroyBulletWorld(bullet);
+    return ms;
+}
+
+void benchPhysics(btDynamicsWorld* course, const PhysicsWorldOptions& options, const btVector3& start)
+{
+    // The course's static bodies move from world to world
+    std::vector<btRigidBody*> statics;
+    btCollisionObjectArray& objects = course->getCollisionObjectArray();
+    for (int i = 0; i < objects.size(); i++) {
+        btRigidBody* body = btRigidBody::upcast(objects[i]);
+        if (body && body->isStaticObject()) {
+            statics.push_back(body);
+        }
+    }
+    for (btRigidBody* body : statics) {
+        course->removeRigidBody(body);
+    }
+
+    // Single threaded, then the multithreaded world with as many thread counts as asked for
+    std::vector<PhysicsWorldOptions> worlds;
+    PhysicsWorldOptions single = options;
+    single.multithreaded = false;
+    worlds.push_back(single);
+
+    btITaskScheduler* scheduler = findTaskScheduler(options.scheduler);
+    if (scheduler) {
+        PhysicsWorldOptions multi = options;
+        multi.multithreaded = true;
+        if (options.threads > 0) {
+            worlds.push_back(multi);
+        }
+        else {
+            int maxThreads = scheduler->getMaxNumThreads();
+            for (int threads = 1; threads < maxThreads; threads *= 2) {
+                multi.threads = threads;
+                worlds.push_back(multi);
+            }
+            multi.threads = maxThreads;
+            worlds.push_back(multi);
+        }
+    }
+    else {
+        std::printf("Task scheduler %s isn't available, timing the single threaded world only\n", options.scheduler.c_str());
+    }
+
+    std::printf("Physics scaling on the course, %d steps at %.0f Hz after %d to settle, %s scheduler\n",
+        TIMED_STEPS, PHYSICS_RATE, WARMUP_STEPS, options.scheduler.c_str());
+    std::printf("%8s %6s %8s %10s %8s\n", "marbles", "world", "threads", "ms/step", "speedup");
+
+    for (int marbles : { 36, 500, 5000 }) {
+        double singleMs = 0.0;
+        for (const PhysicsWorldOptions& world : worlds) {
+            int threads = 1;
+            double ms = timeSteps(world, statics, marbles, start, threads);
+            if (!world.multithreaded) singleMs = ms;
+            std::printf("%8d %6s %8d %10.3f %8.2f\n", marbles, world.multithreaded ? "mt" : "st", threads, ms, singleMs / ms);
+        }
+    }
+
+    for (btRigidBody* body : statics) {
+        course->addRigidBody(body);
+    }
+}
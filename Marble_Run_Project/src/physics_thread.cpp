@@ -0,0 +1,175 @@
+#include "physics_thread.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "bulletHelpers.h"
+#include "settings.h"
+
+static double steadySeconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+PhysicsThread::PhysicsThread(btDynamicsWorld* world, bool threaded)
+    : mWorld(world), mThreaded(threaded), mTimestep(PHYSICS_RATE, PHYSICS_MAX_SUBSTEPS)
+{
+    mSnapshot = &mSnapshots.read();
+}
+
+PhysicsThread::~PhysicsThread()
+{
+    mStop = true;
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
+void PhysicsThread::start()
+{
+    if (mStarted) {
+        return;
+    }
+    mStarted = true;
+    collectBodies();
+    publish(false);
+
+    if (mThreaded) {
+        mThread = std::thread(&PhysicsThread::threadLoop, this);
+    }
+}
+
+uint64_t PhysicsThread::submit(std::function<void(btDynamicsWorld*)> command)
+{
+    std::lock_guard<std::mutex> lock(mCommandMutex);
+    mCommands.push_back(std::move(command));
+    return ++mCommandsSubmitted;
+}
+
+bool PhysicsThread::applyCommands()
+{
+    {
+        std::lock_guard<std::mutex> lock(mCommandMutex);
+        if (mCommands.empty()) return false;
+        mApplying.swap(mCommands);
+    }
+
+    for (auto& command : mApplying) {
+        command(mWorld);
+    }
+    mCommandsApplied += mApplying.size();
+    mApplying.clear();
+
+    // Commands may have added or removed marbles
+    collectBodies();
+    return true;
+}
+
+void PhysicsThread::collectBodies()
+{
+    mBodies.clear();
+    btCollisionObjectArray& objects = mWorld->getCollisionObjectArray();
+    for (int i = 0; i < objects.size(); i++) {
+        if (interpolatedMotionState(objects[i])) {
+            mBodies.push_back(btRigidBody::upcast(objects[i]));
+        }
+    }
+}
+
+void PhysicsThread::stepOnce()
+{
+    applyCommands();
+
+    double start = steadySeconds();
+    for (btRigidBody* body : mBodies) {
+        static_cast<InterpolatedMotionState*>(body->getMotionState())->beginStep();
+    }
+    // One step of exactly the fixed size, no substeps of Bullet's own. Motion states get
+    // the body transforms as they are after it.
+    mWorld->stepSimulation(btScalar(mTimestep.step()), 0);
+
+    mRules.apply(mBodies);
+    mStepMs = (steadySeconds() - start) * 1000.0;
+
+    publish(true);
+}
+
+void PhysicsThread::publish(bool stepped)
+{
+    PhysicsSnapshot& snapshot = mSnapshots.back();
+
+    snapshot.bodies.resize(mBodies.size());
+    for (size_t i = 0; i < mBodies.size(); i++) {
+        const InterpolatedMotionState* state = static_cast<InterpolatedMotionState*>(mBodies[i]->getMotionState());
+        // Without a step there is nothing to blend from
+        snapshot.bodies[i] = { mBodies[i], stepped ? state->mPrevious : state->mCurrent, state->mCurrent };
+    }
+    snapshot.finishOrder = mRules.finishOrder();
+    snapshot.commandsApplied = mCommandsApplied;
+    snapshot.steps = mTimestep.mSteps;
+    snapshot.droppedTime = mTimestep.mDroppedTime;
+    snapshot.stepMs = mStepMs;
+    snapshot.time = steadySeconds();
+
+    mSnapshots.publish();
+}
+
+void PhysicsThread::threadLoop()
+{
+    double last = steadySeconds();
+    while (!mStop) {
+        double now = steadySeconds();
+        double dt = now - last;
+        last = now;
+
+        if (!mRunning) {
+            // Paused. Edits still go through, and no time piles up.
+            if (applyCommands()) publish(false);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        int steps = mTimestep.advance(dt);
+        for (int i = 0; i < steps; i++) {
+            stepOnce();
+        }
+        if (steps == 0 && applyCommands()) {
+            publish(false);
+        }
+
+        // Sleep until the next step is due
+        double wait = (1.0 - mTimestep.alpha()) * mTimestep.step();
+        std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+    }
+}
+
+const PhysicsSnapshot& PhysicsThread::update(double dt)
+{
+    if (!mThreaded && mStarted) {
+        int steps = mRunning ? mTimestep.advance(dt) : 0;
+        for (int i = 0; i < steps; i++) {
+            stepOnce();
+        }
+        if (steps == 0 && applyCommands()) {
+            publish(false);
+        }
+    }
+
+    mSnapshot = &mSnapshots.read();
+
+    // The thread publishes each step as it happens, so blend by the time since. Inline,
+    // the accumulator knows how far the frame is past the last step.
+    float alpha;
+    if (mThreaded) {
+        alpha = static_cast<float>((steadySeconds() - mSnapshot->time) / mTimestep.step());
+        alpha = std::min(std::max(alpha, 0.0f), 1.0f);
+    }
+    else {
+        alpha = mTimestep.alpha();
+    }
+
+    for (const PhysicsBodyState& state : mSnapshot->bodies) {
+        static_cast<InterpolatedMotionState*>(state.body->getMotionState())->blend(state.previous, state.current, alpha);
+    }
+    return *mSnapshot;
+}
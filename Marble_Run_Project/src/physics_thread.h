@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <BulletDynamics/Dynamics/btDynamicsWorld.h>
+#include <btBulletDynamicsCommon.h>
+#include <BulletCollision/CollisionDispatch/btGhostObject.h>
+
+#include "course_physics.h"
+#include "fixed_timestep.h"
+#include "triple_buffer.h"
+
+// Transforms of a body after the last two steps
+struct PhysicsBodyState {
+	btRigidBody* body;
+	btTransform previous;
+	btTransform current;
+};
+
+// What the render side sees of the world, published after every step
+struct PhysicsSnapshot {
+	std::vector<PhysicsBodyState> bodies;
+	// Bodies in the order they first reached the finish line
+	std::vector<const btCollisionObject*> finishOrder;
+	uint64_t commandsApplied = 0;
+	long long steps = 0;
+	double droppedTime = 0.0;
+	double stepMs = 0.0;		// cost of the last step
+	double time = 0.0;			// steady clock seconds when published
+};
+
+// Steps a world at PHYSICS_RATE, on its own thread or inline from update(). Bodies with an
+// InterpolatedMotionState are published after each step and blended by update() on the
+// render thread, which never touches the world while it steps. Anything else that changes
+// the world goes through submit() and runs between steps.
+class PhysicsThread {
+public:
+	PhysicsThread(btDynamicsWorld* world, bool threaded);
+	~PhysicsThread();
+
+	// Marbles overlapping finishLine are added to finishOrder
+	void setFinishLine(btGhostObject* finishLine) { mRules.setFinishLine(finishLine); }
+	// Marbles falling below minY are moved back to start
+	void setRespawn(btScalar minY, const btVector3& start) { mRules.setRespawn(minY, start); }
+
+	// Call once the world is built. Until then, and while running is false, nothing steps.
+	void start();
+	void setRunning(bool running) { mRunning = running; }
+
+	// Runs command on the physics side between steps. Returns its number, which
+	// commandsApplied of a snapshot reaches once it ran.
+	uint64_t submit(std::function<void(btDynamicsWorld*)> command);
+
+	// Render thread, once a frame. Steps by dt first when not threaded, then takes the
+	// newest snapshot and blends the marbles between its two steps.
+	const PhysicsSnapshot& update(double dt);
+	const PhysicsSnapshot& snapshot() const { return *mSnapshot; }
+
+	bool isThreaded() const { return mThreaded; }
+	double step() const { return mTimestep.step(); }
+	int maxSubSteps() const { return mTimestep.maxSubSteps(); }
+
+private:
+	void threadLoop();
+	bool applyCommands();
+	void collectBodies();
+	void stepOnce();
+	void publish(bool stepped);
+
+	btDynamicsWorld* mWorld;
+	bool mThreaded;
+	FixedTimestep mTimestep;
+	std::thread mThread;
+	std::atomic<bool> mStop{ false };
+	std::atomic<bool> mRunning{ true };
+	bool mStarted = false;
+
+	std::mutex mCommandMutex;
+	std::vector<std::function<void(btDynamicsWorld*)>> mCommands;
+	std::vector<std::function<void(btDynamicsWorld*)>> mApplying;
+	uint64_t mCommandsSubmitted = 0;
+	uint64_t mCommandsApplied = 0;
+
+	// Physics side
+	std::vector<btRigidBody*> mBodies;
+	RaceRules mRules;
+	double mStepMs = 0.0;
+
+	TripleBuffer<PhysicsSnapshot> mSnapshots;
+	const PhysicsSnapshot* mSnapshot;
+};
@@ -0,0 +1,125 @@
+#include "race.h"
+
+#include <chrono>
+
+#include "course_physics.h"
+
+using Clock = std::chrono::high_resolution_clock;
+
+RaceCourse buildRaceCourse(glm::vec3 start)
+{
+    RaceCourse course;
+    course.layout = buildCourseLayout(start);
+    for (const std::vector<TrackSupport>& supports : course.layout.tracks) {
+        course.trackMeshes.push_back(buildTrackCollisionMesh(supports));
+    }
+    return course;
+}
+
+std::vector<RaceEntry> raceEntries(const RaceCourse& course, const std::vector<MarbleSpec>& marbles)
+{
+    std::vector<glm::vec3> positions = marbleStartPositions(course.layout.start, static_cast<int>(marbles.size()));
+
+    std::vector<RaceEntry> entries;
+    for (size_t i = 0; i < marbles.size(); i++) {
+        entries.push_back({ marbles[i], positions[i] });
+    }
+    return entries;
+}
+
+RaceWorld::RaceWorld(const RaceCourse& course, const PhysicsWorldOptions& options)
+    : mStart(course.layout.start)
+{
+    createBulletWorld(mBullet, options);
+
+    mGround = createGroundRigidBody();
+    for (const std::shared_ptr<MeshData>& mesh : course.trackMeshes) {
+        mStatics.push_back(createTrackRigidBody(mesh));
+    }
+    for (const PlinkoLayout& plinko : course.layout.plinkos) {
+        mStatics.push_back(createPlinkoRigidBody(plinko));
+    }
+
+    // In the world between races, so the destructor finds everything there
+    mBullet.pWorld->addRigidBody(mGround);
+    for (btRigidBody* body : mStatics) {
+        mBullet.pWorld->addRigidBody(body);
+    }
+    mFinishLine = createFinishLine(mBullet.pWorld, course.layout.finishLine);
+}
+
+RaceWorld::~RaceWorld()
+{
+    deleteCollisionObjects(mBullet.pWorld);
+    destroyBulletWorld(mBullet);
+}
+
+RaceResult RaceWorld::run(const std::vector<RaceEntry>& entries, const RaceSettings& settings)
+{
+    btDynamicsWorld* world = mBullet.pWorld;
+
+    // The broadphase only resets when empty. Leftover pairs and tree shape from the last
+    // race would change the order contacts are solved in.
+    world->removeCollisionObject(mFinishLine);
+    for (btRigidBody* body : mStatics) {
+        world->removeRigidBody(body);
+    }
+    world->removeRigidBody(mGround);
+    mBullet.pBroadphase->resetPool(mBullet.pDispatcher);
+    mBullet.pSolver->reset();
+
+    // Same order as createWorld
+    world->addRigidBody(mGround);
+
+    std::vector<btRigidBody*> marbles;
+    for (size_t i = 0; i < entries.size(); i++) {
+        btRigidBody* marble = createMarbleRigidBody(entries[i].marble, entries[i].start);
+        marble->setUserIndex(static_cast<int>(i));
+        world->addRigidBody(marble);
+        marbles.push_back(marble);
+    }
+    for (btRigidBody* body : mStatics) {
+        world->addRigidBody(body);
+    }
+    world->addCollisionObject(mFinishLine, btBroadphaseProxy::SensorTrigger, btBroadphaseProxy::DefaultFilter);
+
+    RaceRules rules;
+    rules.setFinishLine(mFinishLine);
+    rules.setRespawn(MARBLE_RESPAWN_HEIGHT, { mStart.x, mStart.y, mStart.z });
+
+    RaceResult result;
+    result.finishTimes.assign(entries.size(), -1.0);
+
+    btScalar step = btScalar(1.0 / settings.rate);
+    long long maxSteps = static_cast<long long>(settings.maxTime * settings.rate);
+    auto begin = Clock::now();
+    while (result.placements.size() < entries.size() && result.steps < maxSteps) {
+        world->stepSimulation(step, 0);
+        result.steps++;
+
+        int finished = rules.apply(marbles);
+        const std::vector<const btCollisionObject*>& order = rules.finishOrder();
+        for (size_t i = order.size() - finished; i < order.size(); i++) {
+            int entry = order[i]->getUserIndex();
+            result.placements.push_back(entry);
+            result.finishTimes[entry] = result.steps / settings.rate;
+        }
+    }
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+    result.stepMs = result.steps > 0 ? ms / result.steps : 0.0;
+    result.complete = result.placements.size() == entries.size();
+
+    for (btRigidBody* marble : marbles) {
+        world->removeRigidBody(marble);
+        delete marble->getMotionState();
+        delete marble->getCollisionShape();
+        delete marble;
+    }
+    return result;
+}
+
+RaceResult runRace(const RaceCourse& course, const std::vector<RaceEntry>& entries, const RaceSettings& settings)
+{
+    RaceWorld world(course, settings.world);
+    return world.run(entries, settings);
+}
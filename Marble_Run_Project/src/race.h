@@ -0,0 +1,73 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+#include <BulletCollision/CollisionDispatch/btGhostObject.h>
+
+#include "bulletHelpers.h"
+#include "course.h"
+#include "mesh_builder.h"
+#include "settings.h"
+
+// Races run start to finish in a world of their own, without drawing anything.
+
+// A course ready to race on. The track meshes are built once and only read by the worlds
+// raced on it, so any number of races can share them.
+struct RaceCourse {
+	CourseLayout layout;
+	std::vector<std::shared_ptr<MeshData>> trackMeshes;
+};
+
+RaceCourse buildRaceCourse(glm::vec3 start);
+
+struct RaceEntry {
+	MarbleSpec marble;
+	glm::vec3 start;
+};
+
+// Marbles in drop order, placed above the course start as the app places them
+std::vector<RaceEntry> raceEntries(const RaceCourse& course, const std::vector<MarbleSpec>& marbles);
+
+struct RaceSettings {
+	double rate = PHYSICS_RATE;
+	double maxTime = RACE_MAX_TIME;
+	PhysicsWorldOptions world;
+};
+
+struct RaceResult {
+	// Entries in the order they crossed the finish line
+	std::vector<int> placements;
+	// Race seconds when each entry finished, negative for those that didn't
+	std::vector<double> finishTimes;
+	long long steps = 0;
+	double stepMs = 0.0;		// average cost of a step
+	bool complete = false;		// every entry finished before maxTime
+};
+
+// A world for racing on one course again and again. The course bodies are made once. Before
+// each race every body is taken out and the broadphase and solver are reset, so a race runs
+// the same no matter what the world raced before.
+class RaceWorld {
+public:
+	RaceWorld(const RaceCourse& course, const PhysicsWorldOptions& options = PhysicsWorldOptions());
+	~RaceWorld();
+	RaceWorld(const RaceWorld&) = delete;
+	RaceWorld& operator=(const RaceWorld&) = delete;
+
+	// Steps the course with entries at settings.rate until every marble finished or maxTime
+	// passed. settings.world is what the constructor was given.
+	RaceResult run(const std::vector<RaceEntry>& entries, const RaceSettings& settings);
+
+private:
+	Bullet mBullet;
+	glm::vec3 mStart;
+	// Ground goes in before the marbles, the other course bodies after them
+	btRigidBody* mGround;
+	std::vector<btRigidBody*> mStatics;
+	btGhostObject* mFinishLine;
+};
+
+// One race in a world of its own
+RaceResult runRace(const RaceCourse& course, const std::vector<RaceEntry>& entries,
+	const RaceSettings& settings = RaceSettings());
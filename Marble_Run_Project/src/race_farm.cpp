@@ -0,0 +1,136 @@
+#include "race_farm.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <numeric>
+#include <thread>
+
+#include "rng.h"
+#include "thread_pool.h"
+
+using Clock = std::chrono::high_resolution_clock;
+
+int MarbleRaceStats::finished() const
+{
+    return std::accumulate(places.begin(), places.end(), 0);
+}
+
+double MarbleRaceStats::winProbability(int races) const
+{
+    return races > 0 && !places.empty() ? double(places[0]) / races : 0.0;
+}
+
+double MarbleRaceStats::meanPlace() const
+{
+    int count = finished();
+    if (count == 0) return 0.0;
+
+    double sum = 0.0;
+    for (size_t p = 0; p < places.size(); p++) {
+        sum += double(p + 1) * places[p];
+    }
+    return sum / count;
+}
+
+double MarbleRaceStats::meanTime() const
+{
+    int count = finished();
+    return count > 0 ? totalTime / count : 0.0;
+}
+
+std::vector<RaceEntry> raceFarmEntries(const RaceCourse& course, const std::vector<MarbleSpec>& marbles,
+    int race, float startJitter, std::vector<int>& order)
+{
+    Rng rng(RNG_STREAM_RACE + static_cast<uint64_t>(race));
+
+    order.resize(marbles.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), rng);
+
+    std::vector<glm::vec3> positions = marbleStartPositions(course.layout.start, static_cast<int>(marbles.size()));
+    std::vector<RaceEntry> entries;
+    for (size_t i = 0; i < marbles.size(); i++) {
+        glm::vec3 pos = positions[i];
+        pos.x += rng.uniform(-startJitter, startJitter);
+        pos.z += rng.uniform(-startJitter, startJitter);
+        entries.push_back({ marbles[order[i]], pos });
+    }
+    return entries;
+}
+
+RaceFarmResult runRaceFarm(const RaceCourse& course, const std::vector<MarbleSpec>& marbles, const RaceFarmSettings& settings)
+{
+    RaceFarmResult result;
+    result.races = std::max(0, settings.races);
+    result.threads = settings.threads > 0 ? settings.threads : static_cast<int>(std::thread::hardware_concurrency());
+    result.threads = std::max(1, std::min(result.threads, std::max(1, result.races)));
+
+    RaceSettings race = settings.race;
+    race.world.multithreaded = false;
+
+    // What a race needs to be counted, filled in by whichever thread ran it
+    struct RaceRecord {
+        std::vector<int> order;
+        RaceResult result;
+    };
+    std::vector<RaceRecord> records(result.races);
+
+    // Made on the thread that uses it, so the track BVHs build in parallel too
+    std::vector<std::unique_ptr<RaceWorld>> worlds(result.threads);
+
+    auto start = Clock::now();
+    result.steals = workStealingFor(result.threads, records.size(), [&](int thread, size_t index) {
+        if (!worlds[thread]) {
+            worlds[thread].reset(new RaceWorld(course, race.world));
+        }
+        RaceRecord& record = records[index];
+        std::vector<RaceEntry> entries = raceFarmEntries(course, marbles, static_cast<int>(index), settings.startJitter, record.order);
+        record.result = worlds[thread]->run(entries, race);
+    });
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    worlds.clear();
+
+    result.marbles.resize(marbles.size());
+    for (MarbleRaceStats& stats : result.marbles) {
+        stats.places.assign(marbles.size(), 0);
+    }
+    for (const RaceRecord& record : records) {
+        const RaceResult& raced = record.result;
+        for (size_t place = 0; place < raced.placements.size(); place++) {
+            int entry = raced.placements[place];
+            MarbleRaceStats& stats = result.marbles[record.order[entry]];
+            stats.places[place]++;
+            stats.totalTime += raced.finishTimes[entry];
+        }
+        for (size_t entry = 0; entry < raced.finishTimes.size(); entry++) {
+            if (raced.finishTimes[entry] < 0.0) {
+                result.marbles[record.order[entry]].unfinished++;
+            }
+        }
+        result.steps += raced.steps;
+    }
+    return result;
+}
+
+void printRaceFarm(const RaceFarmResult& result, const std::vector<MarbleSpec>& marbles)
+{
+    std::printf("%d races on %d threads in %.1f s, %.2f races/s, %zu steals, %.0f steps/s\n",
+        result.races, result.threads, result.seconds, result.racesPerSecond(), result.steals,
+        result.seconds > 0.0 ? result.steps / result.seconds : 0.0);
+    std::printf("%-20s %8s %8s %10s %10s %10s\n", "marble", "radius", "density", "win %", "mean place", "mean time");
+
+    std::vector<int> best(marbles.size());
+    std::iota(best.begin(), best.end(), 0);
+    std::stable_sort(best.begin(), best.end(), [&result](int a, int b) {
+        return result.marbles[a].places[0] > result.marbles[b].places[0];
+    });
+    for (int i : best) {
+        const MarbleRaceStats& stats = result.marbles[i];
+        std::printf("%-20s %8.3f %8.2f %10.2f %10.2f %10.2f", marbles[i].name.c_str(), marbles[i].radius,
+            marbles[i].density, 100.0 * stats.winProbability(result.races), stats.meanPlace(), stats.meanTime());
+        if (stats.unfinished > 0) std::printf("  %d unfinished", stats.unfinished);
+        std::printf("\n");
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "course.h"
+#include "race.h"
+#include "settings.h"
+
+// Many races on one course to estimate how likely each marble is to win. Every race has its
+// own drop order and start positions, drawn from the global seed and the race's number, and
+// the races run on worker threads with a RaceWorld each. Which thread runs a race doesn't
+// change its result, so a seed gives the same estimates on any number of threads.
+
+struct RaceFarmSettings {
+	int races = 1000;
+	int threads = RACE_FARM_THREADS;
+	float startJitter = RACE_FARM_START_JITTER;
+	// world is forced single threaded, the farm already keeps every core busy
+	RaceSettings race;
+};
+
+// Placements of one marble over all races
+struct MarbleRaceStats {
+	// places[p] is the number of races the marble finished in place p + 1
+	std::vector<int> places;
+	int unfinished = 0;
+	double totalTime = 0.0;		// summed over the races it finished
+
+	int finished() const;
+	double winProbability(int races) const;
+	double meanPlace() const;
+	double meanTime() const;
+};
+
+struct RaceFarmResult {
+	// Same order as the marbles given
+	std::vector<MarbleRaceStats> marbles;
+	int races = 0;
+	int threads = 0;
+	size_t steals = 0;
+	long long steps = 0;
+	double seconds = 0.0;
+
+	double racesPerSecond() const { return seconds > 0.0 ? races / seconds : 0.0; }
+};
+
+// The entries of race number race: marbles shuffled and their start positions jittered
+std::vector<RaceEntry> raceFarmEntries(const RaceCourse& course, const std::vector<MarbleSpec>& marbles,
+	int race, float startJitter, std::vector<int>& order);
+
+RaceFarmResult runRaceFarm(const RaceCourse& course, const std::vector<MarbleSpec>& marbles,
+	const RaceFarmSettings& settings = RaceFarmSettings());
+
+// Table of win probability, mean place and finish time per marble, best first
+void printRaceFarm(const RaceFarmResult& result, const std::vector<MarbleSpec>& marbles);
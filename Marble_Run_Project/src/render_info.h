@@ -10,9 +10,11 @@
 #include <btBulletDynamicsCommon.h>
 #include <BulletCollision/CollisionDispatch/btGhostObject.h>
 
+#include "bulletHelpers.h"
 #include "structs.h"
 #include "shape.h"
 #include "particle_emitter.h"
+#include "particle_atlas.h"
 #include "camera.h"
 
 struct RenderInfo {
@@ -22,7 +24,12 @@ struct RenderInfo {
 
     std::map<std::string, GLuint> texture;
     std::map<std::string, GLuint> skyboxTexture;
-    std::map<std::string, std::shared_ptr<std::vector<std::vector<float>>>> heightMap;
+    std::map<std::string, Flipbook> flipbook;
+    ParticleAtlas* particleAtlas = nullptr;
+    std::map<std::string, std::vector<Emitter*>> emitterTemplates;
+    std::map<std::string, std::shared_ptr<Heightfield>> heightMap;
     std::vector<SphereInfo> sphereinfo;
+    // Tracks that can be edited from the GUI
+    std::vector<HalfPipeTrack*> tracks;
     btGhostObject* finishLine = nullptr;
 };
\ No newline at end of file
@@ -0,0 +1,160 @@
+#include "rng.h"
+
+#include <atomic>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RNG_SSE2
+#include <emmintrin.h>
+#endif
+
+static std::atomic<uint64_t> gGlobalSeed{ 0 };
+static std::atomic<uint64_t> gNextStreamId{ RNG_STREAM_DYNAMIC };
+
+void setGlobalSeed(uint64_t seed)
+{
+    gGlobalSeed = seed;
+}
+
+uint64_t getGlobalSeed()
+{
+    return gGlobalSeed;
+}
+
+uint64_t nextRngStreamId()
+{
+    return gNextStreamId++;
+}
+
+static uint64_t splitmix64(uint64_t& x)
+{
+    uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static inline uint32_t rotl(uint32_t x, int k)
+{
+    return (x << k) | (x >> (32 - k));
+}
+
+// 24 random bits to a float in [0, 1)
+static inline float toUnitFloat(uint32_t x)
+{
+    return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+Rng::Rng() : Rng(nextRngStreamId())
+{
+}
+
+Rng::Rng(uint64_t streamId)
+{
+    seed(streamId);
+}
+
+void Rng::seed(uint64_t streamId)
+{
+    uint64_t x = getGlobalSeed() ^ (streamId * 0xD1B54A32D192ED03ull);
+
+    // xoshiro must not start from an all-zero state, splitmix output practically never is
+    for (int i = 0; i < 2; i++) {
+        uint64_t v = splitmix64(x);
+        mState[2 * i] = static_cast<uint32_t>(v);
+        mState[2 * i + 1] = static_cast<uint32_t>(v >> 32);
+    }
+    for (int lane = 0; lane < 4; lane++) {
+        for (int i = 0; i < 2; i++) {
+            uint64_t v = splitmix64(x);
+            mLanes[2 * i][lane] = static_cast<uint32_t>(v);
+            mLanes[2 * i + 1][lane] = static_cast<uint32_t>(v >> 32);
+        }
+    }
+}
+
+uint32_t Rng::next()
+{
+    uint32_t result = mState[0] + mState[3];
+    uint32_t t = mState[1] << 9;
+
+    mState[2] ^= mState[0];
+    mState[3] ^= mState[1];
+    mState[1] ^= mState[2];
+    mState[0] ^= mState[3];
+    mState[2] ^= t;
+    mState[3] = rotl(mState[3], 11);
+
+    return result;
+}
+
+float Rng::uniform()
+{
+    return toUnitFloat(next());
+}
+
+float Rng::uniform(float min, float max)
+{
+    return min + (max - min) * uniform();
+}
+
+void Rng::uniformBatch(float* out, int count, float min, float max)
+{
+    int i = 0;
+    float scale = (max - min) * (1.0f / 16777216.0f);
+
+#ifdef RNG_SSE2
+    __m128i s0 = _mm_load_si128(reinterpret_cast<__m128i*>(mLanes[0]));
+    __m128i s1 = _mm_load_si128(reinterpret_cast<__m128i*>(mLanes[1]));
+    __m128i s2 = _mm_load_si128(reinterpret_cast<__m128i*>(mLanes[2]));
+    __m128i s3 = _mm_load_si128(reinterpret_cast<__m128i*>(mLanes[3]));
+    __m128 vScale = _mm_set1_ps(scale);
+    __m128 vMin = _mm_set1_ps(min);
+
+    for (; i + 4 <= count; i += 4) {
+        __m128i result = _mm_add_epi32(s0, s3);
+        __m128i t = _mm_slli_epi32(s1, 9);
+
+        s2 = _mm_xor_si128(s2, s0);
+        s3 = _mm_xor_si128(s3, s1);
+        s1 = _mm_xor_si128(s1, s2);
+        s0 = _mm_xor_si128(s0, s3);
+        s2 = _mm_xor_si128(s2, t);
+        s3 = _mm_or_si128(_mm_slli_epi32(s3, 11), _mm_srli_epi32(s3, 21));
+
+        __m128 f = _mm_cvtepi32_ps(_mm_srli_epi32(result, 8));
+        _mm_storeu_ps(out + i, _mm_add_ps(vMin, _mm_mul_ps(f, vScale)));
+    }
+
+    _mm_store_si128(reinterpret_cast<__m128i*>(mLanes[0]), s0);
+    _mm_store_si128(reinterpret_cast<__m128i*>(mLanes[1]), s1);
+    _mm_store_si128(reinterpret_cast<__m128i*>(mLanes[2]), s2);
+    _mm_store_si128(reinterpret_cast<__m128i*>(mLanes[3]), s3);
+#else
+    for (; i + 4 <= count; i += 4) {
+        for (int lane = 0; lane < 4; lane++) {
+            uint32_t result = mLanes[0][lane] + mLanes[3][lane];
+            uint32_t t = mLanes[1][lane] << 9;
+
+            mLanes[2][lane] ^= mLanes[0][lane];
+            mLanes[3][lane] ^= mLanes[1][lane];
+            mLanes[1][lane] ^= mLanes[2][lane];
+            mLanes[0][lane] ^= mLanes[3][lane];
+            mLanes[2][lane] ^= t;
+            mLanes[3][lane] = rotl(mLanes[3][lane], 11);
+
+            out[i + lane] = min + (result >> 8) * scale;
+        }
+    }
+#endif
+
+    // Remainder from the scalar generator
+    for (; i < count; i++) {
+        out[i] = min + (next() >> 8) * scale;
+    }
+}
+
+Rng& threadRng()
+{
+    thread_local Rng rng;
+    return rng;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+
+// Fixed stream ids. Emitters and threads take ids from a counter above these
+enum RngStream : uint64_t {
+	RNG_STREAM_MARBLE_ORDER = 1,
+	RNG_STREAM_DYNAMIC = 1024,
+	// Race i of a race farm uses RNG_STREAM_RACE + i
+	RNG_STREAM_RACE = 1ull << 32
+};
+
+// Global seed all streams are derived from. Same seed, same run.
+void setGlobalSeed(uint64_t seed);
+uint64_t getGlobalSeed();
+uint64_t nextRngStreamId();
+
+// xoshiro128+ stream. Scalar generator plus four SIMD lanes for batches of floats.
+// Satisfies UniformRandomBitGenerator, so it can be passed to std::shuffle.
+class Rng {
+public:
+	using result_type = uint32_t;
+
+	Rng();
+	explicit Rng(uint64_t streamId);
+
+	void seed(uint64_t streamId);
+
+	uint32_t next();
+	result_type operator()() { return next(); }
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return 0xFFFFFFFFu; }
+
+	// [min, max)
+	float uniform();
+	float uniform(float min, float max);
+	void uniformBatch(float* out, int count, float min = 0.0f, float max = 1.0f);
+
+private:
+	uint32_t mState[4];
+	alignas(16) uint32_t mLanes[4][4];	// [state word][lane]
+};
+
+// One stream per thread, created on first use
+Rng& threadRng();
@@ -1,4 +1,5 @@
 #include "scene.h"
+#include "memory_stats.h"
 
 Scene::Scene(GLFWwindow* window) : mWindow(window)
 {
@@ -81,11 +82,207 @@ void Scene::update(Camera& camera, double dt)
 	mCameraPos = camera.getCameraPos();
 	mDt = dt;
 
+	updateFrustum();
+	for (Terrain* terrain : mTerrains) {
+		terrain->update(mCameraPos, mFrustumPlanes);
+	}
 	updateLightSpaceMatrix();
 	updateDirLight();
 }
 
 
+void Scene::updateFrustum()
+{
+	// Planes from the rows of the view projection matrix, pointing inwards
+	glm::mat4 m = mProjectionMatrix * mViewMatrix;
+	for (int i = 0; i < 3; i++) {
+		glm::vec4 row = { m[0][i], m[1][i], m[2][i], m[3][i] };
+		glm::vec4 w = { m[0][3], m[1][3], m[2][3], m[3][3] };
+		mFrustumPlanes[i * 2] = w + row;
+		mFrustumPlanes[i * 2 + 1] = w - row;
+	}
+	for (glm::vec4& plane : mFrustumPlanes) {
+		plane /= glm::length(glm::vec3(plane));
+	}
+}
+
+bool Scene::sphereInView(glm::vec3 center, float radius) const
+{
+	for (const glm::vec4& plane : mFrustumPlanes) {
+		if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) return false;
+	}
+	return true;
+}
+
+void Scene::updateEmitterLod()
+{
+	// Closest emitters get the detail, the rest is demoted to stay within the particle budget
+	std::vector<std::pair<float, Emitter*>> lodEmitters;
+	for (Emitter* emitter : mEmitters) {
+		if (emitter->mUseLod) {
+			lodEmitters.push_back({ glm::distance(emitter->mPosition, mCameraPos), emitter });
+		}
+	}
+	std::sort(lodEmitters.begin(), lodEmitters.end(),
+		[](const std::pair<float, Emitter*>& a, const std::pair<float, Emitter*>& b) { return a.first < b.first; });
+
+	int particles = 0;
+	std::fill(std::begin(mLodCounts), std::end(mLodCounts), 0);
+
+	for (const std::pair<float, Emitter*>& entry : lodEmitters) {
+		float distance = entry.first;
+		Emitter* emitter = entry.second;
+		Emitter::LodTier tier = Emitter::LOD_FAR;
+		if (!sphereInView(emitter->mPosition, emitter->boundingRadius())) {
+			tier = Emitter::LOD_HIDDEN;
+		}
+		else if (distance < EMITTER_LOD_NEAR) {
+			tier = Emitter::LOD_NEAR;
+		}
+		else if (distance < EMITTER_LOD_FAR) {
+			tier = Emitter::LOD_MID;
+		}
+
+		while (tier < Emitter::LOD_FAR && particles + emitter->expectedParticles(tier) > PARTICLE_BUDGET) {
+			tier = static_cast<Emitter::LodTier>(tier + 1);
+		}
+		particles += emitter->expectedParticles(tier);
+
+		emitter->setLodTier(tier);
+		mLodCounts[tier]++;
+	}
+}
+
+Flipbook Scene::bakeFlipbook(Emitter* emitter)
+{
+	Flipbook flipbook;
+	flipbook.columns = FLIPBOOK_COLUMNS;
+	flipbook.rows = FLIPBOOK_ROWS;
+	flipbook.duration = FLIPBOOK_DURATION;
+
+	int frames = flipbook.columns * flipbook.rows;
+	float frameDt = flipbook.duration / frames;
+
+	// Run until the emitter is in its steady state, then record one snapshot per frame
+	emitter->setPosition(glm::vec3(0.0f));
+	for (float t = 0.0f; t < emitter->mParticleLifetime; t += frameDt) {
+		emitter->updateParticles(frameDt);
+	}
+
+	std::vector<std::vector<Particle>> snapshots;
+	float minY = 0.0f, maxY = 0.0f, maxXZ = 0.0f;
+	for (int f = 0; f < frames; f++) {
+		emitter->updateParticles(frameDt);
+		snapshots.push_back(emitter->mParticlesContainer);
+
+		for (Particle& p : emitter->mParticlesContainer) {
+			if (p.life <= 0.0) continue;
+			minY = std::min(minY, p.position.y - p.size);
+			maxY = std::max(maxY, p.position.y + p.size);
+			maxXZ = std::max(maxXZ, std::max(std::abs(p.position.x), std::abs(p.position.z)) + p.size);
+		}
+	}
+
+	flipbook.centerHeight = (minY + maxY) * 0.5f;
+	flipbook.halfSize = std::max((maxY - minY) * 0.5f, maxXZ);
+
+	int width = flipbook.columns * FLIPBOOK_FRAME_SIZE;
+	int height = flipbook.rows * FLIPBOOK_FRAME_SIZE;
+
+	// Bake into the particle atlas when there is room, so far emitters batch with everything else
+	glm::ivec4 region = { 0, 0, width, height };
+	bool inAtlas = mParticleAtlas && mParticleAtlas->allocate(width, height, region);
+
+	if (inAtlas) {
+		flipbook.texture = mParticleAtlas->mTexture;
+		flipbook.rect = mParticleAtlas->uvRect(region);
+	}
+	else {
+		glGenTextures(1, &flipbook.texture);
+		glBindTexture(GL_TEXTURE_2D, flipbook.texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+
+	GLuint bakeFBO;
+	glGenFramebuffers(1, &bakeFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, bakeFBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, flipbook.texture, 0);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cout << "Flipbook framebuffer problem" << std::endl;
+	}
+
+	// Orthographic camera looking at the emitter from the side
+	float halfSize = flipbook.halfSize;
+	glm::vec3 center = { 0.0f, flipbook.centerHeight, 0.0f };
+	glm::vec3 up = { 0.0f, 1.0f, 0.0f };
+	glm::vec3 front = { 0.0f, 0.0f, -1.0f };
+	glm::mat4 view = glm::lookAt(center - front * 2.0f * halfSize, center, up);
+	glm::mat4 projection = glm::ortho(-halfSize, halfSize, -halfSize, halfSize, 0.0f, 4.0f * halfSize);
+
+	GLuint shaderProgram = mParticleShader;
+	glUseProgram(shaderProgram);
+	shaderSetMat4(shaderProgram, "uView", view);
+	shaderSetMat4(shaderProgram, "uProjection", projection);
+	shaderSetVec3(shaderProgram, "uCameraUp", up);
+	shaderSetVec3(shaderProgram, "uCameraFront", front);
+	shaderSetInt(shaderProgram, "uAnalytic", Emitter::NONE);
+	glm::vec4 fullRect = { 0.0f, 0.0f, 1.0f, 1.0f };
+	shaderSetVec4(shaderProgram, "uUVRect", fullRect);
+
+	// Only clear our own region, the atlas holds other images
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(region.x, region.y, width, height);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glDisable(GL_SCISSOR_TEST);
+	glDisable(GL_DEPTH_TEST);
+	glEnable(GL_BLEND);
+	// Premultiplied color, so the frames composite correctly later
+	glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+	emitter->bindForRender();
+	for (int f = 0; f < frames; f++) {
+		glViewport(region.x + (f % flipbook.columns) * FLIPBOOK_FRAME_SIZE, region.y + (f / flipbook.columns) * FLIPBOOK_FRAME_SIZE,
+			FLIPBOOK_FRAME_SIZE, FLIPBOOK_FRAME_SIZE);
+
+		for (Particle& p : snapshots[f]) {
+			if (p.life > 0.0) {
+				emitter->drawParticle(shaderProgram, p);
+			}
+		}
+	}
+	glBindVertexArray(0);
+
+	// The emitter starts over wherever it gets placed
+	for (Particle& p : emitter->mParticlesContainer) {
+		emitter->resetParticle(p);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, flipbook.texture);
+	glGenerateMipmap(GL_TEXTURE_2D);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// Restore state
+	glDisable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glEnable(GL_DEPTH_TEST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteFramebuffers(1, &bakeFBO);
+
+	int windowWidth, windowHeight;
+	glfwGetWindowSize(mWindow, &windowWidth, &windowHeight);
+	glViewport(0, 0, windowWidth, windowHeight);
+
+	return flipbook;
+}
+
+
 void Scene::setShaders(GLuint basicShader, GLuint phongShader, GLuint skyboxShader, GLuint shadowMapShader)
 {
 	mBasicShader = basicShader;
@@ -99,6 +296,26 @@ void Scene::setParticleShader(GLuint particleShader)
 	mParticleShader = particleShader;
 }
 
+void Scene::setParticleBatchShader(GLuint particleBatchShader)
+{
+	mParticleBatchShader = particleBatchShader;
+}
+
+void Scene::setParticleAtlas(ParticleAtlas* atlas)
+{
+	mParticleAtlas = atlas;
+}
+
+void Scene::setParticleCompositeShader(GLuint particleCompositeShader)
+{
+	mParticleCompositeShader = particleCompositeShader;
+}
+
+void Scene::setTrailShader(GLuint trailShader)
+{
+	mTrailShader = trailShader;
+}
+
 
 void Scene::setAmbientLight(glm::vec4 color)
 {
@@ -144,11 +361,63 @@ void Scene::addPhongShape(Shape* shape)
 	mPhongShapes.push_back(shape);
 }
 
+void Scene::addTerrain(Terrain* terrain)
+{
+	mTerrains.push_back(terrain);
+	mPhongShapes.push_back(terrain);
+}
+
+void Scene::printVertexStats() const
+{
+	// Shapes using a cached mesh report nothing, the first user uploaded it
+	size_t bytes = 0;
+	size_t saved = 0;
+	for (const std::vector<Shape*>* shapes : { &mBasicShapes, &mPhongShapes }) {
+		for (const Shape* shape : *shapes) {
+			bytes += shape->mVertexBytes;
+			saved += shape->mVertexBytesSaved;
+		}
+	}
+	std::cout << "Vertex data: " << bytes / 1024 << " KiB, " << saved / 1024
+		<< " KiB saved by the interleaved format" << std::endl;
+}
+
+void Scene::printCollisionStats() const
+{
+	// Only physics sources keep their CPU mesh, shared with the collision shape. A
+	// btTriangleMesh would have held three btVector3 and three indices per triangle on top.
+	size_t shapeCount = 0;
+	size_t keptCount = 0;
+	size_t triangles = 0;
+	size_t kept = 0;
+	for (const std::vector<Shape*>* shapes : { &mBasicShapes, &mPhongShapes }) {
+		for (const Shape* shape : *shapes) {
+			shapeCount++;
+			if (!shape->mMesh) continue;
+			keptCount++;
+			triangles += shape->mMesh->triangleCount();
+			kept += shape->mMesh->byteSize();
+		}
+	}
+	size_t copies = triangles * (3 * sizeof(btVector3) + 3 * sizeof(int));
+	std::cout << "CPU geometry: " << kept / 1024 << " KiB kept by " << keptCount << " of "
+		<< shapeCount << " shapes" << std::endl;
+	std::cout << "Collision meshes: " << triangles << " triangles shared with rendering, "
+		<< copies / 1024 << " KiB of btTriangleMesh copies avoided" << std::endl;
+	std::cout << "Process memory: " << currentMemoryBytes() / (1024 * 1024) << " MiB, peak "
+		<< peakMemoryBytes() / (1024 * 1024) << " MiB" << std::endl;
+}
+
 void Scene::addEmitter(Emitter* emitter)
 {
 	mEmitters.push_back(emitter);
 }
 
+void Scene::addEmitterTemplate(Emitter* emitter)
+{
+	mEmitterTemplates.push_back(emitter);
+}
+
 
 void Scene::prepareShaderSkybox()
 {
@@ -203,6 +472,8 @@ void Scene::prepareShaderPhong()
 	// Shadow map
 	shaderSetInt(shaderProgram, "ourTexture", 0);
 	shaderSetInt(shaderProgram, "shadowMap", 1);
+	// Bound by HalfPipeTrack, set for every draw so it never shares unit 0 with ourTexture
+	shaderSetInt(shaderProgram, "uTrackSupports", 3);
 	shaderSetMat4(shaderProgram, "uLightSpaceMatrix", mLightSpaceMatrix);
 }
 
@@ -214,6 +485,28 @@ void Scene::prepareShaderParticle()
 	shaderSetMat4(shaderProgram, "uProjection", mProjectionMatrix);
 	shaderSetVec3(shaderProgram, "uCameraUp", mCameraUp);
 	shaderSetVec3(shaderProgram, "uCameraFront", mCameraFront);
+	shaderSetInt(shaderProgram, "uAnalytic", Emitter::NONE);
+	glm::vec4 fullRect = { 0.0f, 0.0f, 1.0f, 1.0f };
+	shaderSetVec4(shaderProgram, "uUVRect", fullRect);
+}
+
+void Scene::prepareShaderParticleBatch()
+{
+	GLuint shaderProgram = mParticleBatchShader;
+	glUseProgram(shaderProgram);
+	shaderSetMat4(shaderProgram, "uView", mViewMatrix);
+	shaderSetMat4(shaderProgram, "uProjection", mProjectionMatrix);
+	shaderSetVec3(shaderProgram, "uCameraUp", mCameraUp);
+	shaderSetVec3(shaderProgram, "uCameraFront", mCameraFront);
+	shaderSetInt(shaderProgram, "ourTexture", 0);
+}
+
+void Scene::prepareShaderTrail()
+{
+	GLuint shaderProgram = mTrailShader;
+	glUseProgram(shaderProgram);
+	shaderSetMat4(shaderProgram, "uView", mViewMatrix);
+	shaderSetMat4(shaderProgram, "uProjection", mProjectionMatrix);
 }
 
 void Scene::prepareShaderShadowMap()
@@ -221,6 +514,7 @@ void Scene::prepareShaderShadowMap()
 	GLuint shaderProgram = mShadowMapShader;
 	glUseProgram(shaderProgram);
 	shaderSetMat4(shaderProgram, "uLightSpaceMatrix", mLightSpaceMatrix);
+	shaderSetInt(shaderProgram, "uTrackSupports", 3);
 }
 
 
@@ -278,15 +572,298 @@ void Scene::drawPhongShapes()
 	}
 }
 
+void Scene::drawTrails()
+{
+	if (!mTrailShader) return;
+
+	prepareShaderTrail();
+	mTrails.update(mDt);
+	mTrails.render(mTrailShader, mCameraPos);
+}
+
 void Scene::drawEmitters()
 {
 	prepareShaderParticle();
-	for (Emitter* emitter : mEmitters) {
+	updateEmitterLod();
+
+	// Shared sources are simulated once, however many emitters draw them
+	for (Emitter* emitter : mEmitterTemplates) {
 		emitter->updateParticles(mDt);
+	}
+
+	if (mSortParticles) {
+		drawEmittersSorted();
+		return;
+	}
+
+	for (Emitter* emitter : mEmitters) {
+		emitter->update(mDt);
 		emitter->renderParticles(mParticleShader);
 	}
 }
 
+void Scene::drawEmittersSorted()
+{
+	mParticleSorter.clear();
+	mParticleRefs.clear();
+
+	// Collect live particles of every emitter, keyed on view depth
+	for (int e = 0; e < mEmitters.size(); e++) {
+		Emitter* emitter = mEmitters[e];
+		emitter->update(mDt);
+		emitter->followBody();
+
+		if (emitter->mUseLod && emitter->mLodTier == Emitter::LOD_HIDDEN) continue;
+
+		if (emitter->mUseLod && emitter->mLodTier == Emitter::LOD_FAR) {
+			if (emitter->mFlipbook.texture) {
+				mParticleSorter.add(glm::dot(emitter->mPosition - mCameraPos, mCameraFront), mParticleRefs.size());
+				mParticleRefs.push_back({ e, REF_FLIPBOOK });
+			}
+			continue;
+		}
+
+		// Instanced particles can not be split up, sort them as one item at the emitter
+		if (emitter->mAnalytic) {
+			mParticleSorter.add(glm::dot(emitter->mPosition - mCameraPos, mCameraFront), mParticleRefs.size());
+			mParticleRefs.push_back({ e, REF_ANALYTIC });
+			continue;
+		}
+
+		const std::vector<Particle>& particles = emitter->particles();
+		for (int i = 0; i < particles.size(); i++) {
+			if (particles[i].life > 0.0) {
+				Particle p = emitter->worldParticle(i);
+				mParticleSorter.add(glm::dot(p.position - mCameraPos, mCameraFront), mParticleRefs.size());
+				mParticleRefs.push_back({ e, i });
+			}
+		}
+	}
+
+	mParticleSorter.sort();
+
+	if (mParticleAtlas && mParticleBatchShader) {
+		drawParticlesBatched();
+	}
+	else {
+		drawParticleRefs(mParticleSorter.values());
+	}
+}
+
+void Scene::drawParticlesBatched()
+{
+	mParticleBatch.clear();
+	mUnbatchedRefs.clear();
+
+	GLuint atlasTexture = mParticleAtlas->mTexture;
+	int rectEmitter = -1;
+	glm::vec4 rect;
+
+	// Sorted order is kept, everything from the atlas goes into one instanced draw
+	for (uint32_t value : mParticleSorter.values()) {
+		const ParticleRef& ref = mParticleRefs[value];
+		Emitter* emitter = mEmitters[ref.emitter];
+
+		if (ref.particle == REF_FLIPBOOK) {
+			if (emitter->mFlipbook.texture != atlasTexture) {
+				mUnbatchedRefs.push_back(value);
+				continue;
+			}
+			Particle billboard = emitter->flipbookBillboard();
+			mParticleBatch.add({ billboard.position, billboard.size, billboard.color, emitter->flipbookFrameRect(), 1.0f });
+			continue;
+		}
+
+		if (ref.particle == REF_ANALYTIC || !mParticleAtlas->contains(emitter->mTexture)) {
+			mUnbatchedRefs.push_back(value);
+			continue;
+		}
+
+		if (ref.emitter != rectEmitter) {
+			rect = mParticleAtlas->rectFor(emitter->mTexture);
+			rectEmitter = ref.emitter;
+		}
+		Particle p = emitter->worldParticle(ref.particle);
+		mParticleBatch.add({ p.position, p.size, p.color, rect, 0.0f });
+	}
+
+	prepareShaderParticleBatch();
+	mParticleBatch.draw(mParticleBatchShader, atlasTexture);
+
+	// Analytic emitters and textures outside the atlas are drawn on top, one emitter at a time
+	if (!mUnbatchedRefs.empty()) {
+		prepareShaderParticle();
+		drawParticleRefs(mUnbatchedRefs);
+	}
+}
+
+void Scene::drawParticleRefs(const std::vector<uint32_t>& order)
+{
+	// Alpha accumulated as coverage, so the result can also be composited from an offscreen target
+	glEnable(GL_BLEND);
+	glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+	glDepthMask(GL_FALSE);
+
+	// Texture and VAO only change when the next particle belongs to another emitter
+	int boundEmitter = -1;
+	for (uint32_t value : order) {
+		const ParticleRef& ref = mParticleRefs[value];
+		Emitter* emitter = mEmitters[ref.emitter];
+
+		if (ref.particle == REF_FLIPBOOK) {
+			// Binds its own texture
+			emitter->drawFlipbook(mParticleShader);
+			boundEmitter = -1;
+			continue;
+		}
+
+		if (ref.emitter != boundEmitter) {
+			emitter->bindForRender();
+			boundEmitter = ref.emitter;
+		}
+
+		if (ref.particle == REF_ANALYTIC) {
+			emitter->drawAnalytic(mParticleShader);
+		}
+		else {
+			Particle p = emitter->worldParticle(ref.particle);
+			emitter->drawParticle(mParticleShader, p);
+		}
+	}
+
+	glBindVertexArray(0);
+
+	glDepthMask(GL_TRUE);
+	glDisable(GL_BLEND);
+}
+
+void Scene::initParticleTargets(int width, int height, int divisor)
+{
+	if (mParticleFBO) {
+		glDeleteFramebuffers(1, &mParticleFBO);
+		glDeleteFramebuffers(1, &mSceneDepthFBO);
+		glDeleteTextures(1, &mParticleColor);
+		glDeleteTextures(1, &mParticleDepth);
+		glDeleteTextures(1, &mSceneDepth);
+	}
+
+	mParticleTargetWidth = width;
+	mParticleTargetHeight = height;
+	mParticleTargetDivisor = divisor;
+	int lowWidth = std::max(width / divisor, 1);
+	int lowHeight = std::max(height / divisor, 1);
+
+	// Full resolution copy of the scene depth, the default framebuffer can not be sampled
+	glGenTextures(1, &mSceneDepth);
+	glBindTexture(GL_TEXTURE_2D, mSceneDepth);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glGenFramebuffers(1, &mSceneDepthFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, mSceneDepthFBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, mSceneDepth, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cout << "Scene depth framebuffer problem" << std::endl;
+	}
+
+	// Low resolution particle color and downsampled depth
+	glGenTextures(1, &mParticleColor);
+	glBindTexture(GL_TEXTURE_2D, mParticleColor);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, lowWidth, lowHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glGenTextures(1, &mParticleDepth);
+	glBindTexture(GL_TEXTURE_2D, mParticleDepth);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, lowWidth, lowHeight, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glGenFramebuffers(1, &mParticleFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, mParticleFBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mParticleColor, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, mParticleDepth, 0);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cout << "Particle framebuffer problem" << std::endl;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	if (!mFullscreenVAO) {
+		glGenVertexArrays(1, &mFullscreenVAO);
+	}
+}
+
+void Scene::drawEmittersOffscreen()
+{
+	int width, height;
+	glfwGetWindowSize(mWindow, &width, &height);
+	int divisor = 1 << mParticleResolution;
+
+	if (width != mParticleTargetWidth || height != mParticleTargetHeight || divisor != mParticleTargetDivisor) {
+		initParticleTargets(width, height, divisor);
+	}
+	int lowWidth = std::max(width / divisor, 1);
+	int lowHeight = std::max(height / divisor, 1);
+
+	// Copy the scene depth, then downsample it for the particle depth test
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, mSceneDepthFBO);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, mSceneDepthFBO);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, mParticleFBO);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, lowWidth, lowHeight, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, mParticleFBO);
+	glViewport(0, 0, lowWidth, lowHeight);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	drawEmitters();
+
+	// Composite onto the full resolution frame with premultiplied alpha
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, width, height);
+
+	GLuint shaderProgram = mParticleCompositeShader;
+	glUseProgram(shaderProgram);
+	glm::vec2 depthParams = { mProjectionMatrix[2][2], mProjectionMatrix[3][2] };
+	shaderSetVec2(shaderProgram, "uDepthParams", depthParams);
+	shaderSetInt(shaderProgram, "uParticleColor", 0);
+	shaderSetInt(shaderProgram, "uParticleDepth", 1);
+	shaderSetInt(shaderProgram, "uSceneDepth", 2);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, mParticleColor);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, mParticleDepth);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, mSceneDepth);
+
+	glDisable(GL_DEPTH_TEST);
+	glDepthMask(GL_FALSE);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+	glBindVertexArray(mFullscreenVAO);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+
+	glDisable(GL_BLEND);
+	glDepthMask(GL_TRUE);
+	glEnable(GL_DEPTH_TEST);
+	glActiveTexture(GL_TEXTURE0);
+}
+
 void Scene::draw()
 {
 	glClearColor(0.2f, 0.0f, 0.3f, 1.0f);
@@ -296,5 +873,12 @@ void Scene::draw()
 	drawPhongShapes();
 	drawBaseShapes();
 	drawSkybox();
-	drawEmitters();
+	drawTrails();
+
+	if (mParticleResolution > 0 && mParticleCompositeShader) {
+		drawEmittersOffscreen();
+	}
+	else {
+		drawEmitters();
+	}
 }
\ No newline at end of file
@@ -10,7 +10,12 @@
 
 #include "settings.h"
 #include "shape.h"
+#include "terrain.h"
 #include "particle_emitter.h"
+#include "particle_sort.h"
+#include "trail_renderer.h"
+#include "particle_atlas.h"
+#include "particle_batcher.h"
 #include "Utils.h"
 #include "camera.h"
 
@@ -23,9 +28,17 @@ public:
 	void updateLightSpaceMatrix();
 	void updateDirLight();
 	void update(Camera& camera, double dt);
+	void updateFrustum();
+	bool sphereInView(glm::vec3 center, float radius) const;
+	void updateEmitterLod();
+	Flipbook bakeFlipbook(Emitter* emitter);
 
 	void setShaders(GLuint basicShader, GLuint phongShader, GLuint skyboxShader, GLuint shadowMapShader);
 	void setParticleShader(GLuint particleShader);
+	void setParticleBatchShader(GLuint particleBatchShader);
+	void setParticleAtlas(ParticleAtlas* atlas);
+	void setParticleCompositeShader(GLuint particleCompositeShader);
+	void setTrailShader(GLuint trailShader);
 
 	void setAmbientLight(glm::vec4 color);
 	void addDirectionLight(DirectionalLight light);
@@ -34,21 +47,34 @@ public:
 	void addSkybox(Skybox* skybox);
 	void addBaseShape(Shape* shape);
 	void addPhongShape(Shape* shape);
+	// Drawn with the phong shapes, after picking its chunks in update
+	void addTerrain(Terrain* terrain);
 	void addEmitter(Emitter* emitter);
+	void addEmitterTemplate(Emitter* emitter);
 
 	void prepareShaderSkybox();
 	void prepareShaderBasic();
 	void prepareShaderPhong();
 	void prepareShaderParticle();
+	void prepareShaderParticleBatch();
+	void prepareShaderTrail();
 	void prepareShaderShadowMap();
 	
 	void shadowPass();
 	void drawSkybox();
 	void drawBaseShapes();
 	void drawPhongShapes();
+	void drawTrails();
 	void drawEmitters();
+	void drawEmittersSorted();
+	void drawParticlesBatched();
+	void drawParticleRefs(const std::vector<uint32_t>& order);
+	void initParticleTargets(int width, int height, int divisor);
+	void drawEmittersOffscreen();
 
 	void draw();
+	void printVertexStats() const;
+	void printCollisionStats() const;
 
 	// Variables
 	GLFWwindow* mWindow;
@@ -59,6 +85,9 @@ public:
 	GLuint mSkyboxShader;
 	GLuint mShadowMapShader;
 	GLuint mParticleShader;
+	GLuint mParticleBatchShader = 0;
+	GLuint mParticleCompositeShader = 0;
+	GLuint mTrailShader = 0;
 
 	glm::mat4 mViewMatrix;
 	glm::mat4 mProjectionMatrix;
@@ -71,8 +100,41 @@ public:
 	float mLightPitch = 0.0f;
 	std::vector<Shape*> mBasicShapes;
 	std::vector<Shape*> mPhongShapes;
+	std::vector<Terrain*> mTerrains;
 	std::vector<Emitter*> mEmitters;
+	std::vector<Emitter*> mEmitterTemplates;
 	std::vector<Skybox*> mSkybox;
+	TrailRenderer mTrails;
+
+	// Particles of all emitters, blended back to front
+	enum {
+		REF_ANALYTIC = -1,	// instanced draw of an analytic emitter
+		REF_FLIPBOOK = -2	// billboard of a far emitter
+	};
+	struct ParticleRef {
+		int emitter;
+		int particle;
+	};
+	bool mSortParticles = SORT_PARTICLES;
+	ParticleSorter mParticleSorter;
+	std::vector<ParticleRef> mParticleRefs;
+	ParticleAtlas* mParticleAtlas = nullptr;
+	ParticleBatcher mParticleBatch;
+	std::vector<uint32_t> mUnbatchedRefs;
+	int mLodCounts[4] = { 0, 0, 0, 0 };
+	glm::vec4 mFrustumPlanes[6];
+
+	// Reduced resolution particle target. 0 - full, 1 - half, 2 - quarter
+	int mParticleResolution = PARTICLE_RESOLUTION;
+	int mParticleTargetWidth = 0;
+	int mParticleTargetHeight = 0;
+	int mParticleTargetDivisor = 0;
+	GLuint mParticleFBO = 0;
+	GLuint mParticleColor = 0;
+	GLuint mParticleDepth = 0;
+	GLuint mSceneDepthFBO = 0;
+	GLuint mSceneDepth = 0;
+	GLuint mFullscreenVAO = 0;
 
 	// Shadow map
 	float mShadowAreaSize = 100;
@@ -12,9 +12,108 @@ const bool DEBUG_MODE = false;
 // 2048 4096 8192 16384
 const unsigned int SHADOW_MAP_SIZE = 8192;
 
+// Particles
+// Torch flames and smoke upload only spawn records, evaluated in the vertex shader
+const bool ANALYTIC_PARTICLES = false;
+// Blend the particles of all emitters back to front
+const bool SORT_PARTICLES = true;
+// Random floats generated per batch for each emitter
+const int RANDOM_POOL_SIZE = 256;
+
+// Emitter LOD, distances in world units
+const float EMITTER_LOD_NEAR = 10.0f;
+const float EMITTER_LOD_FAR = 30.0f;
+// Spawn rate and particle size scale at mid range
+const float EMITTER_LOD_MID_RATE = 0.3f;
+const float EMITTER_LOD_MID_SIZE = 1.8f;
+// Live simulated particles over all LOD emitters
+const int PARTICLE_BUDGET = 4000;
+// Far emitters are replaced by a baked flipbook
+const int FLIPBOOK_COLUMNS = 8;
+const int FLIPBOOK_ROWS = 4;
+const int FLIPBOOK_FRAME_SIZE = 128;
+const float FLIPBOOK_DURATION = 1.0f;
+
+// Particles drawn to a smaller target and upsampled. 0 - full, 1 - half, 2 - quarter resolution
+const int PARTICLE_RESOLUTION = 0;
+
+// Torches draw a few shared flame and smoke simulations instead of their own
+const bool EMITTER_TEMPLATES = true;
+const int EMITTER_TEMPLATE_VARIANTS = 3;
+
+// One texture for all particle images and baked flipbooks
+const int PARTICLE_ATLAS_SIZE = 2048;
+const int PARTICLE_ATLAS_PADDING = 4;
+
+// Marble trails
+const int TRAIL_CAPACITY = 256;
+const float TRAIL_SAMPLE_DISTANCE = 0.1f;
+const float TRAIL_LIFETIME = 3.0f;
+// Moving further than this in one frame is a teleport and restarts the trail
+const float TRAIL_RESET_DISTANCE = 2.0f;
+
+// Shape vertices. 0 - separate float buffers, 1 - one interleaved buffer with half UVs and packed normals
+const int VERTEX_FORMAT = 1;
+// Interleaved normals as two 16-bit octahedral values instead of GL_INT_2_10_10_10_REV
+const bool OCTAHEDRAL_NORMALS = false;
+// Interleaved meshes with every coordinate inside this range store half float positions
+const float HALF_POSITION_RANGE = 2.0f;
+
+// Remove duplicate triangles and reorder for the vertex cache and overdraw before upload
+const bool OPTIMIZE_MESHES = true;
+
+// Tracks are resampled along a smooth path through their supports, keeping the mesh within
+// this distance of it. Straight runs merge, tight turns get more supports, but a track never ends
+// up with more than were placed. 0 keeps the supports as placed.
+const float TRACK_TOLERANCE = 0.05f;
+// Tracks upload only their supports and the vertex shader generates the mesh from them
+const bool PROCEDURAL_TRACKS = true;
+// Track supports can be moved this far and the collision BVH is still refit in place
+const float TRACK_EDIT_MARGIN = 2.0f;
+// Segments around the half pipe of a track
+const int TRACK_SECTORS = 10;
+
+// Ground is heightmap_1 as terrain up to TERRAIN_GROUND_HEIGHT high instead of a flat plane.
+// The renderer and Bullet read the same heightfield samples.
+const bool TERRAIN_GROUND = false;
+const float TERRAIN_GROUND_HEIGHT = 3.0f;
+// Terrain chunks are this many quads a side. Beyond TERRAIN_LOD_DISTANCE from the camera
+// a chunk drops a level of detail every time the distance doubles.
+const int TERRAIN_CHUNK_SIZE = 64;
+const float TERRAIN_LOD_DISTANCE = 10.0f;
+
+// Boxes, planes, spheres and cylinders share one unit mesh per tessellation
+const bool MESH_CACHE = true;
+
 // Bullet
+// Physics advances in fixed steps of 1 / PHYSICS_RATE seconds, at most PHYSICS_MAX_SUBSTEPS
+// a frame. Slower frames drop the extra time. Marbles are drawn interpolated between the
+// last two steps.
+const double PHYSICS_RATE = 60.0;
+const int PHYSICS_MAX_SUBSTEPS = 8;
+// Steps physics on its own thread. The render thread draws from snapshots published after
+// each step and sends world edits over as commands. Not used with the multithreaded world:
+// Bullet gives the thread that made the task scheduler index 0 and sizes its per-thread
+// dispatcher data for the scheduler's threads, so that world is stepped on the render thread.
+const bool PHYSICS_THREAD = true;
+// Bullet's multithreaded world, overridden with --physics-world st|mt. Needs the Bullet
+// libraries built with BT_THREADSAFE, without it the single threaded world is used.
+const bool PHYSICS_MULTITHREADED = false;
+// sequential, default (Bullet's own thread pool), openmp, tbb or ppl. --physics-scheduler NAME
+const char* const PHYSICS_TASK_SCHEDULER = "default";
+// Threads the scheduler runs the world on, 0 for all it has. --physics-threads N
+const int PHYSICS_WORKER_THREADS = 0;
+// Headless races stop after this many seconds of race time, even with marbles still out
+const double RACE_MAX_TIME = 180.0;
+// Race farms move each start position up to this far along x and z, on top of shuffling the
+// drop order, and run on this many threads, 0 for one per hardware thread
+const float RACE_FARM_START_JITTER = 0.05f;
+const int RACE_FARM_THREADS = 0;
+
 const float MARBLE_RESTITUTION = 0.6f;
 const float MARBLE_FRICTION = 0.8f;
+// Marbles falling below this height go back to the start
+const float MARBLE_RESPAWN_HEIGHT = 0.2f;
 
 const float TRACK_RESTITUTION = 0.6f;
 const float TRACK_FRICTION = 0.5f;
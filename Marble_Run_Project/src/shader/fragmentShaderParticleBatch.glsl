@@ -0,0 +1,16 @@
+#version 330 core
+
+in vec4 ourColor;
+in vec2 texCoord;
+flat in float premultiplied;
+
+uniform sampler2D ourTexture;
+
+out vec4 fragColor;
+
+void main() {
+    vec4 color = texture(ourTexture, texCoord) * ourColor;
+
+    // Flipbook frames are already premultiplied, plain particle textures are not
+    fragColor = (premultiplied > 0.5) ? color : vec4(color.rgb * color.a, color.a);
+}
@@ -0,0 +1,48 @@
+#version 330 core
+
+in vec2 texCoord;
+
+uniform sampler2D uParticleColor;   // low resolution, premultiplied alpha
+uniform sampler2D uParticleDepth;   // low resolution scene depth the particles were tested against
+uniform sampler2D uSceneDepth;      // full resolution scene depth
+uniform vec2 uDepthParams;          // projection[2][2], projection[3][2]
+
+out vec4 fragColor;
+
+// Relative depth difference where a low resolution texel counts as another surface
+const float EDGE_THRESHOLD = 0.05;
+
+float linearDepth(float depth)
+{
+    return uDepthParams.y / (uDepthParams.x + depth * 2.0 - 1.0);
+}
+
+void main() {
+    float sceneDepth = linearDepth(texture(uSceneDepth, texCoord).r);
+
+    // The four low resolution texels around this pixel
+    vec2 lowResSize = vec2(textureSize(uParticleDepth, 0));
+    ivec2 base = ivec2(floor(texCoord * lowResSize - 0.5));
+    ivec2 maxTexel = ivec2(lowResSize) - 1;
+
+    float bestDiff = 1e20;
+    float maxDiff = 0.0;
+    ivec2 bestTexel = base;
+    for (int i = 0; i < 4; i++) {
+        ivec2 texel = clamp(base + ivec2(i & 1, i >> 1), ivec2(0), maxTexel);
+        float diff = abs(linearDepth(texelFetch(uParticleDepth, texel, 0).r) - sceneDepth);
+        if (diff < bestDiff) {
+            bestDiff = diff;
+            bestTexel = texel;
+        }
+        maxDiff = max(maxDiff, diff);
+    }
+
+    // Bilinear on flat areas, nearest depth sample across depth edges to avoid halos
+    if (maxDiff < EDGE_THRESHOLD * sceneDepth) {
+        fragColor = texture(uParticleColor, texCoord);
+    }
+    else {
+        fragColor = texelFetch(uParticleColor, bestTexel, 0);
+    }
+}
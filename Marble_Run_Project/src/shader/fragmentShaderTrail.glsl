@@ -0,0 +1,12 @@
+#version 330 core
+
+in vec4 ourColor;
+in float across;
+
+out vec4 fragColor;
+
+void main() {
+    // Soft edges across the ribbon
+    float edge = 1.0 - abs(across * 2.0 - 1.0);
+    fragColor = vec4(ourColor.rgb, ourColor.a * edge);
+}
@@ -0,0 +1,112 @@
+// Half-pipe track vertices pulled from a buffer of supports by gl_VertexID, in the
+// same order and with the same values as buildHalfPipeTrack. Texel layout is
+// described at buildTrackSupportTexels.
+
+uniform bool uProceduralTrack;
+uniform samplerBuffer uTrackSupports;
+uniform int uTrackSectors;
+uniform int uTrackSupportCount;
+
+struct TrackVertex {
+	vec3 position;
+	vec3 normal;
+	vec2 texCoord;
+};
+
+// Corners of the two triangles between two rings as (ring step, side). Curves and
+// end faces use one winding or the other.
+const ivec2 QUAD_A[6] = ivec2[6](ivec2(0, 0), ivec2(0, 1), ivec2(1, 0), ivec2(1, 0), ivec2(0, 1), ivec2(1, 1));
+const ivec2 QUAD_B[6] = ivec2[6](ivec2(0, 0), ivec2(1, 0), ivec2(0, 1), ivec2(1, 0), ivec2(1, 1), ivec2(0, 1));
+// Rim square vertices of each triangle
+const int SQUARE[12] = int[12](0, 3, 2, 0, 2, 1, 4, 7, 6, 4, 6, 5);
+
+vec2 trackRing(int i)
+{
+	return texelFetch(uTrackSupports, i).xy;
+}
+
+vec4 trackPoint(int support)
+{
+	return texelFetch(uTrackSupports, uTrackSectors + 1 + 2 * support);
+}
+
+vec4 trackFrame(int support)
+{
+	return texelFetch(uTrackSupports, uTrackSectors + 2 + 2 * support);
+}
+
+// Point at ring direction a and radius r around a support with frame f
+vec3 trackRingPosition(vec4 p, vec4 f, vec2 a, float r)
+{
+	return vec3(p.x + r * a.x * f.x, p.y + r * a.y, p.z + r * a.x * f.y);
+}
+
+TrackVertex trackVertex(int id)
+{
+	int sectors = uTrackSectors;
+	int segmentVertices = 12 * sectors + 12;
+	int segments = uTrackSupportCount - 1;
+	TrackVertex v;
+
+	if (id < segments * segmentVertices) {
+		int segment = id / segmentVertices;
+		int local = id - segment * segmentVertices;
+		vec4 p1 = trackPoint(segment);
+		vec4 f1 = trackFrame(segment);
+		vec4 p2 = trackPoint(segment + 1);
+		vec4 f2 = trackFrame(segment + 1);
+		float uvRepeat = p1.w;
+		float uvInner1 = f1.z / f1.w;
+		float uvInner2 = f2.z / f2.w;
+
+		if (local < 12 * sectors) {
+			// Inner curve, then outer curve. Normals follow the first support.
+			bool outer = local >= 6 * sectors;
+			int q = outer ? local - 6 * sectors : local;
+			ivec2 c = outer ? QUAD_B[q % 6] : QUAD_A[q % 6];
+			vec2 a = trackRing(q / 6 + c.x);
+			vec4 p = c.y == 0 ? p1 : p2;
+			vec4 f = c.y == 0 ? f1 : f2;
+
+			v.position = trackRingPosition(p, f, a, outer ? f.w : f.z);
+			v.normal = outer ? vec3(a.x * f1.x, a.y, a.x * f1.y) : vec3(-a.x * f1.x, -a.y, -a.x * f1.y);
+			if (outer) {
+				v.texCoord = c.y == 0 ? vec2((a.x + 1.0) * 0.5, 0.0) : vec2((a.y + 1.0) * 0.5, uvRepeat);
+			}
+			else {
+				v.texCoord = c.y == 0 ? vec2((a.x * uvInner1 + 1.0) * 0.5, 0.0) : vec2((a.y * uvInner2 + 1.0) * 0.5, uvRepeat);
+			}
+		}
+		else {
+			// Rim squares. 0-3 on the negative side, 4-7 on the positive
+			int q = SQUARE[local - 12 * sectors];
+			bool second = q == 2 || q == 3 || q == 6 || q == 7;
+			bool outer = q == 0 || q == 3 || q == 5 || q == 6;
+			vec4 p = second ? p2 : p1;
+			vec4 f = second ? f2 : f1;
+			float r = (q < 4 ? -1.0 : 1.0) * (outer ? f.w : f.z);
+			float uvInner = second ? uvInner2 : uvInner1;
+
+			v.position = vec3(p.x + r * f.x, p.y, p.z + r * f.y);
+			v.normal = vec3(0.0, 1.0, 0.0);
+			v.texCoord.x = outer ? (q < 4 ? 1.0 : 0.0) : (q < 4 ? uvInner : 1.0 - uvInner);
+			v.texCoord.y = second ? uvRepeat : 0.0;
+		}
+	}
+	else {
+		// End faces, front then back
+		int local = id - segments * segmentVertices;
+		bool back = local >= 6 * sectors;
+		int q = back ? local - 6 * sectors : local;
+		ivec2 c = back ? QUAD_A[q % 6] : QUAD_B[q % 6];
+		vec2 a = trackRing(q / 6 + c.x);
+		vec4 p = trackPoint(back ? segments : 0);
+		vec4 f = trackFrame(back ? segments : 0);
+		float uvInner = f.z / f.w;
+
+		v.position = trackRingPosition(p, f, a, c.y == 0 ? f.z : f.w);
+		v.normal = back ? vec3(f.y, 0.0, f.x) : vec3(-f.y, 0.0, -f.x);
+		v.texCoord = c.y == 0 ? (a * uvInner + 1.0) * 0.5 : (a + 1.0) * 0.5;
+	}
+	return v;
+}
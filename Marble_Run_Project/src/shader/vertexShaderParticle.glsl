@@ -3,6 +3,10 @@
 layout (location = 0) in vec3 inOffset;
 layout (location = 1) in vec2 inTexCoord;
 
+// Analytic emitters: one spawn record per instance
+layout (location = 2) in vec4 inSpawnOrigin;    // xyz: origin, w: spawn time
+layout (location = 3) in vec4 inSpawnVelocity;  // xyz: velocity, w: seed
+
 //uniform mat4 uModel;
 uniform mat4 uView;
 uniform mat4 uProjection;
@@ -14,16 +18,72 @@ uniform vec4 inColor;
 uniform vec3 inPosition;
 uniform float inSize;
 
+// Analytic emitters. 0 - per particle uniforms, 1 - flame, 2 - smoke
+uniform int uAnalytic;
+uniform float uTime;
+uniform float uLifetime;
+uniform float uBaseSize;
+
+// Texture region, a single frame when drawing a flipbook
+uniform vec4 uUVRect;
+
 out vec4 ourColor;
 out vec2 texCoord;
 
+float hash(float seed)
+{
+    return fract(sin(seed * 78.233) * 43758.5453);
+}
+
+// Closed-form versions of FlameEmitter::updateParticles and SmokeEmitter::updateParticles
+void evaluateAnalytic(out vec3 pos, out vec4 color, out float size)
+{
+    float age = uTime - inSpawnOrigin.w;
+    float lifeSpan = 1.0 - age / uLifetime;    // % of life remaining, [1, 0]
+    vec3 origin = inSpawnOrigin.xyz;
+    vec3 velocity = inSpawnVelocity.xyz;
+    float seed = inSpawnVelocity.w;
+
+    if (uAnalytic == 1) {
+        // Constant upward acceleration of 0.5
+        pos = origin + velocity * age + vec3(0.0, 0.25 * age * age, 0.0);
+        color = vec4(mix(0.7, 1.0, hash(seed)), mix(0.1, 0.7, hash(seed + 1.0)), 0.0, min(0.4, lifeSpan));
+        size = min(uBaseSize, (lifeSpan * 2.0) * uBaseSize);
+    }
+    else {
+        // Upward velocity decays by 0.12 per second, but never below 0.01
+        float tStop = max((velocity.y - 0.01) / 0.12, 0.0);
+        float tDecay = min(age, tStop);
+        float y = velocity.y * tDecay - 0.06 * tDecay * tDecay + 0.01 * (age - tDecay);
+
+        pos = origin + vec3(velocity.x * age, y, velocity.z * age);
+        float grey = max(mix(0.2, 0.5, hash(seed)), 1.0 - lifeSpan - 0.1);
+        color = vec4(vec3(grey), min(0.4, lifeSpan));
+        size = max(uBaseSize, (1.0 - lifeSpan) * 4.0 * uBaseSize);
+    }
+}
+
 void main() {
     // test:
     //gl_Position = uProjection * uView * vec4(inOffset, 1.0);
 
-
     vec3 pos = inPosition;
-    vec3 offset = inOffset * inSize;
+    vec4 color = inColor;
+    float size = inSize;
+
+    if (uAnalytic != 0) {
+        float age = uTime - inSpawnOrigin.w;
+        if (age < 0.0 || age >= uLifetime) {
+            // Dead record, collapse the quad outside the clip volume
+            gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+            ourColor = vec4(0.0);
+            texCoord = uUVRect.xy + inTexCoord * uUVRect.zw;
+            return;
+        }
+        evaluateAnalytic(pos, color, size);
+    }
+
+    vec3 offset = inOffset * size;
 
     vec3 right = normalize(cross(uCameraUp, uCameraFront));
 
@@ -35,6 +95,6 @@ void main() {
 
     gl_Position = uProjection * uView * vec4(pos, 1.0);
     //gl_Position = uProjection * uView * uModel * vec4(pos, 1.0);
-    ourColor = inColor;
-    texCoord = inTexCoord;
-}
\ No newline at end of file
+    ourColor = color;
+    texCoord = uUVRect.xy + inTexCoord * uUVRect.zw;
+}
@@ -0,0 +1,32 @@
+#version 330 core
+
+layout (location = 0) in vec3 inOffset;
+layout (location = 1) in vec2 inTexCoord;
+
+// One instance per particle, see ParticleInstance
+layout (location = 2) in vec4 inPositionSize;
+layout (location = 3) in vec4 inColor;
+layout (location = 4) in vec4 inUVRect;
+layout (location = 5) in float inPremultiplied;
+
+uniform mat4 uView;
+uniform mat4 uProjection;
+uniform vec3 uCameraUp;
+uniform vec3 uCameraFront;
+
+out vec4 ourColor;
+out vec2 texCoord;
+flat out float premultiplied;
+
+void main() {
+    vec3 offset = inOffset * inPositionSize.w;
+    vec3 right = normalize(cross(uCameraUp, uCameraFront));
+
+    // Spherical billboarding
+    vec3 pos = inPositionSize.xyz + (right * offset.x) + (uCameraUp * offset.y);
+
+    gl_Position = uProjection * uView * vec4(pos, 1.0);
+    ourColor = inColor;
+    texCoord = inUVRect.xy + inTexCoord * inUVRect.zw;
+    premultiplied = inPremultiplied;
+}
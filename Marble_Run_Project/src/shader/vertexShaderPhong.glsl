@@ -14,13 +14,35 @@ uniform mat4 uView;
 uniform mat4 uProjection;
 uniform mat4 uNormal;
 uniform mat4 uLightSpaceMatrix;
+// Normal stored as two octahedral coordinates in xy
+uniform bool uOctahedralNormal;
+
+vec3 decodeOctahedral(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0) {
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	}
+	return normalize(n);
+}
+
+#include "trackVertex.glsl"
 
 void main() 
 {
-	fragPos = vec3(uModel * vec4(inPosition, 1.0));
-	normal = mat3(uNormal) * inNormal;
-    texCoord = inTexCoord;
+	vec3 position = inPosition;
+	vec3 objectNormal = uOctahedralNormal ? decodeOctahedral(inNormal.xy) : inNormal;
+	texCoord = inTexCoord;
+	if (uProceduralTrack) {
+		TrackVertex track = trackVertex(gl_VertexID);
+		position = track.position;
+		objectNormal = track.normal;
+		texCoord = track.texCoord;
+	}
+
+	fragPos = vec3(uModel * vec4(position, 1.0));
+	normal = mat3(uNormal) * objectNormal;
 	fragPosLightSpace = uLightSpaceMatrix * vec4(fragPos, 1.0);
 
-    gl_Position = uProjection * uView * uModel * vec4(inPosition, 1.0);
+    gl_Position = uProjection * uView * uModel * vec4(position, 1.0);
 }
\ No newline at end of file
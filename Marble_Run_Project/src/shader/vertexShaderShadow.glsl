@@ -5,7 +5,10 @@ layout (location = 0) in vec3 inPosition;
 uniform mat4 uLightSpaceMatrix;
 uniform mat4 uModel;
 
+#include "trackVertex.glsl"
+
 void main()
 {
-    gl_Position = uLightSpaceMatrix * uModel * vec4(inPosition, 1.0);
+    vec3 position = uProceduralTrack ? trackVertex(gl_VertexID).position : inPosition;
+    gl_Position = uLightSpaceMatrix * uModel * vec4(position, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,19 @@
+#version 330 core
+
+layout (location = 0) in vec3 inPosition;
+layout (location = 1) in vec4 inColor;
+layout (location = 2) in float inAcross;
+
+uniform mat4 uView;
+uniform mat4 uProjection;
+
+out vec4 ourColor;
+out float across;
+
+void main()
+{
+    // Ribbon vertices are built in world space
+    gl_Position = uProjection * uView * vec4(inPosition, 1.0);
+    ourColor = inColor;
+    across = inAcross;
+}
@@ -1,7 +1,11 @@
 #include "shape.h"
+#include "bulletHelpers.h"
+
+#include <algorithm>
 
 Shape::~Shape()
 {
+    if (!mOwnsBuffers) return;
     if (VAO) glDeleteVertexArrays(1, &VAO);
     if (VBO) glDeleteBuffers(4, VBO);
     if (EBO) glDeleteBuffers(1, &EBO);
@@ -10,52 +14,171 @@ Shape::~Shape()
 void Shape::initBuffers()
 {
     glGenVertexArrays(1, &VAO);
-    glGenBuffers(4, VBO);
+    // The interleaved format only needs one vertex buffer
+    glGenBuffers(VERTEX_FORMAT == 1 ? 1 : 4, VBO);
     glGenBuffers(1, &EBO);
 }
 
-void Shape::fillVertexBuffer(std::vector<float> vertices)
+void Shape::fillVertexBuffer(const std::vector<float>& vertices)
 {
     // position attribute
     glBindBuffer(GL_ARRAY_BUFFER, VBO[0]);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &vertices[0], GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &vertices[0], mBufferUsage);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
 }
 
-void Shape::fillColorBuffer(std::vector<float> colors)
+void Shape::fillColorBuffer(const std::vector<float>& colors)
 {
     // color attribute
     glBindBuffer(GL_ARRAY_BUFFER, VBO[1]);
-    glBufferData(GL_ARRAY_BUFFER, colors.size() * sizeof(float), &colors[0], GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, colors.size() * sizeof(float), &colors[0], mBufferUsage);
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(1);
 }
 
-void Shape::fillUVBuffer(std::vector<float> textureUVs)
+void Shape::fillUVBuffer(const std::vector<float>& textureUVs)
 {
     // texture UV attribute
     glBindBuffer(GL_ARRAY_BUFFER, VBO[2]);
-    glBufferData(GL_ARRAY_BUFFER, textureUVs.size() * sizeof(float), &textureUVs[0], GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, textureUVs.size() * sizeof(float), &textureUVs[0], mBufferUsage);
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(2);
 }
 
-void Shape::fillNormalBuffer(std::vector<float> normals)
+void Shape::fillNormalBuffer(const std::vector<float>& normals)
 { 
     // normal attribute
     glBindBuffer(GL_ARRAY_BUFFER, VBO[3]);
-    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(float), &normals[0], GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(float), &normals[0], mBufferUsage);
     glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(3);
 }
 
-void Shape::fillIndexBuffer(std::vector<unsigned int> indices)
+void Shape::fillIndexBuffer(const std::vector<unsigned int>& indices)
 {
     mIndexCount = static_cast<GLsizei>(indices.size());
-    // index
+    // index, 16-bit when every vertex can be addressed with it
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
+    if (!indices.empty() && *std::max_element(indices.begin(), indices.end()) <= 0xFFFF) {
+        std::vector<GLushort> shortIndices(indices.begin(), indices.end());
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(GLushort), &shortIndices[0], GL_STATIC_DRAW);
+        mIndexType = GL_UNSIGNED_SHORT;
+    }
+    else {
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
+        mIndexType = GL_UNSIGNED_INT;
+    }
+}
+
+void Shape::uploadMesh(MeshData&& mesh, bool optimize)
+{
+    if (optimize) {
+        optimizeMesh(mesh);
+    }
+
+    glBindVertexArray(VAO);
+
+    if (VERTEX_FORMAT == 1) {
+        uploadInterleaved(mesh);
+    }
+    else {
+        fillVertexBuffer(mesh.positions);
+        fillUVBuffer(mesh.uvs);
+        fillNormalBuffer(mesh.normals);
+        mVertexBytes = (mesh.positions.size() + mesh.uvs.size() + mesh.normals.size()) * sizeof(float);
+    }
+    fillIndexBuffer(mesh.indices);
+
+    // Unbind VAO
+    glBindVertexArray(0);
+
+    retainMesh(std::move(mesh));
+}
+
+void Shape::retainMesh(MeshData&& mesh)
+{
+    if (mPhysicsSource) {
+        mMesh = std::make_shared<MeshData>(std::move(mesh));
+    }
+    else {
+        // Freed here rather than whenever the caller's mesh goes out of scope
+        mesh = MeshData();
+    }
+}
+
+void Shape::uploadInterleaved(const MeshData& mesh)
+{
+    VertexLayout layout = chooseVertexLayout(mesh, OCTAHEDRAL_NORMALS, HALF_POSITION_RANGE);
+    std::vector<unsigned char> data = packVertices(mesh, layout);
+    GLsizei stride = layout.stride();
+
+    glBindBuffer(GL_ARRAY_BUFFER, VBO[0]);
+    glBufferData(GL_ARRAY_BUFFER, data.size(), data.data(), mBufferUsage);
+
+    // position attribute
+    glVertexAttribPointer(0, 3, layout.halfPositions ? GL_HALF_FLOAT : GL_FLOAT, GL_FALSE, stride, (void*)0);
+    glEnableVertexAttribArray(0);
+
+    // normal attribute, normalized back to [-1, 1] on fetch
+    if (layout.octahedralNormals) {
+        glVertexAttribPointer(3, 2, GL_SHORT, GL_TRUE, stride, (void*)(size_t)layout.normalOffset());
+    }
+    else {
+        glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)(size_t)layout.normalOffset());
+    }
+    glEnableVertexAttribArray(3);
+
+    // texture UV attribute
+    glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)(size_t)layout.uvOffset());
+    glEnableVertexAttribArray(2);
+
+    size_t floatBytes = (mesh.positions.size() + mesh.uvs.size() + mesh.normals.size()) * sizeof(float);
+    mVertexBytes = data.size();
+    mVertexBytesSaved = floatBytes - data.size();
+    mOctahedralNormals = layout.octahedralNormals;
+    mVertexLayout = layout;
+}
+
+void Shape::updateVertices(const MeshData& mesh, size_t first, size_t count)
+{
+    if (count == 0) {
+        return;
+    }
+
+    if (VERTEX_FORMAT == 1) {
+        // Packed with the layout chosen at upload, so the stride still matches
+        std::vector<unsigned char> data = packVertices(mesh, mVertexLayout, first, count);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO[0]);
+        glBufferSubData(GL_ARRAY_BUFFER, first * mVertexLayout.stride(), data.size(), data.data());
+    }
+    else {
+        glBindBuffer(GL_ARRAY_BUFFER, VBO[0]);
+        glBufferSubData(GL_ARRAY_BUFFER, first * 3 * sizeof(float), count * 3 * sizeof(float), &mesh.positions[first * 3]);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO[2]);
+        glBufferSubData(GL_ARRAY_BUFFER, first * 2 * sizeof(float), count * 2 * sizeof(float), &mesh.uvs[first * 2]);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO[3]);
+        glBufferSubData(GL_ARRAY_BUFFER, first * 3 * sizeof(float), count * 3 * sizeof(float), &mesh.normals[first * 3]);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Shape::initCachedMesh(const MeshKey& key, const std::function<MeshData()>& build)
+{
+    const CachedMesh* cached = meshCache().find(key);
+    if (!cached) {
+        initBuffers();
+        uploadMesh(build());
+        cached = &meshCache().add(key, { VAO, { VBO[0], VBO[1], VBO[2], VBO[3] }, EBO, mIndexCount, mIndexType, mOctahedralNormals });
+    }
+
+    VAO = cached->VAO;
+    std::copy(cached->VBO, cached->VBO + 4, VBO);
+    EBO = cached->EBO;
+    mIndexCount = cached->indexCount;
+    mIndexType = cached->indexType;
+    mOctahedralNormals = cached->octahedralNormals;
+    mOwnsBuffers = false;
 }
 
 void Shape::setModelMatrix(glm::mat4 modelMatrix)
@@ -98,7 +221,8 @@ void Shape::draw(GLuint shaderProgram)
         mModelMatrix = glm::make_mat4(matrix);
     }
 
-    shaderSetMat4(shaderProgram, "uModel", mModelMatrix);
+    glm::mat4 model = mModelMatrix * mMeshScale;
+    shaderSetMat4(shaderProgram, "uModel", model);
     glBindVertexArray(VAO);
 
     if (mTexture)
@@ -123,16 +247,22 @@ void Shape::draw(GLuint shaderProgram)
     shaderSetVec4(shaderProgram, "material.specular", mSpecular);
     shaderSetFloat(shaderProgram, "material.shininess", mShininess);
 
-    // Normal matrix
-    glm::mat4 normalMatrix = glm::transpose(glm::inverse(mModelMatrix));
+    // Normal matrix, inverse transpose so non-uniform mesh scale keeps normals correct
+    glm::mat4 normalMatrix = glm::transpose(glm::inverse(model));
     shaderSetMat4(shaderProgram, "uNormal", normalMatrix);
+    shaderSetInt(shaderProgram, "uOctahedralNormal", mOctahedralNormals);
 
     glEnable(GL_CULL_FACE);
 
-    glDrawElements(GL_TRIANGLES, mIndexCount, GL_UNSIGNED_INT, 0);
+    drawGeometry(shaderProgram);
     glBindVertexArray(0);
 }
 
+void Shape::drawGeometry(GLuint shaderProgram)
+{
+    glDrawElements(GL_TRIANGLES, mIndexCount, mIndexType, 0);
+}
+
 
 
 Skybox::Skybox(GLuint texture)
@@ -229,308 +359,65 @@ void Skybox::draw(GLuint shaderProgram)
 
 
 
-Box::Box(float size_x, float size_y, float size_z) :
+Box::Box(float size_x, float size_y, float size_z, bool physicsSource) :
     mSizeX(size_x), mSizeY(size_y), mSizeZ(size_z)
 {
+    mPhysicsSource = physicsSource;
+    if (MESH_CACHE && !physicsSource) {
+        mMeshScale = glm::scale(glm::mat4(1.0f), glm::vec3(size_x, size_y, size_z));
+        initCachedMesh({ MESH_BOX }, [] { return buildBox(1.0f, 1.0f, 1.0f); });
+        return;
+    }
     initBuffers();
     fillBuffers();
 }
 
 void Box::fillBuffers()
 {
-    const float x = mSizeX / 2.0f;
-    const float y = mSizeY / 2.0f;
-    const float z = mSizeZ / 2.0f;
-
-    std::vector<float> vertices = {
-        // Front face
-        -x, -y,  z,   
-        -x, -y, -z,   
-        -x,  y, -z,   
-        -x,  y,  z,   
-
-        // Back face
-         x, -y, -z,   
-         x, -y,  z,   
-         x,  y,  z,   
-         x,  y, -z,   
-
-        // Right face
-         x, -y,  z,   
-        -x, -y,  z,   
-        -x,  y,  z,   
-         x,  y,  z,   
-
-        // Left face
-        -x, -y, -z,  
-         x, -y, -z,  
-         x,  y, -z,  
-        -x,  y, -z,  
-
-        // Top face
-        -x,  y,  z,  
-        -x,  y, -z,  
-         x,  y, -z,  
-         x,  y,  z,  
-
-        // Bottom face
-         x, -y, -z,  
-         x, -y,  z,  
-        -x, -y,  z,  
-        -x, -y, -z,  
-    };
-
-    std::vector<float> textureUVs{
-        1.0, 0.0, 0.0, 0.0, 0.0, 1.0, 1.0, 1.0,
-        1.0, 0.0, 0.0, 0.0, 0.0, 1.0, 1.0, 1.0,
-        1.0, 0.0, 0.0, 0.0, 0.0, 1.0, 1.0, 1.0,
-        1.0, 0.0, 0.0, 0.0, 0.0, 1.0, 1.0, 1.0,
-        1.0, 0.0, 0.0, 0.0, 0.0, 1.0, 1.0, 1.0,
-        1.0, 0.0, 0.0, 0.0, 0.0, 1.0, 1.0, 1.0,
-
-    };
-
-    std::vector<float> normals = {
-        // Front face
-        -1.0f, 0.0f, 0.0f, 
-        -1.0f, 0.0f, 0.0f,
-        -1.0f, 0.0f, 0.0f, 
-        -1.0f, 0.0f, 0.0f,
-        // Back face
-        1.0f, 0.0f, 0.0f,
-        1.0f, 0.0f, 0.0f,
-        1.0f, 0.0f, 0.0f,
-        1.0f, 0.0f, 0.0f,
-        // Right face
-        0.0f, 0.0f, 1.0f,
-        0.0f, 0.0f, 1.0f,
-        0.0f, 0.0f, 1.0f,
-        0.0f, 0.0f, 1.0f,
-        // Left face
-        0.0f, 0.0f, -1.0f,
-        0.0f, 0.0f, -1.0f,
-        0.0f, 0.0f, -1.0f,
-        0.0f, 0.0f, -1.0f,
-        // Top face
-        0.0f, 1.0f, 0.0f,
-        0.0f, 1.0f, 0.0f,
-        0.0f, 1.0f, 0.0f,
-        0.0f, 1.0f, 0.0f,
-        // Bottom face
-        0.0f, -1.0f, 0.0f,
-        0.0f, -1.0f, 0.0f,
-        0.0f, -1.0f, 0.0f,
-        0.0f, -1.0f, 0.0f,
-    };
-
-    std::vector<unsigned int> indices = {
-        // Front face
-        0, 2, 1,
-        2, 0, 3,
-        // Back face
-        4, 6, 5,
-        6, 4, 7,
-        // Right face
-        8, 10, 9,
-        10, 8, 11,
-        // Left face
-        12, 14, 13,
-        14, 12, 15,
-        // Top face
-        16, 18, 17,
-        18, 16, 19,
-        // Bottom face
-        20, 21, 22,
-        22, 23, 20,
-    };
-
-    glBindVertexArray(VAO);
-
-    fillVertexBuffer(vertices);
-    fillUVBuffer(textureUVs);
-    fillNormalBuffer(normals);
-    fillIndexBuffer(indices);
-
-    // Unbind VAO
-    glBindVertexArray(0);
-
-};
+    uploadMesh(buildBox(mSizeX, mSizeY, mSizeZ));
+}
 
 
 
-Pyramid::Pyramid(float size_x, float height, float size_z) :
+Pyramid::Pyramid(float size_x, float height, float size_z, bool physicsSource) :
     mSizeX(size_x), mHeight(height), mSizeZ(size_z)
 {
+    mPhysicsSource = physicsSource;
     initBuffers();
     fillBuffers();
 }
 
 void Pyramid::fillBuffers()
 {
-    const float x = mSizeX / 2.0f;
-    const float h = mHeight / 2.0f;
-    const float z = mSizeZ / 2.0f;
-
-    std::vector<float> vertices = {
-        // Side 1
-        -x, -h, -z,
-         x, -h, -z,
-         0,  h,  0,
-
-        // Side 2
-         x, -h, -z,
-         x, -h,  z,
-         0,  h,  0,
-
-        // Side 3
-         x, -h, z, 
-        -x, -h, z, 
-         0,  h, 0, 
-
-        // Side 4 
-        -x, -h,  z,
-        -x, -h, -z,
-         0,  h,  0,
-
-        // Bottom    
-         x, -h, -z,
-         x, -h,  z,
-        -x, -h,  z,
-        -x, -h, -z,
-    };
-
-    std::vector<float> textureUVs = {
-        1.0, 0.0,
-        0.0, 0.0,
-        0.5, 1.0,
-
-        1.0, 0.0,
-        0.0, 0.0,
-        0.5, 1.0,
-
-        1.0, 0.0,
-        0.0, 0.0,
-        0.5, 1.0,
-
-        1.0, 0.0,
-        0.0, 0.0,
-        0.5, 1.0,
-
-        0.0, 0.0,
-        0.0, 1.0,
-        1.0, 1.0,
-        1.0, 0.0,
-    };
-
-    glm::vec3 n1 = glm::normalize(glm::cross(glm::vec3(0, mHeight, z), glm::vec3(1, 0, 0) ));
-    glm::vec3 n2 = glm::normalize(glm::cross(glm::vec3(-x, mHeight, 0), glm::vec3(0, 0, 1) ));
-    glm::vec3 n3 = glm::normalize(glm::cross(glm::vec3(0, mHeight, -z), glm::vec3(-1, 0, 0) ));
-    glm::vec3 n4 = glm::normalize(glm::cross(glm::vec3(x, mHeight, 0), glm::vec3(0, 0, -1) ));
- 
-    std::vector<float> normals = {
-        n1.x, n1.y, n1.z,
-        n1.x, n1.y, n1.z,
-        n1.x, n1.y, n1.z,
-
-        n2.x, n2.y, n2.z,
-        n2.x, n2.y, n2.z,
-        n2.x, n2.y, n2.z,
-
-        n3.x, n3.y, n3.z,
-        n3.x, n3.y, n3.z,
-        n3.x, n3.y, n3.z,
-
-        n4.x, n4.y, n4.z,
-        n4.x, n4.y, n4.z,
-        n4.x, n4.y, n4.z,
-
-        0.0, -1.0, 0.0,
-        0.0, -1.0, 0.0,
-        0.0, -1.0, 0.0,
-        0.0, -1.0, 0.0,
-    };
-
-    std::vector<unsigned int> indices = {
-        // Sides
-        0, 2, 1,
-        3, 5, 4,
-        6, 8, 7,
-        9, 11, 10,
-        // Bottom
-        12, 13, 14,
-        14, 15, 12,
-    };
-
-    glBindVertexArray(VAO);
-
-    fillVertexBuffer(vertices);
-    fillUVBuffer(textureUVs);
-    fillNormalBuffer(normals);
-    fillIndexBuffer(indices);
-
-    mVertices = vertices;
-    mIndices = indices;
-
-    // Unbind VAO
-    glBindVertexArray(0);
+    uploadMesh(buildPyramid(mSizeX, mHeight, mSizeZ));
 }
 
 
 
-Plane::Plane(float size_x, float size_z) :
+Plane::Plane(float size_x, float size_z, bool physicsSource) :
     mSizeX(size_x), mSizeZ(size_z)
 {
+    mPhysicsSource = physicsSource;
+    if (MESH_CACHE && !physicsSource) {
+        mMeshScale = glm::scale(glm::mat4(1.0f), glm::vec3(size_x, 1.0f, size_z));
+        initCachedMesh({ MESH_PLANE }, [] { return buildPlane(1.0f, 1.0f); });
+        return;
+    }
     initBuffers();
     fillBuffers();
 }
 
 void Plane::fillBuffers()
 {
-    const float x = mSizeX / 2.0f;
-    const float z = mSizeZ / 2.0f;
-
-    std::vector<float> vertices = {  
-             x, 0.0f, -z,
-             x, 0.0f,  z,
-            -x, 0.0f,  z,
-            -x, 0.0f, -z,
-    };
-
-    std::vector<float> textureUVs = {
-        0.0, 0.0,
-        0.0, 1.0,
-        1.0, 1.0,
-        1.0, 0.0,
-    };
-
-    std::vector<float> normals = {
-        0.0, 1.0, 0.0,
-        0.0, 1.0, 0.0,
-        0.0, 1.0, 0.0,
-        0.0, 1.0, 0.0,
-    };
-
-    std::vector<unsigned int> indices = {
-        0, 2, 1,
-        2, 0, 3,
-    };
-
-    glBindVertexArray(VAO);
-
-    fillVertexBuffer(vertices);
-    fillUVBuffer(textureUVs);
-    fillNormalBuffer(normals);
-    fillIndexBuffer(indices);
-
-    // Unbind VAO
-    glBindVertexArray(0);
+    uploadMesh(buildPlane(mSizeX, mSizeZ));
 }
 
 
 
-CompositePlane::CompositePlane(int width, int depth, GLuint texture)
-    : mWidth(width), mDepth(depth), mHeightMap(nullptr)
+CompositePlane::CompositePlane(int width, int depth, GLuint texture, bool physicsSource)
+    : mWidth(width), mDepth(depth), mHeightfield(nullptr)
 {
+    mPhysicsSource = physicsSource;
     mTexture = texture;
     initBuffers();
     fillBuffers();
@@ -538,14 +425,15 @@ CompositePlane::CompositePlane(int width, int depth, GLuint texture)
 
 CompositePlane::CompositePlane(
     GLuint texture,
-    std::shared_ptr<std::vector<std::vector<float>>> heightMap)
-    : mHeightMap(heightMap)
+    std::shared_ptr<Heightfield> heightfield, bool physicsSource)
+    : mWidth(0), mDepth(0), mHeightfield(heightfield)
 {
+    mPhysicsSource = physicsSource;
     mTexture = texture;
 
-    if (mHeightMap && !mHeightMap->empty() && !(*mHeightMap)[0].empty()) {
-        mWidth = (*mHeightMap).size();
-        mDepth = (*mHeightMap)[0].size();
+    if (mHeightfield && mHeightfield->width() > 1 && mHeightfield->depth() > 1) {
+        mWidth = mHeightfield->width();
+        mDepth = mHeightfield->depth();
     }
     else {
         std::cout << "Heightmap is empty or not assigned.\n";
@@ -557,581 +445,67 @@ CompositePlane::CompositePlane(
 
 void CompositePlane::fillBuffers()
 {
-    std::vector<float> vertices;
-    std::vector<float> textureUVs;
-    std::vector<float> normals;
-    std::vector<unsigned int> indices;
-
-    const float x_to_z_ratio = static_cast<float>(mDepth) / mWidth;
-    const float scale = 0.1f;
-
-
-    for (int x = 0; x < mWidth; x++) {
-        for (int z = 0; z < mDepth; z++) {
-
-            float u = (x / float(mWidth - 1));
-            float v = (z / float(mDepth - 1));
-
-            float height = 0.0f;
-            if (mHeightMap && !mHeightMap->empty() && !(*mHeightMap)[0].empty()) {
-                height = (*mHeightMap)[x][z] * scale; // safe access
-            }
-
-            vertices.push_back(u - 0.5f);
-            vertices.push_back(height);
-            vertices.push_back((v - 0.5f) * x_to_z_ratio);
-
-            // UV
-            textureUVs.push_back(1-u); // Mirror texture the correct way
-            textureUVs.push_back(v);
-
-            normals.push_back(0.0f);
-            normals.push_back(1.0f);
-            normals.push_back(0.0f);
-        }
-    }
-
-    for (int x = 0; x < mWidth -1; x++) {
-        for (int z = 0; z < mDepth -1; z++) {
-
-            int start = x * mDepth + z;
-
-            indices.push_back(start);
-            indices.push_back(start + 1);
-            indices.push_back(start + mDepth);
-
-            indices.push_back(start + 1);
-            indices.push_back(start + mDepth + 1);
-            indices.push_back(start + mDepth);
-        }
+    if (mWidth < 2 || mDepth < 2) {
+        return;
     }
-
-    glBindVertexArray(VAO);
-
-    fillVertexBuffer(vertices);
-    fillUVBuffer(textureUVs);
-    fillNormalBuffer(normals);
-    fillIndexBuffer(indices);
-
-    // Unbind VAO
-    glBindVertexArray(0);
+    uploadMesh(buildCompositePlane(mWidth, mDepth, mHeightfield.get()));
 }
 
 
 
-Sphere::Sphere(float radius, int sectors, int stacks) : 
+Sphere::Sphere(float radius, int sectors, int stacks, bool physicsSource) :
     mRadius(radius), mSectors(sectors), mStacks(stacks)
 {
+    mPhysicsSource = physicsSource;
+    if (MESH_CACHE && !physicsSource) {
+        mMeshScale = glm::scale(glm::mat4(1.0f), glm::vec3(radius));
+        initCachedMesh({ MESH_SPHERE, sectors, stacks }, [=] { return buildSphere(1.0f, sectors, stacks); });
+        return;
+    }
     initBuffers();
     fillBuffers();
 }
 
 void Sphere::fillBuffers()
 {
-    std::vector<float> vertices;
-    std::vector<float> textureUVs;
-    std::vector<float> normals;
-    std::vector<unsigned int> indices;
-
-    const float radius = mRadius;
-
-    float x, y, z, xy;                              // vertex position
-    float nx, ny, nz;                               // normal
-    float lengthInv = 1.0f / radius;
-    float u, v;
-
-    const float sectorStep = 2 * PI / mSectors;
-    const float stackStep = PI / mStacks;
-    float sectorAngle, stackAngle;
-
-    for (int i = 0; i <= mStacks; ++i) {
-        stackAngle = PI / 2 - i * stackStep;        // starting from pi/2 to -pi/2
-        xy = radius * cosf(stackAngle);             // r * cos(u)
-        z = radius * sinf(stackAngle);              // r * sin(u)
-
-        // add (sectorCount+1) vertices per stack
-        // the first and last vertices have same position and normal, but different tex coords
-        for (int j = 0; j <= mSectors; ++j) {
-            sectorAngle = j * sectorStep;           // starting from 0 to 2pi
-
-            // vertex position
-            x = xy * cosf(sectorAngle);             // r * cos(u) * cos(v)
-            y = xy * sinf(sectorAngle);             // r * cos(u) * sin(v)
-
-            vertices.push_back(x);
-            vertices.push_back(y);
-            vertices.push_back(z);
-
-            // normalized vertex normal
-            nx = x * lengthInv;
-            ny = y * lengthInv;
-            nz = z * lengthInv;
-
-            normals.push_back(nx);
-            normals.push_back(ny);
-            normals.push_back(nz);
-
-            // vertex tex coord between [0, 1]
-            u = (float)j / mSectors;
-            v = (float)i / mStacks;
-
-            textureUVs.push_back(1-u);
-            textureUVs.push_back(v);
-        }
-    }
-
-    // indices
-    //  k1--k1+1
-    //  |  / |
-    //  | /  |
-    //  k2--k2+1
-    unsigned int k1, k2;
-    for (int i = 0; i < mStacks; ++i) {
-        k1 = i * (mSectors + 1);     // beginning of current stack
-        k2 = k1 + mSectors + 1;      // beginning of next stack
-
-        for (int j = 0; j < mSectors; ++j, ++k1, ++k2) {
-            if (i != 0) {
-                indices.push_back(k1);
-                indices.push_back(k2);
-                indices.push_back(k1 + 1);
-            }
-            if (i != (mStacks - 1)) {
-                indices.push_back(k1 + 1);
-                indices.push_back(k2);
-                indices.push_back(k2 + 1);
-            }
-        }
-    }
-
-    glBindVertexArray(VAO);
-
-    fillVertexBuffer(vertices);
-    fillUVBuffer(textureUVs);
-    fillNormalBuffer(normals);
-    fillIndexBuffer(indices);
-
-    // Unbind VAO
-    glBindVertexArray(0);
+    uploadMesh(buildSphere(mRadius, mSectors, mStacks));
 }
 
 
 
-Cylinder::Cylinder(float radius, float height, int sectors) : 
+Cylinder::Cylinder(float radius, float height, int sectors, bool physicsSource) :
     mRadius(radius), mHeight(height), mSectors(sectors)
 {
+    mPhysicsSource = physicsSource;
+    if (MESH_CACHE && !physicsSource) {
+        // Texture repeat depends on the proportions, so it is part of the key
+        int uvRepeat = std::max(int(height / (2 * radius)), 1);
+        mMeshScale = glm::scale(glm::mat4(1.0f), glm::vec3(2 * radius, height, 2 * radius));
+        initCachedMesh({ MESH_CYLINDER, sectors, uvRepeat }, [=] { return buildCylinder(0.5f, 1.0f, sectors, uvRepeat); });
+        return;
+    }
     initBuffers();
     fillBuffers();
 }
 
 void Cylinder::fillBuffers()
 {
-    std::vector<float> vertices;
-    std::vector<float> textureUVs;
-    std::vector<float> normals;
-    std::vector<unsigned int> indices;
-
-    int uvRepeat = std::max(int(mHeight / (2 * mRadius)), 1);
-
-    const float radius = mRadius;
-    const float h = mHeight / 2;
-
-    float x, z;                                     // vertex position
-    float nx, ny, nz;                               // normal
-    float u, v;                                     // texCoord
-
-    const float sectorStep = 2 * PI / mSectors;
-    float sectorAngle;
-
-    // Outer shell:
-    for (int i = 0; i <= mSectors; ++i) {
-        float sectorAngle = i * sectorStep;
-
-        float cosA = cosf(sectorAngle);
-        float sinA = sinf(sectorAngle);
-        x = radius * cosA;
-        z = radius * sinA;
-        nx = cosA;
-        ny = 0.0f;
-        nz = sinA;
-
-        // Top - bottom
-        vertices.insert(vertices.end(), {
-            x, h, z,
-            x, -h, z
-            });
-
-        normals.insert(normals.end(), { nx, ny, nz, nx, ny, nz });
-
-        u = (float)i / mSectors;
-        textureUVs.insert(textureUVs.end(), { u, 1.0f * uvRepeat, u, 0.0f });
-
-    }
-
-    for (int i = 0; i < mSectors; ++i) {
-        int k1 = i * 2;
-        int k2 = k1 + 2;
-
-        indices.push_back(k1);
-        indices.push_back(k2);
-        indices.push_back(k1 + 1);
-
-        indices.push_back(k2);
-        indices.push_back(k2 + 1);
-        indices.push_back(k1 + 1);
-    }
-
-    // Top circle:
-    int topCenterIndex = vertices.size() / 3;
-    vertices.push_back(0.0f); 
-    vertices.push_back(h); 
-    vertices.push_back(0.0f);
-
-    normals.push_back(0.0f); 
-    normals.push_back(1.0f); 
-    normals.push_back(0.0f);
-
-    textureUVs.push_back(0.5f); 
-    textureUVs.push_back(0.5f);
-
-    for (int i = 0; i <= mSectors; ++i) {
-        float sectorAngle = i * sectorStep;
-        float cosA = cosf(sectorAngle);
-        float sinA = sinf(sectorAngle);
-        x = radius * cosA;
-        z = radius * sinA;
-
-        vertices.push_back(x);
-        vertices.push_back(h);
-        vertices.push_back(z);
-
-        normals.push_back(0.0f);
-        normals.push_back(1.0f);
-        normals.push_back(0.0f);
-
-        textureUVs.push_back((cosA + 1.0f) * 0.5f);
-        textureUVs.push_back((sinA + 1.0f) * 0.5f);
-    }
-
-    for (int i = 0; i < mSectors; ++i) {
-        indices.push_back(topCenterIndex);
-        indices.push_back(topCenterIndex + i + 2);
-        indices.push_back(topCenterIndex + i + 1);
-    }
-
-    // Bottom circle:
-    int bottomCenterIndex = vertices.size() / 3;
-
-    vertices.push_back(0.0f); 
-    vertices.push_back(-h); 
-    vertices.push_back(0.0f);
-
-    normals.push_back(0.0f); 
-    normals.push_back(-1.0f); 
-    normals.push_back(0.0f);
-
-    textureUVs.push_back(0.5f); 
-    textureUVs.push_back(0.5f);
-
-    for (int i = 0; i <= mSectors; ++i) {
-        float sectorAngle = i * sectorStep;
-        float cosA = cos(sectorAngle);
-        float sinA = sin(sectorAngle);
-        x = radius * cosA;
-        z = radius * sinA;
-
-        vertices.push_back(x);
-        vertices.push_back(-h);
-        vertices.push_back(z);
-
-        normals.push_back(0.0f);
-        normals.push_back(-1.0f);
-        normals.push_back(0.0f);
-
-        textureUVs.push_back((cosA + 1.0f) * 0.5f);
-        textureUVs.push_back((sinA + 1.0f) * 0.5f);
-    }
-
-    for (int i = 0; i < mSectors; ++i) {
-        indices.push_back(bottomCenterIndex);
-        indices.push_back(bottomCenterIndex + i + 1);
-        indices.push_back(bottomCenterIndex + i + 2);
-    }
-
-    glBindVertexArray(VAO);
-
-    fillVertexBuffer(vertices);
-    fillUVBuffer(textureUVs);
-    fillNormalBuffer(normals);
-    fillIndexBuffer(indices);
-
-    // Unbind VAO
-    glBindVertexArray(0);
+    uploadMesh(buildCylinder(mRadius, mHeight, mSectors));
 }
 
 
 
-HalfPipe::HalfPipe(float innerRadius, float outerRadius, float length, int sectors) :
+HalfPipe::HalfPipe(float innerRadius, float outerRadius, float length, int sectors, bool physicsSource) :
     mInnerRadius(innerRadius), mOuterRadius(outerRadius), mLength(length), mSectors(sectors)
 {
+    mPhysicsSource = physicsSource;
     initBuffers();
     fillBuffers();
 }
 
 void HalfPipe::fillBuffers()
 {
-    std::vector<float> vertices;
-    std::vector<float> textureUVs;
-    std::vector<float> normals;
-    std::vector<unsigned int> indices;
-
-    int uvRepeat = std::max(int(mLength / (2*mOuterRadius)), 1);
-
-    const float rInner = mInnerRadius;
-    const float rOuter = mOuterRadius;
-    const float length = mLength / 2.0f;
-
-    float xIn, xOut, yIn, yOut;                     // vertex position
-    float nx, ny, nz;                               // normal
-    const float uvInner = rInner / rOuter;          // uv distance for inner curve [0 to 1]
-
-    const float sectorStep = PI / mSectors;
-    unsigned int startIndex;
-
-    // Inner curve
-    startIndex = vertices.size() / 3;
-    nz = 0.0f;
-    for (int i = 0; i <= mSectors; ++i) {
-        float sectorAngle = PI + i * sectorStep;    // starting from pi to 2*pi
-
-        float cosA = cosf(sectorAngle);
-        float sinA = sinf(sectorAngle);
-        xIn = rInner * cosA;
-        yIn = rInner * sinA;
-        nx = -cosA;
-        ny = -sinA;
-
-        // front - back
-        vertices.push_back(xIn);
-        vertices.push_back(yIn);
-        vertices.push_back(-length);
-
-        vertices.push_back(xIn);
-        vertices.push_back(yIn);
-        vertices.push_back(length);
-
-        normals.insert(normals.end(), { nx, ny, nz, nx, ny, nz });
-
-        textureUVs.insert(textureUVs.end(), {
-        (cosA * uvInner + 1.0f) * 0.5f, 0.0f,
-        (sinA * uvInner + 1.0f) * 0.5f, 1.0f * uvRepeat,
-            });
-    }
-    for (int i = 0; i < mSectors; ++i) {
-        int k1 = i * 2 + startIndex;
-        int k2 = k1 + 2;
-
-        indices.push_back(k1);
-        indices.push_back(k1 + 1);
-        indices.push_back(k2);
-
-        indices.push_back(k2);
-        indices.push_back(k1 + 1);
-        indices.push_back(k2 + 1);
-    }
-
-
-    // Outer curve
-    startIndex = vertices.size() / 3;
-    for (int i = 0; i <= mSectors; ++i) {
-        float sectorAngle = PI + i * sectorStep;
-    
-        float cosA = cosf(sectorAngle);
-        float sinA = sinf(sectorAngle);
-        xOut = rOuter * cosA;
-        yOut = rOuter * sinA;
-        nx = cosA;
-        ny = sinA;
-
-        // front - back
-        vertices.push_back(xOut);
-        vertices.push_back(yOut);
-        vertices.push_back(-length);
-
-        vertices.push_back(xOut);
-        vertices.push_back(yOut);
-        vertices.push_back(length);
-
-        normals.insert(normals.end(), { nx, ny, nz, nx, ny, nz });
-
-        textureUVs.insert(textureUVs.end(), {
-        (cosA + 1.0f) * 0.5f, 0.0f,
-        (sinA + 1.0f) * 0.5f, 1.0f * uvRepeat,
-            });
-    }
-    for (int i = 0; i < mSectors; ++i) {
-        int k1 = i * 2 + startIndex;
-        int k2 = k1 + 2;
-
-        indices.push_back(k1);
-        indices.push_back(k2);
-        indices.push_back(k1 + 1);
-
-        indices.push_back(k2);
-        indices.push_back(k2 + 1);
-        indices.push_back(k1 + 1);
-    }
-
-    // Front face
-    startIndex = vertices.size() / 3;
-    nx = 0;
-    ny = 0;
-    nz = -1.0f;
-    for (int i = 0; i <= mSectors; ++i) {
-        float sectorAngle = PI + i * sectorStep;
-
-        float cosA = cosf(sectorAngle);
-        float sinA = sinf(sectorAngle);
-        xIn = rInner * cosA;
-        yIn = rInner * sinA;
-        xOut = rOuter * cosA;
-        yOut = rOuter * sinA;
-
-        // inner - outer
-        vertices.push_back(xIn);
-        vertices.push_back(yIn);
-        vertices.push_back(-length);
-
-        vertices.push_back(xOut);
-        vertices.push_back(yOut);
-        vertices.push_back(-length);
-
-        normals.insert(normals.end(), { nx, ny, nz, nx, ny, nz });
-
-        textureUVs.push_back((cosA * uvInner + 1.0f) * 0.5f);
-        textureUVs.push_back((sinA * uvInner + 1.0f) * 0.5f);
-        textureUVs.push_back((cosA + 1.0f) * 0.5f);
-        textureUVs.push_back((sinA + 1.0f) * 0.5f);
-    }
-    for (int i = 0; i < mSectors; ++i) {
-        int k1 = i * 2 + startIndex;
-        int k2 = k1 + 2;
-
-        indices.push_back(k1);
-        indices.push_back(k2);
-        indices.push_back(k1 + 1);
-
-        indices.push_back(k2);
-        indices.push_back(k2 + 1);
-        indices.push_back(k1 + 1);
-    }
-
-    // Back face
-    startIndex = vertices.size() / 3;
-    nx = 0;
-    ny = 0;
-    nz = 1.0f;
-    for (int i = 0; i <= mSectors; ++i) {
-        float sectorAngle = PI + i * sectorStep;
-
-        float cosA = cosf(sectorAngle);
-        float sinA = sinf(sectorAngle);
-        xIn = rInner * cosA;
-        yIn = rInner * sinA;
-        xOut = rOuter * cosA;
-        yOut = rOuter * sinA;
-
-        // inner - outer
-        vertices.push_back(xIn);
-        vertices.push_back(yIn);
-        vertices.push_back(length);
-
-        vertices.push_back(xOut);
-        vertices.push_back(yOut);
-        vertices.push_back(length);
-
-        normals.insert(normals.end(), { nx, ny, nz, nx, ny, nz });
-
-        textureUVs.push_back((cosA * uvInner + 1.0f) * 0.5f);
-        textureUVs.push_back((sinA * uvInner + 1.0f) * 0.5f);
-        textureUVs.push_back((cosA + 1.0f) * 0.5f);
-        textureUVs.push_back((sinA + 1.0f) * 0.5f);
-    }
-    for (int i = 0; i < mSectors; ++i) {
-        int k1 = i * 2 + startIndex;
-        int k2 = k1 + 2;
-
-        indices.push_back(k1);
-        indices.push_back(k1 + 1);
-        indices.push_back(k2);
-
-        indices.push_back(k2);
-        indices.push_back(k1 + 1);
-        indices.push_back(k2 + 1);
-    }
-
-    // Squares
-    startIndex = vertices.size() / 3;
-    nx = 0;
-    ny = 1.0f;
-    nz = 0;
-
-    vertices.insert(vertices.end(), { 
-        -rOuter, 0.0f, -length,
-        -rInner, 0.0f, -length,
-        -rInner, 0.0f, length,
-        -rOuter, 0.0f, length,
-
-        rInner, 0.0f, -length,
-        rOuter, 0.0f, -length,
-        rOuter, 0.0f, length,
-        rInner, 0.0f, length,
-        });
-
-    normals.insert(normals.end(), { 
-        nx, ny, nz,
-        nx, ny, nz,
-        nx, ny, nz,
-        nx, ny, nz,
-
-        nx, ny, nz,
-        nx, ny, nz,
-        nx, ny, nz,
-        nx, ny, nz,
-        });
-
-    textureUVs.insert(textureUVs.end(), {
-        1.0f, 0.0f,
-        uvInner, 0.0f,
-        uvInner, 1.0f * uvRepeat,
-        1.0f, 1.0f * uvRepeat,
-
-        1.0f - uvInner, 0.0f,
-        0.0f, 0.0f,
-        0.0f, 1.0f * uvRepeat,
-        1.0f - uvInner, 1.0f * uvRepeat,
-        });
-
-    indices.insert(indices.end(), {
-        startIndex, startIndex + 3, startIndex + 2,
-        startIndex, startIndex + 2, startIndex + 1,
-
-        startIndex+4, startIndex + 7, startIndex + 6,
-        startIndex+4, startIndex + 6, startIndex + 5,
-        });
-
-    glBindVertexArray(VAO);
-
-    fillVertexBuffer(vertices);
-    fillUVBuffer(textureUVs);
-    fillNormalBuffer(normals);
-    fillIndexBuffer(indices);
-
-    mVertices = vertices;
-    mIndices = indices;
-
-    // Unbind VAO
-    glBindVertexArray(0);
+    uploadMesh(buildHalfPipe(mInnerRadius, mOuterRadius, mLength, mSectors));
 }
 
 
@@ -1139,6 +513,8 @@ void HalfPipe::fillBuffers()
 HalfPipeTrack::HalfPipeTrack(std::vector<TrackSupport> supports, int sectors) :
     mSupports(supports), mSectors(sectors)
 {
+    // Edits and the collision shape both work on the kept mesh
+    mPhysicsSource = true;
     initBuffers();
     fillBuffers();
 }
@@ -1149,329 +525,129 @@ void HalfPipeTrack::fillBuffers()
         return;
     }
 
-    std::vector<float> vertices;
-    std::vector<float> textureUVs;
-    std::vector<float> normals;
-    std::vector<unsigned int> indices;
-
-    int uvRepeat = 1;
-
-    float rInner1, rInner2;
-    float rOuter1, rOuter2;
-
-    float xIn1, xOut1, yIn1, yOut1, zIn1, zOut1;        // vertex position for s1
-    float xIn2, xOut2, yIn2, yOut2, zIn2, zOut2;        // vertex position for s2
-    float nx, ny, nz;                                   // normal
-    float uvInner1, uvInner2;                           // uv distance for inner curve [0 to 1]
-
-    const float sectorStep = PI / mSectors;
-    float sectorAngle;
-    unsigned int startIndex;
-
-    // Segments
-    for (int sIdx = 0; sIdx < mSupports.size() - 1; sIdx++) {
-        TrackSupport s1 = mSupports[sIdx];
-        TrackSupport s2 = mSupports[sIdx + 1];
-
-        float cosR1 = cosf(glm::radians(s1.angle));
-        float cosR2 = cosf(glm::radians(s2.angle));
-        float sinR1 = sinf(glm::radians(s1.angle));
-        float sinR2 = sinf(glm::radians(s2.angle));
-
-        rInner1 = s1.innerRadius;
-        rInner2 = s2.innerRadius;
-        rOuter1 = s1.outerRadius;
-        rOuter2 = s2.outerRadius;
-
-        uvInner1 = rInner1 / rOuter1;
-        uvInner2 = rInner2 / rOuter2;
-
-        float length = std::sqrt(std::pow(s2.x - s1.x, 2) + std::pow(s2.y - s1.y, 2) + std::pow(s2.z - s1.z, 2));
-
-        uvRepeat = std::max(int(length / (rOuter1 + rOuter2)), 1);
-
-        // Inner curve
-        startIndex = vertices.size() / 3;
-        for (int i = 0; i <= mSectors; ++i) {
-            float sectorAngle = PI + i * sectorStep;    // starting from pi to 2*pi
-
-            float cosA = cosf(sectorAngle);
-            float sinA = sinf(sectorAngle);
+    // Not optimized: the track is already cache friendly in build order, and edits
+    // depend on each segment keeping its place in the buffers
+    mBufferUsage = GL_DYNAMIC_DRAW;
+    MeshData mesh = buildHalfPipeTrack(mSupports, mSectors);
 
-            xIn1 = s1.x + (rInner1 * cosA * cosR1);
-            yIn1 = s1.y + (rInner1 * sinA);
-            zIn1 = s1.z + (rInner1 * cosA * sinR1);
-
-            xIn2 = s2.x + (rInner2 * cosA * cosR2);
-            yIn2 = s2.y + (rInner2 * sinA);
-            zIn2 = s2.z + (rInner2 * cosA * sinR2);
-
-            nx = -cosA * cosR1;
-            ny = -sinA;
-            nz = -cosA * sinR1;
-
-            vertices.insert(vertices.end(), { 
-                xIn1, yIn1, zIn1,
-                xIn2, yIn2, zIn2,
-            });
-
-            normals.insert(normals.end(), { nx, ny, nz, nx, ny, nz });
-
-            textureUVs.insert(textureUVs.end(), {
-                (cosA * uvInner1 + 1.0f) * 0.5f, 0.0f,
-                (sinA * uvInner2 + 1.0f) * 0.5f, 1.0f * uvRepeat,
-            });
-        }
-        for (int i = 0; i < mSectors; ++i) {
-            int k1 = i * 2 + startIndex;
-            int k2 = k1 + 2;
-
-            indices.push_back(k1);
-            indices.push_back(k1 + 1);
-            indices.push_back(k2);
+    if (!mProcedural) {
+        uploadMesh(std::move(mesh), false);
+        return;
+    }
 
-            indices.push_back(k2);
-            indices.push_back(k1 + 1);
-            indices.push_back(k2 + 1);
-        }
+    // Only the supports go to the GPU, the vertex shader builds the mesh from them.
+    // The CPU mesh is still needed for the collision shape.
+    std::vector<float> texels = buildTrackSupportTexels(mSupports, mSectors);
+    glGenBuffers(1, &mSupportBuffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, mSupportBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, texels.size() * sizeof(float), texels.data(), mBufferUsage);
+    glGenTextures(1, &mSupportTexture);
+    glBindTexture(GL_TEXTURE_BUFFER, mSupportTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, mSupportBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
 
-        // Outer curve
-        startIndex = vertices.size() / 3;
-        for (int i = 0; i <= mSectors; ++i) {
-            float sectorAngle = PI + i * sectorStep;    // starting from pi to 2*pi
+    // One vertex per index, drawn without an index buffer
+    mIndexCount = static_cast<GLsizei>(mesh.indices.size());
+    mVertexBytes = texels.size() * sizeof(float);
+    mVertexBytesSaved = mesh.byteSize() - mVertexBytes;
+    retainMesh(std::move(mesh));
+}
 
-            float cosA = cosf(sectorAngle);
-            float sinA = sinf(sectorAngle);
+HalfPipeTrack::~HalfPipeTrack()
+{
+    if (mSupportTexture) glDeleteTextures(1, &mSupportTexture);
+    if (mSupportBuffer) glDeleteBuffers(1, &mSupportBuffer);
+}
 
-            xOut1 = s1.x + (rOuter1 * cosA * cosR1);
-            yOut1 = s1.y + (rOuter1 * sinA);
-            zOut1 = s1.z + (rOuter1 * cosA * sinR1);
+void HalfPipeTrack::drawGeometry(GLuint shaderProgram)
+{
+    if (!mProcedural) {
+        Shape::drawGeometry(shaderProgram);
+        return;
+    }
 
-            xOut2 = s2.x + (rOuter2 * cosA * cosR2);
-            yOut2 = s2.y + (rOuter2 * sinA);
-            zOut2 = s2.z + (rOuter2 * cosA * sinR2);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_BUFFER, mSupportTexture);
+    shaderSetInt(shaderProgram, "uTrackSupports", 3);
+    shaderSetInt(shaderProgram, "uTrackSectors", mSectors);
+    shaderSetInt(shaderProgram, "uTrackSupportCount", static_cast<int>(mSupports.size()));
+    shaderSetInt(shaderProgram, "uProceduralTrack", 1);
 
-            nx = cosA * cosR1;
-            ny = sinA;
-            nz = cosA * sinR1;
+    glDrawArrays(GL_TRIANGLES, 0, mIndexCount);
 
-            vertices.insert(vertices.end(), {
-                xOut1, yOut1, zOut1,
-                xOut2, yOut2, zOut2,
-            });
+    shaderSetInt(shaderProgram, "uProceduralTrack", 0);
+    glActiveTexture(GL_TEXTURE0);
+}
 
-            normals.insert(normals.end(), { nx, ny, nz, nx, ny, nz });
+void HalfPipeTrack::setSupport(size_t index, const TrackSupport& support, btCollisionWorld* world)
+{
+    if (index >= mSupports.size() || !mMesh) {
+        return;
+    }
 
-            textureUVs.insert(textureUVs.end(), {
-                (cosA + 1.0f) * 0.5f, 0.0f,
-                (sinA + 1.0f) * 0.5f, 1.0f * uvRepeat,
-            });
-        }
-        for (int i = 0; i < mSectors; ++i) {
-            int k1 = i * 2 + startIndex;
-            int k2 = k1 + 2;
+    moveSupport(index, support)(world);
+    uploadSupport(index);
+}
 
-            indices.push_back(k1);
-            indices.push_back(k2);
-            indices.push_back(k1 + 1);
+std::function<void(btCollisionWorld*)> HalfPipeTrack::moveSupport(size_t index, const TrackSupport& support)
+{
+    if (index >= mSupports.size() || !mMesh) {
+        return [](btCollisionWorld*) {};
+    }
 
-            indices.push_back(k2);
-            indices.push_back(k2 + 1);
-            indices.push_back(k1 + 1);
+    mSupports[index] = support;
+    if (mProcedural) {
+        // The support, and the texture repeat of the segment ending at it
+        size_t first = index > 0 ? index - 1 : index;
+        std::vector<float> texels((index - first + 1) * 8);
+        for (size_t s = first; s <= index; s++) {
+            fillTrackSupportTexels(mSupports, s, &texels[(s - first) * 8]);
         }
-
-        // Squares
-        startIndex = vertices.size() / 3;
-        nx = 0;
-        ny = 1.0f;
-        nz = 0;
-
-        vertices.insert(vertices.end(), {
-            s1.x + (-rOuter1 * cosR1),
-            s1.y, 
-            s1.z + (-rOuter1 * sinR1),
-            s1.x + (-rInner1 * cosR1),
-            s1.y,
-            s1.z + (-rInner1 * sinR1),
-            s2.x + (-rInner2 * cosR2),
-            s2.y,
-            s2.z + (-rInner2 * sinR2),
-            s2.x + (-rOuter2 * cosR2),
-            s2.y,
-            s2.z + (-rOuter2 * sinR2),
-
-            s1.x + (rInner1 * cosR1), 
-            s1.y, 
-            s1.z + (rInner1 * sinR1),
-            s1.x + (rOuter1 * cosR1), 
-            s1.y,
-            s1.z + (rOuter1 * sinR1),
-            s2.x + (rOuter2 * cosR2), 
-            s2.y, 
-            s2.z + (rOuter2 * sinR2),
-            s2.x + (rInner2 * cosR2), 
-            s2.y, 
-            s2.z + (rInner2 * sinR2),
-        });
-
-        normals.insert(normals.end(), {
-           nx, ny, nz,
-           nx, ny, nz,
-           nx, ny, nz,
-           nx, ny, nz,
-
-           nx, ny, nz,
-           nx, ny, nz,
-           nx, ny, nz,
-           nx, ny, nz,
-        });
-
-        textureUVs.insert(textureUVs.end(), {
-            1.0f, 0.0f,
-            uvInner1, 0.0f,
-            uvInner2, 1.0f * uvRepeat,
-            1.0f, 1.0f * uvRepeat,
-
-            1.0f - uvInner1, 0.0f,
-            0.0f, 0.0f,
-            0.0f, 1.0f * uvRepeat,
-            1.0f - uvInner2, 1.0f * uvRepeat,
-        });
-
-        indices.insert(indices.end(), {
-            startIndex, startIndex + 3, startIndex + 2,
-            startIndex, startIndex + 2, startIndex + 1,
-
-            startIndex + 4, startIndex + 7, startIndex + 6,
-            startIndex + 4, startIndex + 6, startIndex + 5,
-        });
+        glBindBuffer(GL_TEXTURE_BUFFER, mSupportBuffer);
+        glBufferSubData(GL_TEXTURE_BUFFER, trackSupportTexel(mSectors, first) * 4 * sizeof(float),
+            texels.size() * sizeof(float), texels.data());
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
     }
 
-    // Front face
-    TrackSupport s1 = mSupports.front();
-    float cosR1 = cosf(glm::radians(s1.angle));
-    float sinR1 = sinf(glm::radians(s1.angle));
-
-    rInner1 = s1.innerRadius;
-    rOuter1 = s1.outerRadius;
+    // Runs on the physics side. It takes copies of the supports but rewrites the shared mMesh,
+    // which the render side leaves alone until the command ran, see moveSupport in shape.h
+    std::shared_ptr<MeshData> mesh = mMesh;
+    std::vector<TrackSupport> supports = mSupports;
+    int sectors = mSectors;
+    btRigidBody* body = m_pBody;
+    return [mesh, supports, sectors, index, body](btCollisionWorld* world) {
+        // The collision mesh reads the same vertices, so bound them before and after the change
+        std::vector<MeshRange> ranges = halfPipeTrackRanges(supports.size(), sectors, index);
+        btVector3 aabbMin(BT_LARGE_FLOAT, BT_LARGE_FLOAT, BT_LARGE_FLOAT);
+        btVector3 aabbMax(-BT_LARGE_FLOAT, -BT_LARGE_FLOAT, -BT_LARGE_FLOAT);
+        auto growBounds = [&]() {
+            for (const MeshRange& range : ranges) {
+                for (size_t v = range.firstVertex; v < range.firstVertex + range.vertexCount; v++) {
+                    btVector3 p(mesh->positions[v * 3], mesh->positions[v * 3 + 1], mesh->positions[v * 3 + 2]);
+                    aabbMin.setMin(p);
+                    aabbMax.setMax(p);
+                }
+            }
+        };
 
-    nx = -sinR1;
-    ny = 0;
-    nz = -cosR1;
+        growBounds();
+        updateHalfPipeTrack(*mesh, supports, sectors, index);
+        growBounds();
 
-    uvInner1 = rInner1 / rOuter1;
-    
-    startIndex = vertices.size() / 3;
-    for (int i = 0; i <= mSectors; ++i) {
-        float sectorAngle = PI + i * sectorStep;
-
-        float cosA = cosf(sectorAngle);
-        float sinA = sinf(sectorAngle);
-
-        xIn1 = s1.x + (rInner1 * cosA * cosR1);
-        yIn1 = s1.y + (rInner1 * sinA);
-        zIn1 = s1.z + (rInner1 * cosA * sinR1);
-
-        xOut1 = s1.x + (rOuter1 * cosA * cosR1);
-        yOut1 = s1.y + (rOuter1 * sinA);
-        zOut1 = s1.z + (rOuter1 * cosA * sinR1);
-
-        vertices.insert(vertices.end(), {
-            xIn1, yIn1, zIn1,
-            xOut1, yOut1, zOut1,
-        });
-
-        normals.insert(normals.end(), { nx, ny, nz, nx, ny, nz });
-
-        textureUVs.insert(textureUVs.end(), {
-            (cosA * uvInner1 + 1.0f) * 0.5f,
-            (sinA * uvInner1 + 1.0f) * 0.5f,
-            (cosA + 1.0f) * 0.5f,
-            (sinA + 1.0f) * 0.5f,
-        });
-
-        for (int i = 0; i < mSectors; ++i) {
-            int k1 = i * 2 + startIndex;
-            int k2 = k1 + 2;
-
-            indices.push_back(k1);
-            indices.push_back(k2);
-            indices.push_back(k1 + 1);
-
-            indices.push_back(k2);
-            indices.push_back(k2 + 1);
-            indices.push_back(k1 + 1);
+        if (body) {
+            refitCollisionMesh(body, aabbMin, aabbMax, world);
         }
+    };
+}
 
+void HalfPipeTrack::uploadSupport(size_t index)
+{
+    if (mProcedural || index >= mSupports.size() || !mMesh) {
+        return;
     }
 
-    // Back face
-    TrackSupport s2 = mSupports.back();
-    float cosR2 = cosf(glm::radians(s2.angle));
-    float sinR2 = sinf(glm::radians(s2.angle));
-
-    rInner2 = s2.innerRadius;
-    rOuter2 = s2.outerRadius;
-
-    nx = sinR2;
-    ny = 0;
-    nz = cosR2;
-
-    uvInner2 = rInner2 / rOuter2;
-
-    startIndex = vertices.size() / 3;
-    for (int i = 0; i <= mSectors; ++i) {
-        float sectorAngle = PI + i * sectorStep;
-
-        float cosA = cosf(sectorAngle);
-        float sinA = sinf(sectorAngle);
-
-        xIn2 = s2.x + (rInner2 * cosA * cosR2);
-        yIn2 = s2.y + (rInner2 * sinA);
-        zIn2 = s2.z + (rInner2 * cosA * sinR2);
-
-        xOut2 = s2.x + (rOuter2 * cosA * cosR2);
-        yOut2 = s2.y + (rOuter2 * sinA);
-        zOut2 = s2.z + (rOuter2 * cosA * sinR2);
-
-        vertices.insert(vertices.end(), {
-            xIn2, yIn2, zIn2,
-            xOut2, yOut2, zOut2,
-            });
-
-        normals.insert(normals.end(), { nx, ny, nz, nx, ny, nz });
-
-        textureUVs.insert(textureUVs.end(), {
-            (cosA * uvInner2 + 1.0f) * 0.5f,
-            (sinA * uvInner2 + 1.0f) * 0.5f,
-            (cosA + 1.0f) * 0.5f,
-            (sinA + 1.0f) * 0.5f,
-            });
-
-        for (int i = 0; i < mSectors; ++i) {
-            int k1 = i * 2 + startIndex;
-            int k2 = k1 + 2;
-
-            indices.push_back(k1);
-            indices.push_back(k1 + 1);
-            indices.push_back(k2);
-
-            indices.push_back(k2);
-            indices.push_back(k1 + 1);
-            indices.push_back(k2 + 1);
-        }
+    for (const MeshRange& range : halfPipeTrackRanges(mSupports.size(), mSectors, index)) {
+        updateVertices(*mMesh, range.firstVertex, range.vertexCount);
     }
-
-    glBindVertexArray(VAO);
-
-    fillVertexBuffer(vertices);
-    fillUVBuffer(textureUVs);
-    fillNormalBuffer(normals);
-    fillIndexBuffer(indices);
-
-    mVertices = vertices;
-    mIndices = indices;
-
-    // Unbind VAO
-    glBindVertexArray(0);
 }
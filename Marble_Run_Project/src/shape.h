@@ -3,25 +3,38 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
+#include <functional>
+#include <memory>
 #include <iostream>
 #include <vector>
 #include <BulletDynamics/Dynamics/btDynamicsWorld.h>
 #include <btBulletDynamicsCommon.h>
 
+#include "mesh_builder.h"
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
 #include "structs.h"
 #include "Utils.h"
 
 class Shape {  	
 public:
     const float PI = acos(-1.0f);
-    ~Shape();
+    virtual ~Shape();
     
     void initBuffers();
-    void fillVertexBuffer(std::vector<float> vertices);
-    void fillColorBuffer(std::vector<float> colors);
-    void fillUVBuffer(std::vector<float> textureUVs);
-    void fillNormalBuffer(std::vector<float> normals);
-    void fillIndexBuffer(std::vector<unsigned int> indices);
+    void fillVertexBuffer(const std::vector<float>& vertices);
+    void fillColorBuffer(const std::vector<float>& colors);
+    void fillUVBuffer(const std::vector<float>& textureUVs);
+    void fillNormalBuffer(const std::vector<float>& normals);
+    void fillIndexBuffer(const std::vector<unsigned int>& indices);
+    // Takes the mesh, optimizing it first when optimize is set. Afterwards it is kept
+    // in mMesh if the shape is a physics source and released otherwise.
+    void uploadMesh(MeshData&& mesh, bool optimize = OPTIMIZE_MESHES);
+    void retainMesh(MeshData&& mesh);
+    void uploadInterleaved(const MeshData& mesh);
+    // Re-sends vertices [first, first + count) of an uploaded mesh with the same vertex count
+    void updateVertices(const MeshData& mesh, size_t first, size_t count);
+    void initCachedMesh(const MeshKey& key, const std::function<MeshData()>& build);
 
     void setModelMatrix(glm::mat4 modelMatrix);
     void useTexture(GLuint texture);
@@ -31,21 +44,37 @@ public:
 
     virtual void fillBuffers() = 0;
     virtual void draw(GLuint shaderProgram);
+    // The draw call itself, after draw has set the shape's uniforms
+    virtual void drawGeometry(GLuint shaderProgram);
 
     /// Variables
     GLuint VAO;
-    GLuint VBO[4];
-    // 0 - position
+    GLuint VBO[4] = {};
+    // 0 - position, or every attribute when interleaved
     // 1 - color
     // 2 - UV
     // 3 - normal
     GLuint EBO;
+    // False when the buffers belong to the mesh cache
+    bool mOwnsBuffers = true;
+
+    // GL_DYNAMIC_DRAW for shapes that update their vertices
+    GLenum mBufferUsage = GL_STATIC_DRAW;
+    VertexLayout mVertexLayout;
 
     GLsizei mIndexCount;
+    GLenum mIndexType = GL_UNSIGNED_INT;
+    bool mOctahedralNormals = false;
+    // Vertex data uploaded by this shape, and what packing saved over separate float buffers
+    size_t mVertexBytes = 0;
+    size_t mVertexBytesSaved = 0;
     GLuint mTexture;
     bool mCastShadow = true;
-    std::vector<float> mVertices;
-    std::vector<unsigned int> mIndices;
+    // Keeps the CPU geometry after upload so a collision mesh can share it. Set by the
+    // constructor, before fillBuffers, and never served from the mesh cache.
+    bool mPhysicsSource = false;
+    // CPU geometry of a physics source, shared with its collision mesh. Null otherwise.
+    std::shared_ptr<MeshData> mMesh;
 
     // Material
     glm::vec4 mAmbient = glm::vec4(1.0f);
@@ -54,6 +83,8 @@ public:
     float mShininess = 1.0f;
 
     glm::mat4 mModelMatrix = glm::mat4(1.0f);
+    // Size of a cached unit mesh, applied before mModelMatrix
+    glm::mat4 mMeshScale = glm::mat4(1.0f);
 
     // Bullet
     btRigidBody* m_pBody = nullptr;
@@ -73,7 +104,7 @@ private:
     float mSizeZ;
     
 public:
-    Box(float size_x = 0.5f, float size_y = 0.5f, float size_z = 0.5f);
+    Box(float size_x = 0.5f, float size_y = 0.5f, float size_z = 0.5f, bool physicsSource = false);
 	void fillBuffers() override;
 };
 
@@ -84,7 +115,7 @@ private:
     float mSizeZ;
 
 public:
-    Pyramid(float size_x = 0.5f, float height = 1.0f, float size_z = 0.5f);
+    Pyramid(float size_x = 0.5f, float height = 1.0f, float size_z = 0.5f, bool physicsSource = false);
     void fillBuffers() override;
 };
 
@@ -93,7 +124,7 @@ private:
     float mSizeX;
     float mSizeZ;
 public:
-    Plane(float size_x, float size_z);
+    Plane(float size_x, float size_z, bool physicsSource = false);
     void fillBuffers() override;
 };
 
@@ -101,12 +132,13 @@ class CompositePlane : public Shape {
 private:
     int mWidth;
     int mDepth;
-    std::shared_ptr<std::vector<std::vector<float>>> mHeightMap;
+    std::shared_ptr<Heightfield> mHeightfield;
 
 public:
-    CompositePlane(int width, int depth, GLuint texture);
+    CompositePlane(int width, int depth, GLuint texture, bool physicsSource = false);
+    // Grid with one vertex per heightfield sample. Shares the heightfield, no copy is made.
     CompositePlane(GLuint texture, 
-        std::shared_ptr<std::vector<std::vector<float>>> heightMap);
+        std::shared_ptr<Heightfield> heightfield, bool physicsSource = false);
     void fillBuffers() override;
     //void draw() override;
 };
@@ -118,7 +150,7 @@ private:
     int mStacks;
 
 public:
-    Sphere(float radius = 1.0f, int sectors = 50, int stacks = 50);
+    Sphere(float radius = 1.0f, int sectors = 50, int stacks = 50, bool physicsSource = false);
     void fillBuffers() override;
 };
 
@@ -128,7 +160,7 @@ private:
     float mHeight;
     int mSectors;
 public:
-    Cylinder(float radius = 0.5f, float height = 1.0f, int sectors = 50);
+    Cylinder(float radius = 0.5f, float height = 1.0f, int sectors = 50, bool physicsSource = false);
     void fillBuffers() override;
 };
 
@@ -139,7 +171,7 @@ private:
     float mLength;
     int mSectors;
 public:
-    HalfPipe(float innerRadius = 0.9f, float outerRadius = 1.0f, float length = 1.0f, int sectors = 10);
+    HalfPipe(float innerRadius = 0.9f, float outerRadius = 1.0f, float length = 1.0f, int sectors = 10, bool physicsSource = false);
     void fillBuffers() override;
 };
 
@@ -147,7 +179,29 @@ class HalfPipeTrack : public Shape {
 private:
     std::vector<TrackSupport> mSupports;
     int mSectors;
+    // mMesh stays in build order, so the segments of a support can be found and rewritten
+
+    // Supports as a buffer texture when the vertex shader generates the track
+    bool mProcedural = PROCEDURAL_TRACKS;
+    GLuint mSupportBuffer = 0;
+    GLuint mSupportTexture = 0;
 public:
-    HalfPipeTrack(std::vector<TrackSupport> supports, int sectors = 10);
+    HalfPipeTrack(std::vector<TrackSupport> supports, int sectors = TRACK_SECTORS);
+    ~HalfPipeTrack() override;
     void fillBuffers() override;
+    void drawGeometry(GLuint shaderProgram) override;
+
+    const std::vector<TrackSupport>& getSupports() const { return mSupports; }
+    // Regenerates only the segments next to the support and updates them in the vertex
+    // buffer and, when the body has an EditableMeshShape, the collision BVH
+    void setSupport(size_t index, const TrackSupport& support, btCollisionWorld* world = nullptr);
+    // setSupport in two halves for a world stepped on another thread. moveSupport updates the
+    // supports, and the support buffer of a procedural track, and returns the rest for the
+    // physics side: rewriting the shared mesh and refitting the BVH between steps. Once that
+    // ran, uploadSupport copies the new vertices of a non-procedural track to its buffer.
+    // The command writes the mesh without a lock. Until the snapshot's commandsApplied shows it
+    // ran, nothing on the render side may read the mesh, and that includes uploadSupport.
+    std::function<void(btCollisionWorld*)> moveSupport(size_t index, const TrackSupport& support);
+    void uploadSupport(size_t index);
+    bool isProcedural() const { return mProcedural; }
 };
\ No newline at end of file
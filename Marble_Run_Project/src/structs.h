@@ -7,6 +7,7 @@
 
 #include <BulletDynamics/Dynamics/btDynamicsWorld.h>
 #include <btBulletDynamicsCommon.h>
+#include "mesh_builder.h"
 #include "settings.h"
 
 
@@ -16,13 +17,6 @@ struct Time {
     double dt;
 };
 
-struct TrackSupport {
-    float x, y, z;
-    float angle;        // Degrees of rotation clockwise around y-axis. 0.0 along z-axis
-    float innerRadius;
-    float outerRadius;
-};
-
 struct AmbientLight {
     glm::vec4 color;
 };
@@ -53,14 +47,6 @@ struct Light {
     std::vector<PointLight> point;
 };
 
-struct Bullet {
-    btCollisionConfiguration* pCollisionConfiguration;
-    btCollisionDispatcher* pDispatcher;
-    btBroadphaseInterface* pBroadphase;
-    btConstraintSolver* pSolver;
-    btDynamicsWorld* pWorld;
-};
-
 struct MaterialType {
     glm::vec4 ambient = glm::vec4(1.0f);
     glm::vec4 diffuse = glm::vec4(1.0f);
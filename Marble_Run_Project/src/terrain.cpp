@@ -0,0 +1,120 @@
+#include "terrain.h"
+
+#include <algorithm>
+
+Terrain::Terrain(std::shared_ptr<Heightfield> heightfield, glm::vec3 size, GLuint texture, int chunkSize) :
+    mHeightfield(heightfield), mSize(size)
+{
+    mTexture = texture;
+    if (!mHeightfield || mHeightfield->width() < 2 || mHeightfield->depth() < 2) {
+        std::cout << "Heightmap is empty or not assigned.\n";
+        VAO = 0;
+        EBO = 0;
+        return;
+    }
+    mGrid = makeTerrainGrid(mHeightfield->width(), mHeightfield->depth(), chunkSize);
+    initBuffers();
+    fillBuffers();
+}
+
+void Terrain::fillBuffers()
+{
+    const Heightfield& field = *mHeightfield;
+    const int chunks = mGrid.chunkCount();
+    const size_t chunkVertices = mGrid.chunkVertices();
+    const VertexLayout layout;
+    const GLsizei stride = layout.stride();
+
+    std::vector<uint32_t> normals(size_t(field.width()) * field.depth());
+    computeTerrainNormals(field, terrainSampleSpacing(field, mSize), normals.data());
+
+    // Chunks are independent, each writes its own block of the buffer
+    std::vector<unsigned char> vertices(chunks * chunkVertices * stride);
+    mChunkMin.resize(chunks);
+    mChunkMax.resize(chunks);
+    threadPool().parallelFor(chunks, 4, [&](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; c++) {
+            fillTerrainChunk(field, normals.data(), mGrid, mSize, static_cast<int>(c % mGrid.chunksX),
+                static_cast<int>(c / mGrid.chunksX), &vertices[c * chunkVertices * stride], mChunkMin[c], mChunkMax[c]);
+        }
+    });
+
+    std::vector<uint16_t> indices;
+    mIndexRanges.clear();
+    for (int level = 0; level < mGrid.levels; level++) {
+        for (int mask = 0; mask < TERRAIN_EDGE_MASKS; mask++) {
+            std::vector<uint16_t> lod = buildTerrainIndices(mGrid.chunkSize, level, mask);
+            mIndexRanges.push_back({ indices.size() * sizeof(uint16_t), static_cast<GLsizei>(lod.size()) });
+            indices.insert(indices.end(), lod.begin(), lod.end());
+        }
+    }
+
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO[0]);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size(), vertices.data(), GL_STATIC_DRAW);
+
+    // position attribute
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+    glEnableVertexAttribArray(0);
+    // normal attribute, normalized back to [-1, 1] on fetch
+    glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)(size_t)layout.normalOffset());
+    glEnableVertexAttribArray(3);
+    // texture UV attribute
+    glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)(size_t)layout.uvOffset());
+    glEnableVertexAttribArray(2);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint16_t), indices.data(), GL_STATIC_DRAW);
+    glBindVertexArray(0);
+
+    mIndexType = GL_UNSIGNED_SHORT;
+    mVertexLayout = layout;
+    mVertexBytes = vertices.size() + indices.size() * sizeof(uint16_t);
+    // Against one CompositePlane mesh in the same format with 32-bit indices
+    size_t samples = size_t(field.width()) * field.depth();
+    size_t planeBytes = samples * stride + size_t(field.width() - 1) * (field.depth() - 1) * 6 * sizeof(GLuint);
+    mVertexBytesSaved = planeBytes > mVertexBytes ? planeBytes - mVertexBytes : 0;
+
+    mDistances.resize(chunks);
+    mLevels.assign(chunks, 0);
+    mVisible.reserve(chunks);
+}
+
+void Terrain::update(glm::vec3 cameraPos, const glm::vec4* frustumPlanes)
+{
+    mVisible.clear();
+    for (int c = 0; c < mGrid.chunkCount(); c++) {
+        // Distance to the closest point of the chunk, zero inside it
+        glm::vec3 closest = glm::clamp(cameraPos, mChunkMin[c], mChunkMax[c]);
+        mDistances[c] = glm::distance(cameraPos, closest);
+
+        // Outside when the corner furthest along a plane's normal is behind it
+        bool inView = true;
+        for (int p = 0; p < 6 && inView; p++) {
+            glm::vec3 n = glm::vec3(frustumPlanes[p]);
+            glm::vec3 corner(n.x >= 0 ? mChunkMax[c].x : mChunkMin[c].x,
+                n.y >= 0 ? mChunkMax[c].y : mChunkMin[c].y,
+                n.z >= 0 ? mChunkMax[c].z : mChunkMin[c].z);
+            inView = glm::dot(n, corner) + frustumPlanes[p].w >= 0.0f;
+        }
+        if (inView) {
+            mVisible.push_back(c);
+        }
+    }
+    // Levels of hidden chunks count too, visible neighbours stitch to them
+    selectTerrainLevels(mGrid, mDistances, mLodDistance, mLevels);
+}
+
+void Terrain::drawGeometry(GLuint shaderProgram)
+{
+    // The shadow pass draws the chunks visible to the camera, the ground doesn't cast shadows
+    mDrawnChunks = static_cast<int>(mVisible.size());
+    mDrawnTriangles = 0;
+    for (int c : mVisible) {
+        int mask = terrainStitchMask(mGrid, mLevels, c % mGrid.chunksX, c / mGrid.chunksX);
+        const IndexRange& range = mIndexRanges[mLevels[c] * TERRAIN_EDGE_MASKS + mask];
+        glDrawElementsBaseVertex(GL_TRIANGLES, range.count, GL_UNSIGNED_SHORT, (void*)range.offset,
+            static_cast<GLint>(c * mGrid.chunkVertices()));
+        mDrawnTriangles += range.count / 3;
+    }
+}
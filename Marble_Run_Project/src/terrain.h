@@ -0,0 +1,47 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <memory>
+#include <vector>
+
+#include "settings.h"
+#include "shape.h"
+#include "terrain_builder.h"
+
+// Heightfield drawn in chunks with geomipmapped LOD, in the place a CompositePlane
+// with mesh scale size would be. All chunk vertices live in one buffer, and every chunk
+// draws with one of the shared index buffers for its level and coarser neighbours.
+// Only chunks in the view frustum are drawn.
+class Terrain : public Shape {
+public:
+	Terrain(std::shared_ptr<Heightfield> heightfield, glm::vec3 size, GLuint texture,
+		int chunkSize = TERRAIN_CHUNK_SIZE);
+	void fillBuffers() override;
+	// Chooses the level of every chunk and the chunks to draw. Once per frame, before drawing.
+	void update(glm::vec3 cameraPos, const glm::vec4* frustumPlanes);
+	void drawGeometry(GLuint shaderProgram) override;
+
+	int chunkCount() const { return mGrid.chunkCount(); }
+	int mDrawnChunks = 0;
+	size_t mDrawnTriangles = 0;
+	float mLodDistance = TERRAIN_LOD_DISTANCE;
+
+private:
+	struct IndexRange {
+		size_t offset;		// bytes into the index buffer
+		GLsizei count;
+	};
+
+	std::shared_ptr<Heightfield> mHeightfield;
+	glm::vec3 mSize;
+	TerrainGrid mGrid;
+	std::vector<glm::vec3> mChunkMin;
+	std::vector<glm::vec3> mChunkMax;
+	// Level * TERRAIN_EDGE_MASKS + stitch mask
+	std::vector<IndexRange> mIndexRanges;
+
+	std::vector<float> mDistances;
+	std::vector<int> mLevels;
+	std::vector<int> mVisible;
+};
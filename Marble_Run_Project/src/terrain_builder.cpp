@@ -0,0 +1,259 @@
+#include "terrain_builder.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <glm/gtc/packing.hpp>
+
+#include "mesh_builder.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TERRAIN_SSE2
+#include <emmintrin.h>
+#endif
+
+TerrainGrid makeTerrainGrid(int width, int depth, int chunkSize)
+{
+    TerrainGrid grid;
+    if (width < 2 || depth < 2 || chunkSize < 2) {
+        return grid;
+    }
+    grid.chunkSize = chunkSize;
+    grid.chunksX = (width - 2) / chunkSize + 1;
+    grid.chunksZ = (depth - 2) / chunkSize + 1;
+    // The coarsest level still has two quads a side, so its edges can be stitched
+    for (int step = 1; step <= chunkSize / 2; step *= 2) {
+        grid.levels++;
+    }
+    return grid;
+}
+
+glm::vec3 terrainSampleSpacing(const Heightfield& field, glm::vec3 size)
+{
+    float width = static_cast<float>(field.width());
+    float depth = static_cast<float>(field.depth());
+    return glm::vec3(size.x / (width - 1),
+        field.heightScale() * COMPOSITE_PLANE_HEIGHT * size.y,
+        size.z * (depth / width) / (depth - 1));
+}
+
+static uint32_t packTerrainNormal(int x, int y, int z)
+{
+    return (uint32_t(x) & 0x3FF) | ((uint32_t(y) & 0x3FF) << 10) | ((uint32_t(z) & 0x3FF) << 20);
+}
+
+// Sobel gradients in sample units, before scaling. Same arithmetic as the SSE2 path.
+static uint32_t sobelNormal(const short* above, const short* row, const short* below,
+    int left, int x, int right, float kx, float kz)
+{
+    int gx = (above[right] + 2 * row[right] + below[right]) - (above[left] + 2 * row[left] + below[left]);
+    int gz = (below[left] + 2 * below[x] + below[right]) - (above[left] + 2 * above[x] + above[right]);
+    float sx = static_cast<float>(gx) * kx;
+    float sz = static_cast<float>(gz) * kz;
+    float inv = 1.0f / std::sqrt(sx * sx + 1.0f + sz * sz);
+    return packTerrainNormal(
+        static_cast<int>(std::nearbyint(-sx * inv * 511.0f)),
+        static_cast<int>(std::nearbyint(inv * 511.0f)),
+        static_cast<int>(std::nearbyint(-sz * inv * 511.0f)));
+}
+
+#ifdef TERRAIN_SSE2
+// Four shorts widened to int32
+static __m128i loadSamples(const short* p)
+{
+    __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+    return _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+}
+
+// Samples [x, x + 4) of a row with both neighbours inside the row
+static void sobelNormals4(const short* above, const short* row, const short* below,
+    int x, __m128 kx, __m128 kz, uint32_t* out)
+{
+    __m128i aL = loadSamples(above + x - 1), aC = loadSamples(above + x), aR = loadSamples(above + x + 1);
+    __m128i rL = loadSamples(row + x - 1), rR = loadSamples(row + x + 1);
+    __m128i bL = loadSamples(below + x - 1), bC = loadSamples(below + x), bR = loadSamples(below + x + 1);
+
+    __m128i right = _mm_add_epi32(_mm_add_epi32(aR, _mm_slli_epi32(rR, 1)), bR);
+    __m128i left = _mm_add_epi32(_mm_add_epi32(aL, _mm_slli_epi32(rL, 1)), bL);
+    __m128i down = _mm_add_epi32(_mm_add_epi32(bL, _mm_slli_epi32(bC, 1)), bR);
+    __m128i up = _mm_add_epi32(_mm_add_epi32(aL, _mm_slli_epi32(aC, 1)), aR);
+
+    __m128 sx = _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(right, left)), kx);
+    __m128 sz = _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(down, up)), kz);
+    __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, sx), _mm_set1_ps(1.0f)), _mm_mul_ps(sz, sz)));
+    __m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), length);
+    __m128 scale = _mm_set1_ps(511.0f);
+    __m128 negative = _mm_set1_ps(-0.0f);
+
+    // Round to nearest even like nearbyint, then pack three 10-bit fields
+    __m128i mask = _mm_set1_epi32(0x3FF);
+    __m128i nx = _mm_and_si128(_mm_cvtps_epi32(_mm_mul_ps(_mm_mul_ps(_mm_xor_ps(sx, negative), inv), scale)), mask);
+    __m128i ny = _mm_and_si128(_mm_cvtps_epi32(_mm_mul_ps(inv, scale)), mask);
+    __m128i nz = _mm_and_si128(_mm_cvtps_epi32(_mm_mul_ps(_mm_mul_ps(_mm_xor_ps(sz, negative), inv), scale)), mask);
+    __m128i packed = _mm_or_si128(nx, _mm_or_si128(_mm_slli_epi32(ny, 10), _mm_slli_epi32(nz, 20)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), packed);
+}
+#endif
+
+void computeTerrainNormals(const Heightfield& field, glm::vec3 spacing, uint32_t* normals, ThreadPool& pool, bool simd)
+{
+    const int width = field.width();
+    const int depth = field.depth();
+    if (width < 2 || depth < 2) {
+        return;
+    }
+
+    // Slope per Sobel unit. The kernel weights add up to 4 on a side two samples apart.
+    const float kx = spacing.y / (8.0f * spacing.x);
+    const float kz = spacing.y / (8.0f * spacing.z);
+    const short* samples = field.samples();
+
+    pool.parallelFor(depth, 16, [&](size_t begin, size_t end) {
+        for (int z = static_cast<int>(begin); z < static_cast<int>(end); z++) {
+            // Edges repeat the outermost samples
+            const short* above = samples + size_t(std::max(z - 1, 0)) * width;
+            const short* row = samples + size_t(z) * width;
+            const short* below = samples + size_t(std::min(z + 1, depth - 1)) * width;
+            uint32_t* out = normals + size_t(z) * width;
+
+            out[0] = sobelNormal(above, row, below, 0, 0, 1, kx, kz);
+            int x = 1;
+#ifdef TERRAIN_SSE2
+            if (simd) {
+                __m128 vkx = _mm_set1_ps(kx);
+                __m128 vkz = _mm_set1_ps(kz);
+                // x + 4 must stay inside the row for the right neighbours
+                for (; x + 4 < width; x += 4) {
+                    sobelNormals4(above, row, below, x, vkx, vkz, out + x);
+                }
+            }
+#endif
+            for (; x < width; x++) {
+                out[x] = sobelNormal(above, row, below, x - 1, x, std::min(x + 1, width - 1), kx, kz);
+            }
+        }
+    });
+}
+
+void fillTerrainChunk(const Heightfield& field, const uint32_t* normals, const TerrainGrid& grid,
+    glm::vec3 size, int chunkX, int chunkZ, unsigned char* out, glm::vec3& boundsMin, glm::vec3& boundsMax)
+{
+    const int width = field.width();
+    const int depth = field.depth();
+    const glm::vec3 spacing = terrainSampleSpacing(field, size);
+    const float halfX = 0.5f * size.x;
+    const float halfZ = 0.5f * size.z * depth / width;
+    const int stride = VertexLayout().stride();
+
+    boundsMin = glm::vec3(FLT_MAX);
+    boundsMax = glm::vec3(-FLT_MAX);
+    for (int j = 0; j <= grid.chunkSize; j++) {
+        // Past the edge of the heightfield the last sample repeats, leaving empty triangles
+        int z = std::min(chunkZ * grid.chunkSize + j, depth - 1);
+        for (int i = 0; i <= grid.chunkSize; i++) {
+            int x = std::min(chunkX * grid.chunkSize + i, width - 1);
+            glm::vec3 p(x * spacing.x - halfX, field.sample(x, z) * spacing.y, z * spacing.z - halfZ);
+            // Mirrored along x like CompositePlane
+            glm::vec2 uv(1.0f - x / float(width - 1), z / float(depth - 1));
+            uint32_t normal = normals[size_t(z) * width + x];
+            uint32_t texCoord = glm::packHalf2x16(uv);
+
+            std::memcpy(out, &p[0], 12);
+            std::memcpy(out + 12, &normal, 4);
+            std::memcpy(out + 16, &texCoord, 4);
+            out += stride;
+
+            boundsMin = glm::min(boundsMin, p);
+            boundsMax = glm::max(boundsMax, p);
+        }
+    }
+}
+
+std::vector<uint16_t> buildTerrainIndices(int chunkSize, int level, int stitchMask)
+{
+    const int n = chunkSize;
+    const int step = 1 << level;
+
+    // Odd vertices on a stitched edge move onto the even vertex before them, so the edge
+    // runs straight between the vertices the coarser neighbour has
+    auto vertex = [&](int i, int j) {
+        if ((i == 0 && (stitchMask & TERRAIN_EDGE_WEST)) || (i == n && (stitchMask & TERRAIN_EDGE_EAST))) {
+            j -= j % (2 * step);
+        }
+        if ((j == 0 && (stitchMask & TERRAIN_EDGE_NORTH)) || (j == n && (stitchMask & TERRAIN_EDGE_SOUTH))) {
+            i -= i % (2 * step);
+        }
+        return glm::ivec2(i, j);
+    };
+
+    std::vector<uint16_t> indices;
+    indices.reserve(size_t(n / step) * (n / step) * 6);
+    auto triangle = [&](glm::ivec2 a, glm::ivec2 b, glm::ivec2 c) {
+        // Collapsed triangles have no area, corners where two stitched edges meet included
+        int area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+        if (area == 0) {
+            return;
+        }
+        for (glm::ivec2 v : { a, b, c }) {
+            indices.push_back(static_cast<uint16_t>(v.y * (n + 1) + v.x));
+        }
+    };
+
+    // Same winding and diagonal as CompositePlane
+    for (int j = 0; j < n; j += step) {
+        for (int i = 0; i < n; i += step) {
+            glm::ivec2 v00 = vertex(i, j);
+            glm::ivec2 v01 = vertex(i, j + step);
+            glm::ivec2 v10 = vertex(i + step, j);
+            glm::ivec2 v11 = vertex(i + step, j + step);
+            triangle(v00, v01, v10);
+            triangle(v01, v11, v10);
+        }
+    }
+    return indices;
+}
+
+void selectTerrainLevels(const TerrainGrid& grid, const std::vector<float>& distances, float lodDistance,
+    std::vector<int>& levels)
+{
+    levels.resize(grid.chunkCount());
+    for (int i = 0; i < grid.chunkCount(); i++) {
+        int level = 0;
+        for (float d = lodDistance; distances[i] >= d && level < grid.levels - 1; d *= 2.0f) {
+            level++;
+        }
+        levels[i] = level;
+    }
+
+    // Only lowering levels, so this settles. Usually one pass changes nothing.
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int z = 0; z < grid.chunksZ; z++) {
+            for (int x = 0; x < grid.chunksX; x++) {
+                int& level = levels[z * grid.chunksX + x];
+                int limit = level;
+                if (x > 0) limit = std::min(limit, levels[z * grid.chunksX + x - 1] + 1);
+                if (x + 1 < grid.chunksX) limit = std::min(limit, levels[z * grid.chunksX + x + 1] + 1);
+                if (z > 0) limit = std::min(limit, levels[(z - 1) * grid.chunksX + x] + 1);
+                if (z + 1 < grid.chunksZ) limit = std::min(limit, levels[(z + 1) * grid.chunksX + x] + 1);
+                if (limit < level) {
+                    level = limit;
+                    changed = true;
+                }
+            }
+        }
+    }
+}
+
+int terrainStitchMask(const TerrainGrid& grid, const std::vector<int>& levels, int chunkX, int chunkZ)
+{
+    int level = levels[chunkZ * grid.chunksX + chunkX];
+    int mask = 0;
+    if (chunkX > 0 && levels[chunkZ * grid.chunksX + chunkX - 1] > level) mask |= TERRAIN_EDGE_WEST;
+    if (chunkX + 1 < grid.chunksX && levels[chunkZ * grid.chunksX + chunkX + 1] > level) mask |= TERRAIN_EDGE_EAST;
+    if (chunkZ > 0 && levels[(chunkZ - 1) * grid.chunksX + chunkX] > level) mask |= TERRAIN_EDGE_NORTH;
+    if (chunkZ + 1 < grid.chunksZ && levels[(chunkZ + 1) * grid.chunksX + chunkX] > level) mask |= TERRAIN_EDGE_SOUTH;
+    return mask;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "heightfield.h"
+#include "thread_pool.h"
+
+// CPU side of the chunked terrain. The heightfield is cut into square chunks of
+// chunkSize quads that share their edge samples. All chunks draw with the same few
+// index buffers, one per LOD level and set of coarser neighbours, and Terrain picks
+// one for each chunk every frame. Building makes no GL calls.
+
+// Sides of a chunk whose neighbour is one level coarser
+enum TerrainEdge {
+	TERRAIN_EDGE_WEST = 1,		// -x
+	TERRAIN_EDGE_EAST = 2,		// +x
+	TERRAIN_EDGE_NORTH = 4,		// -z
+	TERRAIN_EDGE_SOUTH = 8,		// +z
+	TERRAIN_EDGE_MASKS = 16
+};
+
+struct TerrainGrid {
+	int chunkSize = 0;		// quads along a chunk side, a power of two
+	int chunksX = 0;
+	int chunksZ = 0;
+	int levels = 0;			// level 0 is every sample, each level doubles the step
+
+	int chunkCount() const { return chunksX * chunksZ; }
+	int chunkVertices() const { return (chunkSize + 1) * (chunkSize + 1); }
+};
+
+// Chunks covering a width x depth heightfield. The last row and column of chunks
+// repeat the edge samples where the size isn't a multiple of chunkSize.
+TerrainGrid makeTerrainGrid(int width, int depth, int chunkSize);
+
+// Sample positions of a terrain drawn like a CompositePlane with mesh scale size:
+// x from -size.x / 2 to size.x / 2, z in proportion, heights times COMPOSITE_PLANE_HEIGHT * size.y
+glm::vec3 terrainSampleSpacing(const Heightfield& field, glm::vec3 size);
+
+// Sobel normal of every sample, packed like GL_INT_2_10_10_10_REV. Rows run in parallel,
+// four samples at a time with SSE2 where available. simd false gives the scalar path,
+// which produces the same bits.
+void computeTerrainNormals(const Heightfield& field, glm::vec3 spacing, uint32_t* normals,
+	ThreadPool& pool = threadPool(), bool simd = true);
+
+// Interleaved vertices of one chunk in the float position VertexLayout, and the chunk's bounds
+void fillTerrainChunk(const Heightfield& field, const uint32_t* normals, const TerrainGrid& grid,
+	glm::vec3 size, int chunkX, int chunkZ, unsigned char* out, glm::vec3& boundsMin, glm::vec3& boundsMax);
+
+// Triangles of a chunk at level, indexing the chunk's own vertices. Edges in stitchMask
+// skip every other vertex, so they match a neighbour one level coarser without cracks.
+std::vector<uint16_t> buildTerrainIndices(int chunkSize, int level, int stitchMask);
+
+// Level of every chunk from its distance to the camera, doubling the step every time the
+// distance doubles past lodDistance. Neighbours end up at most one level apart.
+void selectTerrainLevels(const TerrainGrid& grid, const std::vector<float>& distances, float lodDistance,
+	std::vector<int>& levels);
+int terrainStitchMask(const TerrainGrid& grid, const std::vector<int>& levels, int chunkX, int chunkZ);
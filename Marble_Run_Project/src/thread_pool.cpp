@@ -0,0 +1,199 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+ThreadPool::ThreadPool(int workerCount)
+{
+    for (int i = 0; i < workerCount; i++) {
+        mWorkers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStop = true;
+    }
+    mWake.notify_all();
+    for (std::thread& worker : mWorkers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, size_t minChunk, const std::function<void(size_t, size_t)>& body)
+{
+    if (count == 0) {
+        return;
+    }
+
+    // About four chunks per thread evens out chunks that take longer than others
+    size_t threads = mWorkers.size() + 1;
+    size_t chunk = std::max(minChunk, (count + threads * 4 - 1) / (threads * 4));
+    if (mWorkers.empty() || chunk >= count) {
+        body(0, count);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mBody = &body;
+        mCount = count;
+        mChunk = chunk;
+        mNext = 0;
+        mPending = (count + chunk - 1) / chunk;
+        mGeneration++;
+    }
+    mWake.notify_all();
+
+    while (runChunk()) {}
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    mDone.wait(lock, [this] { return mPending == 0; });
+    mBody = nullptr;
+}
+
+bool ThreadPool::runChunk()
+{
+    size_t begin;
+    size_t end;
+    const std::function<void(size_t, size_t)>* body;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (!mBody || mNext >= mCount) {
+            return false;
+        }
+        begin = mNext;
+        end = std::min(mCount, begin + mChunk);
+        mNext = end;
+        body = mBody;
+    }
+
+    (*body)(begin, end);
+
+    bool last;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        last = --mPending == 0;
+    }
+    if (last) {
+        mDone.notify_all();
+    }
+    return true;
+}
+
+void ThreadPool::workerLoop()
+{
+    unsigned int seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mWake.wait(lock, [&] { return mStop || (mGeneration != seen && mBody); });
+            if (mStop) {
+                return;
+            }
+            seen = mGeneration;
+        }
+        while (runChunk()) {}
+    }
+}
+
+ThreadPool& threadPool()
+{
+    static ThreadPool pool(std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1));
+    return pool;
+}
+
+namespace {
+
+// Indices [begin, end) a thread has left. The owner takes from the front, thieves from the back.
+struct StealShare {
+    std::mutex mutex;
+    size_t begin = 0;
+    size_t end = 0;
+};
+
+}
+
+size_t workStealingFor(int threadCount, size_t count, const std::function<void(int, size_t)>& task)
+{
+    threadCount = std::max(1, std::min(threadCount, static_cast<int>(std::max<size_t>(count, 1))));
+    std::unique_ptr<StealShare[]> shares(new StealShare[threadCount]);
+    for (int i = 0; i < threadCount; i++) {
+        shares[i].begin = count * i / threadCount;
+        shares[i].end = count * (i + 1) / threadCount;
+    }
+    std::atomic<size_t> steals{ 0 };
+    // Indices no thread has taken yet, counting those a thief is moving into its own share
+    std::atomic<size_t> unclaimed{ count };
+
+    auto run = [&](int self) {
+        StealShare& own = shares[self];
+        while (true) {
+            size_t index = 0;
+            bool found = false;
+            {
+                std::lock_guard<std::mutex> lock(own.mutex);
+                if (own.begin < own.end) {
+                    index = own.begin++;
+                    found = true;
+                    unclaimed--;
+                }
+            }
+
+            // Every share can look empty while a thief is between taking a range and adding it
+            // to its own, so only the unclaimed count says when the work is done
+            while (!found) {
+                int victim = -1;
+                size_t most = 0;
+                for (int i = 0; i < threadCount; i++) {
+                    if (i == self) continue;
+                    std::lock_guard<std::mutex> lock(shares[i].mutex);
+                    if (shares[i].end - shares[i].begin > most) {
+                        most = shares[i].end - shares[i].begin;
+                        victim = i;
+                    }
+                }
+                if (victim < 0) {
+                    if (unclaimed == 0) return;
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                size_t begin;
+                size_t end;
+                {
+                    std::lock_guard<std::mutex> lock(shares[victim].mutex);
+                    size_t left = shares[victim].end - shares[victim].begin;
+                    if (left == 0) continue;
+                    end = shares[victim].end;
+                    begin = end - (left + 1) / 2;
+                    shares[victim].end = begin;
+                }
+                steals++;
+
+                // The first stolen index runs now, the rest become this thread's share
+                std::lock_guard<std::mutex> lock(own.mutex);
+                index = begin;
+                own.begin = begin + 1;
+                own.end = end;
+                found = true;
+                unclaimed--;
+            }
+
+            task(self, index);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < threadCount; i++) {
+        threads.emplace_back(run, i);
+    }
+    run(0);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    return steals;
+}
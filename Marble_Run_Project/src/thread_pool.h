@@ -0,0 +1,49 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for data parallel loops. The calling thread
+// takes part in the work, so a pool of zero workers runs everything inline.
+class ThreadPool {
+public:
+	explicit ThreadPool(int workerCount);
+	~ThreadPool();
+
+	// Calls body(begin, end) over [0, count) in chunks of at least minChunk, and
+	// returns when every chunk is done. Not reentrant from inside a body.
+	void parallelFor(size_t count, size_t minChunk, const std::function<void(size_t, size_t)>& body);
+
+	int workerCount() const { return static_cast<int>(mWorkers.size()); }
+
+private:
+	void workerLoop();
+	bool runChunk();
+
+	std::vector<std::thread> mWorkers;
+	std::mutex mMutex;
+	std::condition_variable mWake;
+	std::condition_variable mDone;
+	bool mStop = false;
+
+	// Current loop
+	const std::function<void(size_t, size_t)>* mBody = nullptr;
+	size_t mCount = 0;
+	size_t mChunk = 0;
+	size_t mNext = 0;
+	size_t mPending = 0;
+	unsigned int mGeneration = 0;
+};
+
+// Shared pool with one worker less than the hardware threads
+ThreadPool& threadPool();
+
+// Calls task(thread, index) for every index in [0, count) on threadCount threads, the caller
+// being thread 0 and the rest started for the call. Each thread works through a share of its
+// own and, when that runs out, steals the back half of the largest share left, so tasks that
+// take very different times still finish together. For long tasks that keep per thread state,
+// like a physics world each. Returns the number of steals.
+size_t workStealingFor(int threadCount, size_t count, const std::function<void(int, size_t)>& task);
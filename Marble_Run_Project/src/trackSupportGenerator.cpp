@@ -1,4 +1,5 @@
 #include "trackSupportGenerator.h"
+#include "track_path.h"
 
 TrackSupportGenerator::TrackSupportGenerator()
 { }
@@ -79,6 +80,12 @@ std::vector<TrackSupport> TrackSupportGenerator::getSupports()
 	return mSupports;
 }
 
+std::vector<TrackSupport> TrackSupportGenerator::getAdaptiveSupports(float tolerance)
+{
+	// End supports are unchanged, so modules placed from the last support still line up
+	return resampleTrack(mSupports, tolerance);
+}
+
 glm::vec3 TrackSupportGenerator::nextModuleCenter(float moduleLength, float moduleTilt)
 {
 	TrackSupport& last = mSupports.back();
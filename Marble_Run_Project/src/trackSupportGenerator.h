@@ -3,7 +3,8 @@
 #include <glm/glm.hpp>
 #include <vector>
 
-#include "structs.h"
+#include "mesh_builder.h"
+#include "settings.h"
 
 class TrackSupportGenerator {
 public:
@@ -12,6 +13,7 @@ public:
 	void forward(float distance, float dHeight = 0.0f, float innerR = 0.9f, float outerR = 1.0f);
 	void turn(float angle, float radius, float dHeight = 0.0f, int sections = 4, float innerR = 0.9f, float outerR = 1.0f);
 	std::vector<TrackSupport> getSupports();
+	std::vector<TrackSupport> getAdaptiveSupports(float tolerance = TRACK_TOLERANCE);
 	glm::vec3 nextModuleCenter(float moduleLength = 8.0f, float moduleTilt = 10.0f); // default plinko
 	glm::vec3 getLastPos();
 
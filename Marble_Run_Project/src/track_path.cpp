@@ -0,0 +1,168 @@
+#include "track_path.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Horizontal direction of travel. 0 degrees runs along the z-axis
+static glm::vec3 heading(float angle)
+{
+    float a = glm::radians(angle);
+    return glm::vec3(-sinf(a), 0.0f, cosf(a));
+}
+
+static glm::vec3 supportPos(const TrackSupport& s)
+{
+    return glm::vec3(s.x, s.y, s.z);
+}
+
+static float horizontalLength(const TrackSupport& a, const TrackSupport& b)
+{
+    return glm::length(glm::vec2(b.x - a.x, b.z - a.z));
+}
+
+TrackSupport evaluateTrackPath(const std::vector<TrackSupport>& supports, size_t segment, float t)
+{
+    const TrackSupport& s1 = supports[segment];
+    const TrackSupport& s2 = supports[segment + 1];
+    TrackSupport result;
+    // Shortest way round, so 350 to 10 degrees turns through 0
+    float turn = std::remainder(s2.angle - s1.angle, 360.0f);
+    result.angle = s1.angle + turn * t;
+    result.innerRadius = s1.innerRadius + (s2.innerRadius - s1.innerRadius) * t;
+    result.outerRadius = s1.outerRadius + (s2.outerRadius - s1.outerRadius) * t;
+
+    glm::vec3 p1 = supportPos(s1);
+    glm::vec3 p2 = supportPos(s2);
+    float h = horizontalLength(s1, s2);
+    if (h < 1e-4f) {
+        // Vertical drop, no direction to follow
+        glm::vec3 p = p1 + (p2 - p1) * t;
+        result.x = p.x;
+        result.y = p.y;
+        result.z = p.z;
+        return result;
+    }
+
+    // Height changes at the segment's own rate, so y stays linear like the original track
+    // and ramps keep their kink
+    glm::vec3 rise = glm::vec3(0.0f, s2.y - s1.y, 0.0f);
+    glm::vec3 m1 = h * heading(s1.angle) + rise;
+    glm::vec3 m2 = h * heading(s2.angle) + rise;
+
+    // Hermite basis
+    float t2 = t * t;
+    float t3 = t2 * t;
+    glm::vec3 p = (2 * t3 - 3 * t2 + 1) * p1 + (t3 - 2 * t2 + t) * m1
+        + (-2 * t3 + 3 * t2) * p2 + (t3 - t2) * m2;
+
+    result.x = p.x;
+    result.y = p.y;
+    result.z = p.z;
+    return result;
+}
+
+float trackDeviation(const TrackSupport& s, const TrackSupport& a, const TrackSupport& b, float u)
+{
+    // Rim edges as HalfPipeTrack places them, at outerRadius to each side
+    auto rims = [](const TrackSupport& t, glm::vec3& left, glm::vec3& right) {
+        float r = glm::radians(t.angle);
+        glm::vec3 side = glm::vec3(cosf(r), 0.0f, sinf(r)) * t.outerRadius;
+        left = supportPos(t) - side;
+        right = supportPos(t) + side;
+    };
+
+    glm::vec3 sLeft, sRight, aLeft, aRight, bLeft, bRight;
+    rims(s, sLeft, sRight);
+    rims(a, aLeft, aRight);
+    rims(b, bLeft, bRight);
+
+    float center = glm::length(supportPos(s) - (supportPos(a) + (supportPos(b) - supportPos(a)) * u));
+    float left = glm::length(sLeft - (aLeft + (bLeft - aLeft) * u));
+    float right = glm::length(sRight - (aRight + (bRight - aRight) * u));
+    float radius = std::abs(s.outerRadius - (a.outerRadius + (b.outerRadius - a.outerRadius) * u));
+    return std::max(std::max(center, radius), std::max(left, right));
+}
+
+// Dense sample with its distance along the path, used as the interpolation fraction
+struct PathSample {
+    TrackSupport support;
+    float distance;
+};
+
+static void subdivideSegment(const std::vector<TrackSupport>& supports, size_t segment,
+    float t0, const TrackSupport& a, float t1, const TrackSupport& b, float tolerance, int depth,
+    std::vector<TrackSupport>& out)
+{
+    float tm = 0.5f * (t0 + t1);
+    TrackSupport mid = evaluateTrackPath(supports, segment, tm);
+    if (depth < 12 && trackDeviation(mid, a, b, 0.5f) > tolerance) {
+        subdivideSegment(supports, segment, t0, a, tm, mid, tolerance, depth + 1, out);
+        subdivideSegment(supports, segment, tm, mid, t1, b, tolerance, depth + 1, out);
+    }
+    else {
+        out.push_back(b);
+    }
+}
+
+std::vector<TrackSupport> resampleTrack(const std::vector<TrackSupport>& supports, float tolerance)
+{
+    if (supports.size() < 3 || tolerance <= 0.0f) {
+        return supports;
+    }
+
+    // Dense adaptive samples of the path. Original supports lie on the path and are kept as is.
+    std::vector<TrackSupport> dense;
+    dense.push_back(supports.front());
+    for (size_t i = 0; i + 1 < supports.size(); i++) {
+        subdivideSegment(supports, i, 0.0f, supports[i], 1.0f, supports[i + 1], tolerance * 0.25f, 0, dense);
+    }
+
+    std::vector<PathSample> samples;
+    samples.reserve(dense.size());
+    float distance = 0.0f;
+    for (size_t i = 0; i < dense.size(); i++) {
+        if (i > 0) distance += glm::length(supportPos(dense[i]) - supportPos(dense[i - 1]));
+        samples.push_back({ dense[i], distance });
+    }
+
+    // Douglas-Peucker: keep the sample furthest from the straight track between kept samples
+    std::vector<bool> keep(samples.size(), false);
+    keep.front() = true;
+    keep.back() = true;
+    std::vector<std::pair<size_t, size_t>> ranges = { { 0, samples.size() - 1 } };
+    while (!ranges.empty()) {
+        size_t first = ranges.back().first;
+        size_t last = ranges.back().second;
+        ranges.pop_back();
+
+        float span = samples[last].distance - samples[first].distance;
+        float worst = tolerance;
+        size_t worstIndex = 0;
+        for (size_t i = first + 1; i < last; i++) {
+            float u = span > 0.0f ? (samples[i].distance - samples[first].distance) / span : 0.5f;
+            float deviation = trackDeviation(samples[i].support, samples[first].support, samples[last].support, u);
+            if (deviation > worst) {
+                worst = deviation;
+                worstIndex = i;
+            }
+        }
+
+        if (worstIndex) {
+            keep[worstIndex] = true;
+            ranges.push_back({ first, worstIndex });
+            ranges.push_back({ worstIndex, last });
+        }
+    }
+
+    std::vector<TrackSupport> result;
+    for (size_t i = 0; i < samples.size(); i++) {
+        if (keep[i]) result.push_back(samples[i].support);
+    }
+
+    // Following the curve closely can take more supports than were placed. The placed ones
+    // are then the cheaper track.
+    if (result.size() >= supports.size()) {
+        return supports;
+    }
+    return result;
+}
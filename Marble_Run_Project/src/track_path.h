@@ -0,0 +1,22 @@
+#pragma once
+
+#include <vector>
+
+#include "mesh_builder.h"
+
+// Smooth path through a list of supports. Each pair of supports is joined by a
+// cubic Hermite curve whose horizontal tangents follow the support angles. Height,
+// angle and radii change linearly along the segment.
+TrackSupport evaluateTrackPath(const std::vector<TrackSupport>& supports, size_t segment, float t);
+
+// Largest distance between the centre, rims or radius of support s and the
+// straight interpolation of a and b at fraction u. This is how far the mesh
+// between a and b is from s.
+float trackDeviation(const TrackSupport& s, const TrackSupport& a, const TrackSupport& b, float u);
+
+// Samples the path adaptively, then keeps only the supports needed so no point on
+// the path is further than tolerance from the track mesh. Nearly straight runs
+// collapse to their end points, tight curves keep more. The first and last supports
+// are returned unchanged. Never returns more supports than given: when following the path
+// would take as many or more, the supports are returned as placed.
+std::vector<TrackSupport> resampleTrack(const std::vector<TrackSupport>& supports, float tolerance);
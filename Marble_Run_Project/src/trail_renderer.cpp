@@ -0,0 +1,162 @@
+#include "trail_renderer.h"
+
+#include <algorithm>
+#include <cstddef>
+
+TrailRenderer::TrailRenderer(int capacity, float sampleDistance, float lifetime) :
+    mCapacity(capacity), mSampleDistance(sampleDistance), mLifetime(lifetime)
+{
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+
+    // position attribute
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(TrailVertex), (void*)offsetof(TrailVertex, position));
+    glEnableVertexAttribArray(0);
+
+    // color attribute
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(TrailVertex), (void*)offsetof(TrailVertex, color));
+    glEnableVertexAttribArray(1);
+
+    // across attribute
+    glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(TrailVertex), (void*)offsetof(TrailVertex, across));
+    glEnableVertexAttribArray(2);
+
+    glBindVertexArray(0);
+}
+
+TrailRenderer::~TrailRenderer()
+{
+    release();
+}
+
+void TrailRenderer::release()
+{
+    if (VAO) glDeleteVertexArrays(1, &VAO);
+    if (VBO) glDeleteBuffers(1, &VBO);
+    VAO = 0;
+    VBO = 0;
+}
+
+void TrailRenderer::addTrail(btRigidBody* pBody, float width, glm::vec4 color)
+{
+    btTransform trans;
+    pBody->getMotionState()->getWorldTransform(trans);
+    btVector3 pos = trans.getOrigin();
+
+    Trail trail;
+    trail.pBody = pBody;
+    trail.width = width;
+    trail.color = color;
+    trail.tip = glm::vec3(pos.getX(), pos.getY(), pos.getZ());
+    trail.points.resize(mCapacity);
+    mTrails.push_back(trail);
+}
+
+const TrailRenderer::TrailPoint& TrailRenderer::point(const Trail& trail, int i) const
+{
+    return trail.points[(trail.head - trail.count + i + mCapacity) % mCapacity];
+}
+
+void TrailRenderer::update(float dt)
+{
+    mTime += dt;
+
+    for (Trail& trail : mTrails) {
+        btTransform trans;
+        trail.pBody->getMotionState()->getWorldTransform(trans);
+        btVector3 pos = trans.getOrigin();
+        glm::vec3 tip = glm::vec3(pos.getX(), pos.getY(), pos.getZ());
+
+        // Teleported, start a new trail instead of drawing a line across the map
+        if (glm::distance(tip, trail.tip) > TRAIL_RESET_DISTANCE) {
+            trail.count = 0;
+        }
+        trail.tip = tip;
+
+        // Drop samples that have faded out
+        while (trail.count > 0 && mTime - point(trail, 0).time > mLifetime) {
+            trail.count--;
+        }
+
+        // New sample every mSampleDistance, the oldest is overwritten when full
+        if (trail.count == 0 || glm::distance(tip, point(trail, trail.count - 1).position) >= mSampleDistance) {
+            trail.points[trail.head] = { tip, static_cast<float>(mTime) };
+            trail.head = (trail.head + 1) % mCapacity;
+            trail.count = std::min(trail.count + 1, mCapacity);
+        }
+    }
+}
+
+void TrailRenderer::buildStrip(const Trail& trail, glm::vec3 cameraPos)
+{
+    // Samples plus the current position of the body
+    int numPoints = trail.count + 1;
+    if (numPoints < 2) return;
+
+    auto position = [&](int i) {
+        return (i < trail.count) ? point(trail, i).position : trail.tip;
+    };
+    auto time = [&](int i) {
+        return (i < trail.count) ? point(trail, i).time : static_cast<float>(mTime);
+    };
+
+    mFirsts.push_back(static_cast<GLint>(mVertices.size()));
+    mCounts.push_back(numPoints * 2);
+
+    for (int i = 0; i < numPoints; i++) {
+        glm::vec3 p = position(i);
+        glm::vec3 tangent = position(std::min(i + 1, numPoints - 1)) - position(std::max(i - 1, 0));
+
+        // Widen perpendicular to both the trail and the view direction
+        glm::vec3 side = glm::cross(tangent, cameraPos - p);
+        float sideLength = glm::length(side);
+        side = (sideLength > 1e-6f) ? side * (0.5f * trail.width / sideLength) : glm::vec3(0.0f);
+
+        float fade = 1.0f - (static_cast<float>(mTime) - time(i)) / mLifetime;
+        glm::vec4 color = trail.color;
+        color.a *= std::max(fade, 0.0f);
+
+        mVertices.push_back({ p - side, color, 0.0f });
+        mVertices.push_back({ p + side, color, 1.0f });
+    }
+}
+
+void TrailRenderer::render(GLuint shaderProgram, glm::vec3 cameraPos)
+{
+    mVertices.clear();
+    mFirsts.clear();
+    mCounts.clear();
+
+    for (const Trail& trail : mTrails) {
+        buildStrip(trail, cameraPos);
+    }
+    if (mCounts.empty()) return;
+
+    // Grow the buffer when needed, otherwise orphan and refill it
+    size_t size = mVertices.size() * sizeof(TrailVertex);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    if (size > mBufferSize) {
+        mBufferSize = size * 2;
+    }
+    glBufferData(GL_ARRAY_BUFFER, mBufferSize, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, mVertices.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glUseProgram(shaderProgram);
+    glBindVertexArray(VAO);
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDepthMask(GL_FALSE);
+    glDisable(GL_CULL_FACE);
+
+    glMultiDrawArrays(GL_TRIANGLE_STRIP, mFirsts.data(), mCounts.data(), static_cast<GLsizei>(mCounts.size()));
+
+    glBindVertexArray(0);
+
+    glDepthMask(GL_TRUE);
+    glDisable(GL_BLEND);
+}
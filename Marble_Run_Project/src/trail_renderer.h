@@ -0,0 +1,65 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <btBulletDynamicsCommon.h>
+
+#include "settings.h"
+#include "Utils.h"
+
+
+struct TrailVertex {
+	glm::vec3 position;
+	glm::vec4 color;
+	float across;	// 0 on one edge of the ribbon, 1 on the other
+};
+
+// Ribbon trails behind rigid bodies. Positions are sampled by distance travelled
+// into a fixed size ring per trail, and all trails are drawn as camera facing
+// triangle strips from one dynamic buffer.
+class TrailRenderer {
+public:
+	TrailRenderer(int capacity = TRAIL_CAPACITY, float sampleDistance = TRAIL_SAMPLE_DISTANCE, float lifetime = TRAIL_LIFETIME);
+	~TrailRenderer();
+	TrailRenderer(const TrailRenderer&) = delete;
+	TrailRenderer& operator=(const TrailRenderer&) = delete;
+
+	// Deletes the GL buffers, call while the context is still current
+	void release();
+
+	void addTrail(btRigidBody* pBody, float width, glm::vec4 color);
+	void update(float dt);
+	void render(GLuint shaderProgram, glm::vec3 cameraPos);
+
+private:
+	struct TrailPoint {
+		glm::vec3 position;
+		float time;
+	};
+
+	struct Trail {
+		btRigidBody* pBody;
+		float width;
+		glm::vec4 color;
+		glm::vec3 tip;
+		std::vector<TrailPoint> points;	// ring buffer
+		int head = 0;					// next slot to write
+		int count = 0;
+	};
+
+	const TrailPoint& point(const Trail& trail, int i) const;	// 0 is the oldest
+	void buildStrip(const Trail& trail, glm::vec3 cameraPos);
+
+	int mCapacity;
+	float mSampleDistance;
+	float mLifetime;
+	double mTime = 0.0;
+	std::vector<Trail> mTrails;
+
+	GLuint VAO = 0;
+	GLuint VBO = 0;
+	size_t mBufferSize = 0;
+	std::vector<TrailVertex> mVertices;
+	std::vector<GLint> mFirsts;
+	std::vector<GLsizei> mCounts;
+};
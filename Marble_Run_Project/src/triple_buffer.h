@@ -0,0 +1,38 @@
+#pragma once
+
+#include <atomic>
+
+// Single writer, single reader handoff of the newest value without locks. The writer fills
+// back() and publishes it; the reader takes whatever was published last, skipping older
+// values, and keeps it until something newer arrives. Neither side ever waits.
+//
+// back() holds whatever was in the buffer two publishes ago, so the writer has to fill
+// every field, but containers in T keep their capacity.
+template <typename T>
+class TripleBuffer {
+public:
+	// Writer
+	T& back() { return mBuffers[mBack]; }
+	void publish()
+	{
+		mBack = mMiddle.exchange(mBack | FRESH, std::memory_order_acq_rel) & INDEX;
+	}
+
+	// Reader. Before the first publish this is a default constructed T.
+	const T& read()
+	{
+		if (mMiddle.load(std::memory_order_relaxed) & FRESH) {
+			mFront = mMiddle.exchange(mFront, std::memory_order_acq_rel) & INDEX;
+		}
+		return mBuffers[mFront];
+	}
+
+private:
+	static const int INDEX = 3;
+	static const int FRESH = 4;
+
+	T mBuffers[3];
+	int mBack = 0;
+	std::atomic<int> mMiddle{ 1 };	// index, plus FRESH when published and not yet read
+	int mFront = 2;
+};